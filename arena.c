@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* Constants */
+#define ARENA_BLOCK_SIZE 4096            // Minimum size of a block
+#define ARENA_ALIGN (sizeof(void *) * 2) // Alignment of every allocation
+
+void arena_init(Arena *arena) {
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+/**
+ * Makes a block with room for at least size bytes the current block,
+ * reusing a block kept from an earlier reset when it is large enough
+ * @param arena - Arena to grow
+ * @param size - Bytes the caller needs
+ * @return 0 on success, -1 on allocation failure
+ */
+static int next_block(Arena *arena, size_t size) {
+    ArenaBlock *prev = arena->current;
+    ArenaBlock *next = prev ? prev->next : arena->first;
+
+    // Reuse the following block if it is big enough
+    if (next && next->size >= size) {
+        next->used = 0;
+        arena->current = next;
+        return 0;
+    }
+
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    if (prev && prev->size * 2 > block_size) {
+        block_size = prev->size * 2; // Grow geometrically
+    }
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + block_size);
+    if (!block) return -1;
+    block->size = block_size;
+    block->used = 0;
+
+    // Splice the new block in front of any (too small) spare blocks
+    block->next = next;
+    if (prev) {
+        prev->next = block;
+    } else {
+        arena->first = block;
+    }
+    arena->current = block;
+    return 0;
+}
+
+void* arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    ArenaBlock *block = arena->current;
+    if (!block || block->size - block->used < size) {
+        if (next_block(arena, size) != 0) return NULL;
+        block = arena->current;
+    }
+    void *p = block->data + block->used;
+    block->used += size;
+    return p;
+}
+
+char* arena_strndup(Arena *arena, const char *s, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+ArenaMark arena_mark(Arena *arena) {
+    ArenaMark mark;
+    mark.block = arena->current;
+    mark.used = arena->current ? arena->current->used : 0;
+    return mark;
+}
+
+void arena_release(Arena *arena, ArenaMark mark) {
+    if (!mark.block) {
+        arena_reset(arena);
+        return;
+    }
+    arena->current = mark.block;
+    mark.block->used = mark.used;
+}
+
+void arena_reset(Arena *arena) {
+    arena->current = arena->first;
+    if (arena->first) {
+        arena->first->used = 0;
+    }
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
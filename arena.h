@@ -0,0 +1,81 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * Bump allocator for per-line data
+ * Memory is carved out of a chain of blocks and released all at once.
+ * Blocks are kept across resets, so once the arena has grown to fit the
+ * largest line it never calls malloc again.
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;  // Next block in the chain (kept across resets)
+    size_t size;              // Usable bytes in data
+    size_t used;              // Bytes handed out so far
+    char data[];              // Storage
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *first;        // First block of the chain
+    ArenaBlock *current;      // Block allocations are served from
+} Arena;
+
+/**
+ * Position in an arena, used to release everything allocated after it
+ */
+typedef struct {
+    ArenaBlock *block;
+    size_t used;
+} ArenaMark;
+
+/**
+ * Initializes an empty arena (no memory is allocated until first use)
+ * @param arena - Arena to initialize
+ */
+void arena_init(Arena *arena);
+
+/**
+ * Allocates size bytes aligned for any type
+ * @param arena - Arena to allocate from
+ * @param size - Number of bytes
+ * @return Pointer to the memory or NULL if a new block could not be allocated
+ */
+void* arena_alloc(Arena *arena, size_t size);
+
+/**
+ * Copies len bytes of s into the arena and NUL-terminates the copy
+ * @param arena - Arena to allocate from
+ * @param s - Bytes to copy
+ * @param len - Number of bytes
+ * @return The copy or NULL on allocation failure
+ */
+char* arena_strndup(Arena *arena, const char *s, size_t len);
+
+/**
+ * Records the current allocation position
+ * @param arena - Arena to mark
+ * @return Mark to pass to arena_release
+ */
+ArenaMark arena_mark(Arena *arena);
+
+/**
+ * Releases everything allocated since the mark, in O(1)
+ * @param arena - Arena to rewind
+ * @param mark - Position returned by arena_mark
+ */
+void arena_release(Arena *arena, ArenaMark mark);
+
+/**
+ * Releases every allocation in O(1), keeping the blocks for reuse
+ * @param arena - Arena to reset
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * Frees all blocks owned by the arena
+ * @param arena - Arena to free
+ */
+void arena_free(Arena *arena);
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * Generating many arguments: a brace sequence expanded word by word
+ * against the seq substitution scripts used before the shell had braces,
+ * and a program too long for one execve run in batches.
+ *   brace   true {1..N}
+ *   subst   true $(seq 1 N)
+ *   batches /bin/true x{1..N}  (split into as many execve calls as needed)
+ *
+ * usage: bench/brace_bench [words] [shell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the benchmark script
+ * @param path - Where to write it
+ * @param mode - 0: brace, 1: subst, 2: batches
+ * @param words - Number of words to generate
+ */
+static void write_script(const char *path, int mode, int words) {
+    static const char *lines[] = {"true {1..%d}\n", "true $(seq 1 %d)\n", "/bin/true x{1..%d}\n"};
+    FILE *out = fopen(path, "w");
+    fprintf(out, lines[mode], words);
+    fclose(out);
+}
+
+/**
+ * Runs the shell on a script with stdout discarded
+ * @param shell - Path of the shell
+ * @param script - Script to feed on stdin
+ * @return Elapsed seconds
+ */
+static double run_shell(const char *shell, const char *script) {
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+    static const char *modes[] = {"brace", "subst", "batches"};
+    int words = argc > 1 ? atoi(argv[1]) : 1000000;
+    const char *shell = argc > 2 ? argv[2] : "./shell";
+    char path[] = "/tmp/brace_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    for (int i = 0; i < 3; i++) {
+        write_script(path, i, words);
+        double elapsed = run_shell(shell, path);
+        printf("brace mode=%s words=%d seconds=%.3f ns_per_word=%.1f\n",
+               modes[i], words, elapsed, elapsed * 1e9 / words);
+    }
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * Runs the same generated script through the shell with the utility
+ * builtins enabled and with them disabled (enable -n), so every echo,
+ * true, test and printf has to fork/exec the external program.
+ *
+ * usage: bench/builtins_bench [iterations] [shell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the benchmark script
+ * @param path - Where to write it
+ * @param iterations - Number of commands
+ * @param disable - Whether to disable the builtins first
+ */
+static void write_script(const char *path, int iterations, int disable) {
+    static const char *lines[] = {
+        "echo hello world",
+        "true",
+        "test -n nonempty",
+        "printf \"%s %d\\n\" item 42",
+        "[ 1 -lt 2 ]",
+        "false",
+        "pwd",
+    };
+    FILE *out = fopen(path, "w");
+    if (disable) {
+        fprintf(out, "enable -n echo true false pwd test [ printf\n");
+    }
+    for (int i = 0; i < iterations; i++) {
+        fprintf(out, "%s\n", lines[i % 7]);
+    }
+    fclose(out);
+}
+
+/**
+ * Runs the shell on a script with stdout discarded
+ * @param shell - Path of the shell
+ * @param script - Script to feed on stdin
+ * @return Elapsed seconds
+ */
+static double run_shell(const char *shell, const char *script) {
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    const char *shell = argc > 2 ? argv[2] : "./shell";
+    char path[] = "/tmp/builtins_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    for (int disable = 0; disable <= 1; disable++) {
+        write_script(path, iterations, disable);
+        double elapsed = run_shell(shell, path);
+        printf("builtins mode=%s iterations=%d seconds=%.3f us_per_command=%.2f\n",
+               disable ? "external" : "builtin", iterations, elapsed, elapsed * 1e6 / iterations);
+    }
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * Per-request latency of a filter run as a coprocess against spawning it
+ * fresh for every request: each request is one line sent to `sed -u` and
+ * the answer read back.
+ *
+ * usage: bench/coproc_bench [requests]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coproc.h"
+#include "linereader.h"
+#include "pathhash.h"
+#include "spawn.h"
+
+static char *worker[] = {"sed", "-u", "s/a/A/", NULL};
+static const char request[] = "banana\n";
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Starts the worker on a fresh pair of pipes
+ * @param to_fd - Receives the worker's stdin
+ * @param from_fd - Receives the worker's stdout
+ * @return Pid of the worker
+ */
+static pid_t start_worker(int *to_fd, int *from_fd) {
+    int child_in, child_out;
+    LaunchSpec spec;
+
+    if (coproc_pipes(&child_in, &child_out, to_fd, from_fd) != 0) exit(1);
+    launch_spec_init(&spec);
+    spec.stdin_fd = child_in;
+    spec.stdout_fd = child_out;
+    pid_t pid = launch_program(path_hash_lookup(worker[0]), worker, &spec);
+    close(child_in);
+    close(child_out);
+    if (pid < 0) exit(1);
+    return pid;
+}
+
+/**
+ * Prints the median and 99th percentile of a set of latencies
+ * @param mode - Name of the mode
+ * @param samples - Latencies in seconds (sorted here)
+ * @param count - Number of samples
+ */
+static void report(const char *mode, double *samples, int count) {
+    qsort(samples, count, sizeof(double), compare_doubles);
+    printf("coproc mode=%s requests=%d median_us=%.1f p99_us=%.1f\n", mode, count,
+           samples[count / 2] * 1e6, samples[count * 99 / 100] * 1e6);
+}
+
+int main(int argc, char **argv) {
+    int requests = argc > 1 ? atoi(argv[1]) : 2000;
+    double *samples = malloc(requests * sizeof(double));
+    int to_fd, from_fd;
+    LineReader reader;
+
+    // Fresh spawn: fork/exec, send, close, read the answer, reap
+    for (int i = 0; i < requests; i++) {
+        double start = now_sec();
+        pid_t pid = start_worker(&to_fd, &from_fd);
+        write(to_fd, request, sizeof(request) - 1);
+        close(to_fd);
+        line_reader_init(&reader, from_fd);
+        line_reader_next(&reader, NULL);
+        line_reader_free(&reader);
+        close(from_fd);
+        wait_child(pid);
+        samples[i] = now_sec() - start;
+    }
+    report("spawn", samples, requests);
+
+    // Coprocess: one worker answers every request
+    pid_t pid = start_worker(&to_fd, &from_fd);
+    coproc_add("BENCH", pid, to_fd, from_fd);
+    for (int i = 0; i < requests; i++) {
+        double start = now_sec();
+        coproc_write("BENCH", request, sizeof(request) - 1);
+        coproc_read_line("BENCH", NULL);
+        samples[i] = now_sec() - start;
+    }
+    report("coproc", samples, requests);
+
+    coproc_free();
+    wait_child(pid);
+    path_hash_free();
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * Fanning a list of items out over N children: the forall builtin against
+ * piping the list into an external xargs. The items are short, so this
+ * measures the cost of keeping the children busy.
+ *   forall  forall -P N /bin/true < items
+ *   xargs   xargs -P N -n 1 /bin/true < items
+ *
+ * usage: bench/forall_bench [items] [jobs] [shell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the item list and the benchmark script
+ * @param path - Where to write the script
+ * @param items - Where to write the items
+ * @param use_xargs - Whether to use xargs instead of forall
+ * @param count - Number of items
+ * @param jobs - Children at a time
+ */
+static void write_script(const char *path, const char *items, int use_xargs, int count, int jobs) {
+    FILE *out = fopen(items, "w");
+    for (int i = 1; i <= count; i++) {
+        fprintf(out, "%d\n", i);
+    }
+    fclose(out);
+    out = fopen(path, "w");
+    if (use_xargs) {
+        fprintf(out, "xargs -P %d -n 1 /bin/true < %s\n", jobs, items);
+    } else {
+        fprintf(out, "forall -P %d /bin/true < %s\n", jobs, items);
+    }
+    fclose(out);
+}
+
+/**
+ * Runs the shell on a script with stdout discarded
+ * @param shell - Path of the shell
+ * @param script - Script to feed on stdin
+ * @return Elapsed seconds
+ */
+static double run_shell(const char *shell, const char *script) {
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+    static const char *modes[] = {"forall", "xargs"};
+    int count = argc > 1 ? atoi(argv[1]) : 5000;
+    int jobs = argc > 2 ? atoi(argv[2]) : 4;
+    const char *shell = argc > 3 ? argv[3] : "./shell";
+    char path[] = "/tmp/forall_benchXXXXXX";
+    char items[] = "/tmp/forall_itemsXXXXXX";
+    int fd = mkstemp(path);
+    int items_fd = mkstemp(items);
+    if (fd < 0 || items_fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    close(items_fd);
+
+    for (int i = 0; i < 2; i++) {
+        write_script(path, items, i, count, jobs);
+        double elapsed = run_shell(shell, path);
+        printf("forall mode=%s items=%d jobs=%d seconds=%.3f items_per_sec=%.0f\n",
+               modes[i], count, jobs, elapsed, count / elapsed);
+    }
+    unlink(path);
+    unlink(items);
+    return 0;
+}
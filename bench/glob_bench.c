@@ -0,0 +1,107 @@
+/**
+ * Globbing a directory of many files: the first expansion (which reads
+ * the directory), then repeated ones with the listing cache on (a stat per
+ * expansion) and off (a readdir scan every time, as before the cache).
+ *
+ * usage: bench/glob_bench [files] [directory]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "pathglob.h"
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Counts matches (the expansion's work without building argv)
+ */
+static int count_match(const char *path, void *ctx) {
+    (void)path;
+    (*(size_t *)ctx)++;
+    return 0;
+}
+
+/**
+ * Fills a directory with empty files, a tenth of them .txt
+ * Its mtime is moved back an hour, since the cache does not trust a
+ * directory that changed within the last second.
+ * @param dir - Directory to fill
+ * @param files - Number of files
+ */
+static void make_directory(const char *dir, size_t files) {
+    char path[4096];
+    for (size_t i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/file_%zu.%s", dir, i, i % 10 == 0 ? "txt" : "dat");
+        int fd = open(path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            perror(path);
+            exit(1);
+        }
+        close(fd);
+    }
+    struct timespec times[2];
+    clock_gettime(CLOCK_REALTIME, &times[0]);
+    times[0].tv_sec -= 3600;
+    times[1] = times[0];
+    utimensat(AT_FDCWD, dir, times, 0);
+}
+
+/**
+ * Times repeated expansions of a pattern
+ * @param name - Case name
+ * @param pattern - Pattern to expand
+ * @param runs - Number of expansions
+ */
+static void time_glob(const char *name, const char *pattern, int runs) {
+    size_t matches = 0;
+    double start = now_sec();
+    for (int i = 0; i < runs; i++) {
+        path_glob(pattern, count_match, &matches);
+    }
+    double elapsed = now_sec() - start;
+    printf("glob case=%s runs=%d matches=%zu us_per_glob=%.1f\n",
+           name, runs, matches / runs, elapsed * 1e6 / runs);
+}
+
+int main(int argc, char **argv) {
+    size_t files = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    char template[] = "/tmp/glob_benchXXXXXX";
+    const char *dir = argc > 2 ? argv[2] : mkdtemp(template);
+    if (!dir) {
+        perror("mkdtemp");
+        return 1;
+    }
+    make_directory(dir, files);
+
+    char pattern[4096];
+    snprintf(pattern, sizeof(pattern), "%s/*.txt", dir);
+    time_glob("first", pattern, 1);
+    time_glob("cached", pattern, 20);
+    path_glob_set_cache(0);
+    time_glob("uncached", pattern, 20);
+    path_glob_set_cache(1);
+    snprintf(pattern, sizeof(pattern), "%s/file_4242?.dat", dir);
+    time_glob("cached_narrow", pattern, 20);
+    path_glob_set_cache(0);
+    time_glob("uncached_narrow", pattern, 20);
+
+    if (argc <= 2) {
+        char command[4200];
+        snprintf(command, sizeof(command), "rm -rf %s", dir);
+        if (system(command) != 0) return 1;
+    }
+    path_glob_free();
+    return 0;
+}
@@ -0,0 +1,113 @@
+/**
+ * History lookups over a large history file: the cost of opening it (what
+ * every shell pays at startup), building the line and trigram indexes on
+ * first use, and then substring, prefix and !n lookups.
+ *
+ * usage: bench/history_bench [entries] [directory]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "history.h"
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes a history of plausible command lines
+ * @param path - File to write
+ * @param entries - Number of lines
+ * @return Size of the file in bytes
+ */
+static size_t make_history(const char *path, size_t entries) {
+    static const char *commands[] = {
+        "ls -l %zu", "cd /home/user/project_%zu", "git commit -m \"change %zu\"",
+        "make -j %zu", "grep -rn pattern_%zu src", "cat log_%zu.txt | sort | uniq -c",
+    };
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        exit(1);
+    }
+    for (size_t i = 0; i < entries; i++) {
+        fprintf(out, commands[i % 6], i);
+        fputc('\n', out);
+    }
+    size_t bytes = ftell(out);
+    fclose(out);
+    return bytes;
+}
+
+/**
+ * Times a lookup, median of several runs
+ * @param name - Case name
+ * @param text - Query
+ * @param prefix - Whether to look up a prefix (otherwise a substring)
+ */
+static void time_lookup(const char *name, const char *text, int prefix) {
+    enum { RUNS = 21 };
+    double samples[RUNS];
+    size_t results[16], found = 0;
+
+    for (int r = 0; r < RUNS; r++) {
+        double start = now_sec();
+        found = prefix ? history_find_prefix(text) != 0
+                       : history_search(text, results, 16);
+        samples[r] = now_sec() - start;
+    }
+    // Insertion sort is plenty for a handful of samples
+    for (int i = 1; i < RUNS; i++) {
+        for (int j = i; j > 0 && samples[j] < samples[j - 1]; j--) {
+            double t = samples[j];
+            samples[j] = samples[j - 1];
+            samples[j - 1] = t;
+        }
+    }
+    printf("history case=%s query=\"%s\" found=%zu ms=%.4f\n", name, text, found,
+           samples[RUNS / 2] * 1e3);
+}
+
+int main(int argc, char **argv) {
+    size_t entries = argc > 1 ? (size_t)atol(argv[1]) : 2000000;
+    const char *dir = argc > 2 ? argv[2] : "/tmp";
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/history_bench", dir);
+    size_t bytes = make_history(path, entries);
+
+    double start = now_sec();
+    history_open(path);
+    printf("history case=open entries=%zu bytes=%zu ms=%.4f\n", entries, bytes,
+           (now_sec() - start) * 1e3);
+
+    start = now_sec();
+    size_t count = history_count();
+    printf("history case=line_index entries=%zu ms=%.4f\n", count, (now_sec() - start) * 1e3);
+
+    size_t results[16];
+    start = now_sec();
+    history_search("project_12345", results, 16);
+    printf("history case=trigram_index ms=%.4f\n", (now_sec() - start) * 1e3);
+
+    time_lookup("search_rare", "project_12345", 0);
+    time_lookup("search_common", "sort", 0);
+    time_lookup("search_short", "ls", 0);
+    time_lookup("prefix", "grep -rn pattern_6", 1);
+
+    start = now_sec();
+    char *entry = history_get(entries / 2);
+    printf("history case=get ms=%.4f\n", (now_sec() - start) * 1e3);
+    free(entry);
+
+    history_close();
+    unlink(path);
+    return 0;
+}
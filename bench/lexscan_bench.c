@@ -0,0 +1,86 @@
+/**
+ * Tokenizer throughput on the long lines code generators produce, for
+ * each scanning kernel (scalar, SSE2, AVX2) the CPU supports.
+ *
+ * usage: bench/lexscan_bench [line_kb] [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "lexer.h"
+#include "lexscan.h"
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Builds a generated-looking command line: long paths and flags, a few
+ * quoted strings, pipes and redirections
+ * @param bytes - Approximate length
+ * @return Newly allocated line
+ */
+static char* make_line(size_t bytes) {
+    static const char *words[] = {
+        "/opt/build/output/generated/module_000123/objects/file_name.o",
+        "--define=CONFIGURATION_VALUE_WITH_A_LONG_NAME=1",
+        "\"a quoted argument with spaces\"",
+        "-Iinclude/third_party/library/src",
+        "|", ">", "out.log", ";",
+    };
+    char *line = malloc(bytes + 128);
+    size_t len = 0;
+    for (int i = 0; len < bytes; i++) {
+        len += sprintf(line + len, "%s ", words[(i * 7) % 8]);
+    }
+    line[len] = '\0';
+    return line;
+}
+
+/**
+ * Tokenizes the line repeatedly with one kernel and prints throughput
+ * @param mode - Kernel to use
+ * @param line - Line to tokenize
+ * @param iterations - Number of passes
+ */
+static void run_mode(LexScanMode mode, const char *line, int iterations) {
+    if (lex_scan_set_mode(mode) != 0) return;
+
+    Arena arena;
+    TokenList tokens;
+    size_t len = strlen(line), count = 0;
+    arena_init(&arena);
+
+    double start = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        lex_line(&arena, line, &tokens);
+        count += tokens.count;
+        arena_reset(&arena);
+    }
+    double elapsed = now_sec() - start;
+
+    printf("lexscan kernel=%s line_bytes=%zu iterations=%d tokens=%zu seconds=%.4f mb_per_sec=%.1f\n",
+           lex_scan_mode_name(mode), len, iterations, count, elapsed,
+           (double)len * iterations / elapsed / 1e6);
+    arena_free(&arena);
+}
+
+int main(int argc, char **argv) {
+    size_t line_kb = argc > 1 ? (size_t)atoi(argv[1]) : 64;
+    int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+    char *line = make_line(line_kb << 10);
+
+    run_mode(LEX_SCAN_SCALAR, line, iterations);
+    run_mode(LEX_SCAN_SSE2, line, iterations);
+    run_mode(LEX_SCAN_AVX2, line, iterations);
+    free(line);
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * Line reader + lexer throughput on large inputs: a multi-megabyte script
+ * of ordinary lines, and a single command line with 100k arguments.
+ *
+ * usage: bench/linereader_bench [script_mb] [arguments]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "arena.h"
+#include "lexer.h"
+#include "linereader.h"
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Reads and tokenizes every line of a file, resetting the arena per line
+ * the way the shell does, and prints throughput
+ * @param name - Name of the case, for reporting
+ * @param path - File to read
+ * @param bytes - Size of the file
+ */
+static void run_case(const char *name, const char *path, size_t bytes) {
+    Arena arena;
+    LineReader reader;
+    TokenList tokens;
+    size_t lines = 0, token_count = 0;
+    int fd = open(path, O_RDONLY);
+
+    arena_init(&arena);
+    line_reader_init(&reader, fd);
+
+    double start = now_sec();
+    char *line;
+    while ((line = line_reader_next(&reader, NULL)) != NULL) {
+        lex_line(&arena, line, &tokens);
+        token_count += tokens.count;
+        lines++;
+        arena_reset(&arena);
+    }
+    double elapsed = now_sec() - start;
+
+    printf("linereader case=%s bytes=%zu lines=%zu tokens=%zu seconds=%.4f mb_per_sec=%.1f\n",
+           name, bytes, lines, token_count, elapsed, bytes / elapsed / 1e6);
+    line_reader_free(&reader);
+    arena_free(&arena);
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    size_t script_mb = argc > 1 ? (size_t)atoi(argv[1]) : 16;
+    int arguments = argc > 2 ? atoi(argv[2]) : 100000;
+    char path[] = "/tmp/linereader_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    FILE *out = fdopen(fd, "w");
+
+    // A script made of many ordinary command lines
+    size_t bytes = 0;
+    for (int i = 0; bytes < script_mb << 20; i++) {
+        bytes += fprintf(out, "echo line %d \"quoted words here\" | grep -v x > /dev/null; true\n", i);
+    }
+    fflush(out);
+    run_case("script", path, bytes);
+
+    // One enormous generated command line
+    ftruncate(fd, 0);
+    rewind(out);
+    bytes = fprintf(out, "touch");
+    for (int i = 0; i < arguments; i++) {
+        bytes += fprintf(out, " generated_argument_%d", i);
+    }
+    bytes += fprintf(out, "\n");
+    fflush(out);
+    run_case("long_line", path, bytes);
+
+    fclose(out);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * A loop of builtins in a script: the compiled for loop against the same
+ * body unrolled into one line per iteration, which is what scripts had to
+ * do before the shell had loops.
+ *   loop      for i in $(seq 1 N); do test $i; true; done
+ *   unrolled  test 1; true / test 2; true / ... (N lines)
+ *
+ * usage: bench/loop_bench [iterations] [shell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the benchmark script
+ * @param path - Where to write it
+ * @param unrolled - Whether to write one line per iteration
+ * @param iterations - Number of iterations
+ */
+static void write_script(const char *path, int unrolled, int iterations) {
+    FILE *out = fopen(path, "w");
+    if (unrolled) {
+        for (int i = 1; i <= iterations; i++) {
+            fprintf(out, "test %d; true\n", i);
+        }
+    } else {
+        fprintf(out, "for i in $(seq 1 %d); do test $i; true; done\n", iterations);
+    }
+    fclose(out);
+}
+
+/**
+ * Runs the shell on a script with stdout discarded
+ * @param shell - Path of the shell
+ * @param script - Script to feed on stdin
+ * @return Elapsed seconds
+ */
+static double run_shell(const char *shell, const char *script) {
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+    static const char *modes[] = {"loop", "unrolled"};
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    const char *shell = argc > 2 ? argv[2] : "./shell";
+    char path[] = "/tmp/loop_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    for (int i = 0; i < 2; i++) {
+        write_script(path, i, iterations);
+        double elapsed = run_shell(shell, path);
+        printf("loop mode=%s iterations=%d seconds=%.3f ns_per_iteration=%.1f\n",
+               modes[i], iterations, elapsed, elapsed * 1e9 / iterations);
+    }
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * Re-running the same deterministic command: plain against prefixed with
+ * memo, whose first run fills the cache and the rest are replayed
+ * without starting anything.
+ *   plain  sort < lines  (runs times)
+ *   memo   memo sort < lines  (runs times)
+ *
+ * usage: bench/memo_bench [runs] [lines] [shell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the benchmark script
+ * @param path - Where to write the script
+ * @param input - File the command sorts
+ * @param cache - Cache directory for memo
+ * @param memo - Whether to prefix the command with memo
+ * @param runs - Number of times to run it
+ */
+static void write_script(const char *path, const char *input, const char *cache, int memo,
+                         int runs) {
+    FILE *out = fopen(path, "w");
+    fprintf(out, "memoconf -d %s\n", cache);
+    for (int i = 0; i < runs; i++) {
+        fprintf(out, "%ssort < %s\n", memo ? "memo " : "", input);
+    }
+    fprintf(out, "memoconf -c\n");
+    fclose(out);
+}
+
+/**
+ * Runs the shell on a script with stdout discarded
+ * @param shell - Path of the shell
+ * @param script - Script to feed on stdin
+ * @return Elapsed seconds
+ */
+static double run_shell(const char *shell, const char *script) {
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+    static const char *modes[] = {"plain", "memo"};
+    int runs = argc > 1 ? atoi(argv[1]) : 200;
+    int lines = argc > 2 ? atoi(argv[2]) : 20000;
+    const char *shell = argc > 3 ? argv[3] : "./shell";
+    char path[] = "/tmp/memo_benchXXXXXX";
+    char input[] = "/tmp/memo_inputXXXXXX";
+    char cache[] = "/tmp/memo_cacheXXXXXX";
+    int fd = mkstemp(path);
+    int input_fd = mkstemp(input);
+    if (fd < 0 || input_fd < 0 || !mkdtemp(cache)) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    FILE *out = fdopen(input_fd, "w");
+    srand(1);
+    for (int i = 0; i < lines; i++) {
+        fprintf(out, "%d\n", rand());
+    }
+    fclose(out);
+
+    for (int i = 0; i < 2; i++) {
+        write_script(path, input, cache, i, runs);
+        double elapsed = run_shell(shell, path);
+        printf("memo mode=%s runs=%d lines=%d seconds=%.3f runs_per_sec=%.0f\n",
+               modes[i], runs, lines, elapsed, runs / elapsed);
+    }
+    unlink(path);
+    unlink(input);
+    rmdir(cache);
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * Throughput of a three-stage pipeline at several pipe buffer sizes, set
+ * with the `pipe -b` prefix. A larger buffer lets each stage move more
+ * per read and write, so the stages switch less often.
+ *   head -c BYTES /dev/zero | cat | cat > /dev/null
+ *
+ * usage: bench/pipesize_bench [megabytes] [shell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the benchmark script
+ * @param path - Where to write the script
+ * @param size - Pipe buffer size, or NULL for the system's default
+ * @param megabytes - Data to push through the pipeline
+ */
+static void write_script(const char *path, const char *size, int megabytes) {
+    FILE *out = fopen(path, "w");
+    if (size) {
+        fprintf(out, "pipe -b %s ", size);
+    }
+    fprintf(out, "head -c %dM /dev/zero | cat | cat > /dev/null\n", megabytes);
+    fclose(out);
+}
+
+/**
+ * Runs the shell on a script with stdout discarded
+ * @param shell - Path of the shell
+ * @param script - Script to feed on stdin
+ * @return Elapsed seconds
+ */
+static double run_shell(const char *shell, const char *script) {
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+    static const char *sizes[] = {NULL, "4K", "16K", "256K", "1M"};
+    int megabytes = argc > 1 ? atoi(argv[1]) : 1024;
+    const char *shell = argc > 2 ? argv[2] : "./shell";
+    char path[] = "/tmp/pipesize_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        write_script(path, sizes[i], megabytes);
+        double elapsed = run_shell(shell, path);
+        printf("pipesize buffer=%s megabytes=%d seconds=%.3f mb_per_sec=%.0f\n",
+               sizes[i] ? sizes[i] : "default", megabytes, elapsed, megabytes / elapsed);
+    }
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * Appending to a log from a loop of builtins: reopening the file for
+ * every line against keeping it open on a descriptor with exec.
+ *   reopen  for i in $(seq 1 N); do echo line $i >> log; done
+ *   exec    exec 3>> log; for ...; do echo line $i >&3; done; exec 3>&-
+ *
+ * usage: bench/redirect_bench [iterations] [shell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the benchmark script
+ * @param path - Where to write it
+ * @param log - File the script appends to
+ * @param keep_open - Whether to keep the log open with exec
+ * @param iterations - Number of lines to append
+ */
+static void write_script(const char *path, const char *log, int keep_open, int iterations) {
+    FILE *out = fopen(path, "w");
+    if (keep_open) {
+        fprintf(out, "exec 3>> %s\n", log);
+        fprintf(out, "for i in $(seq 1 %d); do echo line $i >&3; done\n", iterations);
+        fprintf(out, "exec 3>&-\n");
+    } else {
+        fprintf(out, "for i in $(seq 1 %d); do echo line $i >> %s; done\n", iterations, log);
+    }
+    fclose(out);
+}
+
+/**
+ * Runs the shell on a script with stdout discarded
+ * @param shell - Path of the shell
+ * @param script - Script to feed on stdin
+ * @return Elapsed seconds
+ */
+static double run_shell(const char *shell, const char *script) {
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+    static const char *modes[] = {"reopen", "exec"};
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    const char *shell = argc > 2 ? argv[2] : "./shell";
+    char path[] = "/tmp/redirect_benchXXXXXX";
+    char log[] = "/tmp/redirect_logXXXXXX";
+    int fd = mkstemp(path);
+    int log_fd = mkstemp(log);
+    if (fd < 0 || log_fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    close(log_fd);
+
+    for (int i = 0; i < 2; i++) {
+        truncate(log, 0);
+        write_script(path, log, i, iterations);
+        double elapsed = run_shell(shell, path);
+        printf("redirect mode=%s iterations=%d seconds=%.3f ns_per_line=%.1f\n",
+               modes[i], iterations, elapsed, elapsed * 1e9 / iterations);
+    }
+    unlink(path);
+    unlink(log);
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * Short sessions per second: a shell started for every session against
+ * sessions served by a pool of workers (shell --server).
+ *   spawn   fork+exec ./shell, feed the session on a pipe, read its output
+ *   server  connect to the socket, send the session, read until closed
+ * Each of C clients runs its share of the sessions back to back.
+ *
+ * usage: bench/server_bench [sessions] [clients] [shell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+static const char session[] = "cd /tmp\nX=1\necho $X\n";
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Sends the session on fd, closes that direction and reads until the end
+ * @param out - Where the session is written
+ * @param in - Where its output comes back (may be out)
+ */
+static void converse(int out, int in) {
+    char buf[4096];
+    write(out, session, sizeof(session) - 1);
+    if (out == in) {
+        shutdown(out, SHUT_WR);
+    } else {
+        close(out);
+    }
+    while (read(in, buf, sizeof(buf)) > 0) {
+    }
+    close(in);
+}
+
+/**
+ * Runs one session in a freshly started shell
+ * @param shell - Path of the shell
+ */
+static void spawn_session(const char *shell) {
+    int to[2], from[2];
+    pipe(to);
+    pipe(from);
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(to[0], STDIN_FILENO);
+        dup2(from[1], STDOUT_FILENO);
+        close(to[0]);
+        close(to[1]);
+        close(from[0]);
+        close(from[1]);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+    close(to[0]);
+    close(from[1]);
+    converse(to[1], from[0]);
+    waitpid(pid, NULL, 0);
+}
+
+/**
+ * Runs one session on the server
+ * @param addr - Address of its socket
+ * @return 0 on success, -1 if the connection failed
+ */
+static int server_session(const struct sockaddr_un *addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    converse(fd, fd);
+    return 0;
+}
+
+/**
+ * Runs the sessions split over several client processes
+ * @param sessions - Total number of sessions
+ * @param clients - Number of clients
+ * @param shell - Shell to spawn, or NULL to use the server
+ * @param addr - Address of the server's socket
+ * @return Elapsed seconds
+ */
+static double run_clients(int sessions, int clients, const char *shell,
+                          const struct sockaddr_un *addr) {
+    pid_t pids[clients];
+    double start = now_sec();
+    for (int c = 0; c < clients; c++) {
+        if ((pids[c] = fork()) == 0) {
+            for (int i = c; i < sessions; i += clients) {
+                if (shell) {
+                    spawn_session(shell);
+                } else if (server_session(addr) != 0) {
+                    _exit(1);
+                }
+            }
+            _exit(0);
+        }
+    }
+    // Not wait(): the server is a child too
+    for (int c = 0; c < clients; c++) {
+        waitpid(pids[c], NULL, 0);
+    }
+    return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+    int sessions = argc > 1 ? atoi(argv[1]) : 2000;
+    int clients = argc > 2 ? atoi(argv[2]) : 4;
+    const char *shell = argc > 3 ? argv[3] : "./shell";
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/server_bench.%d.sock", (int)getpid());
+
+    double elapsed = run_clients(sessions, clients, shell, NULL);
+    printf("server mode=spawn sessions=%d clients=%d seconds=%.3f sessions_per_sec=%.0f\n",
+           sessions, clients, elapsed, sessions / elapsed);
+
+    pid_t server = fork();
+    if (server == 0) {
+        execl(shell, shell, "--server", addr.sun_path, (char *)NULL);
+        _exit(127);
+    }
+    // Wait for the socket to accept connections
+    for (int tries = 0; tries < 200 && server_session(&addr) != 0; tries++) {
+        usleep(10000);
+    }
+    elapsed = run_clients(sessions, clients, NULL, &addr);
+    printf("server mode=server sessions=%d clients=%d seconds=%.3f sessions_per_sec=%.0f\n",
+           sessions, clients, elapsed, sessions / elapsed);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * Per-command spawn latency for each launch backend.
+ * The shell's resident size is simulated with a touched "ballast" buffer,
+ * since that is what makes fork() slow.
+ *
+ * usage: bench/spawn_bench [iterations] [ballast_mb...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pathhash.h"
+#include "spawn.h"
+
+/**
+ * @return Monotonic time in microseconds
+ */
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Spawns `true` repeatedly with one backend and prints latency statistics
+ * @param backend - Backend to measure
+ * @param iterations - Number of spawns
+ * @param ballast_mb - Size of the touched ballast, for reporting
+ */
+static void run_backend(LaunchBackend backend, int iterations, int ballast_mb) {
+    char *args[] = {"true", NULL};
+    const char *program = path_hash_lookup("true");
+    double *samples = malloc(iterations * sizeof(double));
+    LaunchSpec spec;
+
+    launch_spec_init(&spec);
+    set_launch_backend(backend);
+    for (int i = 0; i < iterations; i++) {
+        double start = now_us();
+        pid_t pid = launch_program(program, args, &spec);
+        if (pid > 0) wait_child(pid);
+        samples[i] = now_us() - start;
+    }
+
+    qsort(samples, iterations, sizeof(double), compare_doubles);
+    double total = 0;
+    for (int i = 0; i < iterations; i++) total += samples[i];
+    printf("spawn backend=%s ballast_mb=%d iterations=%d mean_us=%.1f p50_us=%.1f p99_us=%.1f\n",
+           launch_backend_name(backend), ballast_mb, iterations, total / iterations,
+           samples[iterations / 2], samples[iterations * 99 / 100]);
+    free(samples);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    int default_sizes[] = {0, 256, 1024};
+    int nsizes = argc > 2 ? argc - 2 : 3;
+    LaunchBackend backends[] = {LAUNCH_FORK, LAUNCH_VFORK, LAUNCH_POSIX_SPAWN};
+
+    if (iterations <= 0) iterations = 1000;
+    for (int s = 0; s < nsizes; s++) {
+        int mb = argc > 2 ? atoi(argv[s + 2]) : default_sizes[s];
+        size_t bytes = (size_t)mb << 20;
+        char *ballast = NULL;
+        if (bytes > 0) {
+            ballast = malloc(bytes);
+            if (!ballast) {
+                fprintf(stderr, "cannot allocate %d MiB ballast\n", mb);
+                continue;
+            }
+            memset(ballast, 1, bytes);
+        }
+        for (int b = 0; b < 3; b++) {
+            run_backend(backends[b], iterations, mb);
+        }
+        free(ballast);
+    }
+    path_hash_free();
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * Capturing a command's output as arguments: command substitution
+ * against the temp-file workaround scripts used before it existed
+ * (`cmd > file` then `xargs echo < file`), run through the shell.
+ *   subst     echo $(seq 1 5)        program piped straight to the shell
+ *   builtin   echo $(echo 1 2 3 4 5) builtin run in a forked copy of the shell
+ *   tempfile  seq 1 5 > file; xargs echo < file
+ *
+ * usage: bench/subst_bench [iterations] [shell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the benchmark script
+ * @param path - Where to write it
+ * @param mode - Which way to capture the output
+ * @param iterations - Number of captures
+ * @param scratch - Temporary file for the tempfile mode
+ */
+static void write_script(const char *path, const char *mode, int iterations, const char *scratch) {
+    FILE *out = fopen(path, "w");
+    for (int i = 0; i < iterations; i++) {
+        if (strcmp(mode, "subst") == 0) {
+            fprintf(out, "echo $(seq 1 5)\n");
+        } else if (strcmp(mode, "builtin") == 0) {
+            fprintf(out, "echo $(echo 1 2 3 4 5)\n");
+        } else {
+            fprintf(out, "seq 1 5 > %s\nxargs echo < %s\n", scratch, scratch);
+        }
+    }
+    fclose(out);
+}
+
+/**
+ * Runs the shell on a script with stdout discarded
+ * @param shell - Path of the shell
+ * @param script - Script to feed on stdin
+ * @return Elapsed seconds
+ */
+static double run_shell(const char *shell, const char *script) {
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        execl(shell, shell, (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+    static const char *modes[] = {"subst", "builtin", "tempfile"};
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    const char *shell = argc > 2 ? argv[2] : "./shell";
+    char path[] = "/tmp/subst_benchXXXXXX";
+    char scratch[] = "/tmp/subst_scratchXXXXXX";
+    int fd = mkstemp(path);
+    int scratch_fd = mkstemp(scratch);
+    if (fd < 0 || scratch_fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    close(scratch_fd);
+
+    for (int i = 0; i < 3; i++) {
+        write_script(path, modes[i], iterations, scratch);
+        double elapsed = run_shell(shell, path);
+        printf("subst mode=%s iterations=%d seconds=%.3f us_per_capture=%.2f\n",
+               modes[i], iterations, elapsed, elapsed * 1e6 / iterations);
+    }
+    unlink(path);
+    unlink(scratch);
+    return 0;
+}
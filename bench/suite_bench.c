@@ -0,0 +1,295 @@
+/**
+ * Benchmark suite for the shell's hot paths, run by `make bench`:
+ * tokenizer throughput, parse cost per line (what process_commands does
+ * before running a line), spawn latency per launch backend, throughput of
+ * an N-stage pipeline run by the shell, and `source` over a large script.
+ *
+ * Every result is one line:
+ *   bench name=<case> value=<number> unit=<unit> better=<higher|lower>
+ * With --baseline FILE (a previous run's output) each line also gets
+ * baseline=<number> change=<percent>, and regression=1 when it is worse
+ * than the baseline by more than the threshold. Baselines are machine
+ * specific: regenerate them with `make bench-baseline`.
+ *
+ * usage: bench/suite_bench [--baseline FILE] [--threshold PCT] [--check]
+ *                          [--quick] [--shell PATH]
+ *   --check exits with status 1 if any case regressed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "lexer.h"
+#include "parser.h"
+#include "pathhash.h"
+#include "spawn.h"
+
+/* Constants */
+#define MAX_RESULTS 32
+#define MAX_NAME 64
+
+/**
+ * One measured (or baseline) value
+ */
+typedef struct {
+    char name[MAX_NAME];
+    double value;
+} Result;
+
+static Result baseline[MAX_RESULTS];
+static int baseline_count = 0;
+static double threshold = 25.0;  // Percent worse than baseline that counts as a regression
+static int regressions = 0;
+
+/**
+ * Representative command lines for the lexer and parser cases
+ */
+static const char *sample_lines[] = {
+    "ls -l /usr/bin",
+    "echo \"hello world\" > out.txt",
+    "cat < in.txt | grep -v foo | sort | uniq -c > counts.txt",
+    "cd /tmp; ls; pwd",
+    "make -j 8 all; echo done",
+    "printf \"%s=%d\\n\" key 42 | tee log.txt",
+    "sleep 1 &",
+    "parallel -j 4 { gzip a; gzip b; gzip c; gzip d }",
+    "find . -name \"*.c\" | xargs wc -l | sort -n | tail -1",
+    "test -f config; source config > /dev/null",
+};
+#define SAMPLE_COUNT (sizeof(sample_lines) / sizeof(sample_lines[0]))
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Loads a previous run's output as the baseline
+ * @param path - File written by an earlier run
+ * @return 0 on success, -1 if it could not be read
+ */
+static int load_baseline(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (!in) return -1;
+    char line[512];
+    while (baseline_count < MAX_RESULTS && fgets(line, sizeof(line), in)) {
+        Result *r = &baseline[baseline_count];
+        if (sscanf(line, "bench name=%63s value=%lf", r->name, &r->value) == 2) {
+            baseline_count++;
+        }
+    }
+    fclose(in);
+    return 0;
+}
+
+/**
+ * Prints one result, compared with the baseline if there is one
+ * @param name - Case name
+ * @param value - Measured value
+ * @param unit - Unit of the value
+ * @param higher_is_better - Direction of improvement
+ */
+static void report(const char *name, double value, const char *unit, int higher_is_better) {
+    printf("bench name=%s value=%.3f unit=%s better=%s", name, value, unit,
+           higher_is_better ? "higher" : "lower");
+    for (int i = 0; i < baseline_count; i++) {
+        if (strcmp(baseline[i].name, name) != 0 || baseline[i].value == 0) continue;
+        double change = (value - baseline[i].value) / baseline[i].value * 100;
+        double worse = higher_is_better ? -change : change;
+        printf(" baseline=%.3f change=%+.1f%%", baseline[i].value, change);
+        if (worse > threshold) {
+            printf(" regression=1");
+            regressions++;
+        }
+        break;
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+/**
+ * Tokenizer throughput over the sample lines
+ * @param rounds - Passes over the samples
+ */
+static void bench_tokenize(int rounds) {
+    Arena arena;
+    TokenList tokens;
+    size_t count = 0;
+
+    arena_init(&arena);
+    double start = now_sec();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+            lex_line(&arena, sample_lines[i], &tokens);
+            count += tokens.count;
+            arena_reset(&arena);
+        }
+    }
+    double elapsed = now_sec() - start;
+    arena_free(&arena);
+    report("tokenize", count / elapsed / 1e6, "Mtokens/s", 1);
+}
+
+/**
+ * Parse cost per line, with the arena mark/release process_commands uses
+ * @param rounds - Passes over the samples
+ */
+static void bench_parse(int rounds) {
+    Arena arena;
+    Sequence seq;
+
+    arena_init(&arena);
+    double start = now_sec();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+            ArenaMark mark = arena_mark(&arena);
+            parse_line(&arena, sample_lines[i], &seq);
+            arena_release(&arena, mark);
+        }
+    }
+    double elapsed = now_sec() - start;
+    arena_free(&arena);
+    report("parse_line", elapsed / (rounds * SAMPLE_COUNT) * 1e9, "ns/line", 0);
+}
+
+/**
+ * Median fork/exec latency of `true` with one launch backend
+ * @param backend - Backend to measure
+ * @param iterations - Number of spawns
+ */
+static void bench_spawn(LaunchBackend backend, int iterations) {
+    char *args[] = {"true", NULL};
+    const char *program = path_hash_lookup("true");
+    double *samples = malloc(iterations * sizeof(double));
+    LaunchSpec spec;
+    char name[MAX_NAME];
+
+    launch_spec_init(&spec);
+    set_launch_backend(backend);
+    for (int i = 0; i < iterations; i++) {
+        double start = now_sec();
+        pid_t pid = launch_program(program, args, &spec);
+        if (pid > 0) wait_child(pid);
+        samples[i] = now_sec() - start;
+    }
+    qsort(samples, iterations, sizeof(double), compare_doubles);
+    snprintf(name, sizeof(name), "spawn_%s", launch_backend_name(backend));
+    report(name, samples[iterations / 2] * 1e6, "us", 0);
+    free(samples);
+}
+
+/**
+ * Runs a script through the shell, discarding its output
+ * @param shell - Path of the shell
+ * @param script - Commands to feed it
+ * @return Wall time in seconds, or -1 if the shell failed
+ */
+static double time_shell(const char *shell, const char *script) {
+    char command[4096];
+    snprintf(command, sizeof(command), "%s > /dev/null", shell);
+
+    double start = now_sec();
+    FILE *in = popen(command, "w");
+    if (!in) return -1;
+    fputs(script, in);
+    int status = pclose(in);
+    double elapsed = now_sec() - start;
+    return status == 0 ? elapsed : -1;
+}
+
+/**
+ * Throughput of a pipeline of cat stages run by the shell (execute_pipe)
+ * @param shell - Path of the shell
+ * @param stages - Number of cat stages after the producer
+ * @param megabytes - Data pushed through the pipeline
+ */
+static void bench_pipeline(const char *shell, int stages, int megabytes) {
+    char script[512];
+    int len = snprintf(script, sizeof(script), "head -c %dM /dev/zero", megabytes);
+    for (int i = 0; i < stages; i++) {
+        len += snprintf(script + len, sizeof(script) - len, " | cat");
+    }
+    snprintf(script + len, sizeof(script) - len, " > /dev/null\n");
+
+    char name[MAX_NAME];
+    snprintf(name, sizeof(name), "pipeline_%d_stages", stages);
+    double elapsed = time_shell(shell, script);
+    if (elapsed > 0) report(name, megabytes / elapsed / 1024, "GB/s", 1);
+}
+
+/**
+ * Speed of `source` over a large generated script
+ * @param shell - Path of the shell
+ * @param lines - Lines in the script
+ */
+static void bench_source(const char *shell, int lines) {
+    char path[] = "/tmp/suite_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return;
+    }
+    FILE *out = fdopen(fd, "w");
+    for (int i = 0; i < lines; i++) {
+        fputs(i % 2 ? "true\n" : "test -n word; echo line > /dev/null\n", out);
+    }
+    fclose(out);
+
+    char script[256];
+    snprintf(script, sizeof(script), "source %s\n", path);
+    double elapsed = time_shell(shell, script);
+    unlink(path);
+    if (elapsed > 0) report("source", lines / elapsed / 1e3, "klines/s", 1);
+}
+
+int main(int argc, char **argv) {
+    const char *shell = "./shell";
+    int quick = 0, check = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            if (load_baseline(argv[++i]) != 0) {
+                fprintf(stderr, "suite_bench: no baseline at %s (run make bench-baseline)\n", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--shell") == 0 && i + 1 < argc) {
+            shell = argv[++i];
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = 1;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else {
+            fprintf(stderr, "usage: %s [--baseline FILE] [--threshold PCT] [--check] [--quick] [--shell PATH]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    int scale = quick ? 1 : 10;
+    bench_tokenize(20000 * scale);
+    bench_parse(20000 * scale);
+    bench_spawn(LAUNCH_POSIX_SPAWN, 200 * scale);
+    bench_spawn(LAUNCH_FORK, 200 * scale);
+    bench_pipeline(shell, 1, 128 * scale);
+    bench_pipeline(shell, 4, 128 * scale);
+    bench_source(shell, 20000 * scale);
+
+    path_hash_free();
+    if (regressions > 0) {
+        fprintf(stderr, "suite_bench: %d case(s) regressed by more than %.0f%%\n", regressions, threshold);
+    }
+    return check && regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * Spawn cost as the number of shell variables grows.
+ * Each spawn follows a variable change, as in a script that sets a
+ * counter and runs a program on every line:
+ *   lazy   the change is to an unexported variable, so the environment
+ *          handed to the program is reused as is
+ *   eager  the change is to an exported variable, so the environment is
+ *          rebuilt from the whole table, as it would be on every spawn
+ *          without the lazy rebuild
+ * The extra variables are unexported, so the program's environment is
+ * the same size in every run.
+ *
+ * usage: bench/vars_bench [iterations] [variables...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pathhash.h"
+#include "spawn.h"
+#include "vars.h"
+
+extern char **environ;
+
+/**
+ * @return Monotonic time in microseconds
+ */
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * Sets a variable change and a spawn of `true` going, over and over
+ * @param variables - Number of extra variables in the store
+ * @param exported - Whether the changed variable is exported
+ * @param iterations - Number of spawns
+ */
+static void run_mode(int variables, int exported, int iterations) {
+    char *args[] = {"true", NULL};
+    const char *program = path_hash_lookup("true");
+    char name[32], value[32];
+    LaunchSpec spec;
+
+    vars_init(environ);
+    for (int i = 0; i < variables; i++) {
+        snprintf(name, sizeof(name), "BENCH_VAR_%d", i);
+        var_set(name, "some value", 0);
+    }
+    launch_spec_init(&spec);
+
+    double start = now_us();
+    double environ_us = 0;
+    for (int i = 0; i < iterations; i++) {
+        snprintf(value, sizeof(value), "%d", i);
+        var_set("BENCH_COUNTER", value, exported);
+        double before = now_us();
+        spec.envp = vars_environ();
+        environ_us += now_us() - before;
+        pid_t pid = launch_program(program, args, &spec);
+        if (pid > 0) wait_child(pid);
+    }
+    double total = now_us() - start;
+    printf("vars mode=%s variables=%d iterations=%d us_per_spawn=%.1f environ_us=%.2f\n",
+           exported ? "eager" : "lazy", variables, iterations, total / iterations,
+           environ_us / iterations);
+    vars_free();
+}
+
+int main(int argc, char **argv) {
+    static const int default_sizes[] = {0, 1000, 10000, 100000};
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+
+    if (argc > 2) {
+        for (int i = 2; i < argc; i++) {
+            run_mode(atoi(argv[i]), 0, iterations);
+            run_mode(atoi(argv[i]), 1, iterations);
+        }
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++) {
+        run_mode(default_sizes[i], 0, iterations);
+        run_mode(default_sizes[i], 1, iterations);
+    }
+    return 0;
+}
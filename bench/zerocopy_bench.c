@@ -0,0 +1,173 @@
+/**
+ * Zero-copy data movement throughput (GB/s) against a plain read/write
+ * loop: file to file, file to pipe to file (what a here-document or a
+ * redirected stage sees), and a pipe fanned out to two files (cmd >a >b).
+ *
+ * usage: bench/zerocopy_bench [megabytes] [directory]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "zerocopy.h"
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * The baseline: copy through a 64K user-space buffer
+ * @param in_fd - Source
+ * @param out_fds - Destinations
+ * @param count - Number of destinations
+ */
+static void copy_buffered(int in_fd, const int *out_fds, int count) {
+    static char buffer[65536];
+    ssize_t n;
+    while ((n = read(in_fd, buffer, sizeof(buffer))) > 0) {
+        for (int i = 0; i < count; i++) {
+            if (write(out_fds[i], buffer, n) != n) {
+                perror("write");
+                exit(1);
+            }
+        }
+    }
+}
+
+/**
+ * Opens (and truncates) a scratch output file
+ * @param dir - Directory for scratch files
+ * @param name - File name
+ * @return Descriptor
+ */
+static int open_output(const char *dir, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        exit(1);
+    }
+    return fd;
+}
+
+/**
+ * Starts a process that writes a file into a pipe
+ * @param path - File to send
+ * @param zerocopy - Whether the producer splices or uses read/write
+ * @param pid - Receives the producer's pid
+ * @return Read end of the pipe
+ */
+static int start_producer(const char *path, int zerocopy, pid_t *pid) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    *pid = fork();
+    if (*pid == 0) {
+        close(fds[0]);
+        int in = open(path, O_RDONLY);
+        if (zerocopy) {
+            zc_copy(in, fds[1]);
+        } else {
+            copy_buffered(in, &fds[1], 1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    return fds[0];
+}
+
+/**
+ * Runs one case in both modes, best of three, and prints their throughput
+ * @param name - Name of the case
+ * @param source - Input file
+ * @param dir - Directory for scratch files
+ * @param bytes - Size of the input file
+ * @param outputs - Number of output files
+ * @param via_pipe - Whether the data goes through a pipe first
+ */
+static void run_case(const char *name, const char *source, const char *dir,
+                     size_t bytes, int outputs, int via_pipe) {
+    for (int zerocopy = 0; zerocopy <= 1; zerocopy++) {
+        double best = 0;
+        for (int round = 0; round < 3; round++) {
+            int out_fds[2];
+            for (int i = 0; i < outputs; i++) {
+                out_fds[i] = open_output(dir, i == 0 ? "zerocopy_out_a" : "zerocopy_out_b");
+            }
+
+            double start = now_sec();
+            pid_t producer = -1;
+            int in = via_pipe ? start_producer(source, zerocopy, &producer) : open(source, O_RDONLY);
+            if (!zerocopy) {
+                copy_buffered(in, out_fds, outputs);
+            } else if (outputs > 1) {
+                zc_fanout(in, out_fds, outputs);
+            } else {
+                zc_copy(in, out_fds[0]);
+            }
+            if (producer > 0) {
+                waitpid(producer, NULL, 0);
+            }
+            double elapsed = now_sec() - start;
+            if (round == 0 || elapsed < best) best = elapsed;
+
+            close(in);
+            for (int i = 0; i < outputs; i++) {
+                close(out_fds[i]);
+            }
+        }
+        printf("zerocopy case=%s mode=%s bytes=%zu outputs=%d seconds=%.4f gb_per_sec=%.2f\n",
+               name, zerocopy ? "zerocopy" : "buffered", bytes, outputs, best,
+               bytes / best / 1e9);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : 256;
+    const char *dir = argc > 2 ? argv[2] : "/tmp";
+    char source[4096];
+    snprintf(source, sizeof(source), "%s/zerocopy_in", dir);
+
+    // Source data: one buffer of pseudo-random bytes written repeatedly
+    int fd = open(source, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(source);
+        return 1;
+    }
+    static char block[1 << 20];
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = (char)(i * 2654435761u >> 13);
+    }
+    for (size_t i = 0; i < megabytes; i++) {
+        if (write(fd, block, sizeof(block)) != (ssize_t)sizeof(block)) {
+            perror("write");
+            return 1;
+        }
+    }
+    close(fd);
+    size_t bytes = megabytes << 20;
+
+    run_case("file_to_file", source, dir, bytes, 1, 0);
+    run_case("pipe_to_file", source, dir, bytes, 1, 1);
+    run_case("pipe_fanout", source, dir, bytes, 2, 1);
+
+    char path[4096];
+    unlink(source);
+    snprintf(path, sizeof(path), "%s/zerocopy_out_a", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/zerocopy_out_b", dir);
+    unlink(path);
+    return 0;
+}
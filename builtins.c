@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "builtins.h"
+
+/**
+ * Decodes one backslash escape (as understood by echo -e and printf)
+ * @param s - Points just past the backslash; advanced past the escape
+ * @param out - Receives the decoded character
+ * @param stop - Set to 1 for \c (stop all output), may be NULL
+ * @return 1 if an escape was decoded, 0 if the backslash is literal
+ */
+static int decode_escape(const char **s, char *out, int *stop) {
+    const char *p = *s;
+    int value = 0;
+
+    switch (*p) {
+    case 'a': *out = '\a'; break;
+    case 'b': *out = '\b'; break;
+    case 'e': *out = 27; break;
+    case 'f': *out = '\f'; break;
+    case 'n': *out = '\n'; break;
+    case 'r': *out = '\r'; break;
+    case 't': *out = '\t'; break;
+    case 'v': *out = '\v'; break;
+    case '\\': *out = '\\'; break;
+    case 'c':
+        if (stop) {
+            *stop = 1;
+            *s = p + 1;
+            return 1;
+        }
+        return 0;
+    case '0':
+        // \0nnn: up to three octal digits after the zero
+        p++;
+        for (int i = 0; i < 3 && *p >= '0' && *p <= '7'; i++) {
+            value = value * 8 + (*p++ - '0');
+        }
+        *out = (char)value;
+        *s = p;
+        return 1;
+    default:
+        return 0;
+    }
+    *s = p + 1;
+    return 1;
+}
+
+/**
+ * Writes a string, interpreting backslash escapes
+ * @param s - String to write
+ * @return 1 if output should stop (\c), 0 otherwise
+ */
+static int put_escaped(const char *s) {
+    int stop = 0;
+    while (*s && !stop) {
+        char c = *s++;
+        if (c == '\\' && decode_escape(&s, &c, &stop)) {
+            if (stop) break;
+        }
+        putchar(c);
+    }
+    return stop;
+}
+
+int builtin_echo(char **args) {
+    int newline = 1, escapes = 0;
+    int i = 1;
+
+    // Options are only recognized before the first operand
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        const char *opt = args[i] + 1;
+        if (strspn(opt, "neE") != strlen(opt)) break;
+        for (; *opt; opt++) {
+            if (*opt == 'n') newline = 0;
+            else if (*opt == 'e') escapes = 1;
+            else escapes = 0;
+        }
+    }
+
+    for (int first = i; args[i]; i++) {
+        if (i > first) putchar(' ');
+        if (escapes) {
+            if (put_escaped(args[i])) return 0;
+        } else {
+            fputs(args[i], stdout);
+        }
+    }
+    if (newline) putchar('\n');
+    return 0;
+}
+
+int builtin_true(char **args) {
+    return 0;
+}
+
+int builtin_false(char **args) {
+    return 1;
+}
+
+int builtin_pwd(char **args) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("pwd");
+        return 1;
+    }
+    puts(cwd);
+    return 0;
+}
+
+/**
+ * State of a `test` expression evaluation
+ */
+typedef struct {
+    char **args;      // Operands (not including the command name)
+    int count;        // Number of operands
+    int pos;          // Next operand to look at
+    int error;        // Set on a syntax error
+} TestParser;
+
+static int test_or(TestParser *t);
+
+/**
+ * Parses an integer operand for the arithmetic comparisons
+ * @param t - Parser state (error is set on failure)
+ * @param s - Operand
+ * @return The value (0 on error)
+ */
+static long long test_number(TestParser *t, const char *s) {
+    char *end;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    while (*end == ' ' || *end == '\t') end++;
+    if (end == s || *end != '\0' || errno) {
+        fprintf(stderr, "test: %s: integer expression expected\n", s);
+        t->error = 1;
+        return 0;
+    }
+    return v;
+}
+
+/**
+ * Evaluates a unary file or string test such as -f or -z
+ * @param op - Operator including the dash
+ * @param arg - Operand
+ * @param known - Set to 0 if op is not a unary operator
+ * @return Result of the test
+ */
+static int test_unary(const char *op, const char *arg, int *known) {
+    struct stat st;
+    *known = 1;
+    if (op[0] != '-' || op[1] == '\0' || op[2] != '\0') {
+        *known = 0;
+        return 0;
+    }
+    switch (op[1]) {
+    case 'z': return arg[0] == '\0';
+    case 'n': return arg[0] != '\0';
+    case 'e': return stat(arg, &st) == 0;
+    case 'f': return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+    case 'd': return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+    case 'b': return stat(arg, &st) == 0 && S_ISBLK(st.st_mode);
+    case 'c': return stat(arg, &st) == 0 && S_ISCHR(st.st_mode);
+    case 'p': return stat(arg, &st) == 0 && S_ISFIFO(st.st_mode);
+    case 'S': return stat(arg, &st) == 0 && S_ISSOCK(st.st_mode);
+    case 's': return stat(arg, &st) == 0 && st.st_size > 0;
+    case 'h':
+    case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    case 'r': return access(arg, R_OK) == 0;
+    case 'w': return access(arg, W_OK) == 0;
+    case 'x': return access(arg, X_OK) == 0;
+    case 't': return isatty(atoi(arg));
+    }
+    *known = 0;
+    return 0;
+}
+
+/**
+ * Checks whether a word is a binary operator
+ * @param op - Word to check
+ * @return 1 if it is, 0 otherwise
+ */
+static int is_binary_op(const char *op) {
+    static const char *ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt",
+                                "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL};
+    for (int i = 0; ops[i]; i++) {
+        if (strcmp(op, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Evaluates a binary comparison
+ * @param t - Parser state
+ * @param a - Left operand
+ * @param op - Operator
+ * @param b - Right operand
+ * @return Result of the comparison
+ */
+static int test_binary(TestParser *t, const char *a, const char *op, const char *b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(a, b) > 0;
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        struct stat sa, sb;
+        int ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+        if (op[1] == 'e') return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (op[1] == 'n') return ha && (!hb || sa.st_mtime > sb.st_mtime);
+        return hb && (!ha || sa.st_mtime < sb.st_mtime);
+    }
+
+    long long x = test_number(t, a), y = test_number(t, b);
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    return x >= y;
+}
+
+/**
+ * primary := '(' expr ')' | unary-op word | word binary-op word | word
+ */
+static int test_primary(TestParser *t) {
+    int remaining = t->count - t->pos;
+    if (remaining <= 0) {
+        t->error = 1;
+        return 0;
+    }
+    char *word = t->args[t->pos];
+
+    // A binary comparison takes precedence when its operator follows
+    if (remaining >= 3 && is_binary_op(t->args[t->pos + 1])) {
+        int r = test_binary(t, word, t->args[t->pos + 1], t->args[t->pos + 2]);
+        t->pos += 3;
+        return r;
+    }
+    if (strcmp(word, "(") == 0 && remaining >= 2) {
+        t->pos++;
+        int r = test_or(t);
+        if (t->pos >= t->count || strcmp(t->args[t->pos], ")") != 0) {
+            t->error = 1;
+            return 0;
+        }
+        t->pos++;
+        return r;
+    }
+    if (remaining >= 2) {
+        int known;
+        int r = test_unary(word, t->args[t->pos + 1], &known);
+        if (known) {
+            t->pos += 2;
+            return r;
+        }
+    }
+    // A lone word is true when it is not empty
+    t->pos++;
+    return word[0] != '\0';
+}
+
+/**
+ * not := '!' not | primary
+ */
+static int test_not(TestParser *t) {
+    if (t->pos < t->count - 1 && strcmp(t->args[t->pos], "!") == 0) {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+/**
+ * and := not ('-a' not)*
+ */
+static int test_and(TestParser *t) {
+    int r = test_not(t);
+    while (t->pos < t->count && strcmp(t->args[t->pos], "-a") == 0) {
+        t->pos++;
+        r = test_not(t) && r;
+    }
+    return r;
+}
+
+/**
+ * or := and ('-o' and)*
+ */
+static int test_or(TestParser *t) {
+    int r = test_and(t);
+    while (t->pos < t->count && strcmp(t->args[t->pos], "-o") == 0) {
+        t->pos++;
+        r = test_and(t) || r;
+    }
+    return r;
+}
+
+/**
+ * Evaluates a test expression
+ * @param args - Operands
+ * @param count - Number of operands
+ * @return 0 if true, 1 if false, 2 on a syntax error
+ */
+static int evaluate_test(char **args, int count) {
+    TestParser t = {args, count, 0, 0};
+    if (count == 0) return 1;
+
+    int r = test_or(&t);
+    if (!t.error && t.pos != t.count) {
+        fprintf(stderr, "test: %s: unexpected operator\n", args[t.pos]);
+        return 2;
+    }
+    if (t.error) return 2;
+    return r ? 0 : 1;
+}
+
+int builtin_test(char **args) {
+    int count = 0;
+    while (args[count + 1]) count++;
+    return evaluate_test(args + 1, count);
+}
+
+int builtin_bracket(char **args) {
+    int count = 0;
+    while (args[count + 1]) count++;
+    if (count == 0 || strcmp(args[count], "]") != 0) {
+        fprintf(stderr, "[: missing `]'\n");
+        return 2;
+    }
+    return evaluate_test(args + 1, count - 1);
+}
+
+/**
+ * Converts a printf numeric argument; 'c or "c gives the character code
+ * @param s - Argument (NULL counts as 0)
+ * @param status - Set to 1 if the argument is not a valid number
+ * @return The value
+ */
+static long long printf_number(const char *s, int *status) {
+    if (!s) return 0;
+    if (s[0] == '\'' || s[0] == '"') return (unsigned char)s[1];
+
+    char *end;
+    errno = 0;
+    long long v = strtoll(s, &end, 0);
+    if (*s == '\0' || *end != '\0' || errno) {
+        fprintf(stderr, "printf: %s: invalid number\n", s);
+        *status = 1;
+    }
+    return v;
+}
+
+int builtin_printf(char **args) {
+    if (args[1] == NULL) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    const char *format = args[1];
+    char **arg = args + 2;
+    int status = 0;
+
+    // The format is reused until every argument has been consumed
+    do {
+        char **round_start = arg;
+        for (const char *f = format; *f; f++) {
+            if (*f == '\\') {
+                char c;
+                const char *p = f + 1;
+                if (decode_escape(&p, &c, NULL)) {
+                    putchar(c);
+                    f = p - 1;
+                } else {
+                    putchar('\\');
+                }
+                continue;
+            }
+            if (*f != '%') {
+                putchar(*f);
+                continue;
+            }
+            if (f[1] == '%') {
+                putchar('%');
+                f++;
+                continue;
+            }
+
+            // Copy flags, width and precision into a spec for the C library
+            char spec[64];
+            size_t n = 0;
+            spec[n++] = '%';
+            f++;
+            while (*f && strchr("-+ #0123456789.", *f) && n < sizeof(spec) - 4) {
+                spec[n++] = *f++;
+            }
+            char conv = *f;
+            if (conv == '\0') {
+                fprintf(stderr, "printf: missing format character\n");
+                return 1;
+            }
+            const char *value = *arg ? *arg++ : NULL;
+
+            switch (conv) {
+            case 'd':
+            case 'i':
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = conv;
+                spec[n] = '\0';
+                printf(spec, printf_number(value, &status));
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+                spec[n++] = conv;
+                spec[n] = '\0';
+                printf(spec, value ? strtod(value, NULL) : 0.0);
+                break;
+            case 'c':
+                spec[n++] = 'c';
+                spec[n] = '\0';
+                printf(spec, value ? value[0] : '\0');
+                break;
+            case 's':
+                spec[n++] = 's';
+                spec[n] = '\0';
+                printf(spec, value ? value : "");
+                break;
+            case 'b':
+                if (value && put_escaped(value)) return status;
+                break;
+            default:
+                fprintf(stderr, "printf: %%%c: invalid directive\n", conv);
+                return 1;
+            }
+        }
+        // Stop if the format consumed nothing (avoids looping forever)
+        if (arg == round_start) break;
+    } while (*arg);
+
+    return status;
+}
@@ -0,0 +1,19 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+/**
+ * In-process versions of small utilities that dominate generated scripts
+ * Running these inside the shell saves a fork/exec per call. Each takes
+ * an argument vector like main() and returns an exit status; output goes
+ * to stdout/stderr, so the caller's redirections apply.
+ */
+
+int builtin_echo(char **args);
+int builtin_true(char **args);
+int builtin_false(char **args);
+int builtin_pwd(char **args);
+int builtin_test(char **args);
+int builtin_bracket(char **args);
+int builtin_printf(char **args);
+
+#endif
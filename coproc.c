@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "coproc.h"
+#include "linereader.h"
+
+/**
+ * One running coprocess
+ */
+typedef struct Coproc {
+    char *name;
+    pid_t pid;                // Last process of the worker
+    int to_fd;                // Worker's stdin, or -1 once closed
+    int from_fd;              // Worker's stdout
+    LineReader reader;        // Buffers the worker's answers
+    struct Coproc *next;
+} Coproc;
+
+static Coproc *coprocs = NULL;
+
+/**
+ * @param name - Name to look up
+ * @return The coprocess, or NULL if there is none
+ */
+static Coproc* find_coproc(const char *name) {
+    for (Coproc *c = coprocs; c; c = c->next) {
+        if (strcmp(c->name, name) == 0) return c;
+    }
+    return NULL;
+}
+
+/**
+ * Closes a coprocess's pipes and frees it
+ * @param c - Coprocess to free
+ */
+static void free_coproc(Coproc *c) {
+    if (c->to_fd >= 0) close(c->to_fd);
+    close(c->from_fd);
+    line_reader_free(&c->reader);
+    free(c->name);
+    free(c);
+}
+
+int coproc_pipes(int *child_in, int *child_out, int *to_fd, int *from_fd) {
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) != 0) {
+        perror("pipe failed");
+        return -1;
+    }
+    if (pipe2(out, O_CLOEXEC) != 0) {
+        perror("pipe failed");
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    *child_in = in[0];
+    *to_fd = in[1];
+    *from_fd = out[0];
+    *child_out = out[1];
+    return 0;
+}
+
+int coproc_add(const char *name, pid_t pid, int to_fd, int from_fd) {
+    Coproc *c = malloc(sizeof(Coproc));
+    if (!c || !(c->name = strdup(name)) || line_reader_init(&c->reader, from_fd) != 0) {
+        if (c) free(c->name);
+        free(c);
+        close(to_fd);
+        close(from_fd);
+        return -1;
+    }
+    c->pid = pid;
+    c->to_fd = to_fd;
+    c->from_fd = from_fd;
+
+    // A new coprocess takes over the name
+    for (Coproc **p = &coprocs; *p; p = &(*p)->next) {
+        if (strcmp((*p)->name, name) == 0) {
+            Coproc *old = *p;
+            *p = old->next;
+            free_coproc(old);
+            break;
+        }
+    }
+    c->next = coprocs;
+    coprocs = c;
+    return 0;
+}
+
+int coproc_write(const char *name, const char *data, size_t len) {
+    Coproc *c = find_coproc(name);
+    if (!c || c->to_fd < 0) {
+        fflush(stdout);
+        fprintf(stderr, "%s: %s\n", name, c ? "input closed" : "no such coprocess");
+        return -1;
+    }
+
+    // Hold SIGPIPE back so a dead worker only fails the write
+    sigset_t pipe_set, old_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipe_set, &old_set);
+
+    int err = 0;
+    while (len > 0) {
+        ssize_t n = write(c->to_fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            err = errno;
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+
+    // Discard the SIGPIPE a failed write left pending before unblocking
+    if (err == EPIPE) {
+        struct timespec zero = {0, 0};
+        sigtimedwait(&pipe_set, NULL, &zero);
+    }
+    sigprocmask(SIG_SETMASK, &old_set, NULL);
+    if (err != 0) {
+        fflush(stdout);
+        fprintf(stderr, "%s: %s\n", name, strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+char* coproc_read_line(const char *name, size_t *len) {
+    Coproc *c = find_coproc(name);
+    if (!c) {
+        fflush(stdout);
+        fprintf(stderr, "%s: no such coprocess\n", name);
+        return NULL;
+    }
+    return line_reader_next(&c->reader, len);
+}
+
+int coproc_close(const char *name) {
+    Coproc *c = find_coproc(name);
+    if (!c) return -1;
+    if (c->to_fd >= 0) {
+        close(c->to_fd);
+        c->to_fd = -1;
+    }
+    return 0;
+}
+
+void coproc_free(void) {
+    while (coprocs) {
+        Coproc *next = coprocs->next;
+        free_coproc(coprocs);
+        coprocs = next;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef COPROC_H
+#define COPROC_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Coprocesses: long-lived workers the shell talks to over two pipes
+ * A worker started once can answer many requests, each costing a write
+ * and a read instead of a fork, exec and dynamic link. Workers are found
+ * by name (COPROC unless given one). The worker has to flush after every
+ * answer (sed -u, grep --line-buffered, ...), or the reader will wait for
+ * its output buffer to fill.
+ */
+
+/**
+ * Creates the pipes for a new coprocess
+ * Both shell-side descriptors are close-on-exec, so other children never
+ * hold the worker's input open.
+ * @param child_in - Receives the descriptor to use as the worker's stdin
+ * @param child_out - Receives the descriptor to use as the worker's stdout
+ * @param to_fd - Receives the shell's end of the worker's stdin
+ * @param from_fd - Receives the shell's end of the worker's stdout
+ * @return 0 on success, -1 on failure
+ */
+int coproc_pipes(int *child_in, int *child_out, int *to_fd, int *from_fd);
+
+/**
+ * Records a started coprocess, replacing (and closing) any of the same name
+ * @param name - Name of the coprocess
+ * @param pid - Pid of its last process
+ * @param to_fd - Shell's end of its stdin
+ * @param from_fd - Shell's end of its stdout
+ * @return 0 on success, -1 on allocation failure (descriptors are closed)
+ */
+int coproc_add(const char *name, pid_t pid, int to_fd, int from_fd);
+
+/**
+ * Sends data to a coprocess in one write
+ * A worker that has exited makes this fail with EPIPE instead of killing
+ * the shell with SIGPIPE.
+ * @param name - Name of the coprocess
+ * @param data - Bytes to send
+ * @param len - Number of bytes
+ * @return 0 on success, -1 on failure (error reported)
+ */
+int coproc_write(const char *name, const char *data, size_t len);
+
+/**
+ * Reads the next line a coprocess wrote
+ * @param name - Name of the coprocess
+ * @param len - Receives the length of the line (optional)
+ * @return The line without its newline (valid until the next read), or
+ *         NULL at end of output or if there is no such coprocess
+ */
+char* coproc_read_line(const char *name, size_t *len);
+
+/**
+ * Closes a coprocess's input so it sees end of file (its output stays
+ * readable)
+ * @param name - Name of the coprocess
+ * @return 0 on success, -1 if there is no such coprocess
+ */
+int coproc_close(const char *name);
+
+/**
+ * Closes every coprocess's pipes (the workers see end of file)
+ */
+void coproc_free(void);
+
+#endif
@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#endif
+
+#include "events.h"
+
+/* Constants */
+#define INITIAL_KEPT_STATUSES 16 // Unclaimed exits there is room for at first
+
+static int epoll_fd = -1;             // Watches signal_fd
+static int signal_fd = -1;            // Delivers the blocked signals
+static int wait_flags = 0;            // WUNTRACED with job control
+static int pending_interrupt = 0;     // SIGINT or SIGQUIT read but not yet taken
+static sigset_t shell_signals;        // Signals the shell keeps blocked
+
+/**
+ * A child the loop reaped that no handler knew, kept for whoever waits
+ * for it later (a fan-out helper, a substitution's stages)
+ */
+typedef struct {
+    pid_t pid;
+    int raw;
+    struct rusage usage;
+} KeptStatus;
+
+static KeptStatus *kept = NULL;       // Kept until their pid is waited for (malloc'd, grows)
+static int kept_count = 0;
+static int kept_capacity = 0;
+
+/**
+ * @param set - Receives the signals the shell handles itself
+ */
+static void handled_signals(sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, SIGCHLD);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGQUIT);
+}
+
+int events_init(int job_control) {
+    handled_signals(&shell_signals);
+    sigprocmask(SIG_BLOCK, &shell_signals, NULL);
+    if (job_control) {
+        // Ctrl-Z and background terminal access must not stop the shell
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+        wait_flags = WUNTRACED;
+    }
+
+#ifdef __linux__
+    signal_fd = signalfd(-1, &shell_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd >= 0 && epoll_fd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = signal_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) == 0) return 0;
+    }
+    if (signal_fd >= 0) close(signal_fd);
+    if (epoll_fd >= 0) close(epoll_fd);
+    signal_fd = epoll_fd = -1;
+#endif
+    return -1;
+}
+
+void events_reset_child(void) {
+    sigset_t set;
+    if (signal_fd >= 0) close(signal_fd);
+    if (epoll_fd >= 0) close(epoll_fd);
+    signal_fd = epoll_fd = -1;
+    wait_flags = 0;
+    pending_interrupt = 0;
+    kept_count = 0;
+
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    handled_signals(&set);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+}
+
+/**
+ * Reads every queued signal, remembering interrupts
+ * SIGCHLD needs no action: the caller reaps whatever has changed.
+ */
+static void drain_signals(void) {
+#ifdef __linux__
+    struct signalfd_siginfo info[8];
+    ssize_t n;
+    while (signal_fd >= 0 && (n = read(signal_fd, info, sizeof(info))) > 0) {
+        for (size_t i = 0; i < (size_t)n / sizeof(info[0]); i++) {
+            if (info[i].ssi_signo != SIGCHLD) pending_interrupt = info[i].ssi_signo;
+        }
+    }
+#endif
+}
+
+/**
+ * Reaps every child that has changed state
+ * @param handler - Called once per child
+ * @param ctx - Passed through to handler
+ * @param none_left - Set to 1 if the shell has no children at all
+ * @return Number of children reported
+ */
+static int reap_ready(ChildHandler handler, void *ctx, int *none_left) {
+    int raw, count = 0;
+    struct rusage usage;
+    pid_t pid;
+    while ((pid = wait4(-1, &raw, WNOHANG | wait_flags, &usage)) > 0) {
+        if (WIFSTOPPED(raw)) memset(&usage, 0, sizeof(usage));
+        handler(pid, raw, &usage, ctx);
+        count++;
+    }
+    *none_left = pid < 0 && errno == ECHILD;
+    return count;
+}
+
+int events_poll_children(ChildHandler handler, void *ctx) {
+    int none_left;
+    return reap_ready(handler, ctx, &none_left);
+}
+
+int events_wait_children(ChildHandler handler, void *ctx) {
+    int none_left;
+    while (1) {
+        int count = reap_ready(handler, ctx, &none_left);
+        if (count > 0) return count;
+        if (none_left) return -1;
+
+        if (epoll_fd < 0) {
+            // No loop: sleep in wait4 itself
+            int raw;
+            struct rusage usage;
+            pid_t pid = wait4(-1, &raw, wait_flags, &usage);
+            if (pid < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            if (WIFSTOPPED(raw)) memset(&usage, 0, sizeof(usage));
+            handler(pid, raw, &usage, ctx);
+            return 1 + reap_ready(handler, ctx, &none_left);
+        }
+#ifdef __linux__
+        // Sleep until a signal arrives; SIGCHLD is queued even if a child
+        // exited between the poll above and this call
+        struct epoll_event ev;
+        if (epoll_wait(epoll_fd, &ev, 1, -1) < 0 && errno != EINTR) return -1;
+        drain_signals();
+#endif
+    }
+}
+
+void events_keep_status(pid_t pid, int raw, const struct rusage *usage) {
+    if (WIFSTOPPED(raw)) return;
+    if (kept_count == kept_capacity) {
+        int capacity = kept_capacity ? kept_capacity * 2 : INITIAL_KEPT_STATUSES;
+        KeptStatus *bigger = realloc(kept, capacity * sizeof(KeptStatus));
+        if (!bigger) return;
+        kept = bigger;
+        kept_capacity = capacity;
+    }
+    KeptStatus *k = &kept[kept_count++];
+    k->pid = pid;
+    k->raw = raw;
+    k->usage = *usage;
+}
+
+int events_take_status(pid_t pid, int *raw, struct rusage *usage) {
+    for (int i = 0; i < kept_count; i++) {
+        if (kept[i].pid != pid) continue;
+        *raw = kept[i].raw;
+        if (usage) *usage = kept[i].usage;
+        kept[i] = kept[--kept_count];
+        return 1;
+    }
+    return 0;
+}
+
+void events_free(void) {
+    free(kept);
+    kept = NULL;
+    kept_count = kept_capacity = 0;
+}
+
+int events_interrupt_pending(void) {
+    drain_signals();
+    if (signal_fd < 0 && !pending_interrupt) {
+        sigset_t set;
+        sigpending(&set);
+        if (sigismember(&set, SIGINT)) return SIGINT;
+        if (sigismember(&set, SIGQUIT)) return SIGQUIT;
+    }
+    return pending_interrupt;
+}
+
+int events_take_interrupt(void) {
+    drain_signals();
+    if (signal_fd < 0) {
+        // Without the loop, interrupts wait in the pending set
+        sigset_t set;
+        struct timespec zero = {0, 0};
+        sigemptyset(&set);
+        sigaddset(&set, SIGINT);
+        sigaddset(&set, SIGQUIT);
+        int sig = sigtimedwait(&set, NULL, &zero);
+        if (sig > 0) pending_interrupt = sig;
+    }
+    int sig = pending_interrupt;
+    pending_interrupt = 0;
+    return sig;
+}
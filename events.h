@@ -0,0 +1,98 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/**
+ * The shell's event loop for children and signals
+ * SIGCHLD, SIGINT and SIGQUIT are blocked in the shell and, on Linux,
+ * read from a signalfd that epoll watches; the shell sleeps in
+ * epoll_wait until some child changes state and then reaps every child
+ * that has, in the order they finished. Ctrl-C therefore never kills the
+ * shell: it is noted and handed to whoever asks (events_take_interrupt).
+ * With job control the stop signals are ignored too. Children get the
+ * default dispositions back when they are launched (see spawn.c).
+ * Elsewhere, or in forked copies of the shell, waiting falls back to a
+ * blocking wait4.
+ */
+
+/**
+ * Called for every child that changed state
+ * @param pid - The child
+ * @param raw - Status from wait4 (exited, signalled or stopped)
+ * @param usage - Resource usage from wait4 (zero for a stop)
+ * @param ctx - Caller's context
+ */
+typedef void (*ChildHandler)(pid_t pid, int raw, const struct rusage *usage, void *ctx);
+
+/**
+ * Blocks the shell's signals and sets up the loop
+ * @param job_control - Whether to also ignore SIGTSTP, SIGTTIN and SIGTTOU
+ *                      and report stopped children
+ * @return 0 on success, -1 if the loop is unavailable (waits still work)
+ */
+int events_init(int job_control);
+
+/**
+ * Restores default signal handling and drops the loop, in a forked copy
+ * of the shell
+ */
+void events_reset_child(void);
+
+/**
+ * Blocks until at least one child has changed state, and reports every
+ * child that has
+ * @param handler - Called once per child
+ * @param ctx - Passed through to handler
+ * @return Number of children reported, or -1 if there are no children
+ */
+int events_wait_children(ChildHandler handler, void *ctx);
+
+/**
+ * Reports children that have already changed state, without blocking
+ * @param handler - Called once per child
+ * @param ctx - Passed through to handler
+ * @return Number of children reported
+ */
+int events_poll_children(ChildHandler handler, void *ctx);
+
+/**
+ * Keeps the exit status of a child the loop reaped but no handler knew
+ * The loop waits for any child, so it can reap one the shell waits for
+ * by pid elsewhere; that wait then finds the status here. It is held
+ * (however many pile up) until the wait takes it.
+ * @param pid - The child
+ * @param raw - Status from wait4 (stops are not kept)
+ * @param usage - Resource usage from wait4
+ */
+void events_keep_status(pid_t pid, int raw, const struct rusage *usage);
+
+/**
+ * Takes (and forgets) a status kept by events_keep_status
+ * @param pid - Child to look for
+ * @param raw - Receives its status
+ * @param usage - Receives its resource usage, unless NULL
+ * @return 1 if it was kept, 0 otherwise
+ */
+int events_take_status(pid_t pid, int *raw, struct rusage *usage);
+
+/**
+ * Frees the kept statuses
+ */
+void events_free(void);
+
+/**
+ * Checks for a SIGINT or SIGQUIT the shell received, leaving it for
+ * events_take_interrupt
+ * @return The signal number, or 0 if there was none
+ */
+int events_interrupt_pending(void);
+
+/**
+ * Checks for (and forgets) a SIGINT or SIGQUIT the shell received
+ * @return The signal number, or 0 if there was none
+ */
+int events_take_interrupt(void);
+
+#endif
@@ -0,0 +1,655 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "expand.h"
+#include "pathglob.h"
+
+/* Constants */
+#define INITIAL_FIELD_SIZE 64    // Initial room for the word being built
+#define INITIAL_ARGV_SIZE 8      // Initial room in an expanded argument vector
+#define DEFAULT_IFS " \t\n"      // Field separators when $IFS is not set
+#define BRACE_MARK '\1'          // Stands for a part that is not unquoted text
+#define BRACE_MAX_MARKS (1 << 14) // Such parts a braced word may have (two 7-bit bytes)
+#define BRACE_ITEM_ROOM 32       // Room for a generated number beyond the word's length
+
+/**
+ * State of one expansion: the fields produced so far and the one being built
+ */
+typedef struct {
+    Arena *arena;
+    char **argv;          // Finished fields, in the arena
+    int argc;
+    int capacity;
+    char *field;          // Field being built (malloc'd, reused)
+    size_t len;
+    size_t size;
+    int open;             // Whether a field has been started (it may be empty)
+    int globbing;         // Whether fields are patterns (arguments are)
+    char *pattern;        // The field with quoted glob characters escaped
+    size_t pattern_len;   // (malloc'd, reused)
+    size_t pattern_size;
+    int glob;             // Whether the field has unquoted glob characters
+    const ExpandHooks *hooks;
+    const char *ifs;      // Field separators, looked up on first use
+} Expansion;
+
+/**
+ * @param e - Expansion state
+ * @param c - Byte to check
+ * @return 1 if unquoted expansions are split at c
+ */
+static int is_field_separator(Expansion *e, char c) {
+    if (!e->ifs) {
+        e->ifs = e->hooks->lookup("IFS", e->hooks->ctx);
+        if (!e->ifs) e->ifs = DEFAULT_IFS;
+    }
+    return c != '\0' && strchr(e->ifs, c) != NULL;
+}
+
+/**
+ * Grows a buffer of the expansion to hold more bytes and a terminator
+ * @param buf - Buffer (malloc'd, may be NULL)
+ * @param size - Its size, updated on growth
+ * @param needed - Bytes it must hold
+ * @return 0 on success, -1 on allocation failure
+ */
+static int reserve_bytes(char **buf, size_t *size, size_t needed) {
+    if (needed + 1 <= *size) return 0;
+    size_t bigger_size = *size ? *size : INITIAL_FIELD_SIZE;
+    while (needed + 1 > bigger_size) bigger_size *= 2;
+    char *bigger = realloc(*buf, bigger_size);
+    if (!bigger) return -1;
+    *buf = bigger;
+    *size = bigger_size;
+    return 0;
+}
+
+/**
+ * Adds text to the pattern of the field being built
+ * Quoted glob characters, and every backslash (the lexer keeps them as
+ * written), are escaped so they only match themselves.
+ * @param e - Expansion state
+ * @param text - Bytes to add
+ * @param len - Number of bytes
+ * @param quoted - Whether the text was quoted
+ * @return 0 on success, -1 on allocation failure
+ */
+static int pattern_append(Expansion *e, const char *text, size_t len, int quoted) {
+    // At worst every byte is escaped
+    if (reserve_bytes(&e->pattern, &e->pattern_size, e->pattern_len + len * 2) != 0) return -1;
+    for (size_t i = 0; i < len; i++) {
+        char c = text[i];
+        if (c == '\\' || (quoted && (c == '*' || c == '?' || c == '['))) {
+            e->pattern[e->pattern_len++] = '\\';
+        } else if (c == '*' || c == '?' || c == '[') {
+            e->glob = 1;
+        }
+        e->pattern[e->pattern_len++] = c;
+    }
+    return 0;
+}
+
+/**
+ * Adds text to the field being built, starting one if needed
+ * @param e - Expansion state
+ * @param text - Bytes to add
+ * @param len - Number of bytes
+ * @param quoted - Whether the text was quoted (it is then never a pattern)
+ * @return 0 on success, -1 on allocation failure
+ */
+static int field_append(Expansion *e, const char *text, size_t len, int quoted) {
+    if (reserve_bytes(&e->field, &e->size, e->len + len) != 0) return -1;
+    memcpy(e->field + e->len, text, len);
+    e->len += len;
+    e->open = 1;
+    return e->globbing ? pattern_append(e, text, len, quoted) : 0;
+}
+
+/**
+ * Adds a finished word to argv
+ * @param e - Expansion state
+ * @param word - The word (must outlive the expansion)
+ * @return 0 on success, -1 on allocation failure
+ */
+static int push_field(Expansion *e, char *word) {
+    // Room is kept for the terminating NULL
+    if (e->argc + 1 >= e->capacity) {
+        int capacity = e->capacity ? e->capacity * 2 : INITIAL_ARGV_SIZE;
+        char **bigger = arena_alloc(e->arena, capacity * sizeof(char *));
+        if (!bigger) return -1;
+        if (e->argc) memcpy(bigger, e->argv, e->argc * sizeof(char *));
+        e->argv = bigger;
+        e->capacity = capacity;
+    }
+    e->argv[e->argc++] = word;
+    e->argv[e->argc] = NULL;
+    return 0;
+}
+
+/**
+ * Drops the field being built
+ * @param e - Expansion state
+ */
+static void field_reset(Expansion *e) {
+    e->len = 0;
+    e->open = 0;
+    e->pattern_len = 0;
+    e->glob = 0;
+}
+
+/**
+ * Copies the field being built into the arena and starts over
+ * @param e - Expansion state
+ * @return The field, or NULL on allocation failure
+ */
+static char* field_take(Expansion *e) {
+    char *copy = arena_strndup(e->arena, e->field ? e->field : "", e->len);
+    field_reset(e);
+    return copy;
+}
+
+/**
+ * Adds a path a pattern matched to argv
+ * @param path - Matched path
+ * @param ctx - Expansion state
+ * @return 0 on success, -1 on allocation failure
+ */
+static int push_match(const char *path, void *ctx) {
+    Expansion *e = ctx;
+    char *word = arena_strndup(e->arena, path, strlen(path));
+    return word ? push_field(e, word) : -1;
+}
+
+/**
+ * Ends the field being built, if one was started, and adds it to argv
+ * @param e - Expansion state
+ * @return 0 on success, -1 on allocation failure
+ */
+static int field_end(Expansion *e) {
+    if (!e->open) return 0;
+    if (e->glob) {
+        e->pattern[e->pattern_len] = '\0';
+        if (glob_has_pattern(e->pattern, e->pattern_len)) {
+            // The matching paths replace the word; it stays if none match
+            int matches = path_glob(e->pattern, push_match, e);
+            if (matches < 0) return -1;
+            if (matches > 0) {
+                field_reset(e);
+                return 0;
+            }
+        }
+    }
+    char *word = field_take(e);
+    return word ? push_field(e, word) : -1;
+}
+
+/**
+ * Adds the result of an expansion that is split into fields
+ * Separators end the field being built; a field is started by the first
+ * byte after them.
+ * @param e - Expansion state
+ * @param text - Output to add
+ * @param len - Length of text
+ * @return 0 on success, -1 on allocation failure
+ */
+static int append_split(Expansion *e, const char *text, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        if (is_field_separator(e, text[i])) {
+            if (field_end(e) != 0) return -1;
+            i++;
+            continue;
+        }
+        size_t run = 1;
+        while (i + run < len && !is_field_separator(e, text[i + run])) run++;
+        if (field_append(e, text + i, run, 0) != 0) return -1;
+        i += run;
+    }
+    return 0;
+}
+
+/**
+ * Expands one part of a word into the fields being built
+ * @param e - Expansion state
+ * @param part - Part to expand
+ * @param split - Whether an unquoted expansion is split
+ * @return 0 on success, -1 on failure
+ */
+static int expand_part(Expansion *e, const WordPart *part, int split) {
+    if (part->kind == PART_LITERAL) {
+        return field_append(e, part->text, part->len, part->quoted);
+    }
+
+    size_t len = 0;
+    char *output = NULL;
+    const char *value;
+    if (part->kind == PART_VARIABLE) {
+        value = e->hooks->lookup(part->text, e->hooks->ctx);
+        len = value ? strlen(value) : 0;
+    } else {
+        value = output = e->hooks->capture(part->text, &len, e->hooks->ctx);
+        if (!output) return -1;
+        // Trailing newlines are dropped, as in every shell
+        while (len > 0 && output[len - 1] == '\n') len--;
+        // Output with a NUL in it is cut there, since arguments are C strings
+        len = strnlen(output, len);
+    }
+
+    int status = split && !part->quoted ? append_split(e, value, len)
+                                        : field_append(e, value, len, part->quoted);
+    free(output);
+    if (status != 0) return -1;
+    if (part->quoted) e->open = 1;
+    return 0;
+}
+
+/**
+ * Expands one word into the fields it produces
+ * @param e - Expansion state
+ * @param parts - Parts of the word
+ * @param split - Whether unquoted expansions are split
+ * @return 0 on success, -1 on failure
+ */
+static int expand_word(Expansion *e, const WordPart *parts, int split) {
+    for (const WordPart *part = parts; part; part = part->next) {
+        if (expand_part(e, part, split) != 0) return -1;
+    }
+    return 0;
+}
+
+/**
+ * A word laid out for brace expansion: its unquoted text as written, with
+ * every other part (quoted text, variables, substitutions) replaced by
+ * BRACE_MARK and two index bytes with the high bit set, which no brace
+ * syntax matches. Braces and commas inside those parts stay literal.
+ */
+typedef struct {
+    char *text;                // Layout (malloc'd)
+    size_t len;
+    const WordPart **opaque;   // Parts the marks stand for (malloc'd)
+} BraceWord;
+
+/**
+ * A {first..last[..step]} sequence
+ */
+typedef struct {
+    long first;
+    long last;
+    long step;                 // Always positive; the direction comes from the ends
+    int width;                 // Zero-padded width (an end was written 01), or 0
+    int letters;               // Whether the ends are single letters
+} BraceSequence;
+
+/**
+ * Lays out a word for brace expansion
+ * @param parts - Parts of the word
+ * @param w - Receives the layout
+ * @return 0 if the word has a `{` to look at, 1 if not (nothing to free),
+ *         -1 on allocation failure
+ */
+static int brace_layout(const WordPart *parts, BraceWord *w) {
+    size_t len = 0;
+    int marks = 0, open = 0;
+    for (const WordPart *part = parts; part; part = part->next) {
+        if (part->kind == PART_LITERAL && !part->quoted) {
+            if (memchr(part->text, BRACE_MARK, part->len)) return 1;
+            if (memchr(part->text, '{', part->len)) open = 1;
+            len += part->len;
+        } else {
+            marks++;
+            len += 3;
+        }
+    }
+    if (!open || marks > BRACE_MAX_MARKS) return 1;
+
+    w->text = malloc(len + 1);
+    w->opaque = malloc((marks ? marks : 1) * sizeof(WordPart *));
+    if (!w->text || !w->opaque) {
+        free(w->text);
+        free(w->opaque);
+        return -1;
+    }
+    w->len = 0;
+    marks = 0;
+    for (const WordPart *part = parts; part; part = part->next) {
+        if (part->kind == PART_LITERAL && !part->quoted) {
+            memcpy(w->text + w->len, part->text, part->len);
+            w->len += part->len;
+        } else {
+            w->text[w->len++] = BRACE_MARK;
+            w->text[w->len++] = (char)(0x80 | (marks >> 7));
+            w->text[w->len++] = (char)(0x80 | (marks & 0x7f));
+            w->opaque[marks++] = part;
+        }
+    }
+    w->text[w->len] = '\0';
+    return 0;
+}
+
+/**
+ * @param text - Laid out word
+ * @param len - Its length
+ * @param i - Offset of an item: a mark, an escaped character or a byte
+ * @return Length of the item
+ */
+static size_t brace_item_length(const char *text, size_t len, size_t i) {
+    if (text[i] == BRACE_MARK) return 3;
+    return text[i] == '\\' && i + 1 < len ? 2 : 1;
+}
+
+/**
+ * Reads one end or the step of a sequence: an integer or a single letter
+ * @param text - Text of the end
+ * @param len - Its length
+ * @param value - Receives its value
+ * @param width - Receives the width to pad to if it has a leading zero
+ * @return 1 for an integer, 2 for a letter, 0 if it is neither
+ */
+static int sequence_end(const char *text, size_t len, long *value, int *width) {
+    if (len == 1 && ((text[0] >= 'a' && text[0] <= 'z') || (text[0] >= 'A' && text[0] <= 'Z'))) {
+        *value = text[0];
+        *width = 0;
+        return 2;
+    }
+    size_t sign = len > 0 && text[0] == '-';
+    // 18 digits cannot overflow, even with a step added
+    if (len == sign || len - sign > 18) return 0;
+    long n = 0;
+    for (size_t i = sign; i < len; i++) {
+        if (text[i] < '0' || text[i] > '9') return 0;
+        n = n * 10 + (text[i] - '0');
+    }
+    *value = sign ? -n : n;
+    *width = len - sign > 1 && text[sign] == '0' ? (int)len : 0;
+    return 1;
+}
+
+/**
+ * Reads the inside of a brace as a sequence: {1..10}, {1..10..2}, {a..e}
+ * or {01..10} (zero-padded)
+ * @param text - Text between the braces
+ * @param len - Its length
+ * @param seq - Receives the sequence
+ * @return 1 if it is one, 0 otherwise
+ */
+static int parse_sequence(const char *text, size_t len, BraceSequence *seq) {
+    const char *dots = memmem(text, len, "..", 2);
+    if (!dots) return 0;
+    const char *last = dots + 2;
+    const char *end = text + len;
+    const char *step = memmem(last, end - last, "..", 2);
+    int first_width, last_width, step_width;
+    int first_kind = sequence_end(text, dots - text, &seq->first, &first_width);
+    int last_kind = sequence_end(last, (step ? step : end) - last, &seq->last, &last_width);
+    if (!first_kind || first_kind != last_kind) return 0;
+    seq->step = 1;
+    if (step && sequence_end(step + 2, end - step - 2, &seq->step, &step_width) != 1) return 0;
+    if (seq->step < 0) seq->step = -seq->step;
+    if (seq->step == 0) seq->step = 1;
+    seq->letters = first_kind == 2;
+    seq->width = first_width > last_width ? first_width : last_width;
+    return 1;
+}
+
+/**
+ * Finds the first brace expansion in a laid out word: a `{` with its
+ * matching `}` and either a comma at the top level or a sequence inside
+ * @param w - Laid out word
+ * @param from - Where to start looking (nothing before it expands)
+ * @param open - Receives the offset of the {
+ * @param close - Receives the offset of the matching }
+ * @param seq - Receives the sequence, if it is one
+ * @return 0 for none, 1 for a comma list, 2 for a sequence
+ */
+static int find_brace(const BraceWord *w, size_t from, size_t *open, size_t *close,
+                      BraceSequence *seq) {
+    const char *text = w->text;
+    for (size_t i = from; i < w->len; i += brace_item_length(text, w->len, i)) {
+        if (text[i] != '{') continue;
+        int depth = 0, comma = 0;
+        size_t j;
+        for (j = i; j < w->len; j += brace_item_length(text, w->len, j)) {
+            if (text[j] == '{') {
+                depth++;
+            } else if (text[j] == '}' && --depth == 0) {
+                break;
+            } else if (text[j] == ',' && depth == 1) {
+                comma = 1;
+            }
+        }
+        // An unmatched { is literal, but a later one may still expand
+        if (j >= w->len) continue;
+        *open = i;
+        *close = j;
+        if (comma) return 1;
+        if (parse_sequence(text + i + 1, j - i - 1, seq)) return 2;
+    }
+    return 0;
+}
+
+/**
+ * Expands a word that has no braces left into its fields
+ * @param e - Expansion state
+ * @param w - Laid out word
+ * @param opaque - Parts the marks stand for
+ * @return 0 on success, -1 on failure
+ */
+static int brace_emit(Expansion *e, const BraceWord *w, const WordPart **opaque) {
+    const char *text = w->text;
+    size_t i = 0;
+    while (i < w->len) {
+        if (text[i] == BRACE_MARK) {
+            int index = ((text[i + 1] & 0x7f) << 7) | (text[i + 2] & 0x7f);
+            if (expand_part(e, opaque[index], 1) != 0) return -1;
+            i += 3;
+            continue;
+        }
+        size_t run = 1;
+        while (i + run < w->len && text[i + run] != BRACE_MARK) run++;
+        if (field_append(e, text + i, run, 0) != 0) return -1;
+        i += run;
+    }
+    return field_end(e);
+}
+
+/**
+ * Writes a number of a sequence (snprintf costs more than the rest of a
+ * generated word)
+ * @param out - Where to write it (room for BRACE_ITEM_ROOM bytes or width)
+ * @param value - Number to write
+ * @param width - Width to zero-pad to, sign included
+ * @return Length written
+ */
+static int format_number(char *out, long value, int width) {
+    char digits[BRACE_ITEM_ROOM];
+    unsigned long n = value < 0 ? -(unsigned long)value : (unsigned long)value;
+    int count = 0;
+    do {
+        digits[count++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    int len = 0;
+    if (value < 0) out[len++] = '-';
+    for (int pad = width - count - len; pad > 0; pad--) out[len++] = '0';
+    while (count > 0) out[len++] = digits[--count];
+    return len;
+}
+
+/**
+ * Brace-expands a laid out word, expanding every word it generates into
+ * fields as soon as it is made, left to right
+ * @param e - Expansion state
+ * @param w - Laid out word
+ * @param from - Where braces may start (the text before has none)
+ * @param opaque - Parts the marks stand for
+ * @return 0 on success, -1 on failure
+ */
+static int brace_expand(Expansion *e, const BraceWord *w, size_t from, const WordPart **opaque) {
+    size_t open, close;
+    BraceSequence seq;
+    int kind = find_brace(w, from, &open, &close, &seq);
+    if (kind == 0) {
+        return brace_emit(e, w, opaque);
+    }
+
+    // Every generated word is the text before the brace, one item and the
+    // text after it; an item is never longer than the word or a number
+    const char *text = w->text;
+    size_t tail = w->len - close - 1;
+    BraceWord item = {malloc(w->len + BRACE_ITEM_ROOM + 1), 0, NULL};
+    if (!item.text) return -1;
+    memcpy(item.text, text, open);
+
+    int status = 0;
+    if (kind == 1) {
+        size_t start = open + 1;
+        int depth = 0;
+        for (size_t j = open + 1; j <= close && status == 0;
+             j += brace_item_length(text, w->len, j)) {
+            if (j == close || (depth == 0 && text[j] == ',')) {
+                memcpy(item.text + open, text + start, j - start);
+                memcpy(item.text + open + (j - start), text + close + 1, tail);
+                item.len = open + (j - start) + tail;
+                // The item itself may hold braces, as in {a,b{1,2}}
+                status = brace_expand(e, &item, open, opaque);
+                start = j + 1;
+            } else if (text[j] == '{') {
+                depth++;
+            } else if (text[j] == '}') {
+                depth--;
+            }
+        }
+    } else {
+        long step = seq.first <= seq.last ? seq.step : -seq.step;
+        for (long v = seq.first; status == 0 && (step > 0 ? v <= seq.last : v >= seq.last);
+             v += step) {
+            int n;
+            if (seq.letters) {
+                item.text[open] = (char)v;
+                n = 1;
+            } else {
+                n = format_number(item.text + open, v, seq.width);
+            }
+            memcpy(item.text + open + n, text + close + 1, tail);
+            item.len = open + n + tail;
+            status = brace_expand(e, &item, open + n, opaque);
+        }
+    }
+    free(item.text);
+    return status;
+}
+
+/**
+ * Expands an argument into its fields, brace expansion first
+ * Each word a brace generates is expanded, split and globbed on its own
+ * as soon as it is made; only the fields are kept, so memory still grows
+ * with the number of words ({1..100000} makes 100000 arguments).
+ * @param e - Expansion state
+ * @param parts - Parts of the argument
+ * @return 0 on success, -1 on failure
+ */
+static int expand_argument(Expansion *e, const WordPart *parts) {
+    BraceWord w;
+    int laid = brace_layout(parts, &w);
+    if (laid < 0) return -1;
+    if (laid > 0) {
+        return expand_word(e, parts, 1) == 0 ? field_end(e) : -1;
+    }
+    int status = brace_expand(e, &w, 0, w.opaque);
+    free(w.text);
+    free(w.opaque);
+    return status;
+}
+
+int command_needs_expansion(const Command *cmd) {
+    if (cmd->parts) return 1;
+    for (int i = 0; i < cmd->assign_count; i++) {
+        if (cmd->assigns[i].parts) return 1;
+    }
+    for (int i = 0; i < cmd->redirect_count; i++) {
+        if (cmd->redirects[i].parts) return 1;
+    }
+    return 0;
+}
+
+int expand_command(Arena *arena, const Command *cmd, Command *out, const ExpandHooks *hooks) {
+    Expansion e;
+    memset(&e, 0, sizeof(e));
+    e.arena = arena;
+    e.hooks = hooks;
+
+    *out = *cmd;
+    out->parts = NULL;
+    out->batch_first = 0;
+    out->batch_count = 0;
+    int status = 0;
+
+    // Assignments come first, as they are written
+    for (int i = 0; i < cmd->assign_count && status == 0; i++) {
+        if (!cmd->assigns[i].parts) continue;
+        if (out->assigns == cmd->assigns) {
+            out->assigns = arena_alloc(arena, cmd->assign_count * sizeof(Assignment));
+            if (!out->assigns) return -1;
+            memcpy(out->assigns, cmd->assigns, cmd->assign_count * sizeof(Assignment));
+        }
+        const char *value = NULL;
+        if (expand_word(&e, cmd->assigns[i].parts, 0) == 0) {
+            value = field_take(&e);
+        }
+        if (!value) status = -1;
+        out->assigns[i].value = value;
+        out->assigns[i].parts = NULL;
+    }
+
+    if (cmd->parts) {
+        // An empty vector still needs its terminating NULL
+        status = push_field(&e, NULL);
+        e.argc = 0;
+    }
+    // Arguments are patterns; assignments and redirection targets are not
+    e.globbing = 1;
+    for (int i = 0; i < cmd->argc && cmd->parts && status == 0; i++) {
+        if (cmd->parts[i]) {
+            int before = e.argc;
+            status = expand_argument(&e, cmd->parts[i]);
+            // The argument that grew the most is the one to split into
+            // batches if the command turns out too long to run at once
+            if (e.argc - before > out->batch_count) {
+                out->batch_first = before;
+                out->batch_count = e.argc - before;
+            }
+        } else {
+            // Plain words are shared with the parsed command
+            status = push_field(&e, cmd->argv[i]);
+        }
+    }
+    if (status == 0 && cmd->parts) {
+        out->argv = e.argv;
+        out->argc = e.argc;
+    }
+    e.globbing = 0;
+
+    // Redirection targets expand to exactly one word
+    for (int i = 0; i < cmd->redirect_count && status == 0; i++) {
+        if (!cmd->redirects[i].parts) continue;
+        if (out->redirects == cmd->redirects) {
+            out->redirects = arena_alloc(arena, cmd->redirect_count * sizeof(Redirect));
+            if (!out->redirects) {
+                status = -1;
+                break;
+            }
+            memcpy(out->redirects, cmd->redirects, cmd->redirect_count * sizeof(Redirect));
+        }
+        const char *target = NULL;
+        if (expand_word(&e, cmd->redirects[i].parts, 0) == 0) {
+            target = field_take(&e);
+        }
+        if (!target) status = -1;
+        out->redirects[i].target = target;
+        out->redirects[i].parts = NULL;
+    }
+    free(e.field);
+    free(e.pattern);
+    return status;
+}
@@ -0,0 +1,75 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "parser.h"
+
+/**
+ * Word expansion, done when a command runs
+ * Words with parts (see lexer.h) become their final arguments. First an
+ * argument's unquoted braces are expanded, a{b,c} to ab ac and {1..3} to
+ * 1 2 3 ({01..10} pads, {a..e} and {1..10..2} work too), each generated
+ * word going through the rest as soon as it is made. Then every
+ * variable reference is replaced by the variable's value and every
+ * command substitution by the command's output without its trailing
+ * newlines. Unless it was inside double quotes, the result is split into
+ * words at the characters of $IFS (space, tab and newline by default). A
+ * word that expands to nothing unquoted disappears. An argument with
+ * unquoted glob characters (written or expanded) is then replaced by the
+ * paths it matches, sorted (see pathglob.h), and kept as it is if there
+ * are none. Assignment values and redirection targets are never split,
+ * globbed or brace-expanded. The argument that expanded to the most words
+ * is recorded (batch_first/batch_count in Command), so a program whose
+ * arguments would not fit in one execve can be run on them in batches.
+ * Every field is held until the command runs, so a large brace range
+ * costs memory in proportion to its words. Variables are read and
+ * commands run by the caller, through hooks.
+ */
+
+/**
+ * Runs the command of a substitution and collects what it writes
+ * @param command - Command text
+ * @param len - Receives the length of the output
+ * @param ctx - Caller's context
+ * @return The output (malloc'd, freed by the caller), or NULL if the
+ *         command could not be run (reported)
+ */
+typedef char* (*CaptureFn)(const char *command, size_t *len, void *ctx);
+
+/**
+ * Reads a variable for a reference
+ * @param name - Variable name (or ?, $ or !)
+ * @param ctx - Caller's context
+ * @return Its value, or NULL if it is not set
+ */
+typedef const char* (*LookupFn)(const char *name, void *ctx);
+
+/**
+ * How an expansion reaches the rest of the shell
+ */
+typedef struct {
+    CaptureFn capture;    // Runs command substitutions
+    LookupFn lookup;      // Reads variables
+    void *ctx;            // Passed to both
+} ExpandHooks;
+
+/**
+ * @param cmd - Command as parsed
+ * @return 1 if any argument, assignment or redirection target has parts,
+ *         0 otherwise
+ */
+int command_needs_expansion(const Command *cmd);
+
+/**
+ * Expands a command's arguments, assignments and redirection targets
+ * @param arena - Arena that receives whatever the expansion produces
+ * @param cmd - Command as parsed
+ * @param out - Receives the expanded command (its block is shared)
+ * @param hooks - Reads variables and runs substitutions
+ * @return 0 on success, -1 if a substitution failed or on allocation failure
+ */
+int expand_command(Arena *arena, const Command *cmd, Command *out, const ExpandHooks *hooks);
+
+#endif
@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "history.h"
+
+/* Constants */
+#define INITIAL_ENTRY_CAPACITY 1024
+#define INITIAL_TRIGRAM_SLOTS 4096
+
+/**
+ * Entries containing one trigram, in increasing order
+ */
+typedef struct {
+    uint32_t key;             // The three bytes plus one (0 marks a free slot)
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *ids;            // Entry numbers
+} Posting;
+
+static int history_fd = -1;          // Append-only history file
+static const char *map = NULL;       // The file, mapped read-only
+static size_t map_size = 0;          // Bytes mapped
+
+static size_t *offsets = NULL;       // Start of every indexed entry
+static size_t entry_count = 0;       // Entries in the line index
+static size_t entry_capacity = 0;
+static size_t indexed_bytes = 0;     // Bytes the line index covers (whole lines only)
+
+static Posting *trigrams = NULL;     // Open-addressing table of posting lists
+static size_t trigram_slots = 0;     // Size of the table (a power of two)
+static size_t trigram_used = 0;      // Occupied slots
+static size_t trigram_entries = 0;   // Entries added to the trigram index
+
+/**
+ * Gets the text of an indexed entry
+ * @param n - Entry number, starting at 1
+ * @param len - Receives its length (without the newline)
+ * @return Pointer into the mapping (not NUL-terminated)
+ */
+static const char* entry_text(size_t n, size_t *len) {
+    size_t start = offsets[n - 1];
+    size_t end = n < entry_count ? offsets[n] : indexed_bytes;
+    *len = end - start - 1;
+    return map + start;
+}
+
+/**
+ * @param s - Three bytes
+ * @return Key of the trigram in the table (never 0)
+ */
+static uint32_t trigram_key(const char *s) {
+    return ((uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 |
+            (unsigned char)s[2]) + 1;
+}
+
+/**
+ * Finds a trigram's slot
+ * @param key - Trigram key
+ * @return Its slot, or the free slot where it belongs
+ */
+static Posting* trigram_slot(uint32_t key) {
+    size_t i = (key * 2654435761u) & (trigram_slots - 1);
+    while (trigrams[i].key != 0 && trigrams[i].key != key) {
+        i = (i + 1) & (trigram_slots - 1);
+    }
+    return &trigrams[i];
+}
+
+/**
+ * Doubles the trigram table, moving every posting list
+ * @return 0 on success, -1 on allocation failure
+ */
+static int grow_trigrams(void) {
+    Posting *old = trigrams;
+    size_t old_slots = trigram_slots;
+
+    trigram_slots = old_slots ? old_slots * 2 : INITIAL_TRIGRAM_SLOTS;
+    trigrams = calloc(trigram_slots, sizeof(Posting));
+    if (!trigrams) {
+        trigrams = old;
+        trigram_slots = old_slots;
+        return -1;
+    }
+    for (size_t i = 0; i < old_slots; i++) {
+        if (old[i].key != 0) *trigram_slot(old[i].key) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * Adds one entry's trigrams to the index
+ * @param n - Entry number (entries must be added in order)
+ * @return 0 on success, -1 on allocation failure
+ */
+static int index_trigrams(size_t n) {
+    size_t len;
+    const char *text = entry_text(n, &len);
+
+    for (size_t i = 0; i + 3 <= len; i++) {
+        if ((trigram_used + 1) * 2 > trigram_slots && grow_trigrams() != 0) return -1;
+        uint32_t key = trigram_key(text + i);
+        Posting *p = trigram_slot(key);
+        if (p->key == 0) {
+            p->key = key;
+            trigram_used++;
+        }
+        // Each entry is listed once per trigram however often it repeats
+        if (p->count > 0 && p->ids[p->count - 1] == n) continue;
+        if (p->count == p->capacity) {
+            uint32_t capacity = p->capacity ? p->capacity * 2 : 4;
+            uint32_t *bigger = realloc(p->ids, capacity * sizeof(uint32_t));
+            if (!bigger) return -1;
+            p->ids = bigger;
+            p->capacity = capacity;
+        }
+        p->ids[p->count++] = (uint32_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Frees the trigram index
+ */
+static void free_trigrams(void) {
+    for (size_t i = 0; i < trigram_slots; i++) {
+        free(trigrams[i].ids);
+    }
+    free(trigrams);
+    trigrams = NULL;
+    trigram_slots = trigram_used = trigram_entries = 0;
+}
+
+/**
+ * Catches up with the file: remaps it if its size changed and indexes the
+ * lines (ours or another shell's) appended since the last call
+ * @return 0 on success, -1 on failure
+ */
+static int history_sync(void) {
+    struct stat st;
+    if (history_fd < 0 || fstat(history_fd, &st) != 0) return -1;
+
+    size_t size = (size_t)st.st_size;
+    if (size < indexed_bytes) {
+        // Truncated under us: start over
+        free_trigrams();
+        entry_count = indexed_bytes = 0;
+    }
+    if (size != map_size) {
+        if (map) munmap((void *)map, map_size);
+        map = NULL;
+        map_size = 0;
+        if (size > 0) {
+            void *m = mmap(NULL, size, PROT_READ, MAP_SHARED, history_fd, 0);
+            if (m == MAP_FAILED) return -1;
+            map = m;
+            map_size = size;
+        }
+    }
+
+    // A line another shell is still writing has no newline yet
+    const char *nl;
+    while (indexed_bytes < map_size &&
+           (nl = memchr(map + indexed_bytes, '\n', map_size - indexed_bytes)) != NULL) {
+        if (entry_count == entry_capacity) {
+            size_t capacity = entry_capacity ? entry_capacity * 2 : INITIAL_ENTRY_CAPACITY;
+            size_t *bigger = realloc(offsets, capacity * sizeof(size_t));
+            if (!bigger) return -1;
+            offsets = bigger;
+            entry_capacity = capacity;
+        }
+        offsets[entry_count++] = indexed_bytes;
+        indexed_bytes = nl - map + 1;
+    }
+
+    // Once built, the trigram index follows the line index
+    while (trigrams && trigram_entries < entry_count) {
+        if (index_trigrams(trigram_entries + 1) != 0) return -1;
+        trigram_entries++;
+    }
+    return 0;
+}
+
+int history_open(const char *path) {
+    history_close();
+    if (path) {
+        history_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    } else {
+#ifdef __linux__
+        history_fd = memfd_create("history", MFD_CLOEXEC);
+#else
+        FILE *scratch = tmpfile();
+        history_fd = scratch ? dup(fileno(scratch)) : -1;
+        if (scratch) fclose(scratch);
+#endif
+    }
+    return history_fd >= 0 ? 0 : -1;
+}
+
+int history_add(const char *line, size_t len) {
+    if (history_fd < 0 || len == 0) return -1;
+
+    // One write per entry, so concurrent shells never interleave lines
+    struct iovec parts[2] = {
+        {(void *)line, len},
+        {"\n", 1},
+    };
+    return writev(history_fd, parts, 2) == (ssize_t)(len + 1) ? 0 : -1;
+}
+
+size_t history_count(void) {
+    history_sync();
+    return entry_count;
+}
+
+char* history_get(size_t n) {
+    history_sync();
+    if (n == 0 || n > entry_count) return NULL;
+    size_t len;
+    const char *text = entry_text(n, &len);
+    return strndup(text, len);
+}
+
+/**
+ * Collects entries that contain (or start with) a text, newest first
+ * @param text - Text to look for
+ * @param prefix - Whether the entry must start with the text
+ * @param results - Receives entry numbers
+ * @param max - Room in results
+ * @return Number of entries stored in results
+ */
+static size_t find_entries(const char *text, int prefix, size_t *results, size_t max) {
+    size_t want = strlen(text), found = 0, len;
+    const char *entry;
+
+    if (history_sync() != 0 || max == 0) return 0;
+
+    // Short queries have no trigram to look up
+    if (want < 3) {
+        for (size_t n = entry_count; n > 0 && found < max; n--) {
+            entry = entry_text(n, &len);
+            if (prefix ? len >= want && memcmp(entry, text, want) == 0
+                       : memmem(entry, len, text, want) != NULL) {
+                results[found++] = n;
+            }
+        }
+        return found;
+    }
+
+    // Build the trigram index on first use
+    if (!trigrams) {
+        if (grow_trigrams() != 0) return 0;
+        if (history_sync() != 0) return 0;
+    }
+
+    // Every match contains all of the text's trigrams: walk the rarest list
+    Posting *rarest = NULL;
+    for (size_t i = 0; i + 3 <= want; i++) {
+        Posting *p = trigram_slot(trigram_key(text + i));
+        if (p->key == 0) return 0;
+        if (!rarest || p->count < rarest->count) rarest = p;
+    }
+    for (uint32_t j = rarest->count; j > 0 && found < max; j--) {
+        size_t n = rarest->ids[j - 1];
+        entry = entry_text(n, &len);
+        if (prefix ? len >= want && memcmp(entry, text, want) == 0
+                   : memmem(entry, len, text, want) != NULL) {
+            results[found++] = n;
+        }
+    }
+    return found;
+}
+
+size_t history_find_prefix(const char *prefix) {
+    size_t n;
+    return find_entries(prefix, 1, &n, 1) ? n : 0;
+}
+
+size_t history_search(const char *text, size_t *results, size_t max) {
+    return find_entries(text, 0, results, max);
+}
+
+void history_print(FILE *out, size_t first, size_t last) {
+    size_t len;
+    history_sync();
+    if (last > entry_count) last = entry_count;
+    for (size_t n = first ? first : 1; n <= last; n++) {
+        const char *text = entry_text(n, &len);
+        fprintf(out, "%5zu  %.*s\n", n, (int)len, text);
+    }
+}
+
+char* history_expand(const char *line) {
+    size_t word = strcspn(line, " \t");
+    const char *rest = line + word;
+    char *event = strndup(line + 1, word - 1);
+    if (!event) return NULL;
+
+    size_t count = history_count(), n = 0;
+    char *end;
+    long number = strtol(event, &end, 10);
+    if (strcmp(event, "!") == 0) {
+        n = count;
+    } else if (end != event && *end == '\0') {
+        if (number < 0 && (size_t)-number <= count) {
+            n = count + 1 + number;
+        } else if (number > 0) {
+            n = (size_t)number;
+        }
+    } else {
+        n = history_find_prefix(event);
+    }
+    free(event);
+
+    char *entry = history_get(n);
+    if (!entry) {
+        fflush(stdout);
+        fprintf(stderr, "%.*s: event not found\n", (int)word, line);
+        return NULL;
+    }
+    char *expanded = malloc(strlen(entry) + strlen(rest) + 1);
+    if (expanded) {
+        strcpy(expanded, entry);
+        strcat(expanded, rest);
+    }
+    free(entry);
+    return expanded;
+}
+
+void history_close(void) {
+    free_trigrams();
+    free(offsets);
+    offsets = NULL;
+    entry_count = entry_capacity = indexed_bytes = 0;
+    if (map) munmap((void *)map, map_size);
+    map = NULL;
+    map_size = 0;
+    if (history_fd >= 0) close(history_fd);
+    history_fd = -1;
+}
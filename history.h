@@ -0,0 +1,86 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * Persistent command history
+ * The history is an append-only file with one command per line. It is
+ * memory-mapped rather than read, so opening it costs the same however
+ * long it is; the line index and the trigram index used by searches are
+ * built the first time they are needed and then extended as the file
+ * grows. Every entry is appended with a single O_APPEND write, so several
+ * shells can share one file, and each sees the others' entries on its
+ * next query.
+ */
+
+/**
+ * Opens (creating if needed) the history file
+ * @param path - History file, or NULL for a history that lives only as
+ *               long as this shell
+ * @return 0 on success, -1 if it could not be opened (nothing is recorded)
+ */
+int history_open(const char *path);
+
+/**
+ * Appends a command line to the history
+ * @param line - Command line (must not contain a newline)
+ * @param len - Length of the line
+ * @return 0 on success, -1 on failure
+ */
+int history_add(const char *line, size_t len);
+
+/**
+ * @return Number of entries, including those other shells appended
+ */
+size_t history_count(void);
+
+/**
+ * Copies one entry
+ * @param n - Entry number, starting at 1
+ * @return NUL-terminated copy (caller frees), or NULL if there is no such entry
+ */
+char* history_get(size_t n);
+
+/**
+ * Finds the newest entry that starts with a prefix
+ * @param prefix - Text the entry must start with
+ * @return Entry number, or 0 if none matches
+ */
+size_t history_find_prefix(const char *prefix);
+
+/**
+ * Finds entries containing a substring, newest first
+ * Queries of three or more bytes go through the trigram index, shorter
+ * ones scan the entries.
+ * @param text - Text to look for
+ * @param results - Receives entry numbers
+ * @param max - Room in results
+ * @return Number of entries stored in results
+ */
+size_t history_search(const char *text, size_t *results, size_t max);
+
+/**
+ * Prints entries numbered like `history` does
+ * @param out - Stream to print to
+ * @param first - First entry to print
+ * @param last - Last entry to print
+ */
+void history_print(FILE *out, size_t first, size_t last);
+
+/**
+ * Expands a history reference at the start of a line:
+ * !! (the last entry), !n, !-n or !prefix, followed by the rest of the line
+ * @param line - Line starting with '!'
+ * @return Expanded line (caller frees), or NULL if the event was not found
+ *         (error already reported)
+ */
+char* history_expand(const char *line);
+
+/**
+ * Unmaps the history and frees its indexes
+ */
+void history_close(void);
+
+#endif
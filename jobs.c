@@ -0,0 +1,644 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "events.h"
+#include "jobs.h"
+#include "spawn.h"
+#include "trace.h"
+#include "zerocopy.h"
+
+/* Constants */
+#define INITIAL_PARALLEL_ITEMS 64   // Initial room for the items of a parallel run
+
+/**
+ * A background (or stopped) pipeline
+ */
+typedef struct Job {
+    int id;                   // Job number shown to the user
+    pid_t pgid;               // Process group with job control, otherwise 0
+    pid_t *pids;              // Stage processes (0 once reaped)
+    int *statuses;            // Exit status of every stage
+    int count;                // Number of stages
+    int remaining;            // Stages still running
+    int stopped;              // Stages stopped by a signal
+    int stop_reported;        // The user has been told it stopped
+    int status;               // Exit status of the job
+    char *text;               // Command text for messages
+    double start;             // When it was started (monotonic seconds)
+    long trace_id;            // Pipeline id in trace records
+    struct Job *next;
+} Job;
+
+static Job *jobs = NULL;      // Oldest job first
+static int next_job_id = 1;
+static int job_control = 0;   // Jobs get process groups and the terminal
+static pid_t shell_pgid = 0;  // The shell's own process group
+
+int pipefail = 0;
+
+int pipeline_status(const int *statuses, int count) {
+    if (pipefail) {
+        // The rightmost failure wins
+        for (int i = count - 1; i >= 0; i--) {
+            if (statuses[i] != 0) return statuses[i];
+        }
+        return 0;
+    }
+    return count > 0 ? statuses[count - 1] : 0;
+}
+
+int job_control_init(void) {
+    if (!isatty(STDIN_FILENO)) return -1;
+    // Lead a process group of our own and own the terminal
+    setpgid(0, 0);
+    shell_pgid = getpgrp();
+    signal(SIGTTOU, SIG_IGN);
+    if (tcsetpgrp(STDIN_FILENO, shell_pgid) != 0) return -1;
+    job_control = 1;
+    return 0;
+}
+
+int job_control_enabled(void) {
+    return job_control;
+}
+
+void job_control_reset(void) {
+    job_control = 0;
+}
+
+/**
+ * Hands the terminal to a process group
+ * @param pgid - Group to put in the foreground (0: the shell's)
+ */
+static void give_terminal(pid_t pgid) {
+    if (job_control) {
+        tcsetpgrp(STDIN_FILENO, pgid > 0 ? pgid : shell_pgid);
+    }
+}
+
+/**
+ * Sends a signal to every process of a job
+ * @param job - Job to signal
+ * @param sig - Signal to send
+ */
+static void signal_job(Job *job, int sig) {
+    if (job->pgid > 0) {
+        kill(-job->pgid, sig);
+        return;
+    }
+    for (int i = 0; i < job->count; i++) {
+        if (job->pids[i] > 0) kill(job->pids[i], sig);
+    }
+}
+
+int job_add(const pid_t *pids, int count, const Pipeline *pipeline, pid_t pgid) {
+    Job *job = calloc(1, sizeof(Job));
+    if (!job || !(job->pids = calloc(count, sizeof(pid_t))) ||
+        !(job->statuses = calloc(count, sizeof(int)))) {
+        if (job) free(job->pids);
+        free(job);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (pids[i] > 0) {
+            job->pids[job->count++] = pids[i];
+        }
+    }
+    job->pgid = pgid;
+    job->remaining = job->count;
+    job->status = job->count ? 0 : 127;
+    job->text = pipeline_text(pipeline);
+    job->start = monotonic_now();
+    job->trace_id = trace_reserve_id();
+
+    // Reuse numbers once every job has finished, like other shells
+    if (!jobs) next_job_id = 1;
+    job->id = next_job_id++;
+
+    Job **link = &jobs;
+    while (*link) link = &(*link)->next;
+    *link = job;
+    return job->id;
+}
+
+/**
+ * Frees a job
+ * @param job - Job to free
+ */
+static void free_job(Job *job) {
+    free(job->pids);
+    free(job->statuses);
+    free(job->text);
+    free(job);
+}
+
+/**
+ * Records that one stage of a job exited
+ * @param job - Job owning the stage
+ * @param index - Stage index
+ * @param status - Shell-style exit status
+ * @param usage - Resource usage reported by wait4
+ */
+static void stage_exited(Job *job, int index, int status, const struct rusage *usage) {
+    ProcessStats stats;
+    stats.start = job->start;
+    stats.end = monotonic_now();
+    stats.status = status;
+    stats.usage = *usage;
+    trace_process(job->trace_id, index, job->pids[index], job->text, &stats);
+
+    job->pids[index] = 0;
+    job->statuses[index] = status;
+    job->remaining--;
+    if (job->remaining == 0) {
+        job->status = pipeline_status(job->statuses, job->count);
+    }
+}
+
+int job_child_changed(pid_t pid, int raw, const struct rusage *usage) {
+    for (Job *job = jobs; job; job = job->next) {
+        for (int i = 0; i < job->count; i++) {
+            if (job->pids[i] != pid) continue;
+            if (WIFSTOPPED(raw)) {
+                job->stopped++;
+                job->stop_reported = 0;
+            } else {
+                stage_exited(job, i, exit_status_of(raw), usage);
+            }
+            return 1;
+        }
+    }
+    // Nobody's job: someone may still wait for it by pid
+    events_keep_status(pid, raw, usage);
+    return 0;
+}
+
+/**
+ * Event-loop callback for children that belong to jobs (or nobody)
+ */
+static void job_event(pid_t pid, int raw, const struct rusage *usage, void *ctx) {
+    (void)ctx;
+    job_child_changed(pid, raw, usage);
+}
+
+/**
+ * @param job - Job to describe
+ * @return "Running", "Stopped", "Done" or "Exit N" (static buffer)
+ */
+static const char* job_state(const Job *job) {
+    static char state[32];
+    if (job->remaining > 0) return job->stopped > 0 ? "Stopped" : "Running";
+    if (job->status == 0) return "Done";
+    snprintf(state, sizeof(state), "Exit %d", job->status);
+    return state;
+}
+
+/**
+ * Prints a job like `jobs` does
+ * @param out - Stream to print to
+ * @param job - Job to print
+ */
+static void print_job(FILE *out, const Job *job) {
+    fprintf(out, "[%d]%c  %-24s%s\n", job->id, job->next ? '-' : '+', job_state(job),
+            job->text ? job->text : "");
+}
+
+/**
+ * Removes finished jobs from the table, and reports jobs that stopped
+ * @param report - Stream for notices, or NULL
+ */
+static void drop_finished(FILE *report) {
+    Job **link = &jobs;
+    while (*link) {
+        Job *job = *link;
+        if (job->remaining > 0) {
+            if (report && job->stopped > 0 && !job->stop_reported) {
+                print_job(report, job);
+            }
+            job->stop_reported |= job->stopped > 0;
+            link = &job->next;
+            continue;
+        }
+        if (report) print_job(report, job);
+        *link = job->next;
+        free_job(job);
+    }
+}
+
+void job_reap(FILE *report) {
+    events_poll_children(job_event, NULL);
+    drop_finished(report);
+}
+
+void job_list(FILE *out) {
+    events_poll_children(job_event, NULL);
+    for (Job *job = jobs; job; job = job->next) {
+        print_job(out, job);
+        job->stop_reported |= job->stopped > 0;
+    }
+    drop_finished(NULL);
+}
+
+/**
+ * Blocks until every stage of a job has exited (or, with job control,
+ * until it stops)
+ * @param job - Job to wait for
+ */
+static void wait_job(Job *job) {
+    // Output the shell has buffered comes before anything the job prints now
+    fflush(stdout);
+    while (job->remaining > 0 && job->stopped == 0) {
+        if (events_wait_children(job_event, NULL) < 0) break;
+    }
+}
+
+/**
+ * Finds a job by number (%n, with %% or %+ for the newest) or pid
+ * @param spec - Job to find, or NULL for the newest
+ * @return The job, or NULL if there is none
+ */
+static Job* find_job(const char *spec) {
+    Job *newest = jobs;
+    while (newest && newest->next) newest = newest->next;
+    if (spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) return newest;
+
+    int want_id = spec[0] == '%';
+    long number = strtol(want_id ? spec + 1 : spec, NULL, 10);
+    for (Job *job = jobs; job; job = job->next) {
+        if (want_id && job->id == number) return job;
+        for (int i = 0; !want_id && i < job->count; i++) {
+            if (job->pids[i] == number) return job;
+        }
+    }
+    return NULL;
+}
+
+int job_wait(const char *spec) {
+    int status = 0;
+
+    if (spec == NULL) {
+        for (Job *job = jobs; job; job = job->next) {
+            wait_job(job);
+            status = job->remaining > 0 ? 128 + SIGTSTP : job->status;
+        }
+        drop_finished(NULL);
+        return status;
+    }
+
+    Job *job = find_job(spec);
+    if (!job) return 127;
+    wait_job(job);
+    status = job->remaining > 0 ? 128 + SIGTSTP : job->status;
+    drop_finished(NULL);
+    return status;
+}
+
+int job_foreground(const char *spec) {
+    Job *job = find_job(spec);
+    if (!job) return -1;
+
+    // Show what is being resumed, then let it have the terminal
+    printf("%s\n", job->text ? job->text : "");
+    fflush(stdout);
+    give_terminal(job->pgid);
+    if (job->stopped > 0) {
+        job->stopped = 0;
+        signal_job(job, SIGCONT);
+    }
+    wait_job(job);
+    give_terminal(0);
+
+    int status;
+    if (job->remaining > 0) {
+        fprintf(stdout, "\n");
+        print_job(stdout, job);
+        job->stop_reported = 1;
+        status = 128 + SIGTSTP;
+    } else {
+        status = job->status;
+    }
+    drop_finished(NULL);
+    return status;
+}
+
+int job_background(const char *spec) {
+    Job *job = find_job(spec);
+    if (!job) return -1;
+    if (job->stopped > 0) {
+        job->stopped = 0;
+        signal_job(job, SIGCONT);
+    }
+    printf("[%d]+ %s &\n", job->id, job->text ? job->text : "");
+    return 0;
+}
+
+/**
+ * What wait_foreground is waiting for
+ */
+typedef struct {
+    const pid_t *pids;
+    int count;
+    ProcessStats *stats;
+    char *reaped;             // Which processes have exited
+    int remaining;            // Processes still running
+    int stopped;              // Set once one of them was stopped
+    pid_t pgid;               // Group that has the terminal
+} Foreground;
+
+/**
+ * Event-loop callback while a foreground pipeline runs
+ */
+static void foreground_event(pid_t pid, int raw, const struct rusage *usage, void *ctx) {
+    Foreground *fg = ctx;
+    int index = -1;
+    for (int i = 0; i < fg->count; i++) {
+        if (fg->pids[i] == pid) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        // Not ours: it belongs to a background job
+        job_child_changed(pid, raw, usage);
+        return;
+    }
+    if (WIFSTOPPED(raw)) {
+        // A stage that touched the terminal before it was handed over
+        // only needs to go on; anything else is the user's Ctrl-Z
+        int sig = WSTOPSIG(raw);
+        if ((sig == SIGTTIN || sig == SIGTTOU) && fg->pgid > 0) {
+            kill(pid, SIGCONT);
+        } else {
+            fg->stopped = 1;
+        }
+        return;
+    }
+    fg->reaped[index] = 1;
+    fg->stats[index].end = monotonic_now();
+    fg->stats[index].status = exit_status_of(raw);
+    fg->stats[index].usage = *usage;
+    fg->remaining--;
+}
+
+int wait_foreground(pid_t *pids, int count, ProcessStats *stats,
+                    const Pipeline *pipeline, pid_t pgid) {
+    char reaped[count];
+    Foreground fg = {pids, count, stats, reaped, 0, 0, job_control ? pgid : 0};
+    for (int i = 0; i < count; i++) {
+        reaped[i] = 0;
+        stats[i].end = stats[i].start;
+        stats[i].status = 127;
+        memset(&stats[i].usage, 0, sizeof(struct rusage));
+        if (pids[i] > 0) fg.remaining++;
+    }
+
+    give_terminal(fg.pgid);
+    while (fg.remaining > 0 && !fg.stopped) {
+        if (events_wait_children(foreground_event, &fg) < 0) break;
+    }
+    give_terminal(0);
+    if (!fg.stopped) return 0;
+
+    // Ctrl-Z: what is still running becomes a stopped job
+    pid_t running[count];
+    for (int i = 0; i < count; i++) {
+        running[i] = !reaped[i] && pids[i] > 0 ? pids[i] : -1;
+        if (running[i] > 0) {
+            stats[i].status = 128 + SIGTSTP;
+            pids[i] = -1;
+        }
+    }
+    int id = job_add(running, count, pipeline, fg.pgid);
+    Job *job = find_job(NULL);
+    if (id > 0 && job) {
+        job->stopped = 1;
+        job->stop_reported = 1;
+        printf("\n");
+        print_job(stdout, job);
+    }
+    return id;
+}
+
+void jobs_free(void) {
+    while (jobs) {
+        Job *next = jobs->next;
+        free_job(jobs);
+        jobs = next;
+    }
+}
+
+/**
+ * Creates an anonymous file to capture one item's output
+ * @return Descriptor or -1 on failure
+ */
+static int capture_fd(void) {
+#ifdef __linux__
+    int fd = memfd_create("parallel", MFD_CLOEXEC);
+    if (fd >= 0) return fd;
+#endif
+    char path[] = "/tmp/parallelXXXXXX";
+    int fd2 = mkstemp(path);
+    if (fd2 >= 0) {
+        unlink(path);
+        fcntl(fd2, F_SETFD, FD_CLOEXEC);
+    }
+    return fd2;
+}
+
+/**
+ * Copies a finished item's captured output to stdout and closes it
+ * @param fd - Capture descriptor
+ */
+static void emit_output(int fd) {
+    fflush(stdout);
+    lseek(fd, 0, SEEK_SET);
+    zc_copy(fd, STDOUT_FILENO);
+    close(fd);
+}
+
+/**
+ * One item of a parallel run
+ */
+typedef struct {
+    pid_t pid;                // Process to wait for, or -1
+    int fd;                   // Captured output, or -1 once written out
+    double start;             // When it was started
+    char *label;              // Command for the trace, or NULL
+    int done;                 // Whether it has finished
+} ParallelItem;
+
+/**
+ * State of a parallel run, shared with the event-loop callback
+ */
+typedef struct {
+    ParallelItem *items;      // Every item started so far (malloc'd, grows)
+    int capacity;
+    int started;
+    int first;                // Items before this one have all finished
+    int emitted;              // In item order: items written out so far
+    int in_order;             // Write output in item order, else as items finish
+    int finished;             // Items that finished during the last wait
+    int result;               // Last failing status
+} ParallelRun;
+
+/**
+ * Event-loop callback while parallel items run
+ */
+static void parallel_event(pid_t pid, int raw, const struct rusage *usage, void *ctx) {
+    ParallelRun *run = ctx;
+    int index = -1;
+    for (int i = run->first; i < run->started; i++) {
+        if (run->items[i].pid == pid && !run->items[i].done) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        // Not ours: it belongs to a background job
+        job_child_changed(pid, raw, usage);
+        return;
+    }
+    if (WIFSTOPPED(raw)) {
+        // Items share the shell's process group; they cannot be stopped alone
+        kill(pid, SIGCONT);
+        return;
+    }
+    ParallelItem *item = &run->items[index];
+    item->done = 1;
+    run->finished++;
+    int status = exit_status_of(raw);
+    if (status != 0) run->result = status;
+    while (run->first < run->started && run->items[run->first].done) run->first++;
+
+    // Per-item timing goes to the trace, with the item number as the stage
+    ProcessStats stats = {item->start, monotonic_now(), status, *usage};
+    trace_process(0, index, pid, item->label, &stats);
+    free(item->label);
+    item->label = NULL;
+
+    if (!run->in_order && item->fd >= 0) {
+        emit_output(item->fd);
+        item->fd = -1;
+    }
+}
+
+/**
+ * Starts the next item, making room for it first
+ * @param run - Parallel run
+ * @param start - Starts an item
+ * @param ctx - Passed through to start
+ * @return 1 if an item was started (or failed to start), 0 if there are
+ *         no more items, -1 on allocation failure
+ */
+static int start_item(ParallelRun *run, ParallelStart start, void *ctx) {
+    if (run->started == run->capacity) {
+        int capacity = run->capacity ? run->capacity * 2 : INITIAL_PARALLEL_ITEMS;
+        ParallelItem *bigger = realloc(run->items, capacity * sizeof(ParallelItem));
+        if (!bigger) return -1;
+        run->items = bigger;
+        run->capacity = capacity;
+    }
+    ParallelItem *item = &run->items[run->started];
+    item->fd = capture_fd();
+    item->start = monotonic_now();
+    item->done = 0;
+    item->label = NULL;
+    char **label = trace_enabled() ? &item->label : NULL;
+    item->pid = item->fd >= 0 ? start(run->started, item->fd, label, ctx) : -1;
+    if (item->pid == PARALLEL_END) {
+        close(item->fd);
+        return 0;
+    }
+    if (item->pid < 0) {
+        free(item->label);
+        item->label = NULL;
+        // Reported by start; the item counts as failed
+        item->done = 1;
+        run->result = 127;
+        if (!run->in_order && item->fd >= 0) {
+            emit_output(item->fd);
+            item->fd = -1;
+        }
+    }
+    run->started++;
+    return 1;
+}
+
+/**
+ * Gives up on a run whose children can no longer be waited for: closes
+ * every capture not yet written out and reaps each item still running
+ * @param run - Parallel run
+ */
+static void abandon_items(ParallelRun *run) {
+    for (int i = run->emitted; i < run->started; i++) {
+        ParallelItem *item = &run->items[i];
+        if (item->fd >= 0) close(item->fd);
+        item->fd = -1;
+        if (!item->done && item->pid > 0) {
+            int raw;
+            while (waitpid(item->pid, &raw, 0) < 0 && errno == EINTR) {}
+        }
+        item->done = 1;
+        free(item->label);
+        item->label = NULL;
+    }
+    run->emitted = run->started;
+    if (run->result == 0) run->result = 1;
+}
+
+int run_parallel(int count, int max_jobs, int in_order, ParallelStart start, void *ctx) {
+    if (count == 0) return 0;
+    if (max_jobs <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_jobs = cpus > 0 ? (int)cpus : 1;
+    }
+
+    ParallelRun run;
+    memset(&run, 0, sizeof(run));
+    run.in_order = in_order;
+    int running = 0, more = 1;
+    while (more || running > 0 || run.emitted < run.started) {
+        // Keep max_jobs children in flight, taking items as they come
+        while (more && running < max_jobs && (count < 0 || run.started < count)) {
+            int started = start_item(&run, start, ctx);
+            if (started < 0) {
+                fprintf(stderr, "parallel: Memory allocation failed\n");
+                run.result = 1;
+            }
+            if (started <= 0) {
+                more = 0;
+                break;
+            }
+            if (!run.items[run.started - 1].done) running++;
+        }
+        if (count >= 0 && run.started == count) more = 0;
+
+        // In item order, write out every finished item not blocked by an earlier one
+        while (run.emitted < run.started && run.items[run.emitted].done) {
+            if (run.items[run.emitted].fd >= 0) emit_output(run.items[run.emitted].fd);
+            run.items[run.emitted].fd = -1;
+            run.emitted++;
+        }
+        if (running == 0) continue;
+
+        // Sleep until some children finish, then record them
+        run.finished = 0;
+        if (events_wait_children(parallel_event, &run) < 0) {
+            abandon_items(&run);
+            break;
+        }
+        running -= run.finished;
+    }
+
+    free(run.items);
+    return run.result;
+}
@@ -0,0 +1,160 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "parser.h"
+#include "spawn.h"
+
+/**
+ * Background jobs, job control and parallel execution
+ * A job is a pipeline started with '&', or a foreground pipeline the
+ * user stopped with Ctrl-Z. The shell keeps running while it does; `wait`
+ * blocks until jobs finish. With job control (an interactive shell on a
+ * terminal) every pipeline runs in its own process group, which owns the
+ * terminal while it is in the foreground, and `fg`/`bg` resume stopped
+ * jobs. run_parallel keeps up to N children in flight and replays their
+ * output in submission or completion order. All waiting goes through the
+ * event loop (events.h), so children are reaped in the order they finish.
+ */
+
+/**
+ * Shell option: a pipeline's status is its rightmost failing stage's
+ * rather than its last stage's (set -o pipefail)
+ */
+extern int pipefail;
+
+/**
+ * Combines the stages' statuses into the pipeline's, honouring pipefail
+ * @param statuses - Exit status of every stage
+ * @param count - Number of stages
+ * @return Status of the pipeline
+ */
+int pipeline_status(const int *statuses, int count);
+
+/**
+ * Turns on job control: the shell leads its own process group and takes
+ * the terminal
+ * @return 0 on success, -1 if stdin is not a terminal we can control
+ */
+int job_control_init(void);
+
+/**
+ * @return 1 if pipelines get their own process groups
+ */
+int job_control_enabled(void);
+
+/**
+ * Turns job control off, in a forked copy of the shell
+ */
+void job_control_reset(void);
+
+/**
+ * Records a started background pipeline
+ * @param pids - Process of every stage (entries <= 0 are skipped)
+ * @param count - Number of stages
+ * @param pipeline - Pipeline that was started (used for its text)
+ * @param pgid - Its process group, or 0 without job control
+ * @return Job number
+ */
+int job_add(const pid_t *pids, int count, const Pipeline *pipeline, pid_t pgid);
+
+/**
+ * Hands a child reaped elsewhere (e.g. by wait4(-1)) to its job
+ * @param pid - Reaped or stopped child
+ * @param raw - Status reported by wait4
+ * @param usage - Resource usage reported by wait4
+ * @return 1 if the child belonged to a job, 0 otherwise (its exit status
+ *         is then kept for a wait by pid, see events_keep_status)
+ */
+int job_child_changed(pid_t pid, int raw, const struct rusage *usage);
+
+/**
+ * Reaps finished job processes without blocking
+ * @param report - Stream for "Done" and "Stopped" notices, or NULL to stay quiet
+ */
+void job_reap(FILE *report);
+
+/**
+ * Lists the jobs with their state, then forgets the finished ones
+ * @param out - Stream to print to
+ */
+void job_list(FILE *out);
+
+/**
+ * Resumes a job in the foreground and waits for it (fg)
+ * @param spec - "%n", a pid, or NULL for the newest job
+ * @return Its exit status (128+SIGTSTP if it stopped again), or -1 if
+ *         there is no such job
+ */
+int job_foreground(const char *spec);
+
+/**
+ * Resumes a stopped job in the background (bg)
+ * @param spec - "%n", a pid, or NULL for the newest job
+ * @return 0 on success, -1 if there is no such job
+ */
+int job_background(const char *spec);
+
+/**
+ * Waits for jobs to finish
+ * @param spec - "%n" (job number), a pid, or NULL for every job
+ * @return Exit status of the (last) job, 127 if spec matches no job
+ */
+int job_wait(const char *spec);
+
+/**
+ * Waits for a foreground pipeline's children in the order they finish, so
+ * each one's end time is accurate; children of background jobs reaped on
+ * the way are handed to their jobs. With job control the pipeline's
+ * process group has the terminal meanwhile, and if the user stops it,
+ * what is still running becomes a stopped job.
+ * @param pids - Children to wait for (entries <= 0 get status 127); the
+ *               ones handed to a stopped job are set to -1
+ * @param count - Number of children
+ * @param stats - One per child, start already filled in; receives the rest
+ * @param pipeline - Pipeline being waited for (for a stopped job's text)
+ * @param pgid - The pipeline's process group, or 0
+ * @return 0 once every child exited, or the number of the stopped job
+ */
+int wait_foreground(pid_t *pids, int count, ProcessStats *stats,
+                    const Pipeline *pipeline, pid_t pgid);
+
+/**
+ * Frees the job table (jobs keep running)
+ */
+void jobs_free(void);
+
+#define PARALLEL_END 0    // Returned by a ParallelStart when there are no more items
+
+/**
+ * Starts one item of a parallel run
+ * @param index - Item number
+ * @param out_fd - Descriptor the item must use as stdout
+ * @param label - Receives the item's command for the trace (malloc'd, may
+ *                be left NULL), or NULL when nobody is tracing
+ * @param ctx - Caller's context
+ * @return Pid of the process to wait for, -1 if it could not start
+ *         (reported), or PARALLEL_END if there are no more items
+ */
+typedef pid_t (*ParallelStart)(int index, int out_fd, char **label, void *ctx);
+
+/**
+ * Runs items with at most max_jobs children at a time, starting the next
+ * item whenever one finishes
+ * Each item's stdout is captured and written out whole, either in item
+ * order as soon as every earlier item has finished, or as soon as the
+ * item finishes, so output never interleaves. Every item is traced as a
+ * process whose stage is its number (see trace.h).
+ * @param count - Number of items, or -1 to start items until start
+ *                returns PARALLEL_END
+ * @param max_jobs - Maximum children in flight (<= 0: one per CPU)
+ * @param in_order - Whether output keeps item order (else completion order)
+ * @param start - Starts an item
+ * @param ctx - Passed through to start
+ * @return 0 if every item succeeded, otherwise the last failing status
+ */
+int run_parallel(int count, int max_jobs, int in_order, ParallelStart start, void *ctx);
+
+#endif
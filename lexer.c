@@ -0,0 +1,380 @@
+#include <string.h>
+#include <ctype.h>
+
+#include "lexer.h"
+#include "lexscan.h"
+
+/* Constants */
+#define INITIAL_TOKEN_SIZE 64    // Initial size of token array
+
+int lex_is_special(char c) {
+    return (c == '(' || c == ')' || c == '<' || c == '>' ||
+            c == ';' || c == '|' || c == '&');
+}
+
+int token_is(const Token *token, char c) {
+    return token->kind == TOKEN_SPECIAL && token->len == 1 && token->text[0] == c;
+}
+
+int token_is_op(const Token *token, const char *op) {
+    return token->kind == TOKEN_SPECIAL && strcmp(token->text, op) == 0;
+}
+
+/**
+ * Measures the operator starting at a special character
+ * The redirection operators `>>`, `<<`, `<<-`, `<<<`, `>&` and `<&` are
+ * the only ones longer than one character.
+ * @param input - Text starting at a special character
+ * @return Length of the operator
+ */
+static size_t operator_length(const char *input) {
+    if (input[0] == '<' && input[1] == '<') {
+        return input[2] == '-' || input[2] == '<' ? 3 : 2;
+    }
+    if ((input[0] == '>' && input[1] == '>') ||
+        ((input[0] == '<' || input[0] == '>') && input[1] == '&')) {
+        return 2;
+    }
+    return 1;
+}
+
+/**
+ * Checks whether a word is a descriptor number for the redirection
+ * right after it, as in 2>file (the digits and the operator touch)
+ * @param word - Text of the word
+ * @param len - Its length
+ * @return 1 if it is all digits, 0 otherwise
+ */
+static int is_io_number(const char *word, size_t len) {
+    if (len == 0) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (!isdigit((unsigned char)word[i])) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Finds the end of a command substitution
+ * Parentheses nest, except inside double quotes; backquotes do not nest.
+ * @param input - Text just after the opening $( or `
+ * @param len - Bytes left in the line
+ * @param backquote - Whether it was opened with a backquote
+ * @return Length of the command: up to the closing ) or `, or to the end
+ *         of the line if it is never closed
+ */
+static size_t substitution_length(const char *input, size_t len, int backquote) {
+    if (backquote) {
+        const char *close = memchr(input, '`', len);
+        return close ? (size_t)(close - input) : len;
+    }
+    int depth = 1, in_quotes = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (input[i] == '"') {
+            in_quotes = !in_quotes;
+        } else if (!in_quotes && input[i] == '(') {
+            depth++;
+        } else if (!in_quotes && input[i] == ')' && --depth == 0) {
+            return i;
+        }
+    }
+    return len;
+}
+
+/**
+ * @param c - Character to check
+ * @return 1 if c may be part of a variable name
+ */
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+/**
+ * Measures a variable reference: $NAME, ${NAME}, $?, $$ or $!
+ * @param input - Text just after the $
+ * @param name - Receives the offset of the name in input
+ * @param name_len - Receives the length of the name
+ * @return Length of the reference after the $, or 0 if the $ is literal
+ */
+static size_t variable_length(const char *input, size_t *name, size_t *name_len) {
+    int braced = input[0] == '{';
+    size_t start = braced, len = 0;
+    if (input[start] != '\0' && strchr("?$!", input[start])) {
+        len = 1;
+    } else if (!isdigit((unsigned char)input[start])) {
+        while (is_name_char(input[start + len])) len++;
+    }
+    if (len == 0 || (braced && input[start + len] != '}')) return 0;
+    *name = start;
+    *name_len = len;
+    return start + len + braced;
+}
+
+/**
+ * Checks unquoted text for glob characters: `*`, `?`, or a `[` closed by a
+ * later `]` (the expansion decides whether the word really is a pattern)
+ * @param text - Text to check
+ * @param len - Its length
+ * @return 1 if it has any, 0 otherwise
+ */
+static int has_glob_chars(const char *text, size_t len) {
+    if (memchr(text, '*', len) || memchr(text, '?', len)) return 1;
+    const char *open = memchr(text, '[', len);
+    return open && memchr(open + 1, ']', len - (open + 1 - text)) != NULL;
+}
+
+/**
+ * Follows unquoted text for a possible brace expansion: a `{` and a later
+ * `}` (the expansion decides whether they really form one)
+ * @param text - Text to scan
+ * @param len - Its length
+ * @param state - 0 before any `{`, 1 after one, 2 once a `}` follows it
+ */
+static void scan_braces(const char *text, size_t len, int *state) {
+    const char *open = *state ? text : memchr(text, '{', len);
+    if (!open) return;
+    *state = memchr(open, '}', len - (open - text)) ? 2 : 1;
+}
+
+/**
+ * Appends a part to the list of the word being built
+ * @param arena - Arena that receives the part
+ * @param tail - Where the next part is linked, advanced past the new one
+ * @param kind - Kind of part
+ * @param text - Its text
+ * @param len - Length of text
+ * @param quoted - Whether it was inside double quotes
+ * @return 0 on success, -1 on allocation failure
+ */
+static int push_part(Arena *arena, WordPart ***tail, PartKind kind, const char *text,
+                     size_t len, int quoted) {
+    WordPart *part = arena_alloc(arena, sizeof(WordPart));
+    if (!part) return -1;
+    part->kind = kind;
+    part->text = text;
+    part->len = len;
+    part->quoted = quoted;
+    part->next = NULL;
+    **tail = part;
+    *tail = &part->next;
+    return 0;
+}
+
+/**
+ * Appends a token, doubling the array inside the arena when it is full
+ * @param arena - Arena holding the token array
+ * @param list - Token list to append to
+ * @param text - Token text (NUL-terminated, in the arena)
+ * @param len - Length of text
+ * @param kind - Kind of token
+ * @param quoted - Whether any part of the token was quoted
+ * @return 0 on success, -1 on allocation failure
+ */
+static int push_token(Arena *arena, TokenList *list, const char *text, size_t len,
+                      TokenKind kind, int quoted) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : INITIAL_TOKEN_SIZE;
+        Token *items = arena_alloc(arena, capacity * sizeof(Token));
+        if (!items) return -1;
+        if (list->count) {
+            memcpy(items, list->items, list->count * sizeof(Token));
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    Token *t = &list->items[list->count++];
+    t->text = text;
+    t->len = len;
+    t->kind = kind;
+    t->quoted = quoted;
+    t->parts = NULL;
+    return 0;
+}
+
+/**
+ * Appends a word token, finishing its list of parts if it has one
+ * @param arena - Arena holding the tokens
+ * @param list - Token list to append to
+ * @param word - Start of the word's text (NUL-terminated here)
+ * @param out - End of the word's text
+ * @param quoted - Whether any part of the word was quoted
+ * @param has_parts - Whether the word keeps its parts (it expands or globs)
+ * @param parts - Head of the list of parts
+ * @param tail - End of the list of parts
+ * @param literal - Start of the text not yet in a part
+ * @param source - The word as written, kept as the text of a word with parts
+ * @param source_len - Length of source
+ * @return 0 on success, -1 on allocation failure
+ */
+static int push_word(Arena *arena, TokenList *list, char *word, char *out, int quoted,
+                     int has_parts, WordPart **parts, WordPart **tail, char *literal,
+                     const char *source, size_t source_len) {
+    *out = '\0';
+    if (!has_parts) {
+        return push_token(arena, list, word, out - word, TOKEN_WORD, quoted);
+    }
+    if (out > literal && push_part(arena, &tail, PART_LITERAL, literal, out - literal, 0) != 0) {
+        return -1;
+    }
+    const char *text = arena_strndup(arena, source, source_len);
+    if (!text || push_token(arena, list, text, source_len, TOKEN_WORD, quoted) != 0) return -1;
+    list->items[list->count - 1].parts = *parts;
+    return 0;
+}
+
+int lex_line(Arena *arena, const char *input, TokenList *list) {
+    size_t input_len = strlen(input);
+
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+
+    // Every token's text fits in one buffer: at worst each input byte
+    // becomes its own token and needs a terminator
+    char *out = arena_alloc(arena, input_len * 2 + 1);
+    if (!out) return -1;
+
+    char *word = out;      // Start of the word being built
+    size_t word_start = 0; // Where the word starts in input
+    int in_word = 0;       // Whether a word is being built (may be empty "")
+    int in_quotes = 0;
+    int quoted = 0;        // Whether the current word contains quotes
+    int expands = 0;       // Whether it has a substitution or variable reference
+    int glob = 0;          // Whether it has unquoted glob characters
+    int braces = 0;        // Brace expansion seen so far (see scan_braces)
+    WordPart *parts = NULL;      // Parts of the word, kept if it expands or globs
+    WordPart **tail = &parts;
+    char *literal = out;         // Start of the word's text not yet in a part
+
+    for (size_t i = 0; i < input_len; i++) {
+        char c = input[i];
+        if (!in_word) word_start = i;
+
+        // Toggles in/out of quotes mode; quotes always start a word. Quoted
+        // and unquoted text go in separate parts, so quoted glob characters
+        // stay literal.
+        if (c == '"') {
+            if (out > literal &&
+                push_part(arena, &tail, PART_LITERAL, literal, out - literal, in_quotes) != 0) {
+                return -1;
+            }
+            literal = out;
+            in_quotes = !in_quotes;
+            in_word = 1;
+            quoted = 1;
+            continue;
+        }
+
+        // A command substitution ends the literal text before it
+        if (c == '`' || (c == '$' && input[i + 1] == '(')) {
+            size_t start = i + (c == '`' ? 1 : 2);
+            size_t len = substitution_length(input + start, input_len - start, c == '`');
+            if (out > literal &&
+                push_part(arena, &tail, PART_LITERAL, literal, out - literal, in_quotes) != 0) {
+                return -1;
+            }
+            const char *command = arena_strndup(arena, input + start, len);
+            if (!command || push_part(arena, &tail, PART_COMMAND, command, len, in_quotes) != 0) {
+                return -1;
+            }
+            literal = out;
+            in_word = 1;
+            expands = 1;
+            i = start + len;   // The closing ) or `
+            continue;
+        }
+
+        // So does a variable reference
+        size_t name, name_len, ref_len;
+        if (c == '$' && (ref_len = variable_length(input + i + 1, &name, &name_len)) > 0) {
+            if (out > literal &&
+                push_part(arena, &tail, PART_LITERAL, literal, out - literal, in_quotes) != 0) {
+                return -1;
+            }
+            const char *text = arena_strndup(arena, input + i + 1 + name, name_len);
+            if (!text || push_part(arena, &tail, PART_VARIABLE, text, name_len, in_quotes) != 0) {
+                return -1;
+            }
+            literal = out;
+            in_word = 1;
+            expands = 1;
+            i += ref_len;
+            continue;
+        }
+
+        if (in_quotes) {
+            // Copy everything up to the closing quote (or a substitution) in one go
+            size_t run = 1 + strcspn(input + i + 1, "\"$`");
+            memcpy(out, input + i, run);
+            out += run;
+            i += run - 1;
+            continue;
+        }
+
+        // Digits right before a redirection become part of the operator
+        if ((c == '<' || c == '>') && in_word && !quoted && !expands && out > word &&
+            is_io_number(word, out - word)) {
+            size_t len = operator_length(input + i);
+            memcpy(out, input + i, len);
+            out += len;
+            *out = '\0';
+            if (push_token(arena, list, word, out - word, TOKEN_SPECIAL, 0) != 0) return -1;
+            out++;
+            i += len - 1;
+            in_word = 0;
+            glob = 0;
+            braces = 0;
+            parts = NULL;
+            tail = &parts;
+            word = literal = out;
+            continue;
+        }
+
+        if (lex_is_special(c) || isspace((unsigned char)c)) {
+            // Save the current word before handling the separator
+            if (in_word) {
+                if (push_word(arena, list, word, out, quoted, expands || glob || braces == 2,
+                              &parts, tail, literal, input + word_start,
+                              i - word_start) != 0) return -1;
+                out++;
+                in_word = 0;
+                quoted = 0;
+                expands = 0;
+                glob = 0;
+                braces = 0;
+                parts = NULL;
+                tail = &parts;
+            }
+            // Special characters are tokens of their own
+            if (!isspace((unsigned char)c)) {
+                size_t len = operator_length(input + i);
+                word = out;
+                memcpy(out, input + i, len);
+                out += len;
+                *out++ = '\0';
+                if (push_token(arena, list, word, len, TOKEN_SPECIAL, 0) != 0) return -1;
+                i += len - 1;
+            }
+            word = literal = out;
+            continue;
+        }
+
+        // Adds the whole run of regular characters to the word; the scan
+        // kernel finds where it ends many bytes at a time (see lexscan.h).
+        // The first character is ordinary even if it is a lone $.
+        size_t run = 1 + lex_scan_word(input + i + 1, input_len - i - 1);
+        if (!glob) glob = has_glob_chars(input + i, run);
+        if (braces < 2) scan_braces(input + i, run, &braces);
+        memcpy(out, input + i, run);
+        out += run;
+        i += run - 1;
+        in_word = 1;
+    }
+
+    // Adds the last word if one is still open
+    if (in_word) {
+        if (push_word(arena, list, word, out, quoted, expands || glob || braces == 2,
+                      &parts, tail, literal, input + word_start,
+                      input_len - word_start) != 0) return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+
+#include "arena.h"
+
+/**
+ * Shell lexer shared by the shell and the tokenize demo
+ * Tokens are string views (pointer + length) into text stored in an arena,
+ * so a whole line is tokenized without a single malloc once the arena has
+ * warmed up. Token text is also NUL-terminated and can be passed to exec.
+ */
+
+typedef enum {
+    TOKEN_WORD,       // Ordinary word (quotes already removed)
+    TOKEN_SPECIAL     // One of ( ) < > | ; & or a redirection operator
+                      // (>> << <<- <<< >& <&); redirections may start with
+                      // a descriptor number, e.g. 2>&
+} TokenKind;
+
+typedef enum {
+    PART_LITERAL,     // Text used as is (quotes already removed)
+    PART_COMMAND,     // $(...) or `...`: replaced by the command's output
+    PART_VARIABLE     // $NAME, ${NAME}, $?, $$ or $!: replaced by its value
+} PartKind;
+
+/**
+ * One piece of a word that is only known when the command runs
+ */
+typedef struct WordPart {
+    PartKind kind;
+    const char *text;       // Literal text, or the command or variable name
+                            // (NUL-terminated)
+    size_t len;             // Length of text
+    int quoted;             // Inside double quotes: the result is not split
+    struct WordPart *next;
+} WordPart;
+
+typedef struct {
+    const char *text; // Token text, NUL-terminated (as written, for words with parts)
+    size_t len;       // Length of text
+    TokenKind kind;   // What kind of token this is
+    int quoted;       // Whether any part of a word was quoted
+    const WordPart *parts; // Pieces to expand when the command runs, or NULL
+} Token;
+
+typedef struct {
+    Token *items;     // Tokens, allocated in the arena
+    size_t count;     // Number of tokens
+    size_t capacity;  // Room in items
+} TokenList;
+
+/**
+ * Checks if a character is a special shell character
+ * @param c - Character to check
+ * @return 1 if special, 0 if not
+ */
+int lex_is_special(char c);
+
+/**
+ * Tokenizes a line into words and special characters
+ * Double quotes group characters (including specials and spaces) into a word.
+ * A word holding a command substitution, $(...) or `...`, or a variable
+ * reference, $NAME or ${NAME} (also inside double quotes), or unquoted glob
+ * characters or braces ({...}) gets a list of parts instead of final text.
+ * Quoted and unquoted text are in separate parts.
+ * @param arena - Arena that receives the token array and token text
+ * @param input - Line to tokenize
+ * @param list - Receives the tokens
+ * @return 0 on success, -1 on allocation failure
+ */
+int lex_line(Arena *arena, const char *input, TokenList *list);
+
+/**
+ * Tests whether a token is the given special character
+ * @param token - Token to test
+ * @param c - Special character
+ * @return 1 if it is, 0 otherwise
+ */
+int token_is(const Token *token, char c);
+
+/**
+ * Tests whether a token is the given (possibly multi-character) operator
+ * @param token - Token to test
+ * @param op - Operator text, e.g. "<<"
+ * @return 1 if it is, 0 otherwise
+ */
+int token_is_op(const Token *token, const char *op);
+
+#endif
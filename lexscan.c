@@ -0,0 +1,163 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexscan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LEXSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Delimiter table: whitespace (as isspace in the C locale), the specials
+ * ( ) < > | ; &, the double quote and the $ and ` that may start a
+ * command substitution or a variable reference
+ */
+static const unsigned char delimiters[256] = {
+    ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1, [' '] = 1,
+    ['('] = 1, [')'] = 1, ['<'] = 1, ['>'] = 1, ['|'] = 1, [';'] = 1, ['&'] = 1,
+    ['"'] = 1, ['$'] = 1, ['`'] = 1,
+};
+
+int lex_is_delimiter(char c) {
+    return delimiters[(unsigned char)c];
+}
+
+/**
+ * Byte-at-a-time kernel, also used for the tail of the vector kernels
+ * @param s - Bytes to scan
+ * @param len - Number of bytes
+ * @return Offset of the first delimiter, or len
+ */
+static size_t scan_scalar(const char *s, size_t len) {
+    size_t i = 0;
+    while (i < len && !delimiters[(unsigned char)s[i]]) i++;
+    return i;
+}
+
+#ifdef LEXSCAN_X86
+/**
+ * Classifies 16 bytes
+ * @param p - Bytes to classify (unaligned)
+ * @return Bit i set if byte i is a delimiter
+ */
+static unsigned classify_sse2(const char *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    // Whitespace 9..13 is a range: (v - 9) <= 4 unsigned
+    __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(9));
+    __m128i m = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('(')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('$')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('`')));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+static size_t scan_sse2(const char *s, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        unsigned mask = classify_sse2(s + i);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + scan_scalar(s + i, len - i);
+}
+
+/**
+ * Classifies 32 bytes
+ * @param p - Bytes to classify (unaligned)
+ * @return Bit i set if byte i is a delimiter
+ */
+__attribute__((target("avx2")))
+static unsigned classify_avx2(const char *p) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+    __m256i m = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted);
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('(')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('`')));
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char *s, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        unsigned mask = classify_avx2(s + i);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + scan_sse2(s + i, len - i);
+}
+#endif
+
+static size_t scan_dispatch(const char *s, size_t len);
+
+static size_t (*scan_kernel)(const char *, size_t) = scan_dispatch;
+static LexScanMode current_mode = LEX_SCAN_SCALAR;
+
+/**
+ * Picks the best kernel on first use, then forwards to it
+ */
+static size_t scan_dispatch(const char *s, size_t len) {
+    const char *force = getenv("MINISHELL_LEX_SCALAR");
+    if (force && strcmp(force, "0") != 0) {
+        lex_scan_set_mode(LEX_SCAN_SCALAR);
+    } else if (lex_scan_set_mode(LEX_SCAN_AVX2) != 0 && lex_scan_set_mode(LEX_SCAN_SSE2) != 0) {
+        lex_scan_set_mode(LEX_SCAN_SCALAR);
+    }
+    return scan_kernel(s, len);
+}
+
+size_t lex_scan_word(const char *s, size_t len) {
+    return scan_kernel(s, len);
+}
+
+int lex_scan_set_mode(LexScanMode mode) {
+    switch (mode) {
+    case LEX_SCAN_SCALAR:
+        scan_kernel = scan_scalar;
+        break;
+#ifdef LEXSCAN_X86
+    case LEX_SCAN_SSE2:
+        scan_kernel = scan_sse2;   // Part of every x86-64 CPU
+        break;
+    case LEX_SCAN_AVX2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2")) return -1;
+        scan_kernel = scan_avx2;
+        break;
+#endif
+    default:
+        return -1;
+    }
+    current_mode = mode;
+    return 0;
+}
+
+LexScanMode lex_scan_get_mode(void) {
+    if (scan_kernel == scan_dispatch) scan_dispatch("", 0);
+    return current_mode;
+}
+
+const char* lex_scan_mode_name(LexScanMode mode) {
+    switch (mode) {
+    case LEX_SCAN_SCALAR: return "scalar";
+    case LEX_SCAN_SSE2: return "sse2";
+    case LEX_SCAN_AVX2: return "avx2";
+    }
+    return "unknown";
+}
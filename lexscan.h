@@ -0,0 +1,55 @@
+#ifndef LEXSCAN_H
+#define LEXSCAN_H
+
+#include <stddef.h>
+
+/**
+ * Vectorized scanning for the lexer
+ * Classifies 16 (SSE2) or 32 (AVX2) bytes at a time into a bitmask of
+ * delimiters (whitespace, specials, the double quote, $ and `) and finds the
+ * next one with a count-trailing-zeros, so long words are consumed in a
+ * few instructions instead of one test per byte. The kernel is picked at
+ * runtime from what the CPU supports; MINISHELL_LEX_SCALAR=1 in the
+ * environment forces the byte-at-a-time version.
+ */
+
+typedef enum {
+    LEX_SCAN_SCALAR,  // One byte at a time
+    LEX_SCAN_SSE2,    // 16 bytes at a time
+    LEX_SCAN_AVX2     // 32 bytes at a time
+} LexScanMode;
+
+/**
+ * Finds the first delimiter in a buffer
+ * @param s - Bytes to scan
+ * @param len - Number of bytes
+ * @return Offset of the first whitespace, special, '"', '$' or '`' byte, or len
+ */
+size_t lex_scan_word(const char *s, size_t len);
+
+/**
+ * Checks whether a byte ends a run of ordinary word characters
+ * @param c - Byte to check
+ * @return 1 for whitespace, specials, '"', '$' and '`', 0 otherwise
+ */
+int lex_is_delimiter(char c);
+
+/**
+ * Selects the scanning kernel
+ * @param mode - Kernel to use
+ * @return 0 on success, -1 if this CPU (or build) lacks it
+ */
+int lex_scan_set_mode(LexScanMode mode);
+
+/**
+ * @return The kernel in use (chosen on first use if not set explicitly)
+ */
+LexScanMode lex_scan_get_mode(void);
+
+/**
+ * @param mode - Kernel to name
+ * @return Printable name ("scalar", "sse2" or "avx2")
+ */
+const char* lex_scan_mode_name(LexScanMode mode);
+
+#endif
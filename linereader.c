@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "linereader.h"
+
+/* Constants */
+#define INITIAL_READ_SIZE 65536  // Initial size of the read buffer
+
+int line_reader_init(LineReader *reader, int fd) {
+    reader->fd = fd;
+    reader->cap = INITIAL_READ_SIZE;
+    reader->buf = malloc(reader->cap);
+    reader->start = 0;
+    reader->end = 0;
+    reader->scan = 0;
+    reader->eof = 0;
+    return reader->buf ? 0 : -1;
+}
+
+void line_reader_init_memory(LineReader *reader, char *buf, size_t len, size_t cap) {
+    reader->fd = -1;
+    reader->buf = buf;
+    reader->cap = cap;
+    reader->start = 0;
+    reader->end = len;
+    reader->scan = 0;
+    reader->eof = 1;
+}
+
+/**
+ * Makes room for more input: slides unconsumed bytes to the front and
+ * doubles the buffer if it is still full
+ * @param reader - Reader to make room in
+ * @return 0 on success, -1 on allocation failure
+ */
+static int make_room(LineReader *reader) {
+    if (reader->start > 0) {
+        size_t pending = reader->end - reader->start;
+        memmove(reader->buf, reader->buf + reader->start, pending);
+        reader->scan -= reader->start;
+        reader->end = pending;
+        reader->start = 0;
+    }
+    // Keep one spare byte for the terminator of an unfinished last line
+    if (reader->end + 1 >= reader->cap) {
+        char *bigger = realloc(reader->buf, reader->cap * 2);
+        if (!bigger) return -1;
+        reader->buf = bigger;
+        reader->cap *= 2;
+    }
+    return 0;
+}
+
+char* line_reader_next(LineReader *reader, size_t *len) {
+    while (1) {
+        // Look for the end of the current line in what is already buffered
+        char *newline = memchr(reader->buf + reader->scan, '\n', reader->end - reader->scan);
+        if (newline) {
+            char *line = reader->buf + reader->start;
+            *newline = '\0';
+            if (len) *len = newline - line;
+            reader->start = newline - reader->buf + 1;
+            reader->scan = reader->start;
+            return line;
+        }
+        reader->scan = reader->end;
+
+        if (reader->eof) {
+            // Hand out a final line that has no newline
+            if (reader->start == reader->end) return NULL;
+            char *line = reader->buf + reader->start;
+            reader->buf[reader->end] = '\0';
+            if (len) *len = reader->end - reader->start;
+            reader->start = reader->end;
+            reader->scan = reader->end;
+            return line;
+        }
+
+        if (make_room(reader) != 0) return NULL;
+        ssize_t n = read(reader->fd, reader->buf + reader->end, reader->cap - reader->end - 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return NULL;
+        }
+        if (n == 0) {
+            reader->eof = 1;
+        }
+        reader->end += n;
+    }
+}
+
+void line_reader_free(LineReader *reader) {
+    free(reader->buf);
+    reader->buf = NULL;
+    reader->cap = 0;
+    reader->start = reader->end = reader->scan = 0;
+}
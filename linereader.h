@@ -0,0 +1,55 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <stddef.h>
+
+/**
+ * Buffered streaming line reader
+ * Reads large chunks with read(2) and hands out lines of any length in
+ * place. The buffer grows geometrically when a line does not fit and is
+ * reused for every following line.
+ */
+typedef struct {
+    int fd;           // Descriptor being read
+    char *buf;        // Buffered bytes
+    size_t cap;       // Size of buf
+    size_t start;     // First unconsumed byte
+    size_t end;       // One past the last buffered byte
+    size_t scan;      // Where the search for the next newline resumes
+    int eof;          // Set once read(2) reported end of file
+} LineReader;
+
+/**
+ * Initializes a reader over an open descriptor
+ * @param reader - Reader to initialize
+ * @param fd - Descriptor to read from (not closed by the reader)
+ * @return 0 on success, -1 on allocation failure
+ */
+int line_reader_init(LineReader *reader, int fd);
+
+/**
+ * Initializes a reader over text already in memory
+ * @param reader - Reader to initialize
+ * @param buf - Text, allocated with malloc; the reader takes it over
+ * @param len - Length of the text
+ * @param cap - Size of buf, more than len
+ */
+void line_reader_init_memory(LineReader *reader, char *buf, size_t len, size_t cap);
+
+/**
+ * Returns the next line without its trailing newline
+ * The line is NUL-terminated, may be modified by the caller, and stays
+ * valid until the next call.
+ * @param reader - Reader to read from
+ * @param len - Receives the length of the line (optional)
+ * @return The line, or NULL at end of input or on error
+ */
+char* line_reader_next(LineReader *reader, size_t *len);
+
+/**
+ * Frees the reader's buffer
+ * @param reader - Reader to free
+ */
+void line_reader_free(LineReader *reader);
+
+#endif
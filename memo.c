@@ -0,0 +1,467 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "memo.h"
+
+/* Constants */
+#define MEMO_DEFAULT_LIMIT (64 << 20)    // Bytes the cache may take up
+#define MEMO_SUBDIR "minishell/memo"     // Under $XDG_CACHE_HOME or ~/.cache
+#define MEMO_HEADER "minishell-memo 1"   // First word of every entry
+#define MEMO_HEADER_MAX 64               // Room for the header line
+#define MEMO_READ_SIZE 65536             // Chunk size when hashing a file
+#define MURMUR_C1 0x87c37b91114253d5ULL  // MurmurHash3 x64_128 constants
+#define MURMUR_C2 0x4cf5ad432745937fULL
+
+static char *memo_dir = NULL;            // Cache directory, once resolved
+static size_t memo_limit = MEMO_DEFAULT_LIMIT;
+static long memo_hits = 0;
+static long memo_misses = 0;
+static long memo_evictions = 0;
+static off_t memo_size = -1;             // Bytes of the entries as last counted, -1 if not yet
+
+/**
+ * An entry seen while scanning the directory
+ */
+typedef struct {
+    char name[MEMO_KEY_SIZE];
+    struct timespec used;        // Last stored or replayed
+    off_t size;
+} MemoEntry;
+
+/**
+ * @param x - Word to rotate
+ * @param r - Bits to rotate it left by (1 to 63)
+ * @return The rotated word
+ */
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * Spreads every bit of a lane over the others (MurmurHash3's finalizer)
+ * @param k - Lane
+ * @return Mixed lane
+ */
+static uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/**
+ * Mixes one 16-byte block into the hash (MurmurHash3 x64_128)
+ * @param hash - Hash to update
+ * @param block - Block, read as two little-endian words
+ */
+static void mix_block(MemoHash *hash, const unsigned char *block) {
+    uint64_t k1, k2;
+    memcpy(&k1, block, 8);
+    memcpy(&k2, block + 8, 8);
+
+    k1 *= MURMUR_C1;
+    k1 = rotl64(k1, 31);
+    k1 *= MURMUR_C2;
+    hash->h1 ^= k1;
+    hash->h1 = rotl64(hash->h1, 27) + hash->h2;
+    hash->h1 = hash->h1 * 5 + 0x52dce729;
+
+    k2 *= MURMUR_C2;
+    k2 = rotl64(k2, 33);
+    k2 *= MURMUR_C1;
+    hash->h2 ^= k2;
+    hash->h2 = rotl64(hash->h2, 31) + hash->h1;
+    hash->h2 = hash->h2 * 5 + 0x38495ab5;
+}
+
+void memo_hash_init(MemoHash *hash) {
+    hash->h1 = 0;
+    hash->h2 = 0;
+    hash->tail_len = 0;
+    hash->total = 0;
+}
+
+void memo_hash_bytes(MemoHash *hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    hash->total += len;
+    if (hash->tail_len > 0) {
+        size_t take = sizeof(hash->tail) - hash->tail_len;
+        if (take > len) take = len;
+        memcpy(hash->tail + hash->tail_len, bytes, take);
+        hash->tail_len += take;
+        bytes += take;
+        len -= take;
+        if (hash->tail_len < sizeof(hash->tail)) return;
+        mix_block(hash, hash->tail);
+        hash->tail_len = 0;
+    }
+    for (; len >= sizeof(hash->tail); bytes += sizeof(hash->tail), len -= sizeof(hash->tail)) {
+        mix_block(hash, bytes);
+    }
+    memcpy(hash->tail, bytes, len);
+    hash->tail_len = len;
+}
+
+void memo_hash_string(MemoHash *hash, const char *text) {
+    uint64_t len = strlen(text);
+    memo_hash_bytes(hash, &len, sizeof(len));
+    memo_hash_bytes(hash, text, len);
+}
+
+/**
+ * Adds what a file holds from an offset on, without moving the offset
+ * @param hash - Hash to add to
+ * @param fd - Open file
+ * @param offset - Where to start
+ * @return 0 on success, -1 on a read error
+ */
+static int hash_contents(MemoHash *hash, int fd, off_t offset) {
+    char *buffer = malloc(MEMO_READ_SIZE);
+    uint64_t size = 0;
+    ssize_t n = -1;
+    while (buffer && (n = pread(fd, buffer, MEMO_READ_SIZE, offset + size)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        memo_hash_bytes(hash, buffer, n);
+        size += n;
+    }
+    free(buffer);
+    // The size goes after the contents, so they stay apart from what follows
+    memo_hash_bytes(hash, &size, sizeof(size));
+    return n == 0 ? 0 : -1;
+}
+
+int memo_hash_file(MemoHash *hash, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int status = hash_contents(hash, fd, 0);
+    close(fd);
+    return status;
+}
+
+int memo_hash_fd(MemoHash *hash, int fd) {
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    return offset < 0 ? -1 : hash_contents(hash, fd, offset);
+}
+
+void memo_hash_final(MemoHash *hash, char *key) {
+    unsigned char tail[16] = {0};
+    uint64_t k1, k2;
+    memcpy(tail, hash->tail, hash->tail_len);
+    memcpy(&k1, tail, 8);
+    memcpy(&k2, tail + 8, 8);
+    if (hash->tail_len > 8) {
+        k2 *= MURMUR_C2;
+        k2 = rotl64(k2, 33);
+        k2 *= MURMUR_C1;
+        hash->h2 ^= k2;
+    }
+    if (hash->tail_len > 0) {
+        k1 *= MURMUR_C1;
+        k1 = rotl64(k1, 31);
+        k1 *= MURMUR_C2;
+        hash->h1 ^= k1;
+    }
+
+    hash->h1 ^= hash->total;
+    hash->h2 ^= hash->total;
+    hash->h1 += hash->h2;
+    hash->h2 += hash->h1;
+    hash->h1 = fmix64(hash->h1);
+    hash->h2 = fmix64(hash->h2);
+    hash->h1 += hash->h2;
+    hash->h2 += hash->h1;
+    snprintf(key, MEMO_KEY_SIZE, "%016llx%016llx",
+             (unsigned long long)hash->h1, (unsigned long long)hash->h2);
+}
+
+/**
+ * Finds the cache directory the first time it is needed
+ * @return Directory, or NULL if there is nowhere to put it
+ */
+static const char* cache_dir(void) {
+    if (memo_dir) return memo_dir;
+    const char *dir = getenv("MINISHELL_MEMO_DIR");
+    if (dir && *dir) {
+        memo_set_dir(dir);
+        return memo_dir;
+    }
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *suffix = "";
+    if (!base || !*base) {
+        base = getenv("HOME");
+        suffix = "/.cache";
+    }
+    if (!base || !*base) return NULL;
+    size_t size = strlen(base) + strlen(suffix) + sizeof(MEMO_SUBDIR) + 1;
+    memo_dir = malloc(size);
+    if (memo_dir) {
+        snprintf(memo_dir, size, "%s%s/%s", base, suffix, MEMO_SUBDIR);
+    }
+    return memo_dir;
+}
+
+/**
+ * Creates a directory and any missing parents, as mkdir -p
+ * @param dir - Directory to create
+ * @return 0 if it exists now, -1 otherwise
+ */
+static int make_dirs(const char *dir) {
+    char path[strlen(dir) + 1];
+    strcpy(path, dir);
+    for (char *slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(path, 0700) != 0 && errno != EEXIST) return -1;
+        *slash = '/';
+    }
+    return mkdir(path, 0700) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+/**
+ * Reads a whole entry and checks it is complete
+ * @param fd - Open entry
+ * @param output - Receives the output (malloc'd)
+ * @param len - Receives its length
+ * @param status - Receives the exit status
+ * @return 0 on success, -1 if the entry is unreadable or damaged
+ */
+static int read_entry(int fd, char **output, size_t *len, int *status) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+    char *data = malloc(st.st_size + 1);
+    if (!data) return -1;
+    size_t used = 0;
+    while (used < (size_t)st.st_size) {
+        ssize_t n = read(fd, data + used, st.st_size - used);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        used += n;
+    }
+    data[used] = '\0';
+
+    // The header is one line; the output after it is taken as it is
+    char *newline = memchr(data, '\n', used);
+    size_t header_len = newline ? (size_t)(newline - data) + 1 : 0;
+    size_t stored = 0;
+    if (used != (size_t)st.st_size || !newline ||
+        sscanf(data, MEMO_HEADER " %d %zu", status, &stored) != 2 ||
+        header_len + stored != used) {
+        free(data);
+        return -1;
+    }
+    memmove(data, data + header_len, stored);
+    *output = data;
+    *len = stored;
+    return 0;
+}
+
+int memo_lookup(const char *key, char **output, size_t *len, int *status) {
+    const char *dir = cache_dir();
+    if (dir) {
+        char path[strlen(dir) + MEMO_KEY_SIZE + 1];
+        snprintf(path, sizeof(path), "%s/%s", dir, key);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            int found = read_entry(fd, output, len, status) == 0;
+            if (found) {
+                // Eviction goes by modification time, so a hit counts as a use
+                futimens(fd, NULL);
+            } else {
+                unlink(path);
+            }
+            close(fd);
+            if (found) {
+                memo_hits++;
+                return 1;
+            }
+        }
+    }
+    memo_misses++;
+    return 0;
+}
+
+/**
+ * Lists the entries of the cache directory
+ * @param dir - Cache directory
+ * @param count - Receives the number of entries
+ * @param total - Receives the bytes they take up
+ * @return The entries (malloc'd), or NULL if there are none or on failure
+ */
+static MemoEntry* scan_entries(const char *dir, int *count, off_t *total) {
+    MemoEntry *entries = NULL;
+    int capacity = 0;
+    *count = 0;
+    *total = 0;
+    DIR *d = opendir(dir);
+    if (!d) return NULL;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        struct stat st;
+        // Entries are named after their key; anything else (a store in
+        // progress included) starts with a '.'
+        if (e->d_name[0] == '.' || strlen(e->d_name) != MEMO_KEY_SIZE - 1 ||
+            fstatat(dirfd(d), e->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            MemoEntry *bigger = realloc(entries, capacity * sizeof(MemoEntry));
+            if (!bigger) break;
+            entries = bigger;
+        }
+        MemoEntry *entry = &entries[(*count)++];
+        strcpy(entry->name, e->d_name);
+        entry->used = st.st_mtim;
+        entry->size = st.st_size;
+        *total += st.st_size;
+    }
+    closedir(d);
+    return entries;
+}
+
+/**
+ * Orders entries from the least recently used (qsort comparator)
+ * @param a - Entry
+ * @param b - Entry
+ * @return Negative, zero or positive as a was used before, with or after b
+ */
+static int compare_use(const void *a, const void *b) {
+    const struct timespec *x = &((const MemoEntry *)a)->used;
+    const struct timespec *y = &((const MemoEntry *)b)->used;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+/**
+ * Removes the least recently used entries until the cache fits its limit,
+ * and counts what is left
+ * @param dir - Cache directory
+ */
+static void evict(const char *dir) {
+    int count;
+    off_t total;
+    MemoEntry *entries = scan_entries(dir, &count, &total);
+    if ((size_t)total > memo_limit) {
+        qsort(entries, count, sizeof(MemoEntry), compare_use);
+        int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        for (int i = 0; dir_fd >= 0 && i < count && (size_t)total > memo_limit; i++) {
+            if (unlinkat(dir_fd, entries[i].name, 0) == 0) {
+                total -= entries[i].size;
+                memo_evictions++;
+            }
+        }
+        if (dir_fd >= 0) close(dir_fd);
+    }
+    free(entries);
+    memo_size = total;
+}
+
+void memo_store(const char *key, const char *output, size_t len, int status) {
+    const char *dir = cache_dir();
+    char header[MEMO_HEADER_MAX];
+    int header_len = snprintf(header, sizeof(header), MEMO_HEADER " %d %zu\n", status, len);
+    if (!dir || header_len + len > memo_limit || make_dirs(dir) != 0) return;
+
+    // Written under a temporary name, so readers only see whole entries
+    char temp[strlen(dir) + sizeof("/.store-XXXXXX")];
+    char path[strlen(dir) + MEMO_KEY_SIZE + 1];
+    snprintf(temp, sizeof(temp), "%s/.store-XXXXXX", dir);
+    snprintf(path, sizeof(path), "%s/%s", dir, key);
+    int fd = mkstemp(temp);
+    if (fd < 0) return;
+    struct stat old;
+    off_t replaced = stat(path, &old) == 0 ? old.st_size : 0;
+    int ok = write(fd, header, header_len) == header_len;
+    for (size_t done = 0; ok && done < len;) {
+        ssize_t n = write(fd, output + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if (ok) done += n;
+    }
+    if (close(fd) != 0 || !ok || rename(temp, path) != 0) {
+        unlink(temp);
+        return;
+    }
+    // The directory is only scanned when the running count says the limit
+    // may have been crossed; other shells' stores are found then
+    if (memo_size >= 0) memo_size += (off_t)(header_len + len) - replaced;
+    if (memo_size < 0 || (size_t)memo_size > memo_limit) evict(dir);
+}
+
+int memo_set_dir(const char *dir) {
+    char *copy = strdup(dir);
+    if (!copy) return -1;
+    free(memo_dir);
+    memo_dir = copy;
+    memo_size = -1;
+    return 0;
+}
+
+int memo_set_limit(const char *text) {
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(text, &end, 10);
+    if (errno || end == text || *text == '-') return -1;
+    unsigned long long unit = 1;
+    if (*end == 'K' || *end == 'k') {
+        unit = 1ULL << 10;
+    } else if (*end == 'M' || *end == 'm') {
+        unit = 1ULL << 20;
+    } else if (*end == 'G' || *end == 'g') {
+        unit = 1ULL << 30;
+    }
+    if (unit > 1) end++;
+    if (*end || n > SIZE_MAX / unit) return -1;
+    memo_limit = n * unit;
+    const char *dir = cache_dir();
+    if (dir) {
+        evict(dir);
+    }
+    return 0;
+}
+
+void memo_clear(void) {
+    const char *dir = cache_dir();
+    int count;
+    off_t total;
+    MemoEntry *entries = dir ? scan_entries(dir, &count, &total) : NULL;
+    if (entries) {
+        int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        for (int i = 0; dir_fd >= 0 && i < count; i++) {
+            unlinkat(dir_fd, entries[i].name, 0);
+        }
+        if (dir_fd >= 0) close(dir_fd);
+        free(entries);
+    }
+    memo_size = -1;
+    memo_hits = memo_misses = memo_evictions = 0;
+}
+
+void memo_print(void) {
+    const char *dir = cache_dir();
+    int count = 0;
+    off_t total = 0;
+    free(dir ? scan_entries(dir, &count, &total) : NULL);
+    printf("dir\t%s\n", dir ? dir : "(none)");
+    printf("limit\t%zu\n", memo_limit);
+    printf("entries\t%d\n", count);
+    printf("bytes\t%lld\n", (long long)total);
+    printf("hits\t%ld\n", memo_hits);
+    printf("misses\t%ld\n", memo_misses);
+    printf("evictions\t%ld\n", memo_evictions);
+}
+
+void memo_free(void) {
+    free(memo_dir);
+    memo_dir = NULL;
+}
@@ -0,0 +1,126 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Result cache for commands prefixed with `memo`
+ * A command is keyed on a 128-bit hash of what it depends on (the
+ * caller feeds in its program, arguments, environment and input files);
+ * its stdout and exit status are stored in a file named after the key,
+ * so a later run with the same key is replayed without starting anything.
+ * A command whose stdin is a pipe or a terminal is not cached (that input
+ * differs from run to run); it runs as if it had no `memo`.
+ * The cache directory is $MINISHELL_MEMO_DIR, or minishell/memo under
+ * $XDG_CACHE_HOME or ~/.cache. It is kept under a size limit by removing
+ * the least recently used entries; a hit counts as a use.
+ */
+
+/* Constants */
+#define MEMO_KEY_SIZE 33         // Hex digits of a key and the terminator
+
+/**
+ * Hash of a command's inputs, built up piece by piece
+ */
+typedef struct {
+    uint64_t h1, h2;             // State of the two lanes
+    unsigned char tail[16];      // Bytes not yet making up a whole block
+    size_t tail_len;
+    uint64_t total;              // Bytes hashed so far
+} MemoHash;
+
+/**
+ * @param hash - Hash to start
+ */
+void memo_hash_init(MemoHash *hash);
+
+/**
+ * Adds raw bytes to a hash
+ * @param hash - Hash to add to
+ * @param data - Bytes
+ * @param len - Number of bytes
+ */
+void memo_hash_bytes(MemoHash *hash, const void *data, size_t len);
+
+/**
+ * Adds a string with its length, so neighbouring strings cannot run
+ * into each other
+ * @param hash - Hash to add to
+ * @param text - String
+ */
+void memo_hash_string(MemoHash *hash, const char *text);
+
+/**
+ * Adds the contents of a file
+ * @param hash - Hash to add to
+ * @param path - File to read
+ * @return 0 on success, -1 if the file could not be read
+ */
+int memo_hash_file(MemoHash *hash, const char *path);
+
+/**
+ * Adds what an open file has left to read, from its current offset
+ * @param hash - Hash to add to
+ * @param fd - Open regular file (its offset is left alone)
+ * @return 0 on success, -1 if the file could not be read
+ */
+int memo_hash_fd(MemoHash *hash, int fd);
+
+/**
+ * Finishes a hash
+ * @param hash - Hash to finish
+ * @param key - Receives the key as hex digits
+ */
+void memo_hash_final(MemoHash *hash, char *key);
+
+/**
+ * Looks a key up, counting a hit or a miss
+ * @param key - Key of the command
+ * @param output - Receives the stored output (malloc'd) on a hit
+ * @param len - Receives its length
+ * @param status - Receives the stored exit status
+ * @return 1 on a hit, 0 on a miss
+ */
+int memo_lookup(const char *key, char **output, size_t *len, int *status);
+
+/**
+ * Stores a command's result, then evicts entries until the cache fits
+ * its limit again; failures only mean the result is not cached
+ * @param key - Key of the command
+ * @param output - Its stdout
+ * @param len - Length of the output
+ * @param status - Its exit status
+ */
+void memo_store(const char *key, const char *output, size_t len, int status);
+
+/**
+ * Uses another cache directory, created when the first entry is stored
+ * @param dir - Directory
+ * @return 0 on success, -1 on allocation failure
+ */
+int memo_set_dir(const char *dir);
+
+/**
+ * Parses and sets the cache's size limit
+ * @param text - Bytes, with an optional K, M or G suffix
+ * @return 0 on success, -1 if the size is malformed
+ */
+int memo_set_limit(const char *text);
+
+/**
+ * Removes every entry and zeroes the counters
+ */
+void memo_clear(void);
+
+/**
+ * Prints the directory, limit, size and counters, one per line
+ */
+void memo_print(void);
+
+/**
+ * Frees the directory name
+ */
+void memo_free(void);
+
+#endif
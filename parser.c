@@ -0,0 +1,1072 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "parser.h"
+#include "pipetune.h"
+
+/* Constants */
+#define INITIAL_LIST_SIZE 4      // Initial room in every AST array
+#define INITIAL_CODE_SIZE 16     // Initial room in a compound command's bytecode
+
+/**
+ * Commands that take a { ... } block after their arguments
+ */
+static const char *block_commands[] = {"parallel", NULL};
+
+/**
+ * Reserved words that end a part of a compound command
+ */
+static const char *closing_keywords[] = {"then", "elif", "else", "fi", "do", "done", NULL};
+
+static int report_errors = 1;  // Cleared by parse_set_quiet
+
+/**
+ * Parser state: the token stream and the position in it
+ */
+typedef struct {
+    Arena *arena;
+    const TokenList *tokens;
+    size_t pos;
+    int depth;                // Number of enclosing { ... } blocks
+    int compounds;            // Number of enclosing compound commands
+    int loops;                // Number of enclosing while, until and for loops
+} Parser;
+
+static int parse_sequence(Parser *p, Sequence *seq, int in_block);
+
+/**
+ * Makes room for one more element in an arena-backed array, doubling it
+ * (by copying into a fresh arena allocation) when it is full
+ * @param arena - Arena holding the array
+ * @param items - Current array (may be NULL)
+ * @param count - Elements in use
+ * @param capacity - Room in the array, updated on growth
+ * @param size - Size of one element
+ * @return The (possibly moved) array or NULL on allocation failure
+ */
+static void* reserve(Arena *arena, void *items, int count, int *capacity, size_t size) {
+    if (count < *capacity) return items;
+
+    int new_capacity = *capacity ? *capacity * 2 : INITIAL_LIST_SIZE;
+    void *bigger = arena_alloc(arena, new_capacity * size);
+    if (!bigger) return NULL;
+    if (count) memcpy(bigger, items, count * size);
+    *capacity = new_capacity;
+    return bigger;
+}
+
+/**
+ * Reports a syntax error at a token
+ * @param token - Offending token, or NULL for end of line
+ * @return -1, for convenience
+ */
+static int syntax_error(const Token *token) {
+    if (report_errors) {
+        fflush(stdout);
+        fprintf(stderr, "syntax error near unexpected token `%s'\n", token ? token->text : "newline");
+    }
+    return -1;
+}
+
+void parse_set_quiet(int quiet) {
+    report_errors = !quiet;
+}
+
+/**
+ * @param p - Parser state
+ * @return The next token, or NULL at the end of the line
+ */
+static const Token* peek(Parser *p) {
+    return p->pos < p->tokens->count ? &p->tokens->items[p->pos] : NULL;
+}
+
+/**
+ * Tests whether a token is the given special character
+ * @param t - Token to test (may be NULL)
+ * @param c - Special character
+ * @return 1 if it is, 0 otherwise
+ */
+static int is_special(const Token *t, char c) {
+    return t && token_is(t, c);
+}
+
+/**
+ * Tests whether a token is an unquoted word with the given text
+ * @param t - Token to test (may be NULL)
+ * @param word - Text to compare against
+ * @return 1 if it matches, 0 otherwise
+ */
+static int is_keyword(const Token *t, const char *word) {
+    return t && t->kind == TOKEN_WORD && !t->quoted && strcmp(t->text, word) == 0;
+}
+
+/**
+ * Tests whether a token is a reserved word that ends a part of a
+ * compound command, when written where a command name would be
+ * @param t - Token to test (may be NULL)
+ * @return 1 if it is, 0 otherwise
+ */
+static int is_closing_keyword(const Token *t) {
+    for (int i = 0; closing_keywords[i]; i++) {
+        if (is_keyword(t, closing_keywords[i])) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Checks whether a command takes a block after its arguments
+ * @param cmd - Command parsed so far
+ * @return 1 if it does, 0 otherwise
+ */
+static int takes_block(const Command *cmd) {
+    if (cmd->argc == 0) return 0;
+    for (int i = 0; block_commands[i]; i++) {
+        if (strcmp(cmd->argv[0], block_commands[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @param text - Word text
+ * @return 1 for a valid variable name ([A-Za-z_][A-Za-z0-9_]*), 0 otherwise
+ */
+static int is_name(const char *text) {
+    if (!(isalpha((unsigned char)*text) || *text == '_')) return 0;
+    for (const char *c = text; *c; c++) {
+        if (!(isalnum((unsigned char)*c) || *c == '_')) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Checks whether a word is a NAME=value assignment
+ * @param t - Word token
+ * @return Length of the name, or 0 if it is not an assignment
+ */
+static size_t assignment_name_length(const Token *t) {
+    const char *eq = strchr(t->text, '=');
+    if (!eq || eq == t->text) return 0;
+    for (const char *c = t->text; c < eq; c++) {
+        if (!(isalnum((unsigned char)*c) || *c == '_')) return 0;
+    }
+    if (isdigit((unsigned char)t->text[0])) return 0;
+    // The name must not come from an expansion
+    if (t->parts && (t->parts->kind != PART_LITERAL || t->parts->len <= (size_t)(eq - t->text))) {
+        return 0;
+    }
+    return eq - t->text;
+}
+
+/**
+ * Adds an assignment word to a command
+ * @param p - Parser state
+ * @param cmd - Command being parsed
+ * @param capacity - Room in cmd->assigns, updated on growth
+ * @param t - Assignment word
+ * @param name_len - Length of its name
+ * @return 0 on success, -1 on allocation failure
+ */
+static int add_assignment(Parser *p, Command *cmd, int *capacity, const Token *t, size_t name_len) {
+    cmd->assigns = reserve(p->arena, cmd->assigns, cmd->assign_count, capacity, sizeof(Assignment));
+    if (!cmd->assigns) return -1;
+    Assignment *a = &cmd->assigns[cmd->assign_count++];
+    a->name = arena_strndup(p->arena, t->text, name_len);
+    a->value = t->text + name_len + 1;
+    a->parts = NULL;
+    if (!a->name) return -1;
+    if (t->parts) {
+        // The value's parts are the word's, minus the NAME= of the first
+        const WordPart *first = t->parts;
+        size_t skip = name_len + 1;
+        if (first->len == skip) {
+            a->parts = first->next;
+        } else {
+            WordPart *rest = arena_alloc(p->arena, sizeof(WordPart));
+            if (!rest) return -1;
+            *rest = *first;
+            rest->text += skip;
+            rest->len -= skip;
+            a->parts = rest;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Adds a word to a command's arguments
+ * @param p - Parser state
+ * @param cmd - Command being parsed
+ * @param argv_capacity - Room in cmd->argv, updated on growth
+ * @param parts_capacity - Room in cmd->parts, updated on growth
+ * @param t - Word token
+ * @return 0 on success, -1 on allocation failure
+ */
+static int add_word(Parser *p, Command *cmd, int *argv_capacity, int *parts_capacity, const Token *t) {
+    if (t->parts && !cmd->parts) {
+        // Arguments before the first one with parts have none
+        *parts_capacity = cmd->argc + INITIAL_LIST_SIZE;
+        cmd->parts = arena_alloc(p->arena, *parts_capacity * sizeof(WordPart *));
+        if (!cmd->parts) return -1;
+        memset(cmd->parts, 0, cmd->argc * sizeof(WordPart *));
+    }
+    if (cmd->parts) {
+        cmd->parts = reserve(p->arena, cmd->parts, cmd->argc, parts_capacity, sizeof(WordPart *));
+        if (!cmd->parts) return -1;
+        cmd->parts[cmd->argc] = t->parts;
+    }
+    cmd->argv = reserve(p->arena, cmd->argv, cmd->argc, argv_capacity, sizeof(char *));
+    if (!cmd->argv) return -1;
+    cmd->argv[cmd->argc++] = (char *)t->text;
+    return 0;
+}
+
+/**
+ * NULL-terminates a command's argument vector (required for exec)
+ * @param p - Parser state
+ * @param cmd - Command being parsed
+ * @param argv_capacity - Room in cmd->argv, updated on growth
+ * @return 0 on success, -1 on allocation failure
+ */
+static int end_words(Parser *p, Command *cmd, int *argv_capacity) {
+    cmd->argv = reserve(p->arena, cmd->argv, cmd->argc, argv_capacity, sizeof(char *));
+    if (!cmd->argv) return -1;
+    cmd->argv[cmd->argc] = NULL;
+    return 0;
+}
+
+/**
+ * Appends an instruction to a program
+ * @param p - Parser state
+ * @param prog - Program being compiled
+ * @param op - Opcode
+ * @param arg - Jump target or status
+ * @param operand - Pipeline or loop, or NULL
+ * @return Index of the instruction, or -1 on allocation failure
+ */
+static int emit(Parser *p, Program *prog, Opcode op, int arg, void *operand) {
+    if (prog->count == prog->capacity) {
+        int capacity = prog->capacity ? prog->capacity * 2 : INITIAL_CODE_SIZE;
+        Instruction *bigger = arena_alloc(p->arena, capacity * sizeof(Instruction));
+        if (!bigger) return -1;
+        if (prog->count) memcpy(bigger, prog->code, prog->count * sizeof(Instruction));
+        prog->code = bigger;
+        prog->capacity = capacity;
+    }
+    Instruction *ins = &prog->code[prog->count];
+    ins->op = op;
+    ins->arg = arg;
+    ins->operand = operand;
+    return prog->count++;
+}
+
+/**
+ * @param op - Opcode
+ * @return 1 if its arg is a jump target
+ */
+static int is_jump(Opcode op) {
+    return op == OP_JUMP || op == OP_JUMP_IF_FAILED || op == OP_JUMP_IF_OK || op == OP_NEXT;
+}
+
+/**
+ * Checks whether a pipeline is just a compound command, whose code can be
+ * copied into an enclosing one instead of being run as a pipeline
+ * @param pipeline - Parsed pipeline
+ * @return 1 if it is, 0 otherwise
+ */
+static int is_inline_compound(const Pipeline *pipeline) {
+    const Command *cmd = &pipeline->commands[0];
+    return pipeline->count == 1 && cmd->program && cmd->redirect_count == 0 &&
+           !pipeline->background && !pipeline->timed && !pipeline->coproc && !pipeline->tuning &&
+           !pipeline->memo;
+}
+
+/**
+ * Checks whether a pipeline is a plain `break` or `continue`
+ * @param pipeline - Parsed pipeline
+ * @param word - "break" or "continue"
+ * @return 1 if it is, 0 otherwise
+ */
+static int is_loop_control(const Pipeline *pipeline, const char *word) {
+    const Command *cmd = &pipeline->commands[0];
+    return pipeline->count == 1 && cmd->argc == 1 && !cmd->parts && cmd->redirect_count == 0 &&
+           cmd->assign_count == 0 && !pipeline->background && !pipeline->timed &&
+           !pipeline->coproc && !pipeline->tuning && !pipeline->memo &&
+           strcmp(cmd->argv[0], word) == 0;
+}
+
+/**
+ * Compiles the pipelines of a condition or body
+ * A nested compound command is copied in with its jumps moved, so nested
+ * loops run in one dispatch loop; break and continue inside a loop become
+ * instructions the loop resolves.
+ * @param p - Parser state
+ * @param prog - Program being compiled
+ * @param seq - Parsed condition or body
+ * @return 0 on success, -1 on allocation failure
+ */
+static int compile_sequence(Parser *p, Program *prog, const Sequence *seq) {
+    for (int i = 0; i < seq->count; i++) {
+        const Pipeline *pipeline = &seq->pipelines[i];
+        if (is_inline_compound(pipeline)) {
+            const Program *inner = pipeline->commands[0].program;
+            int base = prog->count;
+            for (int j = 0; j < inner->count; j++) {
+                const Instruction *ins = &inner->code[j];
+                int arg = is_jump(ins->op) ? ins->arg + base : ins->arg;
+                if (emit(p, prog, ins->op, arg, ins->operand) < 0) return -1;
+            }
+        } else if (p->loops > 0 && is_loop_control(pipeline, "break")) {
+            if (emit(p, prog, OP_BREAK, -1, NULL) < 0) return -1;
+        } else if (p->loops > 0 && is_loop_control(pipeline, "continue")) {
+            if (emit(p, prog, OP_CONTINUE, -1, NULL) < 0) return -1;
+        } else if (emit(p, prog, OP_RUN, 0, (Pipeline *)pipeline) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Points the break and continue instructions of a loop body at the loop
+ * @param prog - Program being compiled
+ * @param start - First instruction of the body
+ * @param top - Where continue goes
+ * @param end - Where break goes
+ */
+static void resolve_loop_control(Program *prog, int start, int top, int end) {
+    for (int i = start; i < prog->count; i++) {
+        Instruction *ins = &prog->code[i];
+        if (ins->op == OP_BREAK || ins->op == OP_CONTINUE) {
+            ins->arg = ins->op == OP_BREAK ? end : top;
+            ins->op = OP_JUMP;
+        }
+    }
+}
+
+/**
+ * Consumes an expected reserved word
+ * @param p - Parser state
+ * @param word - The word
+ * @return 0 if it was next, PARSE_INCOMPLETE at the end of the tokens,
+ *         -1 (reported) otherwise
+ */
+static int expect_keyword(Parser *p, const char *word) {
+    const Token *t = peek(p);
+    if (!t) return PARSE_INCOMPLETE;
+    if (!is_keyword(t, word)) return syntax_error(t);
+    p->pos++;
+    return 0;
+}
+
+/**
+ * Parses a condition or body of a compound command, up to a reserved word
+ * @param p - Parser state
+ * @param seq - Receives the parsed pipelines
+ * @return 0 on success, PARSE_INCOMPLETE, or -1 on error
+ */
+static int parse_part(Parser *p, Sequence *seq) {
+    int status = parse_sequence(p, seq, 1);
+    if (status != 0) return status;
+    if (!peek(p)) return PARSE_INCOMPLETE;
+    // Conditions and bodies may not be empty
+    return seq->count == 0 ? syntax_error(peek(p)) : 0;
+}
+
+/**
+ * Parses and compiles `if ... fi`, after the if
+ * @param p - Parser state
+ * @param prog - Program being compiled
+ * @return 0 on success, PARSE_INCOMPLETE, or -1 on error
+ */
+static int parse_if(Parser *p, Program *prog) {
+    int last_end = -1;    // Jumps to the end, chained through their args
+    Sequence seq;
+    int status;
+
+    while (1) {
+        // Condition: run it and skip the branch if it failed
+        if ((status = parse_part(p, &seq)) != 0 || (status = expect_keyword(p, "then")) != 0) return status;
+        if (compile_sequence(p, prog, &seq) != 0) return -1;
+        int skip = emit(p, prog, OP_JUMP_IF_FAILED, -1, NULL);
+        if (skip < 0) return -1;
+        if ((status = parse_part(p, &seq)) != 0) return status;
+        if (compile_sequence(p, prog, &seq) != 0) return -1;
+        if ((last_end = emit(p, prog, OP_JUMP, last_end, NULL)) < 0) return -1;
+        prog->code[skip].arg = prog->count;
+
+        if (is_keyword(peek(p), "elif")) {
+            p->pos++;
+            continue;
+        }
+        if (is_keyword(peek(p), "else")) {
+            p->pos++;
+            if ((status = parse_part(p, &seq)) != 0) return status;
+            if (compile_sequence(p, prog, &seq) != 0) return -1;
+        } else if (emit(p, prog, OP_STATUS, 0, NULL) < 0) {
+            // No branch was taken
+            return -1;
+        }
+        if ((status = expect_keyword(p, "fi")) != 0) return status;
+        break;
+    }
+    while (last_end >= 0) {
+        int previous = prog->code[last_end].arg;
+        prog->code[last_end].arg = prog->count;
+        last_end = previous;
+    }
+    return 0;
+}
+
+/**
+ * Parses and compiles `while ... done` or `until ... done`, after the
+ * keyword
+ * @param p - Parser state
+ * @param prog - Program being compiled
+ * @param until - Whether the loop runs until its condition succeeds
+ * @return 0 on success, PARSE_INCOMPLETE, or -1 on error
+ */
+static int parse_while(Parser *p, Program *prog, int until) {
+    Sequence seq;
+    int status;
+
+    if (emit(p, prog, OP_LOOP, 0, NULL) < 0) return -1;
+    int top = prog->count;
+    if ((status = parse_part(p, &seq)) != 0 || (status = expect_keyword(p, "do")) != 0) return status;
+    if (compile_sequence(p, prog, &seq) != 0) return -1;
+    int exit_jump = emit(p, prog, until ? OP_JUMP_IF_OK : OP_JUMP_IF_FAILED, -1, NULL);
+    if (exit_jump < 0) return -1;
+
+    p->loops++;
+    status = parse_part(p, &seq);
+    p->loops--;
+    if (status != 0 || (status = expect_keyword(p, "done")) != 0) return status;
+    int body = prog->count;
+    if (compile_sequence(p, prog, &seq) != 0 || emit(p, prog, OP_KEEP, 0, NULL) < 0 ||
+        emit(p, prog, OP_JUMP, top, NULL) < 0) {
+        return -1;
+    }
+    prog->code[exit_jump].arg = prog->count;
+    resolve_loop_control(prog, body, top, prog->count);
+    return emit(p, prog, OP_LOOP_END, 0, NULL) < 0 ? -1 : 0;
+}
+
+/**
+ * Parses and compiles `for NAME in words; do ... done`, after the for
+ * @param p - Parser state
+ * @param prog - Program being compiled
+ * @return 0 on success, PARSE_INCOMPLETE, or -1 on error
+ */
+static int parse_for(Parser *p, Program *prog) {
+    int argv_capacity = 0, parts_capacity = 0;
+    Sequence seq;
+    int status;
+
+    const Token *name = peek(p);
+    if (!name) return PARSE_INCOMPLETE;
+    if (name->kind != TOKEN_WORD || name->quoted || !is_name(name->text)) {
+        return syntax_error(name);
+    }
+    p->pos++;
+    if ((status = expect_keyword(p, "in")) != 0) return status;
+
+    ForLoop *loop = arena_alloc(p->arena, sizeof(ForLoop));
+    if (!loop) return -1;
+    memset(loop, 0, sizeof(ForLoop));
+    loop->name = name->text;
+    const Token *t;
+    while ((t = peek(p)) != NULL && t->kind == TOKEN_WORD) {
+        if (add_word(p, &loop->words, &argv_capacity, &parts_capacity, t) != 0) return -1;
+        p->pos++;
+    }
+    if (end_words(p, &loop->words, &argv_capacity) != 0) return -1;
+    if (!t) return PARSE_INCOMPLETE;
+    if (!is_special(t, ';')) return syntax_error(t);
+    p->pos++;
+    // Empty commands may come before the do, as before any command
+    while (is_special(peek(p), ';')) p->pos++;
+    if ((status = expect_keyword(p, "do")) != 0) return status;
+
+    p->loops++;
+    status = parse_part(p, &seq);
+    p->loops--;
+    if (status != 0 || (status = expect_keyword(p, "done")) != 0) return status;
+    if (emit(p, prog, OP_FOR, 0, loop) < 0) return -1;
+    int top = emit(p, prog, OP_NEXT, -1, NULL);
+    if (top < 0) return -1;
+    int body = prog->count;
+    if (compile_sequence(p, prog, &seq) != 0 || emit(p, prog, OP_KEEP, 0, NULL) < 0 ||
+        emit(p, prog, OP_JUMP, top, NULL) < 0) {
+        return -1;
+    }
+    prog->code[top].arg = prog->count;
+    resolve_loop_control(prog, body, top, prog->count);
+    return emit(p, prog, OP_LOOP_END, 0, NULL) < 0 ? -1 : 0;
+}
+
+/**
+ * Parses and compiles a compound command
+ * @param p - Parser state
+ * @param cmd - Command being parsed; receives the program
+ * @return 0 on success, PARSE_INCOMPLETE, or -1 on error
+ */
+static int parse_compound(Parser *p, Command *cmd) {
+    const Token *t = peek(p);
+    Program *prog = arena_alloc(p->arena, sizeof(Program));
+    if (!prog) return -1;
+    memset(prog, 0, sizeof(Program));
+    prog->keyword = t->text;
+    p->pos++;
+    p->compounds++;
+
+    int status;
+    if (strcmp(t->text, "if") == 0) {
+        status = parse_if(p, prog);
+    } else if (strcmp(t->text, "for") == 0) {
+        status = parse_for(p, prog);
+    } else {
+        status = parse_while(p, prog, strcmp(t->text, "until") == 0);
+    }
+    p->compounds--;
+    cmd->program = prog;
+    return status;
+}
+
+/**
+ * Parses one command: words, redirections and an optional block
+ * @param p - Parser state
+ * @param cmd - Receives the command (empty if there was none)
+ * @return 0 on success, PARSE_INCOMPLETE, or -1 on error
+ */
+static int parse_command(Parser *p, Command *cmd) {
+    int argv_capacity = 0, parts_capacity = 0, redirect_capacity = 0, assign_capacity = 0;
+    const Token *t;
+    RedirectKind kind;
+    int fd, strip_tabs;
+    int status;
+
+    memset(cmd, 0, sizeof(Command));
+    while ((t = peek(p)) != NULL) {
+        if (t->kind == TOKEN_WORD) {
+            // Inside a block an unquoted closing brace always ends it
+            if (p->depth > 0 && is_keyword(t, "}")) break;
+
+            int at_start = cmd->argc == 0 && cmd->assign_count == 0 && cmd->redirect_count == 0 &&
+                           !cmd->block && !cmd->program;
+            // Reserved words only count where a command name would be
+            if (at_start && is_closing_keyword(t)) break;
+            if (at_start && (is_keyword(t, "if") || is_keyword(t, "while") ||
+                             is_keyword(t, "until") || is_keyword(t, "for"))) {
+                if ((status = parse_compound(p, cmd)) != 0) return status;
+                continue;
+            }
+
+            if (is_keyword(t, "{") && !cmd->block && !cmd->program &&
+                (cmd->argc == 0 || takes_block(cmd))) {
+                p->pos++;
+                p->depth++;
+                cmd->block = arena_alloc(p->arena, sizeof(Sequence));
+                if (!cmd->block) return -1;
+                if ((status = parse_sequence(p, cmd->block, 1)) != 0) return status;
+                if (!peek(p)) return PARSE_INCOMPLETE;
+                if (!is_keyword(peek(p), "}")) return syntax_error(peek(p));
+                p->depth--;
+                p->pos++;
+                continue;
+            }
+            // Nothing but redirections may follow a block or compound command
+            if (cmd->block || cmd->program) return syntax_error(t);
+
+            // NAME=value words are assignments until the command name
+            size_t name_len;
+            if (cmd->argc == 0 && (name_len = assignment_name_length(t)) > 0) {
+                if (add_assignment(p, cmd, &assign_capacity, t, name_len) != 0) return -1;
+                p->pos++;
+                continue;
+            }
+
+            if (add_word(p, cmd, &argv_capacity, &parts_capacity, t) != 0) return -1;
+            p->pos++;
+        } else if (redirect_operator(t, &kind, &fd, &strip_tabs)) {
+            // A redirection operator must be followed by a file name
+            p->pos++;
+            const Token *target = peek(p);
+            if (!target || target->kind != TOKEN_WORD) return syntax_error(target);
+            cmd->redirects = reserve(p->arena, cmd->redirects, cmd->redirect_count,
+                                     &redirect_capacity, sizeof(Redirect));
+            if (!cmd->redirects) return -1;
+            Redirect *r = &cmd->redirects[cmd->redirect_count++];
+            memset(r, 0, sizeof(Redirect));
+            r->kind = kind;
+            r->fd = fd;
+            r->strip_tabs = strip_tabs;
+            r->target = target->text;
+            if (r->kind != REDIRECT_HEREDOC) {
+                r->parts = target->parts;
+            }
+            p->pos++;
+        } else {
+            break;
+        }
+    }
+
+    return end_words(p, cmd, &argv_capacity);
+}
+
+/**
+ * @param cmd - Parsed command
+ * @return 1 if the command has no words, redirections, assignments, block
+ *         or compound command
+ */
+static int is_empty(const Command *cmd) {
+    return cmd->argc == 0 && cmd->redirect_count == 0 && !cmd->block && !cmd->program &&
+           cmd->assign_count == 0;
+}
+
+/**
+ * @param t - Token
+ * @return 1 if the token is an unquoted word that looks like an option
+ */
+static int is_option(const Token *t) {
+    return t && t->kind == TOKEN_WORD && !t->quoted && t->text[0] == '-' && t->text[1];
+}
+
+/**
+ * Parses the options after `pipe`, each followed by its value; they are
+ * checked here, so a bad one is a syntax error
+ * @param p - Parser state (at the first option)
+ * @param pipeline - Receives the options
+ * @return 0 on success, -1 on error
+ */
+static int parse_tuning(Parser *p, Pipeline *pipeline) {
+    PipeTuning *tuning = arena_alloc(p->arena, sizeof(PipeTuning));
+    if (!tuning) return -1;
+    pipe_tuning_init(tuning);
+    while (is_option(peek(p))) {
+        const Token *option = peek(p);
+        p->pos++;
+        const Token *value = peek(p);
+        if (!value || value->kind != TOKEN_WORD) return syntax_error(value);
+        if (pipe_tuning_option(tuning, option->text, value->text,
+                               report_errors ? "pipe" : NULL) != 0) {
+            return -1;
+        }
+        p->pos++;
+    }
+    pipeline->tuning = tuning;
+    return 0;
+}
+
+/**
+ * Parses commands joined by '|', optionally prefixed with `time [-p]`,
+ * `pipe OPTIONS`, `memo` (before a single command) or `coproc [NAME]` (a
+ * name is only taken before a { ... } block, as in bash)
+ * @param p - Parser state
+ * @param pipeline - Receives the pipeline (empty if there was none)
+ * @return 0 on success, PARSE_INCOMPLETE, or -1 on error
+ */
+static int parse_pipeline(Parser *p, Pipeline *pipeline) {
+    int capacity = 0;
+    Command cmd;
+    int status;
+
+    memset(pipeline, 0, sizeof(Pipeline));
+    // The time keyword applies to the whole pipeline
+    if (is_keyword(peek(p), "time")) {
+        p->pos++;
+        pipeline->timed = 1;
+        if (is_keyword(peek(p), "-p")) {
+            p->pos++;
+            pipeline->timed = 2;
+        }
+    }
+    // Only taken as a prefix when options follow, so a program named pipe still runs
+    if (is_keyword(peek(p), "pipe") && p->pos + 1 < p->tokens->count &&
+        is_option(&p->tokens->items[p->pos + 1])) {
+        p->pos++;
+        if ((status = parse_tuning(p, pipeline)) != 0) return status;
+    }
+    if (is_keyword(peek(p), "memo") && p->pos + 1 < p->tokens->count &&
+        p->tokens->items[p->pos + 1].kind == TOKEN_WORD) {
+        p->pos++;
+        pipeline->memo = 1;
+    }
+    if (is_keyword(peek(p), "coproc")) {
+        p->pos++;
+        pipeline->coproc = "COPROC";
+        const Token *name = peek(p);
+        if (name && name->kind == TOKEN_WORD && p->pos + 1 < p->tokens->count &&
+            is_keyword(&p->tokens->items[p->pos + 1], "{")) {
+            pipeline->coproc = name->text;
+            p->pos++;
+        }
+    }
+    while (1) {
+        if ((status = parse_command(p, &cmd)) != 0) return status;
+        if (is_empty(&cmd)) {
+            // Only an empty pipeline may have an empty command
+            if (pipeline->count > 0 || pipeline->coproc) return syntax_error(peek(p));
+            return 0;
+        }
+        pipeline->commands = reserve(p->arena, pipeline->commands, pipeline->count,
+                                     &capacity, sizeof(Command));
+        if (!pipeline->commands) return -1;
+        pipeline->commands[pipeline->count++] = cmd;
+
+        if (!is_special(peek(p), '|')) return 0;
+        // Only one command's output is cached
+        if (pipeline->memo) return syntax_error(peek(p));
+        p->pos++;
+    }
+}
+
+/**
+ * Parses pipelines separated by ';' or '&'
+ * @param p - Parser state
+ * @param seq - Receives the sequence
+ * @param nested - Whether a '}' or a reserved word that closes a part of a
+ *                 compound command ends the sequence (the caller checks it)
+ * @return 0 on success, PARSE_INCOMPLETE, or -1 on error
+ */
+static int parse_sequence(Parser *p, Sequence *seq, int nested) {
+    int capacity = 0;
+    Pipeline pipeline;
+    int status;
+
+    seq->pipelines = NULL;
+    seq->count = 0;
+    while (1) {
+        if ((status = parse_pipeline(p, &pipeline)) != 0) return status;
+
+        const Token *t = peek(p);
+        if (pipeline.count > 0) {
+            pipeline.background = is_special(t, '&');
+            seq->pipelines = reserve(p->arena, seq->pipelines, seq->count,
+                                     &capacity, sizeof(Pipeline));
+            if (!seq->pipelines) return -1;
+            seq->pipelines[seq->count++] = pipeline;
+        } else if (is_special(t, '&')) {
+            return syntax_error(t);
+        }
+
+        if (t == NULL) return 0;
+        if (is_special(t, ';') || is_special(t, '&')) {
+            // Empty commands between separators are skipped
+            p->pos++;
+            continue;
+        }
+        if (nested && ((p->depth > 0 && is_keyword(t, "}")) ||
+                       (p->compounds > 0 && is_closing_keyword(t)))) {
+            return 0;
+        }
+        return syntax_error(t);
+    }
+}
+
+int parse_tokens(Arena *arena, const TokenList *tokens, Sequence *seq) {
+    Parser p;
+    p.arena = arena;
+    p.tokens = tokens;
+    p.pos = 0;
+    p.depth = 0;
+    p.compounds = 0;
+    p.loops = 0;
+    return parse_sequence(&p, seq, 0);
+}
+
+int parse_line(Arena *arena, const char *line, Sequence *seq) {
+    TokenList tokens;
+    if (lex_line(arena, line, &tokens) != 0) return -1;
+    return parse_tokens(arena, &tokens, seq);
+}
+
+/**
+ * Growable text buffer for parse_input
+ */
+typedef struct {
+    char *text;
+    size_t len;
+    size_t capacity;
+} TextBuffer;
+
+/**
+ * Appends text to a buffer, keeping room for a terminator
+ * @param buf - Buffer to append to
+ * @param text - Text to append
+ * @param len - Length of text
+ * @return 0 on success, -1 on allocation failure
+ */
+static int buffer_append(TextBuffer *buf, const char *text, size_t len) {
+    if (buf->len + len + 1 > buf->capacity) {
+        size_t capacity = (buf->len + len + 1) * 2;
+        char *bigger = realloc(buf->text, capacity);
+        if (!bigger) return -1;
+        buf->text = bigger;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->text + buf->len, text, len);
+    buf->len += len;
+    buf->text[buf->len] = '\0';
+    return 0;
+}
+
+/**
+ * Reads the here-document bodies that follow one line of a command that
+ * spans several lines, so the next line of the command comes after them
+ * The lines are kept as read, delimiters included, for parse_heredocs.
+ * @param arena - Arena for scratch tokens (released before returning)
+ * @param line - The line
+ * @param reader - Source of the bodies
+ * @param bodies - Receives the lines of the bodies
+ * @return 0 on success, -1 on allocation failure
+ */
+static int collect_heredocs(Arena *arena, const char *line, LineReader *reader, TextBuffer *bodies) {
+    ArenaMark mark = arena_mark(arena);
+    TokenList tokens;
+    int status = 0;
+
+    // A line that does not lex is reported when the command is parsed
+    if (lex_line(arena, line, &tokens) != 0) {
+        arena_release(arena, mark);
+        return 0;
+    }
+    for (size_t i = 0; i + 1 < tokens.count && status == 0; i++) {
+        const Token *t = &tokens.items[i];
+        const Token *target = &tokens.items[i + 1];
+        RedirectKind kind;
+        int fd, strip_tabs;
+        if (!redirect_operator(t, &kind, &fd, &strip_tabs) || kind != REDIRECT_HEREDOC ||
+            target->kind != TOKEN_WORD) {
+            continue;
+        }
+        size_t len;
+        char *body_line;
+        while (status == 0 && (body_line = line_reader_next(reader, &len)) != NULL) {
+            const char *word = body_line;
+            if (strip_tabs) {
+                while (*word == '\t') word++;
+            }
+            int last = strcmp(word, target->text) == 0;
+            if (buffer_append(bodies, body_line, len) != 0 || buffer_append(bodies, "\n", 1) != 0) {
+                status = -1;
+            }
+            if (last) break;
+        }
+    }
+    arena_release(arena, mark);
+    return status;
+}
+
+int parse_input(Arena *arena, const char *line, LineReader *reader, const char *prompt,
+                Sequence *seq, const char **text) {
+    ArenaMark mark = arena_mark(arena);
+    TextBuffer joined = {NULL, 0, 0};   // Lines read so far, once there is more than one
+    TextBuffer bodies = {NULL, 0, 0};   // Here-documents of those lines
+    const char *current = line;
+    int status;
+
+    while ((status = parse_line(arena, current, seq)) == PARSE_INCOMPLETE) {
+        arena_release(arena, mark);
+        if (!joined.text) {
+            // The reader reuses its buffer, so keep the first line
+            if (buffer_append(&joined, line, strlen(line)) != 0 ||
+                (reader && collect_heredocs(arena, joined.text, reader, &bodies) != 0)) {
+                status = -1;
+                break;
+            }
+        }
+        if (prompt) {
+            fputs(prompt, stdout);
+            fflush(stdout);
+        }
+        size_t next_len;
+        char *next = reader ? line_reader_next(reader, &next_len) : NULL;
+        if (!next) {
+            if (report_errors) {
+                fflush(stdout);
+                fprintf(stderr, "syntax error: unexpected end of file\n");
+            }
+            status = -1;
+            break;
+        }
+        size_t offset = joined.len + 2;
+        if (buffer_append(&joined, "; ", 2) != 0 || buffer_append(&joined, next, next_len) != 0 ||
+            collect_heredocs(arena, joined.text + offset, reader, &bodies) != 0) {
+            status = -1;
+            break;
+        }
+        current = joined.text;
+    }
+
+    if (status == 0 && text) {
+        *text = arena_strndup(arena, current, strlen(current));
+        if (!*text) status = -1;
+    }
+    if (status == 0 && joined.text) {
+        // The bodies were read with the lines they follow
+        LineReader collected;
+        if (!bodies.text && buffer_append(&bodies, "", 0) != 0) {
+            status = -1;
+        } else {
+            line_reader_init_memory(&collected, bodies.text, bodies.len, bodies.capacity);
+            bodies.text = NULL;
+            status = parse_heredocs(arena, seq, &collected);
+            line_reader_free(&collected);
+        }
+    } else if (status == 0) {
+        status = parse_heredocs(arena, seq, reader);
+    }
+    free(joined.text);
+    free(bodies.text);
+    return status;
+}
+
+/**
+ * Reads one here-document body, up to its delimiter line
+ * @param arena - Arena that receives the body
+ * @param r - Here-document redirection
+ * @param reader - Source of the following lines
+ * @return 0 on success, -1 on allocation failure
+ */
+static int read_heredoc(Arena *arena, Redirect *r, LineReader *reader) {
+    char *body = NULL;
+    size_t len = 0, capacity = 0, line_len;
+    char *line;
+
+    while (1) {
+        line = reader ? line_reader_next(reader, &line_len) : NULL;
+        if (line == NULL) {
+            fprintf(stderr, "warning: here-document delimited by end-of-file (wanted `%s')\n", r->target);
+            break;
+        }
+        if (r->strip_tabs) {
+            while (*line == '\t') {
+                line++;
+                line_len--;
+            }
+        }
+        if (strcmp(line, r->target) == 0) break;
+
+        // Keep the body in one growing buffer, newline included
+        if (len + line_len + 1 > capacity) {
+            capacity = (len + line_len + 1) * 2;
+            char *bigger = realloc(body, capacity);
+            if (!bigger) {
+                free(body);
+                return -1;
+            }
+            body = bigger;
+        }
+        memcpy(body + len, line, line_len);
+        len += line_len;
+        body[len++] = '\n';
+    }
+
+    r->body = arena_strndup(arena, body ? body : "", len);
+    r->body_len = len;
+    free(body);
+    return r->body ? 0 : -1;
+}
+
+/**
+ * Reads the here-document bodies of the pipelines a compound command runs
+ * @param arena - Arena that receives the bodies
+ * @param prog - Compiled compound command
+ * @param reader - Source of the following lines, or NULL
+ * @return 0 on success, -1 on allocation failure
+ */
+static int program_heredocs(Arena *arena, Program *prog, LineReader *reader) {
+    for (int i = 0; i < prog->count; i++) {
+        if (prog->code[i].op != OP_RUN) continue;
+        Sequence one = {prog->code[i].operand, 1};
+        if (parse_heredocs(arena, &one, reader) != 0) return -1;
+    }
+    return 0;
+}
+
+int parse_heredocs(Arena *arena, Sequence *seq, LineReader *reader) {
+    for (int i = 0; i < seq->count; i++) {
+        Pipeline *pipeline = &seq->pipelines[i];
+        for (int j = 0; j < pipeline->count; j++) {
+            Command *cmd = &pipeline->commands[j];
+            // A block's own redirections are written after its contents
+            if (cmd->block && parse_heredocs(arena, cmd->block, reader) != 0) return -1;
+            if (cmd->program && program_heredocs(arena, cmd->program, reader) != 0) return -1;
+            for (int k = 0; k < cmd->redirect_count; k++) {
+                Redirect *r = &cmd->redirects[k];
+                if (r->kind == REDIRECT_HEREDOC && read_heredoc(arena, r, reader) != 0) return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int redirect_operator(const Token *t, RedirectKind *kind, int *fd, int *strip_tabs) {
+    if (!t || t->kind != TOKEN_SPECIAL) return 0;
+    const char *op = t->text;
+    int number = -1;
+    if (isdigit((unsigned char)*op)) {
+        // Large numbers only need to stay large enough to be refused
+        number = 0;
+        for (; isdigit((unsigned char)*op); op++) {
+            if (number < 100000) number = number * 10 + (*op - '0');
+        }
+    }
+    static const struct {
+        const char *op;
+        RedirectKind kind;
+        int fd;
+    } operators[] = {
+        {"<", REDIRECT_INPUT, 0}, {">", REDIRECT_OUTPUT, 1}, {">>", REDIRECT_APPEND, 1},
+        {"<<", REDIRECT_HEREDOC, 0}, {"<<-", REDIRECT_HEREDOC, 0}, {"<<<", REDIRECT_STRING, 0},
+        {"<&", REDIRECT_DUP, 0}, {">&", REDIRECT_DUP, 1},
+    };
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+        if (strcmp(op, operators[i].op) == 0) {
+            *kind = operators[i].kind;
+            *fd = number >= 0 ? number : operators[i].fd;
+            *strip_tabs = strcmp(op, "<<-") == 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+char* pipeline_text(const Pipeline *pipeline) {
+    size_t size = 1;
+    for (int i = 0; i < pipeline->count; i++) {
+        Command *cmd = &pipeline->commands[i];
+        size += 3;
+        for (int j = 0; j < cmd->assign_count; j++) {
+            size += strlen(cmd->assigns[j].name) + strlen(cmd->assigns[j].value) + 2;
+        }
+        for (int j = 0; j < cmd->argc; j++) size += strlen(cmd->argv[j]) + 1;
+        if (cmd->block) size += 6;
+        if (cmd->program) size += strlen(cmd->program->keyword) + 4;
+    }
+
+    char *text = malloc(size);
+    if (!text) return NULL;
+    text[0] = '\0';
+    for (int i = 0; i < pipeline->count; i++) {
+        Command *cmd = &pipeline->commands[i];
+        if (i > 0) strcat(text, " | ");
+        for (int j = 0; j < cmd->assign_count; j++) {
+            if (j > 0) strcat(text, " ");
+            strcat(text, cmd->assigns[j].name);
+            strcat(text, "=");
+            strcat(text, cmd->assigns[j].value);
+        }
+        for (int j = 0; j < cmd->argc; j++) {
+            if (j > 0 || cmd->assign_count > 0) strcat(text, " ");
+            strcat(text, cmd->argv[j]);
+        }
+        if (cmd->block) strcat(text, cmd->argc ? " {...}" : "{...}");
+        if (cmd->program) {
+            strcat(text, cmd->program->keyword);
+            strcat(text, " ...");
+        }
+    }
+    return text;
+}
@@ -0,0 +1,212 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "arena.h"
+#include "lexer.h"
+#include "linereader.h"
+
+/**
+ * Command-line parser
+ * Builds a compact AST in a single pass over the token stream:
+ *   sequence -> pipeline ((';' | '&') pipeline)*
+ *   pipeline -> ['time' ['-p']] command ('|' command)*
+ *   command  -> (assignment | redirection)* (word | redirection | block)*
+ *   assignment -> NAME=word
+ *   redirection -> [N]('<' | '>' | '>>' | '<<' | '<<-' | '<<<' | '<&' | '>&') word
+ *   block    -> '{' sequence '}'
+ *   compound -> 'if' sequence 'then' sequence
+ *                   ('elif' sequence 'then' sequence)* ['else' sequence] 'fi'
+ *             | ('while' | 'until') sequence 'do' sequence 'done'
+ *             | 'for' NAME 'in' word* ';' 'do' sequence 'done'
+ * A block may start a command (a group run in the shell) or follow the
+ * arguments of a command that takes one, such as `parallel`. A compound
+ * command (written where a command name would be) is compiled to bytecode
+ * as it is parsed: its conditions and bodies become jumps around the
+ * pipelines they run, so a loop runs without parsing anything again.
+ * Every node lives in the arena the parser is given, so an AST can be kept
+ * (for cached scripts) or thrown away with the line.
+ */
+
+/* Returned when the text ends inside a block or compound command */
+#define PARSE_INCOMPLETE -2
+
+typedef enum {
+    REDIRECT_INPUT,   // < file
+    REDIRECT_OUTPUT,  // > file (several of them write the same output to each)
+    REDIRECT_APPEND,  // >> file
+    REDIRECT_HEREDOC, // << delimiter (<<- strips leading tabs)
+    REDIRECT_STRING,  // <<< word: the word and a newline
+    REDIRECT_DUP      // <&N or >&N: a copy of descriptor N; <&- or >&- closes
+} RedirectKind;
+
+typedef struct {
+    RedirectKind kind;
+    int fd;               // Descriptor redirected (0 or 1 unless written, as in 2>)
+    const char *target;   // File name, word, descriptor, or the delimiter of
+                          // a here-document
+    const char *body;     // Here-document text, filled in by parse_heredocs
+    size_t body_len;
+    int strip_tabs;       // Written as <<-
+    const WordPart *parts; // Pieces of a file name to expand, or NULL
+} Redirect;
+
+/**
+ * A NAME=value word before the command name
+ */
+typedef struct {
+    const char *name;     // Variable name
+    const char *value;    // Value as written (final if there are no parts)
+    const WordPart *parts; // Pieces of the value to expand, or NULL
+} Assignment;
+
+struct Sequence;
+struct Program;
+
+typedef struct {
+    char **argv;          // NULL-terminated argument vector (may be just NULL)
+    int argc;             // Number of arguments
+    const WordPart **parts; // Per argument, pieces to expand (NULL entries
+                            // for plain words), or NULL if no argument has any
+    Redirect *redirects;  // Redirections in the order they were written
+    int redirect_count;
+    Assignment *assigns;  // Variables set for the command (or the shell, if
+    int assign_count;     // there is no command)
+    struct Sequence *block; // Commands between { and }, or NULL
+    struct Program *program; // Compiled if, while, until or for, or NULL
+    int batch_first;      // Arguments one word expanded to, which a program
+    int batch_count;      // too long for one execve gets in batches (see expand.h)
+} Command;
+
+typedef struct {
+    Command *commands;    // Stages, connected left to right by pipes
+    int count;
+    int background;       // Terminated by '&': run without waiting
+    int timed;            // Prefixed with time (2 for time -p)
+    const char *coproc;   // Name if started with coproc, otherwise NULL
+    const struct PipeTuning *tuning; // Options of a `pipe` prefix, or NULL (see pipetune.h)
+    int memo;             // Prefixed with memo: the result is cached (see memo.h)
+} Pipeline;
+
+typedef struct Sequence {
+    Pipeline *pipelines;  // Pipelines, run one after another
+    int count;
+} Sequence;
+
+/**
+ * Bytecode of a compound command
+ * The machine has one register, the exit status, and a stack of running
+ * loops. Jump targets are instruction indexes.
+ */
+typedef enum {
+    OP_RUN,              // Run a pipeline (operand), setting the status
+    OP_JUMP,             // Continue at arg
+    OP_JUMP_IF_FAILED,   // Continue at arg if the status is not 0
+    OP_JUMP_IF_OK,       // Continue at arg if the status is 0
+    OP_STATUS,           // Set the status to arg
+    OP_LOOP,             // Enter a while or until loop
+    OP_FOR,              // Enter a for loop (operand), expanding its words
+    OP_NEXT,             // Set the for variable to the next word, or
+                         // continue at arg when there are none left
+    OP_KEEP,             // Remember the status as the loop's
+    OP_LOOP_END,         // Leave the loop, setting the status it remembered
+    OP_BREAK,            // break or continue, until the enclosing loop
+    OP_CONTINUE          // resolves them into jumps
+} Opcode;
+
+typedef struct {
+    Opcode op;
+    int arg;              // Jump target or status
+    void *operand;        // Pipeline for OP_RUN, ForLoop for OP_FOR
+} Instruction;
+
+/**
+ * Operand of OP_FOR
+ */
+typedef struct {
+    const char *name;     // Loop variable
+    Command words;        // Words to loop over, expanded when the loop starts
+} ForLoop;
+
+typedef struct Program {
+    const char *keyword;  // if, while, until or for (for pipeline_text)
+    Instruction *code;
+    int count;
+    int capacity;
+} Program;
+
+/**
+ * Parses tokens into a sequence
+ * Syntax errors are reported on stderr.
+ * @param arena - Arena that receives the AST
+ * @param tokens - Tokens produced by lex_line
+ * @param seq - Receives the parsed sequence
+ * @return 0 on success, PARSE_INCOMPLETE if the tokens end inside a block
+ *         or compound command (not reported), -1 on a syntax error or
+ *         allocation failure
+ */
+int parse_tokens(Arena *arena, const TokenList *tokens, Sequence *seq);
+
+/**
+ * Tokenizes and parses a line in one step
+ * @param arena - Arena that receives the tokens and the AST
+ * @param line - Line to parse
+ * @param seq - Receives the parsed sequence
+ * @return 0 on success, PARSE_INCOMPLETE if the line ends inside a block
+ *         or compound command (not reported), -1 on a syntax error or
+ *         allocation failure
+ */
+int parse_line(Arena *arena, const char *line, Sequence *seq);
+
+/**
+ * Turns the reporting of syntax errors off or back on
+ * Used to try parsing input that is parsed again, and reported, if it
+ * does not parse.
+ * @param quiet - Whether to keep syntax errors to itself
+ */
+void parse_set_quiet(int quiet);
+
+/**
+ * Parses a line, reading more lines while it ends inside a block or
+ * compound command, then reads the bodies of its here-documents
+ * The lines are joined with "; ", so a line break ends a command.
+ * @param arena - Arena that receives the text, tokens and AST
+ * @param line - First line
+ * @param reader - Source of the following lines, or NULL
+ * @param prompt - Printed before reading each further line, or NULL
+ * @param seq - Receives the parsed sequence
+ * @param text - Receives the text that was parsed (in the arena), or NULL
+ * @return 0 on success, -1 on a syntax error (an unfinished command at
+ *         end of input included) or allocation failure
+ */
+int parse_input(Arena *arena, const char *line, LineReader *reader, const char *prompt,
+                Sequence *seq, const char **text);
+
+/**
+ * Reads the bodies of a parsed line's here-documents from the lines that
+ * follow it, in the order the here-documents were written
+ * A body ends at a line holding only the delimiter, or at end of input.
+ * @param arena - Arena that receives the bodies
+ * @param seq - Parsed line
+ * @param reader - Source of the following lines, or NULL (bodies stay empty)
+ * @return 0 on success, -1 on allocation failure
+ */
+int parse_heredocs(Arena *arena, Sequence *seq, LineReader *reader);
+
+/**
+ * Reads a redirection operator token
+ * @param t - Token to read (may be NULL)
+ * @param kind - Receives the kind of redirection
+ * @param fd - Receives the descriptor it redirects
+ * @param strip_tabs - Receives whether it is <<-
+ * @return 1 if the token is a redirection operator, 0 otherwise
+ */
+int redirect_operator(const Token *t, RedirectKind *kind, int *fd, int *strip_tabs);
+
+/**
+ * Rebuilds printable text for a pipeline from its words
+ * @param pipeline - Pipeline to describe
+ * @return Newly allocated text (may be NULL on allocation failure)
+ */
+char* pipeline_text(const Pipeline *pipeline);
+
+#endif
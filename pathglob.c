@@ -0,0 +1,490 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+#include "pathglob.h"
+
+/* Constants */
+#define INITIAL_BUCKET_COUNT 64
+#define MAX_CACHED_LISTINGS 4096  // The cache is emptied when it grows past this
+#define INITIAL_LISTING_SIZE 64   // Initial room for a directory's entries
+#define INITIAL_NAMES_SIZE 1024   // Initial room for their names
+#define INITIAL_PATH_SIZE 256     // Initial room for the path being built
+#define INITIAL_MATCH_SIZE 16     // Initial room for the matches
+#define RACY_SECONDS 1            // A directory changed this recently may change
+                                  // again without its mtime moving
+
+/**
+ * One name in a directory
+ */
+typedef struct {
+    const char *name;
+    unsigned char type;       // d_type (DT_UNKNOWN if the file system does not say)
+} ListingEntry;
+
+/**
+ * Cached contents of one directory
+ */
+typedef struct Listing {
+    char *path;               // Directory as written in the pattern ("" for .)
+    dev_t dev;                // Identity and mtime of the directory when read
+    ino_t ino;
+    struct timespec mtime;
+    int racy;                 // Read too soon after it changed to be trusted
+    unsigned long walk;       // Expansion that last checked it
+    ListingEntry *entries;    // Sorted by name
+    size_t count;
+    char *names;              // Storage for the names
+    struct Listing *next;     // Next listing in the same bucket
+} Listing;
+
+/**
+ * State of one expansion: the path being built and the matches so far
+ */
+typedef struct {
+    char *path;               // NUL-terminated at len
+    size_t len;
+    size_t size;
+    char **matches;           // malloc'd paths
+    size_t count;
+    size_t capacity;
+    int failed;               // Set on allocation failure
+} Walk;
+
+static Listing **buckets = NULL;     // Bucket array (chained hashing)
+static size_t bucket_count = 0;      // Number of buckets
+static size_t listing_count = 0;     // Number of cached listings
+static int cache_enabled = 1;        // Whether listings are kept between expansions
+static unsigned long walk_count = 0; // Number of expansions started
+
+/**
+ * FNV-1a hash of a directory path
+ * @param s - String to hash
+ * @return Hash value
+ */
+static unsigned long hash_path(const char *s) {
+    unsigned long h = 2166136261UL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+/**
+ * Frees every listing but keeps the bucket array
+ */
+static void drop_listings(void) {
+    for (size_t i = 0; i < bucket_count; i++) {
+        Listing *l = buckets[i];
+        while (l) {
+            Listing *next = l->next;
+            free(l->path);
+            free(l->entries);
+            free(l->names);
+            free(l);
+            l = next;
+        }
+        buckets[i] = NULL;
+    }
+    listing_count = 0;
+}
+
+/**
+ * Doubles the bucket array once the load factor passes 1
+ * @return 0 on success, -1 on allocation failure
+ */
+static int ensure_capacity(void) {
+    if (buckets && listing_count < bucket_count) return 0;
+
+    size_t new_count = bucket_count ? bucket_count * 2 : INITIAL_BUCKET_COUNT;
+    Listing **new_buckets = calloc(new_count, sizeof(Listing *));
+    if (!new_buckets) return -1;
+
+    // Rehash existing listings into the new buckets
+    for (size_t i = 0; i < bucket_count; i++) {
+        Listing *l = buckets[i];
+        while (l) {
+            Listing *next = l->next;
+            size_t b = hash_path(l->path) & (new_count - 1);
+            l->next = new_buckets[b];
+            new_buckets[b] = l;
+            l = next;
+        }
+    }
+    free(buckets);
+    buckets = new_buckets;
+    bucket_count = new_count;
+    return 0;
+}
+
+/**
+ * Orders listing entries by name
+ */
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const ListingEntry *)a)->name, ((const ListingEntry *)b)->name);
+}
+
+/**
+ * Reads a directory into a listing, replacing what it held
+ * @param l - Listing to fill
+ * @param dir - Directory to open
+ * @param st - The directory's status
+ * @return 0 on success, -1 if it could not be read
+ */
+static int read_listing(Listing *l, const char *dir, const struct stat *st) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+
+    size_t capacity = INITIAL_LISTING_SIZE, names_size = INITIAL_NAMES_SIZE, names_len = 0;
+    size_t count = 0;
+    ListingEntry *entries = malloc(capacity * sizeof(ListingEntry));
+    size_t *offsets = malloc(capacity * sizeof(size_t));
+    char *names = malloc(names_size);
+    int status = entries && offsets && names ? 0 : -1;
+    struct dirent *ent;
+
+    while (status == 0 && (ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        size_t len = strlen(ent->d_name) + 1;
+        if (count == capacity) {
+            capacity *= 2;
+            ListingEntry *bigger = realloc(entries, capacity * sizeof(ListingEntry));
+            if (bigger) entries = bigger;
+            size_t *more = realloc(offsets, capacity * sizeof(size_t));
+            if (more) offsets = more;
+            if (!bigger || !more) status = -1;
+        }
+        if (status == 0 && names_len + len > names_size) {
+            while (names_len + len > names_size) names_size *= 2;
+            char *bigger = realloc(names, names_size);
+            if (bigger) {
+                names = bigger;
+            } else {
+                status = -1;
+            }
+        }
+        if (status != 0) break;
+        // Names move while the storage grows, so offsets are kept until the end
+        memcpy(names + names_len, ent->d_name, len);
+        offsets[count] = names_len;
+        entries[count].type = ent->d_type;
+        names_len += len;
+        count++;
+    }
+    closedir(d);
+    if (status != 0) {
+        free(entries);
+        free(offsets);
+        free(names);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i].name = names + offsets[i];
+    }
+    free(offsets);
+    qsort(entries, count, sizeof(ListingEntry), compare_entries);
+
+    free(l->entries);
+    free(l->names);
+    l->entries = entries;
+    l->names = names;
+    l->count = count;
+    l->dev = st->st_dev;
+    l->ino = st->st_ino;
+    l->mtime = st->st_mtim;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    l->racy = now.tv_sec <= st->st_mtim.tv_sec + RACY_SECONDS;
+    return 0;
+}
+
+/**
+ * Finds the listing of a directory, reading it if it is not cached or
+ * has changed since it was read
+ * A listing is checked once per expansion, so one being walked is never
+ * read again under the walk.
+ * @param dir - Directory as written ("" for the current one)
+ * @return The listing (empty if the directory could not be read), or NULL
+ *         if there is no such directory
+ */
+static const Listing* get_listing(const char *dir) {
+    size_t b = 0;
+    Listing *l = NULL;
+    if (buckets) {
+        b = hash_path(dir) & (bucket_count - 1);
+        for (l = buckets[b]; l && strcmp(l->path, dir) != 0; l = l->next) {}
+    }
+    if (l && l->walk == walk_count) return l;
+
+    struct stat st;
+    const char *open_path = dir[0] ? dir : ".";
+    if (stat(open_path, &st) != 0 || !S_ISDIR(st.st_mode)) return NULL;
+    if (l && cache_enabled && !l->racy && l->dev == st.st_dev && l->ino == st.st_ino &&
+        l->mtime.tv_sec == st.st_mtim.tv_sec && l->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        l->walk = walk_count;
+        return l;
+    }
+
+    if (!l) {
+        if (ensure_capacity() != 0) return NULL;
+        l = calloc(1, sizeof(Listing));
+        if (!l || !(l->path = strdup(dir))) {
+            free(l);
+            return NULL;
+        }
+        b = hash_path(dir) & (bucket_count - 1);
+        l->next = buckets[b];
+        buckets[b] = l;
+        listing_count++;
+    }
+    l->walk = walk_count;
+    if (read_listing(l, open_path, &st) != 0) {
+        // Empty for this expansion, read again by the next one
+        l->count = 0;
+        l->racy = 1;
+    }
+    return l;
+}
+
+/**
+ * Appends text to the path being built
+ * @param w - Walk state
+ * @param text - Text to append
+ * @param len - Its length
+ * @return 0 on success, -1 on allocation failure
+ */
+static int path_append(Walk *w, const char *text, size_t len) {
+    if (w->len + len + 1 > w->size) {
+        size_t size = w->size ? w->size : INITIAL_PATH_SIZE;
+        while (w->len + len + 1 > size) size *= 2;
+        char *bigger = realloc(w->path, size);
+        if (!bigger) {
+            w->failed = 1;
+            return -1;
+        }
+        w->path = bigger;
+        w->size = size;
+    }
+    memcpy(w->path + w->len, text, len);
+    w->len += len;
+    w->path[w->len] = '\0';
+    return 0;
+}
+
+/**
+ * Cuts the path being built back to an earlier length
+ * @param w - Walk state
+ * @param len - Length to keep
+ */
+static void path_truncate(Walk *w, size_t len) {
+    w->len = len;
+    if (w->path) w->path[len] = '\0';
+}
+
+/**
+ * Adds the path being built to the matches
+ * @param w - Walk state
+ */
+static void add_match(Walk *w) {
+    if (w->len == 0) return;
+    if (w->count == w->capacity) {
+        size_t capacity = w->capacity ? w->capacity * 2 : INITIAL_MATCH_SIZE;
+        char **bigger = realloc(w->matches, capacity * sizeof(char *));
+        if (!bigger) {
+            w->failed = 1;
+            return;
+        }
+        w->matches = bigger;
+        w->capacity = capacity;
+    }
+    if (!(w->matches[w->count] = strdup(w->path))) {
+        w->failed = 1;
+        return;
+    }
+    w->count++;
+}
+
+/**
+ * Checks whether the path being built names a directory
+ * @param w - Walk state
+ * @param entry - Its entry in the parent's listing
+ * @param follow - Whether a symlink to a directory counts
+ * @return 1 if it does, 0 otherwise
+ */
+static int is_directory(Walk *w, const ListingEntry *entry, int follow) {
+    struct stat st;
+    if (entry->type == DT_DIR) return 1;
+    if (entry->type == DT_UNKNOWN || (follow && entry->type == DT_LNK)) {
+        int status = follow ? stat(w->path, &st) : lstat(w->path, &st);
+        return status == 0 && S_ISDIR(st.st_mode);
+    }
+    return 0;
+}
+
+static void walk(Walk *w, const char *rest);
+
+/**
+ * Finds the first entry of a listing that could start with a prefix
+ * @param l - Listing (sorted by name)
+ * @param prefix - Prefix text
+ * @param len - Its length
+ * @return Index of the first entry not ordered before the prefix
+ */
+static size_t lower_bound(const Listing *l, const char *prefix, size_t len) {
+    size_t low = 0, high = l->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strncmp(l->entries[mid].name, prefix, len) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * Matches a `**` component: the rest of the pattern in this directory and
+ * in every directory below it
+ * Hidden directories and symlinks are not entered. A final `**` matches
+ * every name below the directory.
+ * @param w - Walk state, at the directory
+ * @param next - Pattern after the `**` (empty, or starting with '/')
+ */
+static void walk_globstar(Walk *w, const char *next) {
+    size_t base = w->len;
+    if (*next) walk(w, next + strspn(next, "/"));
+
+    const Listing *l = get_listing(w->path ? w->path : "");
+    for (size_t i = 0; l && i < l->count && !w->failed; i++) {
+        const ListingEntry *entry = &l->entries[i];
+        if (entry->name[0] == '.') continue;
+        if (path_append(w, entry->name, strlen(entry->name)) != 0) break;
+        if (!*next) add_match(w);
+        if (is_directory(w, entry, 0) && path_append(w, "/", 1) == 0) {
+            walk_globstar(w, next);
+        }
+        path_truncate(w, base);
+    }
+}
+
+/**
+ * Matches the rest of a pattern below the path built so far
+ * @param w - Walk state
+ * @param rest - Rest of the pattern
+ */
+static void walk(Walk *w, const char *rest) {
+    size_t base = w->len;
+    // Slashes are kept as written
+    size_t slashes = strspn(rest, "/");
+    if (slashes && path_append(w, rest, slashes) != 0) return;
+    rest += slashes;
+    if (*rest == '\0') {
+        add_match(w);
+        path_truncate(w, base);
+        return;
+    }
+
+    size_t len = strcspn(rest, "/");
+    const char *next = rest + len;
+    size_t dir_len = w->len;
+    if (!glob_has_pattern(rest, len)) {
+        // A literal component is taken as is, without its backslashes
+        for (size_t i = 0; i < len && !w->failed; i++) {
+            if (rest[i] == '\\' && i + 1 < len) i++;
+            path_append(w, rest + i, 1);
+        }
+        struct stat st;
+        if (next[strspn(next, "/")] != '\0') {
+            // A missing directory matches nothing when it is listed
+            walk(w, next);
+        } else if (*next ? stat(w->path, &st) == 0 && S_ISDIR(st.st_mode) : lstat(w->path, &st) == 0) {
+            // The last component must exist (as a directory if a slash follows)
+            walk(w, next);
+        }
+        path_truncate(w, base);
+        return;
+    }
+
+    char *component = strndup(rest, len);
+    if (!component) {
+        w->failed = 1;
+        return;
+    }
+    if (strcmp(component, "**") == 0) {
+        walk_globstar(w, next);
+    } else {
+        // Listings are sorted, so only names starting with the pattern's
+        // literal prefix are tried
+        const Listing *l = get_listing(w->path ? w->path : "");
+        size_t prefix = strcspn(component, "*?[\\");
+        for (size_t i = l ? lower_bound(l, component, prefix) : 0; l && i < l->count && !w->failed; i++) {
+            const ListingEntry *entry = &l->entries[i];
+            if (strncmp(entry->name, component, prefix) != 0) break;
+            // A leading '.' is only matched by one in the pattern
+            if (fnmatch(component, entry->name, FNM_PERIOD) != 0) continue;
+            if (path_append(w, entry->name, strlen(entry->name)) != 0) break;
+            if (!*next || is_directory(w, entry, 1)) walk(w, next);
+            path_truncate(w, dir_len);
+        }
+    }
+    free(component);
+    path_truncate(w, base);
+}
+
+/**
+ * Orders matched paths
+ */
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+int glob_has_pattern(const char *pattern, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = pattern[i];
+        if (c == '\\') {
+            i++;
+        } else if (c == '*' || c == '?') {
+            return 1;
+        } else if (c == '[' && i + 2 < len && memchr(pattern + i + 2, ']', len - i - 2)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int path_glob(const char *pattern, GlobMatchFn fn, void *ctx) {
+    Walk w;
+    memset(&w, 0, sizeof(w));
+    if (listing_count > MAX_CACHED_LISTINGS) drop_listings();
+    walk_count++;
+    walk(&w, pattern);
+
+    int status = w.failed ? -1 : (int)w.count;
+    if (status > 0) {
+        qsort(w.matches, w.count, sizeof(char *), compare_paths);
+    }
+    for (size_t i = 0; i < w.count; i++) {
+        if (status >= 0 && fn(w.matches[i], ctx) != 0) status = -1;
+        free(w.matches[i]);
+    }
+    free(w.matches);
+    free(w.path);
+    return status;
+}
+
+void path_glob_set_cache(int enabled) {
+    cache_enabled = enabled;
+}
+
+void path_glob_free(void) {
+    drop_listings();
+    free(buckets);
+    buckets = NULL;
+    bucket_count = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef PATHGLOB_H
+#define PATHGLOB_H
+
+/**
+ * Pathname expansion (globbing)
+ * A pattern is matched one '/'-separated component at a time: `*`, `?`
+ * and `[...]` match within a component (as fnmatch(3) does, so a leading
+ * '.' must be matched explicitly and a backslash makes the next character
+ * literal), and a component that is exactly `**` matches any number of
+ * directories, symlinks not followed. Directory listings are cached,
+ * keyed on the directory's path and checked against its mtime, so a
+ * script globbing the same large directory again only pays for a stat.
+ */
+
+/**
+ * Receives each path a pattern matched, in sorted order
+ * @param path - Matched path (only valid during the call)
+ * @param ctx - Caller's context
+ * @return 0 to go on, -1 to stop (path_glob then fails)
+ */
+typedef int (*GlobMatchFn)(const char *path, void *ctx);
+
+/**
+ * Checks whether a word has anything to expand: an unescaped `*` or `?`,
+ * or a `[` closed by a later `]`
+ * @param pattern - Word to check
+ * @param len - Its length
+ * @return 1 if it does, 0 otherwise
+ */
+int glob_has_pattern(const char *pattern, size_t len);
+
+/**
+ * Expands a pattern to the paths that match it
+ * @param pattern - Pattern to expand
+ * @param fn - Called for every match, in sorted order
+ * @param ctx - Passed to fn
+ * @return Number of matches, or -1 on allocation failure or if fn failed
+ */
+int path_glob(const char *pattern, GlobMatchFn fn, void *ctx);
+
+/**
+ * Turns the directory-listing cache on or off (it starts on)
+ * With the cache off, every directory is read again on every use.
+ * @param enabled - Whether to keep listings between expansions
+ */
+void path_glob_set_cache(int enabled);
+
+/**
+ * Frees every cached listing
+ */
+void path_glob_free(void);
+
+#endif
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pathhash.h"
+
+/* Constants */
+#define INITIAL_BUCKET_COUNT 64
+
+/**
+ * One remembered command
+ */
+typedef struct PathEntry {
+    char *name;               // Command name as typed
+    char *path;               // Resolved executable path
+    unsigned long hits;       // Number of times the entry was used
+    struct PathEntry *next;   // Next entry in the same bucket
+} PathEntry;
+
+static PathEntry **buckets = NULL;   // Bucket array (chained hashing)
+static size_t bucket_count = 0;      // Number of buckets
+static size_t entry_count = 0;       // Number of stored entries
+static char *cached_path_var = NULL; // Copy of $PATH the entries were resolved against
+static char *default_path_var = NULL; // confstr(_CS_PATH), searched when $PATH is unset
+static char *searched_path = NULL;    // Last result of path_hash_search
+static PathSource path_source = NULL; // Reads $PATH, or NULL for getenv
+
+/**
+ * FNV-1a hash of a command name
+ * @param s - String to hash
+ * @return Hash value
+ */
+static unsigned long hash_name(const char *s) {
+    unsigned long h = 2166136261UL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+/**
+ * Frees every entry but keeps the bucket array
+ */
+static void drop_entries(void) {
+    for (size_t i = 0; i < bucket_count; i++) {
+        PathEntry *e = buckets[i];
+        while (e) {
+            PathEntry *next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            e = next;
+        }
+        buckets[i] = NULL;
+    }
+    entry_count = 0;
+}
+
+/**
+ * @return The search path execvp uses when $PATH is unset (the system's
+ *         default, from confstr)
+ */
+static const char* default_path(void) {
+    if (!default_path_var) {
+        size_t size = confstr(_CS_PATH, NULL, 0);
+        default_path_var = size > 0 ? malloc(size) : NULL;
+        if (!default_path_var) return "/bin:/usr/bin";
+        confstr(_CS_PATH, default_path_var, size);
+    }
+    return default_path_var;
+}
+
+/**
+ * Drops the cache if $PATH differs from the value it was built against
+ */
+static void check_path_changed(void) {
+    const char *current = path_source ? path_source() : getenv("PATH");
+    if (current == NULL) current = default_path();
+    if (cached_path_var && strcmp(cached_path_var, current) == 0) {
+        return;
+    }
+    drop_entries();
+    free(cached_path_var);
+    cached_path_var = strdup(current);
+}
+
+/**
+ * Doubles the bucket array once the load factor passes 1
+ * @return 0 on success, -1 on allocation failure
+ */
+static int ensure_capacity(void) {
+    if (buckets && entry_count < bucket_count) return 0;
+
+    size_t new_count = bucket_count ? bucket_count * 2 : INITIAL_BUCKET_COUNT;
+    PathEntry **new_buckets = calloc(new_count, sizeof(PathEntry *));
+    if (!new_buckets) return -1;
+
+    // Rehash existing entries into the new buckets
+    for (size_t i = 0; i < bucket_count; i++) {
+        PathEntry *e = buckets[i];
+        while (e) {
+            PathEntry *next = e->next;
+            size_t b = hash_name(e->name) & (new_count - 1);
+            e->next = new_buckets[b];
+            new_buckets[b] = e;
+            e = next;
+        }
+    }
+    free(buckets);
+    buckets = new_buckets;
+    bucket_count = new_count;
+    return 0;
+}
+
+/**
+ * Finds the entry for a name
+ * @param name - Command name
+ * @return Matching entry or NULL
+ */
+static PathEntry* find_entry(const char *name) {
+    if (!buckets) return NULL;
+    PathEntry *e = buckets[hash_name(name) & (bucket_count - 1)];
+    while (e && strcmp(e->name, name) != 0) {
+        e = e->next;
+    }
+    return e;
+}
+
+/**
+ * Inserts or replaces the path stored for a name
+ * @param name - Command name
+ * @param path - Resolved path (copied)
+ * @return The stored entry or NULL on allocation failure
+ */
+static PathEntry* store_entry(const char *name, const char *path) {
+    PathEntry *e = find_entry(name);
+    char *path_copy = strdup(path);
+    if (!path_copy) return NULL;
+
+    if (e) {
+        free(e->path);
+        e->path = path_copy;
+        return e;
+    }
+
+    if (ensure_capacity() != 0) {
+        free(path_copy);
+        return NULL;
+    }
+    e = malloc(sizeof(PathEntry));
+    if (!e || !(e->name = strdup(name))) {
+        free(e);
+        free(path_copy);
+        return NULL;
+    }
+    e->path = path_copy;
+    e->hits = 0;
+
+    size_t b = hash_name(name) & (bucket_count - 1);
+    e->next = buckets[b];
+    buckets[b] = e;
+    entry_count++;
+    return e;
+}
+
+/**
+ * Walks a search path looking for an executable regular file called name
+ * @param name - Command name (must not contain '/')
+ * @param dirs - Colon-separated directories
+ * @return Newly allocated full path or NULL if not found
+ */
+static char* search_dirs(const char *name, const char *dirs) {
+    size_t name_len = strlen(name);
+    struct stat st;
+
+    while (dirs) {
+        const char *sep = strchr(dirs, ':');
+        size_t dir_len = sep ? (size_t)(sep - dirs) : strlen(dirs);
+
+        // An empty $PATH element means the current directory
+        char *candidate = malloc(dir_len + name_len + 3);
+        if (!candidate) return NULL;
+        if (dir_len == 0) {
+            strcpy(candidate, ".");
+        } else {
+            memcpy(candidate, dirs, dir_len);
+            candidate[dir_len] = '\0';
+        }
+        strcat(candidate, "/");
+        strcat(candidate, name);
+
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+            access(candidate, X_OK) == 0) {
+            return candidate;
+        }
+        free(candidate);
+        dirs = sep ? sep + 1 : NULL;
+    }
+    return NULL;
+}
+
+/**
+ * Walks $PATH looking for an executable regular file called name
+ * @param name - Command name (must not contain '/')
+ * @return Newly allocated full path or NULL if not found
+ */
+static char* search_path(const char *name) {
+    return search_dirs(name, cached_path_var);
+}
+
+void path_hash_set_source(PathSource source) {
+    path_source = source;
+}
+
+const char* path_hash_lookup(const char *name) {
+    if (!name || name[0] == '\0') return NULL;
+    if (strchr(name, '/')) return name;
+
+    check_path_changed();
+    PathEntry *e = find_entry(name);
+    if (!e) {
+        char *path = search_path(name);
+        if (!path) return NULL;
+        e = store_entry(name, path);
+        free(path);
+        if (!e) return NULL;
+    }
+    e->hits++;
+    return e->path;
+}
+
+const char* path_hash_search(const char *name, const char *path) {
+    if (!name || name[0] == '\0') return NULL;
+    if (strchr(name, '/')) return name;
+
+    free(searched_path);
+    searched_path = search_dirs(name, path ? path : default_path());
+    return searched_path;
+}
+
+int path_hash_add(const char *name) {
+    if (!name || strchr(name, '/')) return -1;
+
+    check_path_changed();
+    char *path = search_path(name);
+    if (!path) return -1;
+    PathEntry *e = store_entry(name, path);
+    free(path);
+    return e ? 0 : -1;
+}
+
+int path_hash_set(const char *name, const char *path) {
+    check_path_changed();
+    return store_entry(name, path) ? 0 : -1;
+}
+
+int path_hash_remove(const char *name) {
+    if (!buckets) return -1;
+    PathEntry **link = &buckets[hash_name(name) & (bucket_count - 1)];
+    while (*link) {
+        PathEntry *e = *link;
+        if (strcmp(e->name, name) == 0) {
+            *link = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            entry_count--;
+            return 0;
+        }
+        link = &e->next;
+    }
+    return -1;
+}
+
+void path_hash_print(FILE *out) {
+    check_path_changed();
+    if (entry_count == 0) {
+        fprintf(out, "hash: hash table empty\n");
+        return;
+    }
+    fprintf(out, "hits\tcommand\n");
+    for (size_t i = 0; i < bucket_count; i++) {
+        for (PathEntry *e = buckets[i]; e; e = e->next) {
+            fprintf(out, "%4lu\t%s\n", e->hits, e->path);
+        }
+    }
+}
+
+void path_hash_clear(void) {
+    drop_entries();
+}
+
+void path_hash_free(void) {
+    drop_entries();
+    free(buckets);
+    buckets = NULL;
+    bucket_count = 0;
+    free(cached_path_var);
+    cached_path_var = NULL;
+    free(default_path_var);
+    default_path_var = NULL;
+    free(searched_path);
+    searched_path = NULL;
+}
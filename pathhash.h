@@ -0,0 +1,84 @@
+#ifndef PATHHASH_H
+#define PATHHASH_H
+
+#include <stdio.h>
+
+/**
+ * Command-path hash table (like bash's `hash`)
+ * Maps a bare command name to the absolute path found on $PATH so that
+ * repeated spawns of the same command skip the $PATH walk. The whole table
+ * is dropped automatically whenever $PATH changes; with $PATH unset, the
+ * system's default search path is used, as execvp does.
+ */
+
+/**
+ * Reads the search path the table is built against
+ * @return $PATH, or NULL if it is unset
+ */
+typedef const char* (*PathSource)(void);
+
+/**
+ * Makes the table read $PATH from somewhere other than the environment,
+ * such as the shell's variables (exported or not)
+ * @param source - Reads the search path, or NULL for getenv
+ */
+void path_hash_set_source(PathSource source);
+
+/**
+ * Resolves a command name to an executable path, consulting the cache first
+ * Names containing a '/' are returned unchanged and never cached.
+ * Every successful call counts as one hit for the entry.
+ * @param name - Command name as typed by the user
+ * @return Path to execute (owned by the table) or NULL if not found
+ */
+const char* path_hash_lookup(const char *name);
+
+/**
+ * Resolves a command on a search path of its own, bypassing the table
+ * (for a command run with a PATH=... prefix)
+ * @param name - Command name as typed by the user
+ * @param path - Search path, or NULL for the system's default
+ * @return Path to execute (owned by the table, valid until the next
+ *         search) or NULL if not found
+ */
+const char* path_hash_search(const char *name, const char *path);
+
+/**
+ * Resolves a command on $PATH and remembers it without counting a hit
+ * @param name - Command name to resolve
+ * @return 0 on success, -1 if the command could not be found
+ */
+int path_hash_add(const char *name);
+
+/**
+ * Remembers an explicit path for a command name (hash -p path name)
+ * @param name - Command name
+ * @param path - Path to use for the command
+ * @return 0 on success, -1 on allocation failure
+ */
+int path_hash_set(const char *name, const char *path);
+
+/**
+ * Forgets a single command name
+ * @param name - Command name to remove
+ * @return 0 if it was present, -1 otherwise
+ */
+int path_hash_remove(const char *name);
+
+/**
+ * Prints every remembered command with its hit count
+ * @param out - Stream to print to
+ */
+void path_hash_print(FILE *out);
+
+/**
+ * Forgets every remembered command (hash -r)
+ */
+void path_hash_clear(void);
+
+/**
+ * Frees all memory held by the table
+ */
+void path_hash_free(void);
+
+#endif
@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "pipetune.h"
+
+/* Constants */
+#define PIPE_MAX_SIZE_FILE "/proc/sys/fs/pipe-max-size"  // Largest size others may ask for
+#define IOPRIO_CLASS_BE 2        // I/O priority classes, as ioprio_set(2) takes them
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_BE_LEVELS 8
+
+static PipeTuning defaults = {-1, {0}, 0, {0}, 0, {0}, 0};
+
+void pipe_tuning_init(PipeTuning *t) {
+    t->buffer_size = -1;
+    t->cpu_count = 0;
+    t->nice_count = 0;
+    t->ioprio_count = 0;
+}
+
+PipeTuning* pipe_tuning_defaults(void) {
+    return &defaults;
+}
+
+/**
+ * Parses a whole decimal number
+ * @param text - Text to parse
+ * @param min - Smallest value allowed
+ * @param max - Largest value allowed
+ * @param value - Receives the number
+ * @return 0 on success, -1 if the text is not a number in range
+ */
+static int parse_int(const char *text, long min, long max, int *value) {
+    char *end;
+    errno = 0;
+    long n = strtol(text, &end, 10);
+    if (errno || end == text || *end || n < min || n > max) return -1;
+    *value = (int)n;
+    return 0;
+}
+
+/**
+ * Parses a buffer size, checked against the limit the kernel enforces
+ * on unprivileged processes
+ * @param text - Size, with an optional K or M suffix
+ * @param size - Receives the size in bytes
+ * @return 0 on success, -1 if the size is malformed or too large
+ */
+static int parse_size(const char *text, int *size) {
+    char *end;
+    errno = 0;
+    long long n = strtoll(text, &end, 10);
+    if (errno || end == text || n < 0) return -1;
+    if (*end == 'K' || *end == 'k') {
+        n *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        n *= 1024 * 1024;
+        end++;
+    }
+    if (*end || n > INT_MAX) return -1;
+
+    FILE *f = geteuid() != 0 ? fopen(PIPE_MAX_SIZE_FILE, "r") : NULL;
+    if (f) {
+        long long max;
+        int known = fscanf(f, "%lld", &max) == 1;
+        fclose(f);
+        if (known && n > max) return -1;
+    }
+    *size = (int)n;
+    return 0;
+}
+
+/**
+ * Parses one entry of a per-stage list
+ * @param option - Option letter the list belongs to
+ * @param text - Entry
+ * @param value - Receives the value
+ * @return 0 on success, -1 if the entry is not valid for the option
+ */
+static int parse_entry(char option, const char *text, int *value) {
+    if (strcmp(text, "-") == 0) {
+        *value = PIPE_TUNE_KEEP;
+        return 0;
+    }
+    switch (option) {
+    case 'a':
+        if (strcmp(text, "auto") == 0) {
+            *value = PIPE_TUNE_SPREAD;
+            return 0;
+        }
+        return parse_int(text, 0, CPU_SETSIZE - 1, value);
+    case 'n':
+        return parse_int(text, -20, 19, value);
+    default:
+        if (strcmp(text, "idle") == 0) {
+            *value = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+            return 0;
+        }
+        if (parse_int(text, 0, IOPRIO_BE_LEVELS - 1, value) != 0) return -1;
+        *value |= IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT;
+        return 0;
+    }
+}
+
+/**
+ * Parses a comma-separated per-stage list
+ * @param option - Option letter the list belongs to
+ * @param text - List
+ * @param values - Receives the entries
+ * @param count - Receives the number of entries
+ * @return 0 on success, -1 if an entry is bad or there are too many
+ */
+static int parse_list(char option, const char *text, int *values, int *count) {
+    int parsed[PIPE_TUNE_STAGES];   // The old list stays if this one is bad
+    char entry[32];
+    int n = 0;
+    while (1) {
+        size_t len = strcspn(text, ",");
+        if (len == 0 || len >= sizeof(entry) || n == PIPE_TUNE_STAGES) return -1;
+        memcpy(entry, text, len);
+        entry[len] = '\0';
+        if (parse_entry(option, entry, &parsed[n++]) != 0) return -1;
+        if (text[len] == '\0') break;
+        text += len + 1;
+    }
+    memcpy(values, parsed, n * sizeof(int));
+    *count = n;
+    return 0;
+}
+
+int pipe_tuning_option(PipeTuning *t, const char *option, const char *value, const char *who) {
+    int status;
+    if (strcmp(option, "-b") == 0) {
+        status = parse_size(value, &t->buffer_size);
+    } else if (strcmp(option, "-a") == 0) {
+        status = parse_list('a', value, t->cpus, &t->cpu_count);
+    } else if (strcmp(option, "-n") == 0) {
+        status = parse_list('n', value, t->nices, &t->nice_count);
+    } else if (strcmp(option, "-i") == 0) {
+        status = parse_list('i', value, t->ioprios, &t->ioprio_count);
+    } else {
+        if (who) {
+            fflush(stdout);
+            fprintf(stderr, "%s: unknown option: %s (use -b, -a, -n or -i)\n", who, option);
+        }
+        return -1;
+    }
+    if (status != 0 && who) {
+        fflush(stdout);
+        fprintf(stderr, "%s: bad value for %s: %s\n", who, option, value);
+    }
+    return status;
+}
+
+void pipe_tuning_merge(PipeTuning *t, const PipeTuning *over) {
+    if (over->buffer_size >= 0) {
+        t->buffer_size = over->buffer_size;
+    }
+    if (over->cpu_count > 0) {
+        memcpy(t->cpus, over->cpus, over->cpu_count * sizeof(int));
+        t->cpu_count = over->cpu_count;
+    }
+    if (over->nice_count > 0) {
+        memcpy(t->nices, over->nices, over->nice_count * sizeof(int));
+        t->nice_count = over->nice_count;
+    }
+    if (over->ioprio_count > 0) {
+        memcpy(t->ioprios, over->ioprios, over->ioprio_count * sizeof(int));
+        t->ioprio_count = over->ioprio_count;
+    }
+}
+
+void pipe_tuning_size(const PipeTuning *t, int fd) {
+    if (t->buffer_size > 0 && fcntl(fd, F_SETPIPE_SZ, t->buffer_size) < 0) {
+        fprintf(stderr, "pipe: buffer size %d: %s\n", t->buffer_size, strerror(errno));
+    }
+}
+
+/**
+ * @param values - Per-stage list
+ * @param count - Number of entries (at least 1)
+ * @param stage - Stage of the pipeline
+ * @return The stage's entry: its own, or the last one
+ */
+static int stage_value(const int *values, int count, int stage) {
+    return values[stage < count ? stage : count - 1];
+}
+
+/**
+ * Picks the CPU `auto` gives a stage: the next one the shell may run on
+ * @param stage - Stage of the pipeline
+ * @return CPU number, or -1 if the shell's affinity is unknown
+ */
+static int spread_cpu(int stage) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+    int index = stage % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && index-- == 0) return cpu;
+    }
+    return -1;
+}
+
+void pipe_tuning_stage(const PipeTuning *t, int stage, LaunchSpec *spec) {
+    if (t->cpu_count > 0) {
+        int cpu = stage_value(t->cpus, t->cpu_count, stage);
+        if (cpu == PIPE_TUNE_SPREAD) {
+            cpu = spread_cpu(stage);
+        }
+        if (cpu >= 0) spec->cpu = cpu;
+    }
+    if (t->nice_count > 0) {
+        int nice = stage_value(t->nices, t->nice_count, stage);
+        if (nice != PIPE_TUNE_KEEP) spec->nice = nice;
+    }
+    if (t->ioprio_count > 0) {
+        int ioprio = stage_value(t->ioprios, t->ioprio_count, stage);
+        if (ioprio != PIPE_TUNE_KEEP) spec->ioprio = ioprio;
+    }
+}
+
+/**
+ * Prints one per-stage list, or `off` if it is empty
+ * @param name - Label of the line
+ * @param option - Option letter the list belongs to
+ * @param values - Entries
+ * @param count - Number of entries
+ */
+static void print_list(const char *name, char option, const int *values, int count) {
+    printf("%s\t", name);
+    if (count == 0) {
+        printf("off");
+    }
+    for (int i = 0; i < count; i++) {
+        if (i > 0) putchar(',');
+        if (values[i] == PIPE_TUNE_KEEP) {
+            putchar('-');
+        } else if (option == 'a' && values[i] == PIPE_TUNE_SPREAD) {
+            printf("auto");
+        } else if (option == 'i' && values[i] >> IOPRIO_CLASS_SHIFT == IOPRIO_CLASS_IDLE) {
+            printf("idle");
+        } else {
+            printf("%d", option == 'i' ? values[i] & ((1 << IOPRIO_CLASS_SHIFT) - 1) : values[i]);
+        }
+    }
+    putchar('\n');
+}
+
+void pipe_tuning_print(const PipeTuning *t) {
+    if (t->buffer_size > 0) {
+        printf("buffer\t%d\n", t->buffer_size);
+    } else {
+        printf("buffer\tdefault\n");
+    }
+    print_list("cpu", 'a', t->cpus, t->cpu_count);
+    print_list("nice", 'n', t->nices, t->nice_count);
+    print_list("ioprio", 'i', t->ioprios, t->ioprio_count);
+}
@@ -0,0 +1,91 @@
+#ifndef PIPETUNE_H
+#define PIPETUNE_H
+
+#include <limits.h>
+#include <sys/types.h>
+
+#include "spawn.h"
+
+/**
+ * Pipeline tuning: pipe buffer size, CPU pinning, nice value and I/O
+ * priority of the stages
+ * `pipeconf` sets the defaults every pipeline of two or more stages gets;
+ * a pipeline prefixed with `pipe OPTIONS` overrides them. The options:
+ *   -b SIZE   Pipe buffer size in bytes (K and M suffixes), 0 for the
+ *             system's default (64 KiB on Linux)
+ *   -a LIST   CPU of each stage, or `auto` for the next CPU the shell may
+ *             use, so neighbouring stages do not share one
+ *   -n LIST   Nice value of each stage (-20 to 19)
+ *   -i LIST   I/O priority of each stage: `idle`, or a best-effort level
+ *             from 0 (highest) to 7
+ * A LIST is comma-separated values for the stages from the left, the last
+ * also holding for the stages after it; `-` leaves a stage alone. Each
+ * stage applies its settings itself before it runs its program.
+ */
+
+/* Constants */
+#define PIPE_TUNE_STAGES 16      // Most stages a list can name
+#define PIPE_TUNE_KEEP INT_MIN   // List entry for a stage left alone
+#define PIPE_TUNE_SPREAD -2      // CPU entry for `auto`
+
+typedef struct PipeTuning {
+    int buffer_size;                 // Bytes for every pipe, 0 for the system's
+                                     // default, -1 to inherit
+    int cpus[PIPE_TUNE_STAGES];      // CPU of each stage
+    int cpu_count;                   // Number of entries (0 to inherit)
+    int nices[PIPE_TUNE_STAGES];     // Nice value of each stage
+    int nice_count;
+    int ioprios[PIPE_TUNE_STAGES];   // I/O priority of each stage, as ioprio_set(2) takes it
+    int ioprio_count;
+} PipeTuning;
+
+/**
+ * Sets every option to inherit
+ * @param t - Settings to clear
+ */
+void pipe_tuning_init(PipeTuning *t);
+
+/**
+ * Parses one option into a set of settings
+ * @param t - Settings to change
+ * @param option - Option, such as "-b"
+ * @param value - Its value
+ * @param who - Name errors are reported under, or NULL not to report them
+ * @return 0 on success, -1 for an unknown option or a bad value
+ */
+int pipe_tuning_option(PipeTuning *t, const char *option, const char *value, const char *who);
+
+/**
+ * @return The settings every pipeline starts from
+ */
+PipeTuning* pipe_tuning_defaults(void);
+
+/**
+ * Overrides settings with those another set does not inherit
+ * @param t - Settings to change
+ * @param over - Settings that take precedence
+ */
+void pipe_tuning_merge(PipeTuning *t, const PipeTuning *over);
+
+/**
+ * Sizes a pipe's buffer; failures are reported, the pipe stays usable
+ * @param t - Settings to apply
+ * @param fd - Either end of the pipe
+ */
+void pipe_tuning_size(const PipeTuning *t, int fd);
+
+/**
+ * Puts a stage's CPU, nice value and I/O priority into its launch spec
+ * @param t - Settings to apply
+ * @param stage - Stage of the pipeline, from 0
+ * @param spec - Spec the stage is launched with
+ */
+void pipe_tuning_stage(const PipeTuning *t, int stage, LaunchSpec *spec);
+
+/**
+ * Prints settings as `pipeconf` shows them, one option per line
+ * @param t - Settings to print
+ */
+void pipe_tuning_print(const PipeTuning *t);
+
+#endif
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "linereader.h"
+#include "scriptcache.h"
+
+/* Constants */
+#define MAX_CACHED_SCRIPTS 32    // Scripts kept before the oldest is dropped
+
+static CompiledScript *scripts = NULL;   // Most recently used first
+static int script_count = 0;
+
+/**
+ * Frees a script and everything it owns
+ * @param script - Script to free
+ */
+static void free_script(CompiledScript *script) {
+    arena_free(&script->arena);
+    free(script->path);
+    free(script);
+}
+
+/**
+ * Removes a script from the list, freeing it unless it is still running
+ * @param link - Link that points at the script
+ */
+static void drop_script(CompiledScript **link) {
+    CompiledScript *script = *link;
+    *link = script->next;
+    script_count--;
+    if (script->refs > 0) {
+        script->stale = 1;   // The last release frees it
+    } else {
+        free_script(script);
+    }
+}
+
+/**
+ * Checks whether a cached script still matches the file on disk
+ * @param script - Cached script
+ * @param st - Fresh stat of the file
+ * @return 1 if it is current, 0 otherwise
+ */
+static int is_current(const CompiledScript *script, const struct stat *st) {
+    return script->dev == st->st_dev && script->ino == st->st_ino &&
+           script->size == st->st_size &&
+           script->mtime.tv_sec == st->st_mtim.tv_sec &&
+           script->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/**
+ * Lexes and parses a whole script
+ * @param path - Path of the script
+ * @param st - Stat of the file
+ * @return Compiled script or NULL if it cannot be read or does not parse
+ */
+static CompiledScript* compile_script(const char *path, const struct stat *st) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    CompiledScript *script = calloc(1, sizeof(CompiledScript));
+    LineReader reader;
+    if (!script || !(script->path = strdup(path)) || line_reader_init(&reader, fd) != 0) {
+        if (script) free(script->path);
+        free(script);
+        close(fd);
+        return NULL;
+    }
+    arena_init(&script->arena);
+    script->dev = st->st_dev;
+    script->ino = st->st_ino;
+    script->size = st->st_size;
+    script->mtime = st->st_mtim;
+
+    int capacity = 0;
+    int ok = 1;
+    char *line;
+    size_t len;
+    while (ok && (line = line_reader_next(&reader, &len)) != NULL) {
+        if (len == 0) continue;
+
+        // Grow the line table (kept in malloc'd memory until the end)
+        if (script->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            CompiledLine *bigger = realloc(script->lines, capacity * sizeof(CompiledLine));
+            if (!bigger) {
+                ok = 0;
+                break;
+            }
+            script->lines = bigger;
+        }
+        // A compound command spanning several lines becomes one entry
+        // A script that does not parse is run line by line, which reports
+        // its errors where they are, so they are not reported here
+        CompiledLine *compiled = &script->lines[script->count];
+        parse_set_quiet(1);
+        ok = parse_input(&script->arena, line, &reader, NULL, &compiled->seq, &compiled->text) == 0;
+        parse_set_quiet(0);
+        script->count++;
+    }
+    line_reader_free(&reader);
+    close(fd);
+
+    if (ok && script->count > 0) {
+        // Move the line table into the arena so the script is one allocation chain
+        CompiledLine *lines = arena_alloc(&script->arena, script->count * sizeof(CompiledLine));
+        if (lines) {
+            memcpy(lines, script->lines, script->count * sizeof(CompiledLine));
+        }
+        free(script->lines);
+        script->lines = lines;
+        ok = lines != NULL;
+    } else {
+        free(script->lines);
+        script->lines = NULL;
+    }
+
+    if (!ok) {
+        free_script(script);
+        return NULL;
+    }
+    return script;
+}
+
+CompiledScript* script_cache_acquire(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return NULL;
+
+    // Look for a current copy, dropping an outdated one
+    for (CompiledScript **link = &scripts; *link; link = &(*link)->next) {
+        CompiledScript *script = *link;
+        if (strcmp(script->path, path) != 0) continue;
+        if (is_current(script, &st)) {
+            // Move to the front of the list
+            *link = script->next;
+            script->next = scripts;
+            scripts = script;
+            script->refs++;
+            return script;
+        }
+        drop_script(link);
+        break;
+    }
+
+    CompiledScript *script = compile_script(path, &st);
+    if (!script) return NULL;
+
+    // Evict the least recently used script when the cache is full
+    if (script_count >= MAX_CACHED_SCRIPTS) {
+        CompiledScript **link = &scripts;
+        while ((*link)->next) link = &(*link)->next;
+        drop_script(link);
+    }
+    script->next = scripts;
+    scripts = script;
+    script_count++;
+    script->refs++;
+    return script;
+}
+
+void script_cache_release(CompiledScript *script) {
+    script->refs--;
+    if (script->refs == 0 && script->stale) {
+        free_script(script);
+    }
+}
+
+void script_cache_free(void) {
+    CompiledScript **link = &scripts;
+    while (*link) {
+        drop_script(link);
+    }
+}
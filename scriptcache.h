@@ -0,0 +1,57 @@
+#ifndef SCRIPTCACHE_H
+#define SCRIPTCACHE_H
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "arena.h"
+#include "parser.h"
+
+/**
+ * Cache of compiled scripts for `source`
+ * A script is lexed and parsed once into an AST that is kept, keyed by its
+ * path and validated against the file's identity, size and mtime. Sourcing
+ * an unchanged script again costs one stat() and no lexing or parsing.
+ */
+
+typedef struct {
+    const char *text;         // Source text of the line (for prev)
+    Sequence seq;             // Parsed line
+} CompiledLine;
+
+typedef struct CompiledScript {
+    char *path;               // Path the script was sourced by
+    dev_t dev;                // Identity and version of the file
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    Arena arena;              // Holds the line text and the AST
+    CompiledLine *lines;      // Non-empty lines in file order (the lines of
+                              // a compound command joined into one)
+    int count;
+    int refs;                 // Number of `source` calls running the script
+    int stale;                // Replaced by a newer version; free when unused
+    struct CompiledScript *next;
+} CompiledScript;
+
+/**
+ * Returns the compiled form of a script, compiling it if it is not cached
+ * or the file changed. Only regular files that parse cleanly are cached.
+ * @param path - Path of the script
+ * @return Script to run (release it afterwards), or NULL if the caller
+ *         should fall back to reading the file line by line
+ */
+CompiledScript* script_cache_acquire(const char *path);
+
+/**
+ * Marks a script returned by script_cache_acquire as no longer running
+ * @param script - Script to release
+ */
+void script_cache_release(CompiledScript *script);
+
+/**
+ * Frees every cached script that is not running
+ */
+void script_cache_free(void);
+
+#endif
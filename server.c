@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "server.h"
+
+/* Constants */
+#define LISTEN_BACKLOG 128    // Connections the kernel queues while every worker is busy
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * Notes that the server should stop
+ * @param sig - Signal received (unused)
+ */
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+/**
+ * Creates the listening socket, replacing a stale one at path; anything
+ * else already there is left alone
+ * @param path - Path of the socket
+ * @return Listening descriptor (close-on-exec), or -1 (reported)
+ */
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "server: socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "server: %s exists and is not a socket\n", path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("server: socket");
+        return -1;
+    }
+    unlink(path);  // Only a socket (or nothing) is there
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, LISTEN_BACKLOG) != 0) {
+        fprintf(stderr, "server: cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Forks a worker that waits for one connection
+ * @param listen_fd - Listening socket
+ * @param conn - Receives the connection, in the worker
+ * @return Pid of the worker in the server, 0 in the worker, -1 on failure
+ */
+static pid_t start_worker(int listen_fd, int *conn) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid < 0) perror("server: fork");
+        return pid;
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    do {
+        *conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    } while (*conn < 0 && (errno == EINTR || errno == ECONNABORTED));
+    if (*conn < 0) {
+        perror("server: accept");
+        _exit(1);
+    }
+    close(listen_fd);
+    return 0;
+}
+
+int server_run(const char *path, int workers) {
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    pid_t *pids = calloc(workers, sizeof(pid_t));
+    if (!pids) {
+        fprintf(stderr, "server: Memory allocation failed\n");
+        return -1;
+    }
+    int listen_fd = listen_on(path);
+    if (listen_fd < 0) {
+        free(pids);
+        return -1;
+    }
+
+    // No SA_RESTART, so waitpid returns when a stop is asked for
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_stop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (!stop_requested) {
+        // Top the pool up: at start, and whenever a session has ended
+        for (int i = 0; i < workers && !stop_requested; i++) {
+            if (pids[i] > 0) continue;
+            int conn;
+            pids[i] = start_worker(listen_fd, &conn);
+            if (pids[i] == 0) {
+                free(pids);
+                return conn;
+            }
+        }
+        int raw;
+        pid_t done = waitpid(-1, &raw, 0);
+        if (done < 0 && errno == ECHILD) {
+            // Every fork failed; try again shortly
+            sleep(1);
+        }
+        for (int i = 0; done > 0 && i < workers; i++) {
+            if (pids[i] == done) pids[i] = 0;
+        }
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) kill(pids[i], SIGTERM);
+    }
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) waitpid(pids[i], NULL, 0);
+    }
+    close(listen_fd);
+    unlink(path);
+    free(pids);
+    return SERVER_STOPPED;
+}
@@ -0,0 +1,33 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/**
+ * Server mode: many short sessions without paying for a shell each time
+ * The server listens on a Unix domain socket and keeps a pool of forked
+ * workers blocked in accept(). A worker takes one connection, runs the
+ * session (the client's bytes are its script, its output goes back over
+ * the socket) and exits; the server forks a replacement right away, so
+ * the fork is paid between sessions rather than during one. Every session
+ * is a process of its own: cd, variables, history and jobs never leak
+ * into the next one, and nothing is shared but the listening socket.
+ *
+ * A client writes its commands, shuts down its side for writing and reads
+ * until the server closes the connection.
+ */
+
+#define SERVER_STOPPED (-2)    // server_run's result in the server once it stops
+
+/**
+ * Listens on a socket and keeps a pool of workers waiting for sessions
+ * Returns twice, in a way: in a worker it hands back a connection to
+ * serve; in the server it only returns once SIGINT or SIGTERM stops it
+ * (the workers are stopped and the socket removed).
+ * @param path - Path of the socket (an old one is replaced)
+ * @param workers - Number of workers waiting at once (<= 0: one per CPU)
+ * @return In a worker, the connection's descriptor (close-on-exec); in
+ *         the server, SERVER_STOPPED, or -1 if the socket could not be set
+ *         up (reported)
+ */
+int server_run(const char *path, int workers);
+
+#endif
@@ -2,501 +2,2869 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <unistd.h>
-#include <sys/wait.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/stat.h>
 
-// Global constants
-#define INITIAL_TOKEN_SIZE 64    // Initial size of token array
-#define INITIAL_INPUT_SIZE 256   // Initial size for input buffer
+#include "arena.h"
+#include "builtins.h"
+#include "coproc.h"
+#include "events.h"
+#include "expand.h"
+#include "history.h"
+#include "jobs.h"
+#include "lexer.h"
+#include "linereader.h"
+#include "memo.h"
+#include "parser.h"
+#include "pathhash.h"
+#include "pipetune.h"
+#include "scriptcache.h"
+#include "server.h"
+#include "spawn.h"
+#include "trace.h"
+#include "vars.h"
+#include "zerocopy.h"
+
+extern char **environ;
+
+/* Constants */
+#define BATCH_BUFFER_SIZE (1 << 16)   // stdout buffer when not interactive
+#define HISTORY_FILE ".minishell_history"  // In $HOME, for interactive shells
+#define HISTORY_SEARCH_MAX 1000       // Matches `history -s` prints
+#define CAPTURE_BUFFER_SIZE 4096      // Initial buffer for a command substitution's output
+#define CONTINUATION_PROMPT "> "      // Before further lines of an unfinished command
+#define INTERRUPT_CHECK_MASK 255      // Loops look for Ctrl-C every 256 jumps back
+#define EXEC_HEADROOM 2048            // Bytes of ARG_MAX left unused, as xargs does
+#define MEMO_UNHASHED_INPUT -2        // memo_command_key: stdin is a pipe or terminal
+#define USER_FD_LIMIT 10              // Redirections use 0-9; the shell's own descriptors sit above
 
 // Global variables
-char *last_command = NULL;       // Stores the last executed command
 int first_command = 1;           // Flag to track if the first command is being executed
+Arena line_arena;                // Holds the tokens and AST of the line being processed
+int interactive = 0;             // Whether a user is typing at a terminal
+LineReader *input_reader = NULL; // Where the current line came from (here-document bodies follow it)
+LineReader *prompt_reader = NULL; // Reader the user types into, if any
+int exit_requested = 0;          // Set by the exit builtin; stops every loop running lines
+int last_status = 0;             // Exit status of the last pipeline
+int coproc_shell_fds[2] = {-1, -1}; // Shell's ends of a coprocess being started
+int *last_pipestatus = NULL;     // Stage statuses of the last foreground pipeline
+int last_pipestatus_count = 0;
+int substitution_status = -1;    // Exit status of the last command substitution, or -1
+pid_t shell_pid = 0;             // $$ (also in subshells)
+pid_t last_background_pid = 0;   // $!, or 0 before the first background job
+int server_session = 0;          // Whether this is a server worker serving a client
 
 // Function declarations
-void process_commands(char* input);
-char** tokenize(char* input);
-void execute_command(char** args, char* input_file, char* output_file);
-void execute_pipe(char*** commands, int num_commands, char* input_file, char* output_file);
-void command_help(void);
-void command_cd(char **args);
-void command_source(char *filename);
-void command_prev(void);
-void save_last_command(char *input);
-void cleanup_last_command(void);
-char** allocate_tokens(int size);
-char** resize_tokens(char** tokens, int *size);
+int process_commands(char* input);
+int run_sequence(Sequence* seq);
+int run_program(const Program* program);
+int run_pipeline(Pipeline* pipeline);
+Pipeline* expand_pipeline(Pipeline* pipeline, Pipeline* expanded);
+int run_command(Command* cmd);
+int execute_command(Command* cmd);
+int execute_pipe(Pipeline* pipeline);
+char* read_all(int fd, size_t* len);
+int command_help(char **args);
+int command_cd(char **args);
+int command_source(char **args);
+int command_prev(char **args);
+int command_hash(char **args);
+int command_launcher(char **args);
+int command_pipeconf(char **args);
+int command_memoconf(char **args);
+int command_wait(char **args);
+int command_parallel(Command* cmd);
+int command_exec(Command* cmd);
+int command_forall(char **args);
+int exec_program(Command* cmd);
+int command_enable(char **args);
+int command_trace(char **args);
+int command_times(char **args);
+int command_exit(char **args);
+int command_history(char **args);
+int command_cowrite(char **args);
+int command_coread(char **args);
+int command_coclose(char **args);
+int command_jobs(char **args);
+int command_fg(char **args);
+int command_bg(char **args);
+int command_set(char **args);
+int command_pipestatus(char **args);
+int command_export(char **args);
+int command_unset(char **args);
+int command_break(char **args);
 
 /**
- * Allocates memory for a token array
- * @param size - Initial size of the token array
- * @return Pointer to the allocated token array
+ * A builtin that runs inside the shell process
  */
-char** allocate_tokens(int size) {
-    return (char **)malloc(size * sizeof(char *));
-}
+typedef struct {
+    const char *name;
+    int (*run)(char **args);     // Returns the command's exit status
+    int enabled;                 // Cleared by `enable -n` to use the external program
+} Builtin;
+
+static Builtin builtins[] = {
+    {"help", command_help, 1},
+    {"cd", command_cd, 1},
+    {"source", command_source, 1},
+    {"prev", command_prev, 1},
+    {"history", command_history, 1},
+    {"cowrite", command_cowrite, 1},
+    {"coread", command_coread, 1},
+    {"coclose", command_coclose, 1},
+    {"jobs", command_jobs, 1},
+    {"fg", command_fg, 1},
+    {"bg", command_bg, 1},
+    {"set", command_set, 1},
+    {"pipestatus", command_pipestatus, 1},
+    {"export", command_export, 1},
+    {"unset", command_unset, 1},
+    {"break", command_break, 1},
+    {"continue", command_break, 1},
+    {"hash", command_hash, 1},
+    {"launcher", command_launcher, 1},
+    {"pipeconf", command_pipeconf, 1},
+    {"memoconf", command_memoconf, 1},
+    {"wait", command_wait, 1},
+    {"forall", command_forall, 1},
+    {"enable", command_enable, 1},
+    {"trace", command_trace, 1},
+    {"times", command_times, 1},
+    {"exit", command_exit, 1},
+    // Fast paths for common utilities (see builtins.h)
+    {"echo", builtin_echo, 1},
+    {"true", builtin_true, 1},
+    {"false", builtin_false, 1},
+    {"pwd", builtin_pwd, 1},
+    {"test", builtin_test, 1},
+    {"[", builtin_bracket, 1},
+    {"printf", builtin_printf, 1},
+    {NULL, NULL, 0}
+};
 
 /**
- * Resizes the token array by double previous size when the size limit is reached
- * @param tokens - Existing token array
- * @param size - Pointer to the current size of the array
- * @return Resized token array or NULL on failure
+ * Looks up a builtin by name, including disabled ones
+ * @param name - Command name
+ * @return The builtin or NULL if name is not one
  */
-char** resize_tokens(char** tokens, int *size) {
-    *size *= 2;
-    return (char **)realloc(tokens, (*size) * sizeof(char *));
+Builtin* lookup_builtin(const char *name) {
+    for (int i = 0; builtins[i].name != NULL; i++) {
+        if (strcmp(builtins[i].name, name) == 0) {
+            return &builtins[i];
+        }
+    }
+    return NULL;
 }
 
 /**
- * Tokenizes an input string into an array of tokens
- * Handles quotes, spaces, and special shell characters
- * @param input - Command input string to be tokenized
- * @return Array of tokenized strings or NULL on failure
+ * Looks up an enabled builtin by name
+ * @param name - Command name
+ * @return The builtin or NULL if name is not an enabled builtin
  */
-char** tokenize(char* input) {
-    int token_size = INITIAL_TOKEN_SIZE;
-    char** tokens = allocate_tokens(token_size);
-    int token_count = 0;
-
-    int in_quotes = 0;
-    char buffer[INITIAL_INPUT_SIZE];
-    int buffer_index = 0;
+const Builtin* find_builtin(const char *name) {
+    const Builtin *b = lookup_builtin(name);
+    return b && b->enabled ? b : NULL;
+}
 
-// Loop through each character in the input string
-    for (int i = 0; input[i] != '\0'; i++) {
-        char c = input[i];
+/**
+ * Enables or disables builtins, or lists them
+ * Usage: enable [-n] [name...]
+ * With -n the named builtins are disabled so the external program runs
+ * instead; without names, enabled (or with -n, disabled) builtins are listed.
+ * @param args - Array of arguments
+ * @return 0 on success, 1 if a name is not a builtin
+ */
+int command_enable(char **args) {
+    int disable = args[1] != NULL && strcmp(args[1], "-n") == 0;
+    int first = disable ? 2 : 1;
+    int status = 0;
 
-        // Toggles in/out of quotes mode
-        if (c == '"') {
-            in_quotes = !in_quotes;
-            continue;
+    if (args[first] == NULL) {
+        for (int i = 0; builtins[i].name != NULL; i++) {
+            if (builtins[i].enabled != disable) {
+                printf("enable %s%s\n", disable ? "-n " : "", builtins[i].name);
+            }
         }
-        // If inside quotes, add the character to the buffer
-        if (in_quotes) {
-            buffer[buffer_index++] = c;
+        return 0;
+    }
+    for (int i = first; args[i] != NULL; i++) {
+        Builtin *b = lookup_builtin(args[i]);
+        if (b == NULL || b->run == command_enable) {
+            fprintf(stderr, "enable: %s: not a shell builtin\n", args[i]);
+            status = 1;
             continue;
         }
+        b->enabled = !disable;
+    }
+    return status;
+}
 
-        // Detect special characters like (), <>, |, and ;
-        if (strchr("()<>|;", c)) {
-            // If the buffer contains a token, save it first before handling special char
-            if (buffer_index > 0) {
-                buffer[buffer_index] = '\0';
-                tokens[token_count++] = strdup(buffer);
-                buffer_index = 0;
+/**
+ * Executes the newest history entry again
+ * @param args - Array of arguments (unused)
+ * @return Exit status of the repeated command
+ */
+int command_prev(char **args) {
+    int status = 1;
+    char *command = history_get(history_count());
+    if (command) {
+        status = process_commands(command);
+        free(command);
+    } else {
+        printf("No previous command found.\n");// Inform the user if no command is saved
+    }
+    return status;
+}
 
-                // Resize token array if necessary
-                if (token_count >= token_size) {
-                    tokens = resize_tokens(tokens, &token_size);
-                }
-            }
-            // Handle special character as its own token
-            char special_token[2] = {c, '\0'};
-            tokens[token_count++] = strdup(special_token);
+/**
+ * Lists or searches the command history
+ * Usage: history [n] | history -s text
+ * @param args - Array of arguments
+ * @return 0 on success, 1 if a search found nothing, 2 on bad usage
+ */
+int command_history(char **args) {
+    size_t count = history_count();
 
-            // Resize if necessary
-            if (token_count >= token_size) {
-                tokens = resize_tokens(tokens, &token_size);
-            }
-            continue;
+    if (args[1] == NULL) {
+        history_print(stdout, 1, count);
+        return 0;
+    }
+    if (strcmp(args[1], "-s") == 0) {
+        if (args[2] == NULL) {
+            fprintf(stderr, "history: -s: text required\n");
+            return 2;
         }
-
-        // Handles spaces as token separators
-        if (isspace(c)) {
-            // Save the current token in the buffer (if there is one)
-            if (buffer_index > 0) {
-                buffer[buffer_index] = '\0';
-                tokens[token_count++] = strdup(buffer);
-                buffer_index = 0;
-
-                // Resize token array if necessary
-                if (token_count >= token_size) {
-                    tokens = resize_tokens(tokens, &token_size);
-                }
-            }
-            continue;
+        // Newest first, like a reverse incremental search
+        size_t matches[HISTORY_SEARCH_MAX];
+        size_t found = history_search(args[2], matches, HISTORY_SEARCH_MAX);
+        for (size_t i = 0; i < found; i++) {
+            history_print(stdout, matches[i], matches[i]);
         }
-
-        // Adds regular characters to the buffer
-        buffer[buffer_index++] = c;
+        return found > 0 ? 0 : 1;
     }
 
-    // Adds the last token if any remains in the buffer
-    if (buffer_index > 0) {
-        buffer[buffer_index] = '\0';
-        tokens[token_count++] = strdup(buffer);
-        // Resize if necessary
-        if (token_count >= token_size) {
-            tokens = resize_tokens(tokens, &token_size);
-        }
+    char *end;
+    long last = strtol(args[1], &end, 10);
+    if (*end != '\0' || last < 0) {
+        fprintf(stderr, "history: %s: numeric argument required\n", args[1]);
+        return 2;
     }
+    history_print(stdout, (size_t)last < count ? count - last + 1 : 1, count);
+    return 0;
+}
 
-    // Null-terminate the token array (required for execvp)
-    tokens[token_count] = NULL; 
-    return tokens;
+/**
+ * Asks the shell to stop after the current command
+ * In a forked copy of the shell (a pipeline stage) only that copy exits.
+ * @param args - Array of arguments; args[1] is the exit status (optional)
+ * @return The exit status, which becomes the shell's
+ */
+int command_exit(char **args) {
+    exit_requested = 1;
+    return args[1] ? atoi(args[1]) & 255 : last_status;
 }
 
 /**
- * Saves the last executed command for the 'prev' command functionality.
- * Ensures that the last entered command is stored for reuse.
- * @param input - The command string to be saved
+ * Picks the coprocess a co* builtin talks to
+ * @param args - Array of arguments; "-n NAME" may follow the command name
+ * @param next - Receives the index of the first argument after the name
+ * @return Name of the coprocess (COPROC by default)
  */
-void save_last_command(char *input) {
-    if (input && strlen(input) > 0) {
-        // Free previously saved command to avoid memory leak
-        if (last_command != NULL) {
-            free(last_command);
-        }
-        // Duplicate and save the new command
-        last_command = strdup(input);
-        if (last_command == NULL) {
-            // Handle memory allocation failure
-            fprintf(stderr, "Error: Memory allocation failed while saving the command.\n");
-            exit(EXIT_FAILURE);
-        }
+static const char* coproc_name(char **args, int *next) {
+    if (args[1] && strcmp(args[1], "-n") == 0 && args[2]) {
+        *next = 3;
+        return args[2];
     }
+    *next = 1;
+    return "COPROC";
 }
 
 /**
- * Executes the previously saved command if available
+ * Sends its arguments, joined by spaces, to a coprocess as one line
+ * @param args - Array of arguments
+ * @return 0 on success, 1 on failure
  */
-void command_prev(void) {
-    if (last_command && strlen(last_command) > 0) {
-        // Create a copy of the saved command to avoid modifying the original
-        char *command_copy = strdup(last_command);
-        // handle memory allocation errors
-        if (command_copy == NULL) {
-            fprintf(stderr, "Error: Memory allocation failed while copying the command.\n");
-            exit(EXIT_FAILURE);
-        }
-        // Process the copied command (re-execute it)
-        process_commands(command_copy);
-        free(command_copy);
-    } else {
-        printf("No previous command found.\n");// Inform the user if no command is saved
+int command_cowrite(char **args) {
+    int first;
+    const char *name = coproc_name(args, &first);
+
+    size_t len = 1;
+    for (int i = first; args[i]; i++) len += strlen(args[i]) + 1;
+    char *line = malloc(len);
+    if (!line) return 1;
+    len = 0;
+    for (int i = first; args[i]; i++) {
+        if (i > first) line[len++] = ' ';
+        strcpy(line + len, args[i]);
+        len += strlen(args[i]);
+    }
+    line[len++] = '\n';
+
+    int status = coproc_write(name, line, len) == 0 ? 0 : 1;
+    free(line);
+    return status;
+}
+
+/**
+ * Prints lines a coprocess wrote
+ * @param args - Array of arguments; an optional line count follows the name
+ * @return 0 on success, 1 if its output ended first
+ */
+int command_coread(char **args) {
+    int first;
+    const char *name = coproc_name(args, &first);
+    long count = args[first] ? strtol(args[first], NULL, 10) : 1;
+    size_t len;
+
+    for (long i = 0; i < count; i++) {
+        char *line = coproc_read_line(name, &len);
+        if (!line) return 1;
+        fwrite(line, 1, len, stdout);
+        putchar('\n');
     }
+    return 0;
 }
 
 /**
- * Frees the memory allocated for the last_command variable
- * to avoid memory leaks
+ * Closes a coprocess's input
+ * @param args - Array of arguments
+ * @return 0 on success, 1 if there is no such coprocess
  */
-void cleanup_last_command(void) {
-    if (last_command != NULL) {
-        free(last_command);
-        last_command = NULL;
+int command_coclose(char **args) {
+    int first;
+    const char *name = coproc_name(args, &first);
+    if (coproc_close(name) != 0) {
+        fflush(stdout);
+        fprintf(stderr, "%s: no such coprocess\n", name);
+        return 1;
     }
+    return 0;
 }
 
 /**
  * Displays help information for built-in commands
+ * @param args - Array of arguments (unused)
+ * @return Always 0
  */
-void command_help(void) {
+int command_help(char **args) {
     printf("Available built-in commands:\n");
     printf("cd [path] - Change directory\n");
     printf("source [filename] - Execute script\n");
     printf("prev - Repeat previous command\n");
+    printf("history [n] | history -s text - List the last n commands or search them\n");
+    printf("!! | !n | !-n | !prefix - Run a command from the history\n");
+    printf("hash [-r] [-d name] [-p path name] [name...] - Show or edit the command path cache\n");
+    printf("launcher [fork|vfork|posix_spawn] - Show or select how commands are started\n");
+    printf("command & - Run a command in the background\n");
+    printf("command > a > b - Write the output to every file\n");
+    printf("command <<END - Feed the following lines, up to END, as input (<<- strips tabs)\n");
+    printf("command >>f / <<<word / N>f / N>&M / N>&- - Append, feed a word, use descriptor N (0-9)\n");
+    printf("exec [command] [redirections] - Keep redirections open in the shell, or replace it\n");
+    printf("wait [%%job|pid...] - Wait for background jobs to finish\n");
+    printf("jobs - List background and stopped jobs\n");
+    printf("fg [%%job] / bg [%%job] - Resume a job in the foreground / background\n");
+    printf("set [-o|+o pipefail] - Show or change shell options\n");
+    printf("pipeconf [-r] [-b SIZE] [-a CPUS] [-n NICE] [-i IOPRIO] - Show or set what every\n"
+           "    pipeline gets: pipe buffer size, CPU, nice value and I/O priority of each stage\n");
+    printf("pipe OPTIONS pipeline - Run a pipeline with pipeconf's options changed\n");
+    printf("memo command [args...] [< file] - Replay the output and status of an identical\n"
+           "    earlier run (same program, arguments, environment, directory and input files)\n");
+    printf("memoconf [-c] [-d DIR] [-s SIZE] - Show the result cache and its hits and misses,\n"
+           "    clear it, or change its directory or size limit\n");
+    printf("pipestatus - Show the exit status of every stage of the last pipeline\n");
+    printf("NAME=value [command] - Set a variable for the shell, or only for the command\n");
+    printf("export [NAME[=value]...] - Pass variables to commands, or list those passed\n");
+    printf("unset NAME... - Remove variables\n");
+    printf("if cmd; then cmd; [elif cmd; then cmd;] [else cmd;] fi - Run commands if a command succeeds\n");
+    printf("while cmd; do cmd; done / until ... - Repeat commands while (until) a command succeeds\n");
+    printf("for NAME in words; do cmd; done - Repeat commands with NAME set to each word\n");
+    printf("break / continue - Leave a loop / start its next round\n");
+    printf("parallel [-j N] { cmd; cmd; ... } - Run commands N at a time, output in order\n");
+    printf("forall [-P N] [-c] cmd [args...] < items - Run cmd on every line ({} is the line),\n"
+           "    N at a time, output in input order (-c: as they finish)\n");
+    printf("coproc [NAME { ... }] pipeline - Start a worker the shell talks to over pipes\n");
+    printf("cowrite [-n NAME] [text...] - Send a line to a coprocess\n");
+    printf("coread [-n NAME] [count] - Print the next count lines (default 1) a coprocess wrote\n");
+    printf("coclose [-n NAME] - Close a coprocess's input (it sees end of file)\n");
+    printf("enable [-n] [name...] - Enable or disable (-n) builtins\n");
+    printf("time [-p] pipeline - Report how long a pipeline took\n");
+    printf("times - Show CPU time used by the shell and its children\n");
+    printf("trace [off|fd|file] - Write JSON lines about every process and pipeline\n");
+    printf("echo, true, false, pwd, test, [, printf - Run inside the shell (no fork)\n");
     printf("help - Show this help message\n");
-    printf("exit - Exit the shell\n");
+    printf("exit [n] - Exit the shell with status n (default: the last command's)\n");
+    return 0;
 }
 
 /**
  * Changes the current working directory.
  * If no path is specified, it defaults to the home directory.
  * @param args - Array of arguments including the target directory
+ * @return 0 on success, 1 if the directory could not be entered
  */
-void command_cd(char **args) {
+int command_cd(char **args) {
     if (args[1] == NULL) {
         // No path provided, change to home directory
-        chdir(getenv("HOME"));
-    } else {
-        // Attempt to change to the specified directory
-        if (chdir(args[1]) != 0) {
-            fprintf(stderr, "cd: No such file or directory: %s\n", args[1]);
+        const char *home = var_get("HOME");
+        if (!home) {
+            fprintf(stderr, "cd: HOME not set\n");
+            return 1;
+        }
+        return chdir(home) == 0 ? 0 : 1;
+    }
+    // Attempt to change to the specified directory
+    if (chdir(args[1]) != 0) {
+        fprintf(stderr, "cd: No such file or directory: %s\n", args[1]);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Shows or edits the command path cache.
+ * With no arguments, lists the remembered commands and their hit counts.
+ * -r forgets everything, -d removes one name, -p path name remembers an
+ * explicit path, and bare names are looked up on $PATH and remembered.
+ * @param args - Array of arguments to the builtin
+ * @return 0 on success, 1 if any name could not be found
+ */
+int command_hash(char **args) {
+    int status = 0;
+    if (args[1] == NULL) {
+        path_hash_print(stdout);
+        return 0;
+    }
+    for (int i = 1; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-r") == 0) {
+            path_hash_clear();
+        } else if (strcmp(args[i], "-d") == 0) {
+            if (args[i + 1] == NULL) {
+                fprintf(stderr, "hash: -d: option requires an argument\n");
+                return 2;
+            }
+            if (path_hash_remove(args[++i]) != 0) {
+                fprintf(stderr, "hash: %s: not found\n", args[i]);
+                status = 1;
+            }
+        } else if (strcmp(args[i], "-p") == 0) {
+            if (args[i + 1] == NULL || args[i + 2] == NULL) {
+                fprintf(stderr, "hash: -p: usage: hash -p path name\n");
+                return 2;
+            }
+            path_hash_set(args[i + 2], args[i + 1]);
+            i += 2;
+        } else if (path_hash_add(args[i]) != 0) {
+            fprintf(stderr, "hash: %s: not found\n", args[i]);
+            status = 1;
         }
     }
+    return status;
 }
 
 /**
  * Executes commands from a file line by line
- * Reads each line from the file, processes it as a command, and executes it.
- * @param filename - Name of the file containing commands
+ * Regular files are compiled once and cached (see scriptcache.h), so
+ * sourcing an unchanged script again skips lexing and parsing. Anything
+ * else is read and processed one line at a time.
+ * @param args - Array of arguments; args[1] is the file containing commands
+ * @return Exit status of the last command in the file
  */
-void command_source(char *filename) {
+int command_source(char **args) {
+    char *filename = args[1];
+    int status = 0;
     if (!filename) {
         fprintf(stderr, "source: Missing filename\n");
-        return;
+        return 2;
     }
+
+    CompiledScript *script = script_cache_acquire(filename);
+    if (script) {
+        for (int i = 0; i < script->count && !exit_requested; i++) {
+            first_command = 0;
+            status = run_sequence(&script->lines[i].seq);
+        }
+        script_cache_release(script);
+        return status;
+    }
+
     // Open the file for reading
-    FILE *file = fopen(filename, "r");
-    if (!file) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         fprintf(stderr, "source: No such file: %s\n", filename);
-        return;
+        return 1;
+    }
+    LineReader reader;
+    if (line_reader_init(&reader, fd) != 0) {
+        fprintf(stderr, "source: Memory allocation failed\n");
+        close(fd);
+        return 1;
     }
-    char line[INITIAL_INPUT_SIZE];
-    // Read each line from the file and process it as a command
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = 0;
+    // Read each line (of any length) from the file and process it as a command
+    LineReader *outer_reader = input_reader;
+    char *line;
+    input_reader = &reader;
+    while (!exit_requested && (line = line_reader_next(&reader, NULL)) != NULL) {
         first_command = 0;
-        process_commands(line);
+        status = process_commands(line);
     }
-    fclose(file); // Close file after reading all commands
+    input_reader = outer_reader;
+    line_reader_free(&reader);
+    close(fd); // Close file after reading all commands
+    return status;
 }
 
 /**
- * Executes multiple commands connected by pipes with optional I/O redirection
- * @param commands - Array of command arrays
- * @param num_commands - Number of commands in the pipeline
- * @param input_file - File for input redirection (optional)
- * @param output_file - File for output redirection (optional)
+ * Redirections the shell sets up for a command, and what it must release
  */
-void execute_pipe(char*** commands, int num_commands, char* input_file, char* output_file) {
-    int input_fd = STDIN_FILENO;  // Initialize input descriptor to standard input
-    int pipe_fds[2];              // Array for pipe file descriptors
-    pid_t pids[num_commands];      // Array to store process IDs for each command
+typedef struct {
+    FdAction *actions;  // Redirections in the order written (malloc'd)
+    int action_count;
+    int *fds;           // Here-document feeds and the fan-out pipe, which the
+    int fd_count;       // command gets copies of
+    pid_t fanout;       // Process copying the fan-out pipe to every file, or -1
+} Plumbing;
 
-    // If an input file is specified, open it for reading
-    if (input_file) {   
-        input_fd = open(input_file, O_RDONLY);
-        if (input_fd < 0) {
-            perror("Cannot open input file");
-            exit(1);
+/**
+ * Counts a command's > and >> redirections of stdout
+ * @param cmd - Command to inspect
+ * @return Number of output files
+ */
+int output_count(Command* cmd) {
+    int count = 0;
+    for (int i = 0; i < cmd->redirect_count; i++) {
+        Redirect *r = &cmd->redirects[i];
+        if ((r->kind == REDIRECT_OUTPUT || r->kind == REDIRECT_APPEND) &&
+            r->fd == STDOUT_FILENO) {
+            count++;
         }
     }
+    return count;
+}
 
-    // Loop through all commands in the pipeline
-    for (int i = 0; i < num_commands; i++) {
-        if (i < num_commands - 1) {
-            if (pipe(pipe_fds) == -1) {
-                perror("pipe failed");
-                exit(1);
-            }
-        }
-        // Fork a child process for each command
-        pid_t pid = fork();
-        if (pid == -1) {
-            perror("fork failed");
-            exit(1);
-        } else if (pid == 0) {
-            // Child process logic for piping and redirection
-            if (input_fd != STDIN_FILENO) {
-                dup2(input_fd, STDIN_FILENO); // Redirect input if necessary
-                close(input_fd);
-            }
+/**
+ * Moves a descriptor the shell keeps for itself out of the user's range
+ * (0-9) and marks it close-on-exec, so programs only get the copies the
+ * redirections make
+ * @param fd - Descriptor to move (closed)
+ * @return The new descriptor, or -1 on failure
+ */
+int shell_fd(int fd) {
+    if (fd < 0) return -1;
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, USER_FD_LIMIT);
+    close(fd);
+    return moved;
+}
 
-            if (i < num_commands - 1) {
-                // Redirect output to the write-end of the pipe for all but the last command
-                close(pipe_fds[0]);
-                dup2(pipe_fds[1], STDOUT_FILENO);
-                close(pipe_fds[1]);
-            } else if (output_file) {
-                // If an output file is specified, open it for writing
-                int fd_out = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd_out < 0) {
-                    perror("Cannot open output file");
-                    exit(1);
-                }
-                dup2(fd_out, STDOUT_FILENO);
-                close(fd_out);
-            }
+/**
+ * Holds a user descriptor (3-9) with a close-on-exec placeholder while
+ * nobody uses it, so the shell's own files and pipes never land there
+ * @param fd - Descriptor to hold
+ */
+void reserve_fd(int fd) {
+    int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (null_fd >= 0 && null_fd != fd) {
+        dup3(null_fd, fd, O_CLOEXEC);
+        close(null_fd);
+    }
+}
 
-            // Execute the command using execvp
-            if (execvp(commands[i][0], commands[i]) == -1) {
-                perror("command execution failed");
-                exit(1);
-            }
-        }
+/**
+ * Checks whether a user descriptor is open for redirections to copy
+ * @param fd - Descriptor to check
+ * @return 1 if it is open and not a placeholder (see reserve_fd), 0 otherwise
+ */
+int user_fd_open(int fd) {
+    int flags = fd < USER_FD_LIMIT ? fcntl(fd, F_GETFD) : -1;
+    return flags >= 0 && !(flags & FD_CLOEXEC);
+}
 
-        // Parent process: manages file descriptors
-        pids[i] = pid;
-        if (input_fd != STDIN_FILENO) {
-            close(input_fd);
+/**
+ * Releases the shell's copies of the descriptors once the command has them
+ * @param pl - Plumbing set up by plumb_command
+ */
+void plumb_close(Plumbing* pl) {
+    for (int i = 0; i < pl->fd_count; i++) {
+        close(pl->fds[i]);
+    }
+    pl->fd_count = 0;
+}
+
+/**
+ * Releases everything and waits for the fan-out helper, if any
+ * @param pl - Plumbing set up by plumb_command
+ */
+void plumb_finish(Plumbing* pl) {
+    plumb_close(pl);
+    free(pl->actions);
+    free(pl->fds);
+    pl->actions = NULL;
+    pl->fds = NULL;
+    if (pl->fanout > 0) {
+        wait_child(pl->fanout);
+        pl->fanout = -1;
+    }
+}
+
+/**
+ * Starts the helper that copies a command's output to each of its > and
+ * >> files (opened here, each with its own mode)
+ * @param cmd - Command with several output files
+ * @param pl - Receives the helper and the write end of its pipe
+ * @return Write end for the command's stdout, or -1 (reported)
+ */
+int plumb_fanout(Command* cmd, Plumbing* pl) {
+    int outputs = output_count(cmd);
+    int fds[outputs];
+    int opened = 0;
+    for (int i = 0; i < cmd->redirect_count && opened < outputs; i++) {
+        Redirect *r = &cmd->redirects[i];
+        if ((r->kind != REDIRECT_OUTPUT && r->kind != REDIRECT_APPEND) ||
+            r->fd != STDOUT_FILENO) {
+            continue;
         }
-        if (i < num_commands - 1) {
-            close(pipe_fds[1]);
-            input_fd = pipe_fds[0]; // Set input_fd to the read-end of the current pipe
+        int flags = O_WRONLY | O_CREAT | (r->kind == REDIRECT_APPEND ? O_APPEND : O_TRUNC);
+        fds[opened] = open(r->target, flags | O_CLOEXEC, 0644);
+        if (fds[opened] < 0) {
+            fprintf(stderr, "Cannot open output file: %s\n", r->target);
+            break;
         }
+        opened++;
+    }
+    int write_fd = -1;
+    if (opened == outputs) {
+        pl->fanout = zc_start_fanout(fds, outputs, &write_fd);
+    }
+    for (int i = 0; i < opened; i++) {
+        close(fds[i]);
     }
+    if (pl->fanout < 0) return -1;
+    write_fd = shell_fd(write_fd);
+    pl->fds[pl->fd_count++] = write_fd;
+    return write_fd;
+}
 
-    if (input_fd != STDIN_FILENO) {
-        close(input_fd); // Close the last input descriptor
+/**
+ * Starts feeding a here-document or here-string from memory (see zc_feed)
+ * @param r - The << or <<< redirection
+ * @param pl - Receives the read end
+ * @return Read end for the command, or -1 (reported)
+ */
+int plumb_feed(Redirect* r, Plumbing* pl) {
+    int fd;
+    if (r->kind == REDIRECT_HEREDOC) {
+        fd = zc_feed(r->body, r->body_len);
+    } else {
+        // A here-string is its word and a newline
+        size_t len = strlen(r->target);
+        char *text = arena_alloc(&line_arena, len + 1);
+        if (!text) {
+            fprintf(stderr, "here-string: Memory allocation failed\n");
+            return -1;
+        }
+        memcpy(text, r->target, len);
+        text[len] = '\n';
+        fd = zc_feed(text, len + 1);
+    }
+    if (fd < 0) {
+        perror(r->kind == REDIRECT_HEREDOC ? "here-document" : "here-string");
+        return -1;
     }
+    fd = shell_fd(fd);
+    pl->fds[pl->fd_count++] = fd;
+    return fd;
+}
 
-       // Wait for all child processes to complete
-    for (int i = 0; i < num_commands; i++) {
-        waitpid(pids[i], NULL, 0);
+/**
+ * Turns the target of <&N or >&N into the descriptor to copy, or -1 for -
+ * (close). The descriptor must be open in the shell or set up by an
+ * earlier redirection of the same command.
+ * @param r - The redirection
+ * @param set_up - Descriptors earlier redirections opened (bit per fd)
+ * @param closed - Descriptors earlier redirections closed (bit per fd)
+ * @param source - Receives the descriptor, or -1 to close
+ * @return 0 on success, -1 for a bad descriptor (reported)
+ */
+int dup_source(Redirect* r, unsigned set_up, unsigned closed, int* source) {
+    if (strcmp(r->target, "-") == 0) {
+        *source = -1;
+        return 0;
     }
+    const char *t = r->target;
+    int fd = t[0] >= '0' && t[0] <= '9' && t[1] == '\0' ? t[0] - '0' : -1;
+    if (fd < 0 || !((set_up & (1u << fd)) || (!(closed & (1u << fd)) && user_fd_open(fd)))) {
+        fprintf(stderr, "%s: Bad file descriptor\n", t);
+        return -1;
+    }
+    *source = fd;
+    return 0;
 }
 
 /**
- * Executes a single command with optional I/O redirection
- * Forks a new process to execute the command, redirects I/O if needed.
- * @param args - Array containing the command and its arguments
- * @param input_file - Input file for redirection (optional)
- * @param output_file - Output file for redirection (optional)
+ * Turns a command's redirections into descriptor actions for its spec
+ * They are applied in order after the pipe wiring, so they take
+ * precedence over it. Files are opened by the child; a here-document or
+ * here-string is fed from memory (see zc_feed). With several > or >>
+ * files on stdout, the command writes into a pipe that a helper copies to
+ * every file with tee/splice, so `cmd >a >b` works like `cmd | tee a >b`.
+ * @param cmd - Command whose redirections to apply
+ * @param spec - Spec to fill in
+ * @param pl - Receives what the shell must release after the launch
+ * @return 0 on success, -1 if a descriptor, feed or file could not be set
+ *         up (reported; plumb_finish still needs calling)
  */
-void execute_command(char** args, char* input_file, char* output_file) {
-    // Fork a child process to execute the command
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("Fork Failed");
-        exit(1);
-    } else if (pid == 0) {
-        // Handle input redirection if an input file is provided
-        if (input_file) {
-            int fd_in = open(input_file, O_RDONLY);
-            if (fd_in < 0) {
-                perror("Cannot open input file");
-                exit(1);
-            }
-            dup2(fd_in, STDIN_FILENO); // Redirect input from the file
-            close(fd_in);
+int plumb_command(Command* cmd, LaunchSpec* spec, Plumbing* pl) {
+    pl->actions = NULL;
+    pl->action_count = 0;
+    pl->fds = NULL;
+    pl->fd_count = 0;
+    pl->fanout = -1;
+    if (cmd->redirect_count == 0) {
+        return 0;
+    }
+    pl->actions = malloc(cmd->redirect_count * sizeof(FdAction));
+    pl->fds = malloc(cmd->redirect_count * sizeof(int));
+    if (!pl->actions || !pl->fds) {
+        fprintf(stderr, "Memory allocation failed for redirections\n");
+        return -1;
+    }
+
+    int fanned = 0;
+    unsigned set_up = 0, closed = 0;   // Bit per user descriptor
+    int fan_out = output_count(cmd) > 1;
+    for (int i = 0; i < cmd->redirect_count; i++) {
+        Redirect *r = &cmd->redirects[i];
+        FdAction *a = &pl->actions[pl->action_count];
+        a->fd = r->fd;
+        a->source = -1;
+        a->path = NULL;
+        a->flags = 0;
+        if (r->fd >= USER_FD_LIMIT) {
+            fprintf(stderr, "%d: Bad file descriptor\n", r->fd);
+            return -1;
         }
 
-        // Handle output redirection if an output file is provided
-        if (output_file) {
-            int fd_out = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd_out < 0) {
-                perror("Cannot open output file");
-                exit(1);
+        switch (r->kind) {
+        case REDIRECT_INPUT:
+            a->kind = FD_OPEN;
+            a->path = r->target;
+            a->flags = O_RDONLY;
+            break;
+        case REDIRECT_OUTPUT:
+        case REDIRECT_APPEND:
+            if (fan_out && r->fd == STDOUT_FILENO) {
+                if (fanned) continue;   // The first one stands for all of them
+                fanned = 1;
+                a->kind = FD_DUP;
+                a->source = plumb_fanout(cmd, pl);
+                if (a->source < 0) return -1;
+                break;
             }
-            dup2(fd_out, STDOUT_FILENO);// Redirect output to the file
-            close(fd_out);
+            a->kind = FD_OPEN;
+            a->path = r->target;
+            a->flags = O_WRONLY | O_CREAT | (r->kind == REDIRECT_APPEND ? O_APPEND : O_TRUNC);
+            break;
+        case REDIRECT_HEREDOC:
+        case REDIRECT_STRING:
+            a->kind = FD_DUP;
+            a->source = plumb_feed(r, pl);
+            if (a->source < 0) return -1;
+            break;
+        case REDIRECT_DUP:
+            if (dup_source(r, set_up, closed, &a->source) != 0) return -1;
+            a->kind = a->source < 0 ? FD_CLOSE : FD_DUP;
+            break;
         }
-        // Execute the command using execvp
-        if (execvp(args[0], args) == -1) {
-            perror("command execution failed");
-            exit(1);
+        if (a->kind == FD_CLOSE) {
+            closed |= 1u << a->fd;
+            set_up &= ~(1u << a->fd);
+        } else {
+            set_up |= 1u << a->fd;
         }
-    } else {
-        // In the parent process, wait for the child to finish
-        waitpid(pid, NULL, 0);
+        pl->action_count++;
     }
+    spec->actions = pl->actions;
+    spec->action_count = pl->action_count;
+    return 0;
 }
 
 /**
- * Processes and executes commands based on user input
- * Handles multiple commands separated by pipes and supports redirection
- * @param input - The command input string to process
+ * Formats a command's NAME=value prefixes as environment entries
+ * @param cmd - Expanded command with assignments
+ * @return "NAME=value" strings in line_arena, or NULL on allocation failure
  */
-void process_commands(char* input) {
-    if (strcmp(input, "prev") != 0) {
-        save_last_command(input);
+char** assignment_entries(Command* cmd) {
+    char **entries = arena_alloc(&line_arena, cmd->assign_count * sizeof(char *));
+    for (int i = 0; entries && i < cmd->assign_count; i++) {
+        Assignment *a = &cmd->assigns[i];
+        size_t size = strlen(a->name) + strlen(a->value) + 2;
+        entries[i] = arena_alloc(&line_arena, size);
+        if (!entries[i]) return NULL;
+        snprintf(entries[i], size, "%s=%s", a->name, a->value);
     }
+    return entries;
+}
 
-    // Split the input by semicolons to handle multiple commands
-    char* command = strtok(input, ";");
-    while (command != NULL) {
-        // Trim leading and trailing whitespace from the command
-        while (isspace(*command)) command++;
-        char* end = command + strlen(command) - 1;
-        while (end > command && isspace(*end)) end--;
-        *(end + 1) = '\0';
-
-        // Handle input/output redirection
-        char *input_file = NULL, *output_file = NULL;
-        char *input_redirect_pos = strchr(command, '<');
-        char *output_redirect_pos = strchr(command, '>');
+/**
+ * Picks the environment of a program started for a command: the exported
+ * variables, plus the command's NAME=value prefixes for this program only
+ * @param cmd - Expanded command
+ * @param spec - Receives the environment
+ * @return Array to free once the program has started, or NULL if there
+ *         was nothing to add (spec keeps the shell's environment)
+ */
+char** command_environ(Command* cmd, LaunchSpec* spec) {
+    if (cmd->assign_count == 0) {
+        return NULL;
+    }
+    char **entries = assignment_entries(cmd);
+    spec->envp = entries ? vars_environ_with(entries, cmd->assign_count) : NULL;
+    return spec->envp;
+}
 
-        if (input_redirect_pos) {
-            *input_redirect_pos = '\0';
-            input_file = strtok(input_redirect_pos + 1, " \t");
+/**
+ * Resolves the program a command runs: on the command's own PATH=...
+ * prefix if it has one, otherwise through the path cache (see pathhash.h)
+ * @param cmd - Expanded command
+ * @param name - Program name (argv[0], or argv[1] for exec)
+ * @return Path to execute, or NULL if it was not found
+ */
+const char* command_program(Command* cmd, const char* name) {
+    for (int i = cmd->assign_count - 1; i >= 0; i--) {
+        if (strcmp(cmd->assigns[i].name, "PATH") == 0) {
+            return path_hash_search(name, cmd->assigns[i].value);
         }
+    }
+    return path_hash_lookup(name);
+}
 
-        if (output_redirect_pos) {
-            *output_redirect_pos = '\0';
-            output_file = strtok(output_redirect_pos + 1, " \t");
+/**
+ * Sets a command's NAME=value prefixes as shell variables
+ * @param cmd - Expanded command
+ * @param export - Whether to export them as well
+ * @return 0 on success, 1 on allocation failure
+ */
+int assign_variables(Command* cmd, int export) {
+    for (int i = 0; i < cmd->assign_count; i++) {
+        if (var_set(cmd->assigns[i].name, cmd->assigns[i].value, export) != 0) {
+            fprintf(stderr, "%s: Memory allocation failed\n", cmd->assigns[i].name);
+            return 1;
         }
+    }
+    return 0;
+}
 
-        // Count pipes in the command
-        int num_pipes = 0;
-        char* temp = command;
-        while ((temp = strchr(temp, '|')) != NULL) {
-            num_pipes++;
-            temp++;
-        }
+/**
+ * Checks whether a command runs as a separate program
+ * @param cmd - Command to check
+ * @return 1 for external programs, 0 for builtins, groups, parallel and exec
+ */
+int is_external(Command* cmd) {
+    return cmd->argc > 0 && !cmd->block &&
+           strcmp(cmd->argv[0], "parallel") != 0 && strcmp(cmd->argv[0], "exec") != 0 &&
+           find_builtin(cmd->argv[0]) == NULL;
+}
 
-        if (num_pipes > 0) {
-            // Handle piping if there are pipes in the command
-            char*** pipe_commands = malloc((num_pipes + 1) * sizeof(char**));
-            if (!pipe_commands) {
-                perror("malloc failed");
-                exit(EXIT_FAILURE);
-            }
+/**
+ * Measures what strings take up in execve: each one, its terminator and
+ * its pointer
+ * @param strings - Strings to measure
+ * @param count - How many
+ * @return Bytes
+ */
+size_t exec_size(char **strings, int count) {
+    size_t size = 0;
+    for (int i = 0; i < count; i++) {
+        size += strlen(strings[i]) + 1 + sizeof(char *);
+    }
+    return size;
+}
 
-            // Split the command by pipes and tokenize each subcommand
-            char* pipe_command = strtok(command, "|");
-            int index = 0;
+/**
+ * @param cmd - Expanded program
+ * @return Bytes execve has for its arguments once its environment is in
+ */
+long exec_room(Command* cmd) {
+    long room = sysconf(_SC_ARG_MAX) - EXEC_HEADROOM;
+    char **env = vars_environ();
+    for (int i = 0; env && env[i]; i++) {
+        room -= strlen(env[i]) + 1 + sizeof(char *);
+    }
+    for (int i = 0; i < cmd->assign_count; i++) {
+        room -= strlen(cmd->assigns[i].name) + strlen(cmd->assigns[i].value) + 2 + sizeof(char *);
+    }
+    return room;
+}
 
-            while (pipe_command != NULL) {
-                pipe_commands[index++] = tokenize(pipe_command);
-                pipe_command = strtok(NULL, "|");
-            }
+/**
+ * Checks whether a program's arguments are too long for one execve, so it
+ * must be run on the arguments of its biggest expansion in batches
+ * @param cmd - Expanded program
+ * @return 1 if it must, 0 otherwise
+ */
+int needs_batches(Command* cmd) {
+    return cmd->batch_count > 1 &&
+           (long)exec_size(cmd->argv, cmd->argc) + (long)sizeof(char *) > exec_room(cmd);
+}
 
-            // Execute the piped commands
-            execute_pipe(pipe_commands, num_pipes + 1, input_file, output_file);
-
-            // Freeing memory allocated for pipe commands
-            for (int i = 0; i < num_pipes + 1; i++) {
-                char** args = pipe_commands[i];
-                if (args) {
-                    for (int j = 0; args[j] != NULL; j++) {
-                        free(args[j]);
-                    }
-                    free(args);
-                }
-            }
-            free(pipe_commands);
-        } else {
-            char** args = tokenize(command);
-
-            if (args[0] != NULL) {
-                if (strcmp(args[0], "help") == 0) {
-                    command_help();
-                } else if (strcmp(args[0], "prev") == 0) {
-                    command_prev();
-                } else if (strcmp(args[0], "source") == 0) {
-                    command_source(args[1]);
-                } else if (strcmp(args[0], "cd") == 0) {
-                    command_cd(args);
-                } else {
-                    execute_command(args, input_file, output_file);
-                }
-            }
+/**
+ * Runs a program several times, xargs-style, each time on as many of the
+ * arguments of its biggest expansion as fit in one execve, with the
+ * arguments written before and after it repeated every time
+ * (redirections are already applied, once for all the batches)
+ * @param cmd - Expanded program (see needs_batches)
+ * @return 0 if every batch succeeded, otherwise the last failing status
+ */
+int run_batches(Command* cmd) {
+    int first = cmd->batch_first;
+    int end = first + cmd->batch_count;
+    int after = cmd->argc - end;
+    long room = exec_room(cmd) - (long)exec_size(cmd->argv, first) -
+                (long)exec_size(cmd->argv + end, after) - (long)sizeof(char *);
+    char **argv = malloc((cmd->argc + 1) * sizeof(char *));
+    if (!argv) {
+        fprintf(stderr, "%s: Memory allocation failed\n", cmd->argv[0]);
+        return 1;
+    }
+    memcpy(argv, cmd->argv, first * sizeof(char *));
 
-            // Free tokens after execution
-            for (int i = 0; args[i] != NULL; i++) free(args[i]);
-            free(args);
+    Command batch = *cmd;
+    batch.argv = argv;
+    batch.redirects = NULL;
+    batch.redirect_count = 0;
+    batch.batch_count = 0;
+    int status = 0;
+    for (int next = first; next < end;) {
+        // At least one argument per batch; execve reports it if even that is too long
+        int count = 0;
+        long size = 0;
+        while (next + count < end) {
+            long arg = strlen(cmd->argv[next + count]) + 1 + sizeof(char *);
+            if (count > 0 && size + arg > room) break;
+            size += arg;
+            count++;
         }
+        memcpy(argv + first, cmd->argv + next, count * sizeof(char *));
+        memcpy(argv + first + count, cmd->argv + end, after * sizeof(char *));
+        batch.argc = first + count + after;
+        argv[batch.argc] = NULL;
+        int batch_status = execute_command(&batch);
+        if (batch_status != 0) status = batch_status;
+        if (batch_status == 128 + SIGINT) break;
+        next += count;
+    }
+    free(argv);
+    return status;
+}
 
-        command = strtok(NULL, ";");
+/**
+ * Runs a builtin, group or parallel block in the current process,
+ * assuming its redirections have already been applied (or a program in
+ * batches)
+ * @param cmd - Command to run
+ * @return Exit status of the command
+ */
+int run_in_process(Command* cmd) {
+    if (is_external(cmd)) {
+        // Only a program too long for one execve comes here (see needs_batches)
+        return run_batches(cmd);
+    }
+    if (cmd->program) {
+        return run_program(cmd->program);
+    }
+    if (cmd->argc == 0) {
+        return run_sequence(cmd->block);
+    }
+    if (strcmp(cmd->argv[0], "parallel") == 0) {
+        return command_parallel(cmd);
     }
+    if (strcmp(cmd->argv[0], "exec") == 0) {
+        // In a subshell the redirections are already in place
+        return cmd->argc > 1 ? exec_program(cmd) : 0;
+    }
+    return find_builtin(cmd->argv[0])->run(cmd->argv);
 }
 
 /**
- * Main function: Initializes the shell and processes user input in a loop
+ * Runs something in the shell with a command's redirections applied,
+ * restoring the shell's own descriptors afterwards
+ * @param cmd - Command whose redirections to apply
+ * @param run - What to run, given cmd and ctx
+ * @param ctx - Passed to run
+ * @return What run returned, or 1 if the redirections failed
  */
-int main(int argc, char **argv) {
-    char input[INITIAL_INPUT_SIZE];
-    printf("Welcome to mini-shell\n");
+int with_redirects(Command* cmd, int (*run)(Command* cmd, void* ctx), void* ctx) {
+    if (cmd->redirect_count == 0) {
+        return run(cmd, ctx);
+    }
 
-    while (1) {
-        printf("shell $ ");
-        fflush(stdout);
+    LaunchSpec spec;
+    Plumbing pl;
+    launch_spec_init(&spec);
+    if (plumb_command(cmd, &spec, &pl) != 0) {
+        plumb_finish(&pl);
+        return 1;
+    }
 
-        if ((fgets(input, INITIAL_INPUT_SIZE, stdin) == NULL) || (strcmp(input, "exit\n") == 0)) {
-            printf("Bye bye.\n");
-            break;
+    // Keep a copy of every descriptor the redirections touch (-1: it was
+    // closed), with its close-on-exec flag, so placeholders stay placeholders
+    int saved[USER_FD_LIMIT], saved_flags[USER_FD_LIMIT];
+    for (int fd = 0; fd < USER_FD_LIMIT; fd++) {
+        saved[fd] = -2;
+    }
+    for (int i = 0; i < pl.action_count; i++) {
+        int fd = pl.actions[i].fd;
+        if (saved[fd] == -2) {
+            saved_flags[fd] = fcntl(fd, F_GETFD);
+            saved[fd] = saved_flags[fd] >= 0 ? fcntl(fd, F_DUPFD_CLOEXEC, USER_FD_LIMIT) : -1;
         }
+    }
 
-        // Remove the newline character from input
-        input[strcspn(input, "\n")] = 0;
-        first_command = 0;
-        process_commands(input);
+    fflush(stdout);
+    int status = 1;
+    if (launch_apply_spec(&spec) == 0) {
+        // The command has its copies; the fan-out helper must see the end
+        // of its pipe once stdout is put back
+        plumb_close(&pl);
+        status = run(cmd, ctx);
+    }
+    fflush(stdout);
+    for (int fd = 0; fd < USER_FD_LIMIT; fd++) {
+        if (saved[fd] >= 0) {
+            dup3(saved[fd], fd, saved_flags[fd] & FD_CLOEXEC ? O_CLOEXEC : 0);
+            close(saved[fd]);
+        } else if (saved[fd] == -1) {
+            close(fd);
+        }
     }
+    plumb_finish(&pl);
+    return status;
+}
 
-    cleanup_last_command();
-    return 0;
-}
\ No newline at end of file
+/**
+ * Adapts run_in_process to with_redirects
+ * @param cmd - Command to run
+ * @param ctx - Unused
+ * @return Exit status of the command
+ */
+int run_in_process_with(Command* cmd, void* ctx) {
+    (void)ctx;
+    return run_in_process(cmd);
+}
+
+/**
+ * Runs a builtin, group or parallel block in the shell with its
+ * redirections applied, restoring the shell's own descriptors afterwards
+ * @param cmd - Command to run
+ * @return Exit status of the command
+ */
+int run_redirected(Command* cmd) {
+    return with_redirects(cmd, run_in_process_with, NULL);
+}
+
+/**
+ * Replaces the shell with a program, as `exec cmd args...`
+ * Redirections must already be applied.
+ * @param cmd - The exec command; argv[1] is the program
+ * @return 127 if the program was not found, 126 if it could not run
+ *         (the shell only returns on failure)
+ */
+int exec_program(Command* cmd) {
+    const char *path = command_program(cmd, cmd->argv[1]);
+    if (!path) {
+        fprintf(stderr, "%s: command not found\n", cmd->argv[1]);
+        return 127;
+    }
+    LaunchSpec spec;
+    launch_spec_init(&spec);
+    char **env = command_environ(cmd, &spec);
+    fflush(stdout);
+    job_control_reset();
+    events_reset_child();
+    launch_exec(path, cmd->argv + 1, spec.envp ? spec.envp : vars_environ());
+    perror(cmd->argv[1]);
+    free(env);
+    return 126;
+}
+
+/**
+ * Applies a command's redirections to the shell itself for good, or
+ * replaces the shell with a program
+ * Usage: exec [command [args...]] [redirections]
+ * `exec 3>log` keeps log open on descriptor 3, so `echo x >&3` writes
+ * without opening the file again; `exec 3>&-` closes it.
+ * @param cmd - The exec command
+ * @return 0 on success, 1 if a redirection failed, or what exec_program
+ *         returns
+ */
+int command_exec(Command* cmd) {
+    LaunchSpec spec;
+    Plumbing pl;
+    launch_spec_init(&spec);
+    fflush(stdout);
+    int status = plumb_command(cmd, &spec, &pl) == 0 && launch_apply_spec(&spec) == 0 ? 0 : 1;
+    // A fan-out helper keeps copying for as long as the shell writes to it
+    pl.fanout = -1;
+    plumb_finish(&pl);
+
+    // A user descriptor that was closed gets its placeholder back
+    for (int i = 0; i < cmd->redirect_count; i++) {
+        int fd = cmd->redirects[i].fd;
+        if (fd > STDERR_FILENO && fd < USER_FD_LIMIT && fcntl(fd, F_GETFD) < 0) {
+            reserve_fd(fd);
+        }
+    }
+    if (status != 0 || cmd->argc < 2) {
+        return status;
+    }
+    return exec_program(cmd);
+}
+
+/**
+ * Runs a builtin, group or parallel block in the shell with its NAME=value
+ * prefixes exported while it runs, then puts the variables back
+ * @param cmd - Command to run
+ * @return Exit status of the command
+ */
+int run_with_assignments(Command* cmd) {
+    int count = cmd->assign_count;
+    char *saved[count];
+    int was_exported[count];
+    for (int i = 0; i < count; i++) {
+        const char *old = var_get(cmd->assigns[i].name);
+        saved[i] = old ? strdup(old) : NULL;
+        was_exported[i] = var_exported(cmd->assigns[i].name);
+    }
+
+    int status = assign_variables(cmd, 1);
+    if (status == 0) {
+        status = run_redirected(cmd);
+    }
+
+    // Restore in reverse, so the first value wins if a name repeats
+    for (int i = count - 1; i >= 0; i--) {
+        const char *name = cmd->assigns[i].name;
+        var_unset(name);
+        if (saved[i]) {
+            var_set(name, saved[i], was_exported[i]);
+        } else if (was_exported[i]) {
+            var_export(name);
+        }
+        free(saved[i]);
+    }
+    return status;
+}
+
+/**
+ * Turns a freshly forked copy of the shell into a plain subshell: default
+ * signal handling, no job control and no prompts
+ */
+void become_subshell(void) {
+    events_reset_child();
+    job_control_reset();
+    interactive = 0;
+}
+
+/**
+ * Runs a builtin, group or parallel block in a forked copy of the shell,
+ * so it can be a pipeline stage or a background job
+ * @param cmd - Command to run
+ * @param spec - Stream wiring for the copy
+ * @return Pid of the copy or -1 on failure
+ */
+pid_t launch_in_subshell(Command* cmd, const LaunchSpec* spec) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Fork Failed");
+        return -1;
+    }
+    if (pid == 0) {
+        if (spec->pgid >= 0) {
+            setpgid(0, spec->pgid);
+        }
+        launch_apply_scheduling(spec);
+        become_subshell();
+        // A coprocess's own stages must not keep its input open
+        for (int i = 0; i < 2; i++) {
+            if (coproc_shell_fds[i] >= 0) close(coproc_shell_fds[i]);
+        }
+        if (launch_apply_spec(spec) != 0 || assign_variables(cmd, 1) != 0) {
+            _exit(1);
+        }
+        int status = run_in_process(cmd);
+        fflush(stdout);
+        _exit(status);
+    }
+    return pid;
+}
+
+/**
+ * Starts every stage of a pipeline without waiting for them
+ * Each stage may carry its own redirections, which take precedence over
+ * the pipe on that side. The pipes and stages get the pipeconf settings
+ * (with two or more stages), overridden by the pipeline's `pipe` options
+ * (see pipetune.h); each stage applies its own before it runs.
+ * @param pipeline - Pipeline to start
+ * @param input_fd - First stage's stdin (closed here unless it is STDIN_FILENO)
+ * @param output_fd - Last stage's stdout, or -1 to inherit
+ * @param pids - Receives the pid of each stage (-1 if it did not start)
+ * @param helpers - Receives the pids of fan-out helpers (room for one per stage)
+ * @param new_group - Whether the stages get a process group of their own
+ *                    (only with job control)
+ * @return Number of helpers started
+ */
+int launch_pipeline(Pipeline* pipeline, int input_fd, int output_fd, pid_t* pids, pid_t* helpers,
+                    int new_group) {
+    int num_commands = pipeline->count;
+    int num_helpers = 0;
+    pid_t group = 0;              // With job control, the first stage leads the group
+    int pipe_fds[2];              // Array for pipe file descriptors
+    PipeTuning tuning;
+
+    // The pipeconf defaults are for real pipelines; a single command only
+    // gets the options of its own `pipe` prefix, in the foreground or not
+    pipe_tuning_init(&tuning);
+    if (num_commands > 1) {
+        tuning = *pipe_tuning_defaults();
+    }
+    if (pipeline->tuning) {
+        pipe_tuning_merge(&tuning, pipeline->tuning);
+    }
+
+    // Loop through all commands in the pipeline
+    for (int i = 0; i < num_commands; i++) {
+        Command *cmd = &pipeline->commands[i];
+
+        // Wire the stage to its own redirections first, so a fan-out helper
+        // does not inherit the pipe to the next stage
+        LaunchSpec spec;
+        Plumbing pl;
+        launch_spec_init(&spec);
+        spec.stdin_fd = input_fd;
+        if (new_group && job_control_enabled()) {
+            spec.pgid = group;
+        }
+        pipe_tuning_stage(&tuning, i, &spec);
+        int plumbed = plumb_command(cmd, &spec, &pl) == 0;
+        if (pl.fanout > 0) {
+            helpers[num_helpers++] = pl.fanout;
+            pl.fanout = -1;
+        }
+
+        // The stage's own redirections are applied after the pipe, so
+        // they take precedence over it
+        if (i < num_commands - 1) {
+            if (pipe(pipe_fds) == -1) {
+                perror("pipe failed");
+                exit(1);
+            }
+            pipe_tuning_size(&tuning, pipe_fds[1]);
+            spec.stdout_fd = pipe_fds[1];
+            spec.close_fd = pipe_fds[0];
+        } else {
+            spec.stdout_fd = output_fd;
+        }
+
+        pids[i] = -1;
+        if (!plumbed) {
+            // Error already reported; the stage counts as failed
+        } else if (is_external(cmd) && !needs_batches(cmd)) {
+            // Resolve the program in the parent so the path cache survives the launch
+            char **env = command_environ(cmd, &spec);
+            pids[i] = launch_program(command_program(cmd, cmd->argv[0]), cmd->argv, &spec);
+            free(env);
+        } else if (cmd->argc > 0 || cmd->block || cmd->program) {
+            pids[i] = launch_in_subshell(cmd, &spec);
+        }
+        plumb_finish(&pl);
+        if (pids[i] > 0 && spec.pgid >= 0) {
+            // Also set it here, so it holds before the child gets to it
+            setpgid(pids[i], group ? group : pids[i]);
+            if (!group) group = pids[i];
+        }
+
+        // Parent process: manages file descriptors
+        if (input_fd != STDIN_FILENO) {
+            close(input_fd);
+        }
+        if (i < num_commands - 1) {
+            close(pipe_fds[1]);
+            input_fd = pipe_fds[0]; // Set input_fd to the read-end of the current pipe
+        }
+    }
+
+    if (input_fd != STDIN_FILENO) {
+        close(input_fd); // Close the last input descriptor
+    }
+    return num_helpers;
+}
+
+/**
+ * Accounts for a reaped process in the trace (see trace.h)
+ * @param stage - Stage of the pipeline
+ * @param pid - Process id
+ * @param cmd - Command the process ran
+ * @param stats - What it cost
+ */
+void record_process(int stage, pid_t pid, Command* cmd, const ProcessStats* stats) {
+    char *text = NULL;
+    if (trace_enabled()) {
+        Pipeline single = {cmd, 1, 0, 0, NULL};
+        text = pipeline_text(&single);
+    }
+    trace_process(0, stage, pid, text, stats);
+    free(text);
+}
+
+/**
+ * @param pids - Processes of a pipeline's stages
+ * @param count - Number of stages
+ * @return The first that started (the process group leader), or 0
+ */
+pid_t first_pid(const pid_t* pids, int count) {
+    for (int i = 0; i < count; i++) {
+        if (pids[i] > 0) return pids[i];
+    }
+    return 0;
+}
+
+/**
+ * Remembers the stages' statuses of the last foreground pipeline
+ * @param statuses - Exit status of every stage
+ * @param count - Number of stages
+ */
+void set_pipestatus(const int* statuses, int count) {
+    int *copy = realloc(last_pipestatus, count * sizeof(int));
+    if (!copy) return;
+    memcpy(copy, statuses, count * sizeof(int));
+    last_pipestatus = copy;
+    last_pipestatus_count = count;
+}
+
+/**
+ * Executes multiple commands connected by pipes and waits for all of them
+ * @param pipeline - Pipeline to run
+ * @return Exit status of the pipeline: its last stage's, or with pipefail
+ *         its rightmost failing stage's
+ */
+int execute_pipe(Pipeline* pipeline) {
+    int num_commands = pipeline->count;
+    pid_t pids[2 * num_commands];          // Stages, then fan-out helpers
+    ProcessStats stats[2 * num_commands];  // What each of them cost
+
+    double start = monotonic_now();
+    int num_helpers = launch_pipeline(pipeline, STDIN_FILENO, -1, pids, pids + num_commands, 1);
+    for (int i = 0; i < num_commands + num_helpers; i++) {
+        stats[i].start = start;
+    }
+
+    // Wait for all child processes to complete, in whatever order they exit
+    pid_t group = job_control_enabled() ? first_pid(pids, num_commands) : 0;
+    wait_foreground(pids, num_commands + num_helpers, stats, pipeline, group);
+    int statuses[num_commands];
+    for (int i = 0; i < num_commands; i++) {
+        if (pids[i] > 0) {
+            record_process(i, pids[i], &pipeline->commands[i], &stats[i]);
+        }
+        statuses[i] = stats[i].status;
+    }
+    set_pipestatus(statuses, num_commands);
+    return pipeline_status(statuses, num_commands);
+}
+
+/**
+ * Executes a single external command with optional I/O redirection
+ * Launches a new process to execute the command, redirects I/O if needed.
+ * @param cmd - Command with its arguments and redirections
+ * @return Exit status of the command
+ */
+int execute_command(Command* cmd) {
+    if (needs_batches(cmd)) {
+        // The redirections are set up once, around all the batches
+        return run_redirected(cmd);
+    }
+
+    LaunchSpec spec;
+    Plumbing pl;
+    launch_spec_init(&spec);
+    if (plumb_command(cmd, &spec, &pl) != 0) {
+        plumb_finish(&pl);
+        return 1;
+    }
+
+    // With job control the program leads a process group of its own
+    if (job_control_enabled()) {
+        spec.pgid = 0;
+    }
+
+    // Resolve the program in the parent so the path cache survives the launch
+    ProcessStats stats;
+    char **env = command_environ(cmd, &spec);
+    stats.start = monotonic_now();
+    pid_t pid = launch_program(command_program(cmd, cmd->argv[0]), cmd->argv, &spec);
+    free(env);
+    plumb_close(&pl);
+    int status = 127;
+    if (pid > 0) {
+        // Wait for the child to finish (or be stopped)
+        Pipeline single = {cmd, 1, 0, 0, NULL};
+        wait_foreground(&pid, 1, &stats, &single, spec.pgid >= 0 ? pid : 0);
+        status = stats.status;
+        if (pid > 0) {
+            record_process(0, pid, cmd, &stats);
+        }
+    }
+    plumb_finish(&pl);
+    return status;
+}
+
+/**
+ * Applies the redirections of a command that has no words, the way other
+ * shells do: output files are created (> truncates them) and input files
+ * must exist
+ * @param cmd - Command made only of redirections
+ * @return 0 on success, 1 if a file could not be opened
+ */
+int apply_bare_redirects(Command* cmd) {
+    for (int i = 0; i < cmd->redirect_count; i++) {
+        Redirect *r = &cmd->redirects[i];
+        int flags;
+        if (r->kind == REDIRECT_INPUT) {
+            flags = O_RDONLY;
+        } else if (r->kind == REDIRECT_OUTPUT) {
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+        } else if (r->kind == REDIRECT_APPEND) {
+            flags = O_WRONLY | O_CREAT | O_APPEND;
+        } else {
+            continue;  // Feeds and copies of descriptors: nobody reads or writes them
+        }
+        int fd = open(r->target, flags | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            perror(r->target);
+            return 1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+/**
+ * Lists background and stopped jobs
+ * @param args - Array of arguments (unused)
+ * @return 0
+ */
+int command_jobs(char **args) {
+    job_list(stdout);
+    return 0;
+}
+
+/**
+ * Brings a job to the foreground, resuming it if it was stopped
+ * @param args - Array of arguments; args[1] is the job (default: the newest)
+ * @return Exit status of the job, 1 if there is no such job
+ */
+int command_fg(char **args) {
+    int status = job_foreground(args[1]);
+    if (status < 0) {
+        fflush(stdout);
+        fprintf(stderr, "fg: %s: no such job\n", args[1] ? args[1] : "current");
+        return 1;
+    }
+    return status;
+}
+
+/**
+ * Resumes a stopped job in the background
+ * @param args - Array of arguments; args[1] is the job (default: the newest)
+ * @return 0 on success, 1 if there is no such job
+ */
+int command_bg(char **args) {
+    if (job_background(args[1]) != 0) {
+        fflush(stdout);
+        fprintf(stderr, "bg: %s: no such job\n", args[1] ? args[1] : "current");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Shows or changes shell options; only pipefail exists so far
+ * Usage: set [-o|+o pipefail]
+ * @param args - Array of arguments
+ * @return 0 on success, 2 on bad usage
+ */
+int command_set(char **args) {
+    if (args[1] == NULL || (strcmp(args[1], "-o") == 0 && args[2] == NULL)) {
+        printf("pipefail\t%s\n", pipefail ? "on" : "off");
+        return 0;
+    }
+    int on = strcmp(args[1], "-o") == 0;
+    if ((on || strcmp(args[1], "+o") == 0) && args[2] && strcmp(args[2], "pipefail") == 0) {
+        pipefail = on;
+        return 0;
+    }
+    fprintf(stderr, "set: usage: set [-o|+o pipefail]\n");
+    return 2;
+}
+
+/**
+ * Prints the exit status of every stage of the last foreground pipeline
+ * @param args - Array of arguments (unused)
+ * @return 0
+ */
+int command_pipestatus(char **args) {
+    for (int i = 0; i < last_pipestatus_count; i++) {
+        printf(i ? " %d" : "%d", last_pipestatus[i]);
+    }
+    printf("\n");
+    return 0;
+}
+
+/**
+ * break or continue outside a loop
+ * Inside a loop body they are compiled to jumps (see parser.h), so this
+ * only runs where there is no loop to leave.
+ * @param args - Array of arguments
+ * @return 1
+ */
+int command_break(char **args) {
+    fprintf(stderr, "%s: only meaningful in a `for', `while', or `until' loop\n", args[0]);
+    return 1;
+}
+
+/**
+ * Exports variables to the commands the shell starts
+ * Usage: export [NAME[=value]...]; with no names, lists what is exported
+ * @param args - Array of arguments
+ * @return 0 on success, 1 if a name was invalid
+ */
+int command_export(char **args) {
+    if (args[1] == NULL) {
+        vars_print(stdout, 1);
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        const char *eq = strchr(args[i], '=');
+        size_t len = eq ? (size_t)(eq - args[i]) : strlen(args[i]);
+        if (!var_is_name(args[i], len)) {
+            fprintf(stderr, "export: `%s': not a valid identifier\n", args[i]);
+            status = 1;
+            continue;
+        }
+        char name[len + 1];
+        memcpy(name, args[i], len);
+        name[len] = '\0';
+        if ((eq ? var_set(name, eq + 1, 1) : var_export(name)) != 0) {
+            fprintf(stderr, "export: Memory allocation failed\n");
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/**
+ * Removes variables
+ * @param args - Array of arguments; args[1...] are the names
+ * @return 0 on success, 1 if a name was invalid
+ */
+int command_unset(char **args) {
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        if (!var_is_name(args[i], strlen(args[i]))) {
+            fprintf(stderr, "unset: `%s': not a valid identifier\n", args[i]);
+            status = 1;
+            continue;
+        }
+        var_unset(args[i]);
+    }
+    return status;
+}
+
+/**
+ * Waits for background jobs
+ * @param args - Array of arguments: job specs (%n) or pids; none means all
+ * @return Exit status of the last job waited for
+ */
+int command_wait(char **args) {
+    if (args[1] == NULL) {
+        return job_wait(NULL);
+    }
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        status = job_wait(args[i]);
+        if (status == 127) {
+            fprintf(stderr, "wait: %s: no such job\n", args[i]);
+        }
+    }
+    return status;
+}
+
+/**
+ * Starts one pipeline of a parallel block with its stdout captured
+ * (callback for run_parallel)
+ * @param index - Which pipeline of the block to start
+ * @param out_fd - Descriptor that captures the pipeline's output
+ * @param label - Receives the pipeline's text for the trace, if asked for
+ * @param ctx - The block (a Sequence)
+ * @return Pid to wait for, or -1 on failure
+ */
+pid_t start_parallel_item(int index, int out_fd, char **label, void *ctx) {
+    Pipeline expanded;
+    Pipeline *pipeline = expand_pipeline(&((Sequence *)ctx)->pipelines[index], &expanded);
+    if (!pipeline) {
+        return -1;
+    }
+    Command *cmd = &pipeline->commands[0];
+    if (label) {
+        *label = pipeline_text(pipeline);
+    }
+
+    // A lone program is launched directly; anything else (including a
+    // program whose output fans out to several files) needs a copy of the shell
+    if (pipeline->count == 1 && is_external(cmd) && output_count(cmd) < 2 &&
+        !needs_batches(cmd)) {
+        LaunchSpec spec;
+        Plumbing pl;
+        launch_spec_init(&spec);
+        spec.stdout_fd = out_fd;
+        int plumbed = plumb_command(cmd, &spec, &pl) == 0;
+        pid_t pid = -1;
+        if (plumbed) {
+            char **env = command_environ(cmd, &spec);
+            pid = launch_program(command_program(cmd, cmd->argv[0]), cmd->argv, &spec);
+            free(env);
+        }
+        plumb_finish(&pl);
+        return pid;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Fork Failed");
+        return -1;
+    }
+    if (pid == 0) {
+        become_subshell();
+        dup2(out_fd, STDOUT_FILENO);
+        close(out_fd);
+        int status = pipeline->count > 1 ? execute_pipe(pipeline) : run_command(cmd);
+        fflush(stdout);
+        _exit(status);
+    }
+    return pid;
+}
+
+/**
+ * Runs the pipelines of a block in parallel, at most N at a time,
+ * printing each one's output in block order
+ * Usage: parallel [-j N] { cmd; cmd; ... }
+ * @param cmd - The parallel command with its block
+ * @return 0 if every pipeline succeeded, otherwise a failing status
+ */
+int command_parallel(Command* cmd) {
+    int max_jobs = 0;   // Default: one per CPU
+    for (int i = 1; i < cmd->argc; i++) {
+        if (strcmp(cmd->argv[i], "-j") == 0 && cmd->argv[i + 1] != NULL) {
+            max_jobs = atoi(cmd->argv[++i]);
+        } else if (strncmp(cmd->argv[i], "-j", 2) == 0 && cmd->argv[i][2] != '\0') {
+            max_jobs = atoi(cmd->argv[i] + 2);
+        } else {
+            fprintf(stderr, "parallel: unknown option: %s\n", cmd->argv[i]);
+            return 2;
+        }
+    }
+    if (cmd->block == NULL) {
+        fprintf(stderr, "parallel: usage: parallel [-j N] { cmd; cmd; ... }\n");
+        return 2;
+    }
+    // Items' expansions are kept until the whole block is done
+    ArenaMark mark = arena_mark(&line_arena);
+    int status = run_parallel(cmd->block->count, max_jobs, 1, start_parallel_item, cmd->block);
+    arena_release(&line_arena, mark);
+    return status;
+}
+
+/**
+ * A forall run: where the items come from and what runs on each
+ */
+typedef struct {
+    LineReader reader;    // Items, one per line of stdin
+    char **args;          // Command and arguments; {} stands for the item
+    int argc;
+    int placeholder;      // Whether an argument has {} (else the item is appended)
+    int null_fd;          // Stdin of every item, so none of them eats the list
+} ForallRun;
+
+/**
+ * Replaces every {} in an argument with an item
+ * @param arg - Argument as written
+ * @param item - The item
+ * @param item_len - Its length
+ * @return The argument for this item (malloc'd), or NULL on allocation failure
+ */
+char* substitute_item(const char *arg, const char *item, size_t item_len) {
+    size_t count = 0;
+    for (const char *p = strstr(arg, "{}"); p; p = strstr(p + 2, "{}")) count++;
+    char *out = malloc(strlen(arg) + count * item_len + 1);
+    if (!out) return NULL;
+    char *o = out;
+    const char *p;
+    while ((p = strstr(arg, "{}")) != NULL) {
+        memcpy(o, arg, p - arg);
+        o += p - arg;
+        memcpy(o, item, item_len);
+        o += item_len;
+        arg = p + 2;
+    }
+    strcpy(o, arg);
+    return out;
+}
+
+/**
+ * Reads the next item of a forall run and starts the command on it
+ * (ParallelStart for run_parallel)
+ * @param index - Item number
+ * @param out_fd - Descriptor that captures the item's output
+ * @param label - Receives the item's command for the trace, if asked for
+ * @param ctx - The ForallRun
+ * @return Pid to wait for, -1 on failure, or PARALLEL_END after the last item
+ */
+pid_t start_forall_item(int index, int out_fd, char **label, void *ctx) {
+    ForallRun *run = ctx;
+    size_t len;
+    char *item;
+    // Blank lines are not items
+    do {
+        item = line_reader_next(&run->reader, &len);
+    } while (item && len == 0);
+    if (!item) {
+        return PARALLEL_END;
+    }
+
+    int argc = run->argc + !run->placeholder;
+    char **argv = calloc(argc + 1, sizeof(char *));
+    int ok = argv != NULL;
+    for (int i = 0; ok && i < run->argc; i++) {
+        argv[i] = substitute_item(run->args[i], item, len);
+        ok = argv[i] != NULL;
+    }
+    if (ok && !run->placeholder) {
+        argv[argc - 1] = strdup(item);
+        ok = argv[argc - 1] != NULL;
+    }
+
+    pid_t pid = -1;
+    if (ok) {
+        Command cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.argv = argv;
+        cmd.argc = argc;
+        LaunchSpec spec;
+        launch_spec_init(&spec);
+        spec.stdin_fd = run->null_fd;
+        spec.stdout_fd = out_fd;
+        if (label) {
+            Pipeline single = {&cmd, 1, 0, 0, NULL};
+            *label = pipeline_text(&single);
+        }
+        pid = is_external(&cmd) ? launch_program(path_hash_lookup(argv[0]), argv, &spec)
+                                : launch_in_subshell(&cmd, &spec);
+    } else {
+        fprintf(stderr, "forall: Memory allocation failed\n");
+    }
+    for (int i = 0; argv && i < argc; i++) {
+        free(argv[i]);
+    }
+    free(argv);
+    return pid;
+}
+
+/**
+ * Runs a command on every line of stdin, N at a time, like xargs -P
+ * A new item starts as soon as one finishes; {} in the arguments stands
+ * for the item (without {}, it is appended). Each item's output is
+ * written out whole, in input order or with -c as items finish. Every
+ * item is traced with its number as the stage (see the trace builtin).
+ * Usage: forall [-P N] [-c] command [args...] < items
+ * @param args - Array of arguments
+ * @return 0 if every item succeeded, otherwise a failing status; 2 on bad usage
+ */
+int command_forall(char **args) {
+    int max_jobs = 0;   // Default: one per CPU
+    int in_order = 1;
+    int i = 1;
+    for (; args[i] && args[i][0] == '-'; i++) {
+        if (strcmp(args[i], "-P") == 0 && args[i + 1] != NULL) {
+            max_jobs = atoi(args[++i]);
+        } else if (strncmp(args[i], "-P", 2) == 0 && args[i][2] != '\0') {
+            max_jobs = atoi(args[i] + 2);
+        } else if (strcmp(args[i], "-c") == 0) {
+            in_order = 0;
+        } else {
+            fprintf(stderr, "forall: unknown option: %s\n", args[i]);
+            return 2;
+        }
+    }
+    if (args[i] == NULL) {
+        fprintf(stderr, "forall: usage: forall [-P N] [-c] command [args...] < items\n");
+        return 2;
+    }
+
+    ForallRun run;
+    run.args = args + i;
+    run.argc = 0;
+    run.placeholder = 0;
+    for (; run.args[run.argc]; run.argc++) {
+        if (strstr(run.args[run.argc], "{}")) run.placeholder = 1;
+    }
+    run.null_fd = shell_fd(open("/dev/null", O_RDONLY));
+    if (run.null_fd < 0 || line_reader_init(&run.reader, STDIN_FILENO) != 0) {
+        fprintf(stderr, "forall: cannot set up the items\n");
+        if (run.null_fd >= 0) close(run.null_fd);
+        return 1;
+    }
+    int status = run_parallel(-1, max_jobs, in_order, start_forall_item, &run);
+    line_reader_free(&run.reader);
+    close(run.null_fd);
+    return status;
+}
+
+/**
+ * Selects or shows the process launch backend
+ * @param args - Array of arguments; args[1] is the backend name (optional)
+ * @return 0 on success, 2 for an unknown backend
+ */
+int command_launcher(char **args) {
+    if (args[1] == NULL) {
+        printf("%s\n", launch_backend_name(get_launch_backend()));
+        return 0;
+    }
+    LaunchBackend backend;
+    if (parse_launch_backend(args[1], &backend) != 0) {
+        fprintf(stderr, "launcher: unknown backend: %s (use fork, vfork or posix_spawn)\n", args[1]);
+        return 2;
+    }
+    set_launch_backend(backend);
+    return 0;
+}
+
+/**
+ * Shows or sets the tuning every pipeline gets (see pipetune.h)
+ * Usage: pipeconf [-r] [-b SIZE] [-a CPUS] [-n NICE] [-i IOPRIO]
+ * @param args - Array of arguments; -r first resets every option
+ * @return 0 on success, 2 on bad usage (nothing is changed)
+ */
+int command_pipeconf(char **args) {
+    PipeTuning *defaults = pipe_tuning_defaults();
+    if (args[1] == NULL) {
+        pipe_tuning_print(defaults);
+        return 0;
+    }
+    PipeTuning changed = *defaults;
+    int i = 1;
+    if (strcmp(args[1], "-r") == 0) {
+        pipe_tuning_init(&changed);
+        i++;
+    }
+    for (; args[i]; i += 2) {
+        if (!args[i + 1]) {
+            fprintf(stderr, "pipeconf: %s needs a value\n", args[i]);
+            return 2;
+        }
+        if (pipe_tuning_option(&changed, args[i], args[i + 1], "pipeconf") != 0) {
+            return 2;
+        }
+    }
+    *defaults = changed;
+    return 0;
+}
+
+/**
+ * Hashes what a program's output may depend on: the program file, its
+ * arguments and environment, the working directory and every input
+ * redirection's contents (see memo.h)
+ * @param cmd - Expanded external command
+ * @param key - Receives the key
+ * @return 0 on success, MEMO_UNHASHED_INPUT if its stdin is a pipe or a
+ *         terminal, -1 if it cannot be cached for another reason (its
+ *         input comes from another descriptor or a file that cannot be
+ *         read, or the program is missing, which running it reports)
+ */
+int memo_command_key(Command* cmd, char* key) {
+    MemoHash hash;
+    struct stat st;
+    char cwd[PATH_MAX];
+    const char *path = command_program(cmd, cmd->argv[0]);
+    if (!path || stat(path, &st) != 0 || !getcwd(cwd, sizeof(cwd))) {
+        return -1;
+    }
+
+    // A rebuilt program is another program
+    memo_hash_init(&hash);
+    memo_hash_string(&hash, path);
+    memo_hash_bytes(&hash, &st.st_ino, sizeof(st.st_ino));
+    memo_hash_bytes(&hash, &st.st_size, sizeof(st.st_size));
+    memo_hash_bytes(&hash, &st.st_mtim, sizeof(st.st_mtim));
+    memo_hash_string(&hash, cwd);
+    for (int i = 0; i < cmd->argc; i++) {
+        memo_hash_string(&hash, cmd->argv[i]);
+    }
+    LaunchSpec spec;
+    launch_spec_init(&spec);
+    char **added = command_environ(cmd, &spec);
+    char **env = spec.envp ? spec.envp : vars_environ();
+    for (int i = 0; env && env[i]; i++) {
+        memo_hash_string(&hash, env[i]);
+    }
+    free(added);
+
+    int stdin_known = 0;
+    for (int i = 0; i < cmd->redirect_count; i++) {
+        // Where the output goes does not change what it is
+        Redirect *r = &cmd->redirects[i];
+        int status = 0;
+        if (r->kind == REDIRECT_INPUT || r->kind == REDIRECT_HEREDOC || r->kind == REDIRECT_STRING) {
+            memo_hash_bytes(&hash, &r->fd, sizeof(r->fd));
+            if (r->fd == STDIN_FILENO) stdin_known = 1;
+        }
+        if (r->kind == REDIRECT_INPUT) {
+            status = memo_hash_file(&hash, r->target);
+        } else if (r->kind == REDIRECT_HEREDOC) {
+            memo_hash_bytes(&hash, r->body, r->body_len);
+        } else if (r->kind == REDIRECT_STRING) {
+            memo_hash_string(&hash, r->target);
+        } else if (r->kind == REDIRECT_DUP && r->fd == STDIN_FILENO) {
+            status = -1;
+        }
+        if (status != 0) return -1;
+    }
+    if (!stdin_known) {
+        // An inherited file is hashed from where the command starts reading,
+        // a device such as /dev/null by its number; a pipe or a terminal
+        // gives different input every run
+        struct stat in;
+        if (fstat(STDIN_FILENO, &in) != 0 || isatty(STDIN_FILENO) ||
+            !(S_ISREG(in.st_mode) || S_ISCHR(in.st_mode))) {
+            return MEMO_UNHASHED_INPUT;
+        }
+        memo_hash_bytes(&hash, &in.st_rdev, sizeof(in.st_rdev));
+        if (S_ISREG(in.st_mode) && memo_hash_fd(&hash, STDIN_FILENO) != 0) return -1;
+    }
+    memo_hash_final(&hash, key);
+    return 0;
+}
+
+/**
+ * Writes all of a buffer to a descriptor
+ * @param fd - Descriptor
+ * @param data - Bytes to write
+ * @param len - Number of bytes
+ * @return 0 on success, -1 on a write error
+ */
+int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Replays a cached result, or runs the program with its output captured
+ * and caches that; its redirections are already in place, so stdout is
+ * where the output must go
+ * @param cmd - Expanded external command
+ * @param ctx - Its key
+ * @return Exit status of the command
+ */
+int replay_or_run(Command* cmd, void* ctx) {
+    const char *key = ctx;
+    char *output;
+    size_t len;
+    int status;
+    if (!memo_lookup(key, &output, &len, &status)) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            perror("pipe failed");
+            return 1;
+        }
+        LaunchSpec spec;
+        ProcessStats stats;
+        launch_spec_init(&spec);
+        spec.stdout_fd = fds[1];
+        char **env = command_environ(cmd, &spec);
+        stats.start = monotonic_now();
+        pid_t pid = launch_program(command_program(cmd, cmd->argv[0]), cmd->argv, &spec);
+        free(env);
+        close(fds[1]);
+        output = read_all(fds[0], &len);
+        close(fds[0]);
+        status = 127;
+        if (pid > 0) {
+            wait_child_stats(pid, &stats);
+            status = stats.status;
+            record_process(0, pid, cmd, &stats);
+        }
+        // A program killed by a signal did not finish its output
+        if (output && pid > 0 && status < 128) {
+            memo_store(key, output, len, status);
+        }
+    }
+    if (output && write_all(STDOUT_FILENO, output, len) != 0) {
+        perror(cmd->argv[0]);
+    }
+    free(output);
+    return status;
+}
+
+/**
+ * Runs a command prefixed with `memo`, from the cache if it can
+ * Only programs are cached; builtins, blocks and programs run in batches
+ * just run. What they write to stderr is not cached.
+ * @param cmd - Expanded command
+ * @return Exit status of the command
+ */
+int run_memoized(Command* cmd) {
+    char key[MEMO_KEY_SIZE];
+    int keyed = is_external(cmd) && !needs_batches(cmd) ? memo_command_key(cmd, key) : -1;
+    if (keyed == MEMO_UNHASHED_INPUT) {
+        fflush(stdout);
+        fprintf(stderr, "memo: %s: not cached, stdin is a pipe or terminal\n", cmd->argv[0]);
+    }
+    if (keyed != 0) {
+        return run_command(cmd);
+    }
+    fflush(stdout);
+    return with_redirects(cmd, replay_or_run, key);
+}
+
+/**
+ * Shows the result cache or changes it (see memo.h)
+ * Usage: memoconf [-c] [-d DIR] [-s SIZE]
+ * @param args - Array of arguments; -c removes every entry and zeroes the
+ *               counters, -d and -s set the directory and size limit
+ * @return 0 on success, 2 on bad usage
+ */
+int command_memoconf(char **args) {
+    if (args[1] == NULL) {
+        memo_print();
+        return 0;
+    }
+    for (int i = 1; args[i]; i++) {
+        if (strcmp(args[i], "-c") == 0) {
+            memo_clear();
+        } else if (strcmp(args[i], "-d") == 0 && args[i + 1]) {
+            if (memo_set_dir(args[++i]) != 0) {
+                fprintf(stderr, "memoconf: Memory allocation failed\n");
+                return 1;
+            }
+        } else if (strcmp(args[i], "-s") == 0 && args[i + 1]) {
+            if (memo_set_limit(args[++i]) != 0) {
+                fprintf(stderr, "memoconf: bad size: %s\n", args[i]);
+                return 2;
+            }
+        } else {
+            fprintf(stderr, "memoconf: usage: memoconf [-c] [-d DIR] [-s SIZE]\n");
+            return 2;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Runs a single command: builtins in the shell itself, anything else in a
+ * new process
+ * @param cmd - Command to run
+ * @return Exit status of the command
+ */
+int run_command(Command* cmd) {
+    if (cmd->argc == 0 && cmd->block == NULL && cmd->program == NULL) {
+        // Assignments alone set shell variables; a command whose
+        // substitutions left no words has their status
+        int status = assign_variables(cmd, 0);
+        if (status == 0) {
+            status = apply_bare_redirects(cmd);
+        }
+        return status == 0 && substitution_status >= 0 ? substitution_status : status;
+    }
+    if (is_external(cmd)) {
+        return execute_command(cmd);
+    }
+    if (cmd->argc > 0 && strcmp(cmd->argv[0], "exec") == 0) {
+        return command_exec(cmd);
+    }
+    if (cmd->assign_count > 0) {
+        return run_with_assignments(cmd);
+    }
+    return run_redirected(cmd);
+}
+
+/**
+ * Shows or sets where trace records go (see trace.h)
+ * Usage: trace [off | fd | file]
+ * @param args - Array of arguments
+ * @return 0 on success, 1 if the target could not be opened
+ */
+int command_trace(char **args) {
+    if (args[1] == NULL) {
+        printf("trace: %s\n", trace_enabled() ? "on" : "off");
+        return 0;
+    }
+    if (trace_open(args[1]) != 0) {
+        fprintf(stderr, "trace: cannot write to %s\n", args[1]);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Formats seconds the way `time` and `times` print them, e.g. 0m1.250s
+ * @param out - Stream to print to
+ * @param seconds - Time to print
+ */
+void print_minutes(FILE *out, double seconds) {
+    int minutes = (int)(seconds / 60);
+    fprintf(out, "%dm%.3fs", minutes, seconds - minutes * 60);
+}
+
+/**
+ * Prints the user and system time used by the shell and by its children
+ * @param args - Array of arguments (unused)
+ * @return Always 0
+ */
+int command_times(char **args) {
+    int who[] = {RUSAGE_SELF, RUSAGE_CHILDREN};
+    for (int i = 0; i < 2; i++) {
+        struct rusage usage;
+        getrusage(who[i], &usage);
+        print_minutes(stdout, usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6);
+        printf(" ");
+        print_minutes(stdout, usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6);
+        printf("\n");
+    }
+    return 0;
+}
+
+/**
+ * Prints the report of a pipeline prefixed with `time`
+ * @param stats - Measurements of the pipeline
+ * @param posix - Whether to use the `time -p` format
+ */
+void print_time_report(const ProcessStats* stats, int posix) {
+    double real = stats->end - stats->start;
+    double user = stats->usage.ru_utime.tv_sec + stats->usage.ru_utime.tv_usec / 1e6;
+    double sys = stats->usage.ru_stime.tv_sec + stats->usage.ru_stime.tv_usec / 1e6;
+
+    fflush(stdout);
+    if (posix) {
+        fprintf(stderr, "real %.2f\nuser %.2f\nsys %.2f\n", real, user, sys);
+        return;
+    }
+    const char *labels[] = {"\nreal\t", "user\t", "sys\t"};
+    double values[] = {real, user, sys};
+    for (int i = 0; i < 3; i++) {
+        fputs(labels[i], stderr);
+        print_minutes(stderr, values[i]);
+        fputc('\n', stderr);
+    }
+}
+
+/**
+ * Reads a descriptor to end of file into a growing buffer
+ * @param fd - Descriptor to read
+ * @param len - Receives the number of bytes read
+ * @return The bytes (malloc'd), or NULL on allocation failure
+ */
+char* read_all(int fd, size_t* len) {
+    size_t size = CAPTURE_BUFFER_SIZE, used = 0;
+    char *buffer = malloc(size);
+    while (buffer) {
+        if (used == size) {
+            char *bigger = realloc(buffer, size * 2);
+            if (!bigger) {
+                free(buffer);
+                return NULL;
+            }
+            buffer = bigger;
+            size *= 2;
+        }
+        ssize_t n = read(fd, buffer + used, size - used);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        used += n;
+    }
+    *len = used;
+    return buffer;
+}
+
+/**
+ * Runs the command of a $(...) or `...` with its output captured
+ * (CaptureFn, see expand.h)
+ * A single pipeline of programs is launched straight into the capture
+ * pipe, $(a | b) included; builtins, blocks and several pipelines run in
+ * a forked copy of the shell. The output is read from the pipe into
+ * memory, so nothing touches the disk. The children stay in the shell's
+ * process group, where Ctrl-C and the terminal reach them.
+ * @param command - Command text
+ * @param len - Receives the length of the output
+ * @param ctx - Unused
+ * @return The output, or NULL if the command could not be parsed or run,
+ *         or was interrupted
+ */
+char* capture_output(const char* command, size_t* len, void* ctx) {
+    ArenaMark mark = arena_mark(&line_arena);
+    Sequence seq;
+    int fds[2];
+    if (parse_input(&line_arena, command, NULL, NULL, &seq, NULL) != 0) {
+        arena_release(&line_arena, mark);
+        return NULL;
+    }
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        perror("pipe failed");
+        arena_release(&line_arena, mark);
+        return NULL;
+    }
+
+    Pipeline *pipeline = &seq.pipelines[0];
+    int direct = seq.count == 1 && !pipeline->background && !pipeline->coproc &&
+                 !pipeline->timed && !pipeline->memo;
+    for (int i = 0; direct && i < pipeline->count; i++) {
+        direct = is_external(&pipeline->commands[i]) &&
+                 !command_needs_expansion(&pipeline->commands[i]);
+    }
+
+    int count = direct ? pipeline->count : 1;
+    pid_t pids[2 * count];      // Stages, then fan-out helpers
+    int num_pids = 1;
+    fflush(stdout);
+    if (direct) {
+        num_pids = count + launch_pipeline(pipeline, STDIN_FILENO, fds[1], pids, pids + count, 0);
+    } else {
+        pids[0] = fork();
+        if (pids[0] == 0) {
+            become_subshell();
+            close(fds[0]);
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[1]);
+            int status = run_sequence(&seq);
+            fflush(stdout);
+            _exit(status);
+        }
+        if (pids[0] < 0) {
+            perror("Fork Failed");
+        }
+    }
+    close(fds[1]);
+    char *output = read_all(fds[0], len);
+    close(fds[0]);
+
+    int statuses[count];
+    for (int i = 0; i < num_pids; i++) {
+        int status = pids[i] > 0 ? wait_child(pids[i]) : 127;
+        if (i < count) {
+            statuses[i] = status;
+        }
+    }
+    substitution_status = pipeline_status(statuses, count);
+    arena_release(&line_arena, mark);
+    if (substitution_status == 128 + SIGINT) {
+        // Ctrl-C abandons the command the substitution was for
+        free(output);
+        return NULL;
+    }
+    return output;
+}
+
+/**
+ * Reads a variable for an expansion (LookupFn, see expand.h)
+ * $?, $$, $! and $PIPESTATUS come from the shell's own state, formatted
+ * into line_arena.
+ * @param name - Variable name
+ * @param ctx - Unused
+ * @return Its value, or NULL if it is not set
+ */
+const char* lookup_variable(const char* name, void* ctx) {
+    char number[24];
+    if (strcmp(name, "?") == 0) {
+        snprintf(number, sizeof(number), "%d", last_status);
+    } else if (strcmp(name, "$") == 0) {
+        snprintf(number, sizeof(number), "%d", (int)shell_pid);
+    } else if (strcmp(name, "!") == 0) {
+        if (last_background_pid == 0) {
+            return NULL;
+        }
+        snprintf(number, sizeof(number), "%d", (int)last_background_pid);
+    } else if (strcmp(name, "PIPESTATUS") == 0) {
+        char *text = arena_alloc(&line_arena, last_pipestatus_count * sizeof(number) + 1);
+        if (!text) {
+            return NULL;
+        }
+        text[0] = '\0';
+        for (int i = 0, len = 0; i < last_pipestatus_count; i++) {
+            len += sprintf(text + len, i ? " %d" : "%d", last_pipestatus[i]);
+        }
+        return text;
+    } else {
+        return var_get(name);
+    }
+    return arena_strndup(&line_arena, number, strlen(number));
+}
+
+static const ExpandHooks expand_hooks = {capture_output, lookup_variable, NULL};
+
+/**
+ * Expands the words of a pipeline's stages (see expand.h)
+ * @param pipeline - Pipeline as parsed
+ * @param expanded - Storage for an expanded copy
+ * @return pipeline itself if nothing needs expanding, otherwise expanded
+ *         (its stages in line_arena), or NULL if an expansion failed
+ */
+Pipeline* expand_pipeline(Pipeline* pipeline, Pipeline* expanded) {
+    int needed = 0;
+    for (int i = 0; i < pipeline->count && !needed; i++) {
+        needed = command_needs_expansion(&pipeline->commands[i]);
+    }
+    if (!needed) {
+        return pipeline;
+    }
+
+    *expanded = *pipeline;
+    expanded->commands = arena_alloc(&line_arena, pipeline->count * sizeof(Command));
+    if (!expanded->commands) {
+        return NULL;
+    }
+    for (int i = 0; i < pipeline->count; i++) {
+        if (expand_command(&line_arena, &pipeline->commands[i], &expanded->commands[i],
+                           &expand_hooks) != 0) {
+            return NULL;
+        }
+    }
+    return expanded;
+}
+
+/**
+ * Runs a foreground pipeline
+ * @param pipeline - Pipeline to run
+ * @return Exit status of the pipeline
+ */
+int run_foreground(Pipeline* pipeline) {
+    if (pipeline->memo) {
+        int status = run_memoized(&pipeline->commands[0]);
+        set_pipestatus(&status, 1);
+        return status;
+    }
+    // A single command with `pipe` options is started like a stage, to get them
+    if (pipeline->count > 1 || pipeline->tuning) {
+        return execute_pipe(pipeline);
+    }
+    int status = run_command(&pipeline->commands[0]);
+    set_pipestatus(&status, 1);
+    return status;
+}
+
+/**
+ * Starts a pipeline as a background job
+ * @param pipeline - Pipeline to start
+ * @param input_fd - First stage's stdin (closed here unless it is STDIN_FILENO)
+ * @param output_fd - Last stage's stdout, or -1 to inherit
+ * @return Pid of the last stage, or -1 if it did not start
+ */
+pid_t start_job(Pipeline* pipeline, int input_fd, int output_fd) {
+    // Fan-out helpers go first so the job's status is still its last stage's
+    int count = pipeline->count;
+    pid_t pids[2 * count];
+    int num_helpers = launch_pipeline(pipeline, input_fd, output_fd, pids + count, pids, 1);
+    memmove(pids + num_helpers, pids + count, count * sizeof(pid_t));
+    pid_t group = job_control_enabled() ? first_pid(pids + num_helpers, count) : 0;
+    int id = job_add(pids, num_helpers + count, pipeline, group);
+    if (interactive && id > 0) {
+        printf("[%d] %d\n", id, (int)pids[num_helpers + count - 1]);
+    }
+    return pids[num_helpers + count - 1];
+}
+
+/**
+ * Starts a coprocess: a background job whose stdin and stdout are pipes
+ * the shell keeps, for cowrite and coread
+ * @param pipeline - Pipeline prefixed with coproc
+ * @return 0 if it started, 1 otherwise
+ */
+int start_coproc(Pipeline* pipeline) {
+    int child_in, child_out, to_fd, from_fd;
+    if (coproc_pipes(&child_in, &child_out, &to_fd, &from_fd) != 0) {
+        return 1;
+    }
+    coproc_shell_fds[0] = to_fd;
+    coproc_shell_fds[1] = from_fd;
+    pid_t pid = start_job(pipeline, child_in, child_out);
+    coproc_shell_fds[0] = coproc_shell_fds[1] = -1;
+    close(child_out);
+    if (pid < 0) {
+        close(to_fd);
+        close(from_fd);
+        return 1;
+    }
+    return coproc_add(pipeline->coproc, pid, to_fd, from_fd) == 0 ? 0 : 1;
+}
+
+/**
+ * Runs an expanded pipeline, in the background if it ended with '&'
+ * A foreground pipeline is measured when it is prefixed with `time` or
+ * when tracing is on.
+ * @param pipeline - Pipeline to run
+ * @return Exit status of the pipeline (0 for background jobs)
+ */
+int run_expanded(Pipeline* pipeline) {
+    if (pipeline->coproc) {
+        return start_coproc(pipeline);
+    }
+    if (pipeline->background) {
+        pid_t pid = start_job(pipeline, STDIN_FILENO, -1);
+        if (pid > 0) {
+            last_background_pid = pid;
+        }
+        return 0;
+    }
+    if (!pipeline->timed && !trace_enabled()) {
+        return run_foreground(pipeline);
+    }
+
+    ProcessStats stats;
+    long id = trace_pipeline_begin(&stats);
+    int status = run_foreground(pipeline);
+    char *text = trace_enabled() ? pipeline_text(pipeline) : NULL;
+    trace_pipeline_end(id, &stats, status, pipeline->count, text);
+    free(text);
+    if (pipeline->timed) {
+        print_time_report(&stats, pipeline->timed == 2);
+    }
+    return status;
+}
+
+/**
+ * Expands and runs one pipeline
+ * Whatever the expansion allocated is released once the pipeline is done.
+ * @param pipeline - Pipeline as parsed
+ * @return Exit status of the pipeline (if its expansion failed, 1 or the
+ *         status of the substitution that was interrupted)
+ */
+int run_pipeline(Pipeline* pipeline) {
+    // Rebuilds the environment if an exported variable changed (see vars.h)
+    vars_environ();
+    ArenaMark mark = arena_mark(&line_arena);
+    Pipeline expanded;
+    substitution_status = -1;
+    Pipeline *ready = expand_pipeline(pipeline, &expanded);
+    int status = ready ? run_expanded(ready) : substitution_status > 0 ? substitution_status : 1;
+    arena_release(&line_arena, mark);
+    return status;
+}
+
+/**
+ * Runs every pipeline of a parsed line in order
+ * @param seq - Parsed line
+ * @return Exit status of the last pipeline
+ */
+int run_sequence(Sequence* seq) {
+    int status = 0;
+    for (int i = 0; i < seq->count && !exit_requested; i++) {
+        // Kept current so `exit` and pipestatus see the previous pipeline
+        status = last_status = run_pipeline(&seq->pipelines[i]);
+    }
+    return status;
+}
+
+/**
+ * A loop being run by run_program
+ */
+typedef struct {
+    const ForLoop *loop;  // The for loop, or NULL for while and until
+    char **words;         // Words left to loop over (in line_arena)
+    int count;
+    int next;
+    int status;           // Status of the body's last round (0 before any)
+    ArenaMark mark;       // line_arena before the words were expanded
+} LoopFrame;
+
+/**
+ * Enters a for loop: expands its words, which stay until the loop ends
+ * @param frame - Receives the loop's state
+ * @param loop - The loop
+ */
+static void enter_for(LoopFrame* frame, const ForLoop* loop) {
+    Command expanded = loop->words;
+    frame->loop = loop;
+    frame->mark = arena_mark(&line_arena);
+    frame->next = 0;
+    frame->status = 0;
+    if (command_needs_expansion(&loop->words)) {
+        substitution_status = -1;
+        if (expand_command(&line_arena, &loop->words, &expanded, &expand_hooks) != 0) {
+            // Nothing to loop over; the loop fails
+            expanded.argc = 0;
+            frame->status = substitution_status > 0 ? substitution_status : 1;
+        }
+    }
+    frame->words = expanded.argv;
+    frame->count = expanded.argc;
+}
+
+/**
+ * Runs a compiled compound command (see parser.h)
+ * The dispatch loop keeps the status in a local and the running loops on
+ * a stack. It stops early on exit, or when Ctrl-C ends a command or is
+ * pressed while the loop only runs builtins.
+ * @param program - Compiled if, while, until or for
+ * @return Exit status of the last command it ran (0 if none)
+ */
+int run_program(const Program* program) {
+    LoopFrame *frames = NULL;
+    int depth = 0, capacity = 0;
+    int status = 0;
+    unsigned int jumps = 0;
+    int pc = 0;
+
+    while (pc < program->count && !exit_requested) {
+        const Instruction *ins = &program->code[pc++];
+        switch (ins->op) {
+        case OP_RUN:
+            status = last_status = run_pipeline(ins->operand);
+            if (status == 128 + SIGINT) {
+                pc = program->count;
+            }
+            break;
+        case OP_JUMP:
+            if (ins->arg < pc && (++jumps & INTERRUPT_CHECK_MASK) == 0) {
+                int sig = events_interrupt_pending();
+                if (sig) {
+                    status = last_status = 128 + sig;
+                    pc = program->count;
+                    break;
+                }
+            }
+            pc = ins->arg;
+            break;
+        case OP_JUMP_IF_FAILED:
+            if (status != 0) pc = ins->arg;
+            break;
+        case OP_JUMP_IF_OK:
+            if (status == 0) pc = ins->arg;
+            break;
+        case OP_STATUS:
+            status = ins->arg;
+            break;
+        case OP_LOOP:
+        case OP_FOR:
+            if (depth == capacity) {
+                capacity = capacity ? capacity * 2 : 4;
+                LoopFrame *bigger = realloc(frames, capacity * sizeof(LoopFrame));
+                if (!bigger) {
+                    fprintf(stderr, "Error: Memory allocation failed\n");
+                    status = 1;
+                    pc = program->count;
+                    break;
+                }
+                frames = bigger;
+            }
+            memset(&frames[depth], 0, sizeof(LoopFrame));
+            if (ins->op == OP_FOR) {
+                enter_for(&frames[depth], ins->operand);
+            }
+            depth++;
+            break;
+        case OP_NEXT: {
+            LoopFrame *frame = &frames[depth - 1];
+            if (frame->next >= frame->count ||
+                var_set(frame->loop->name, frame->words[frame->next++], 0) != 0) {
+                pc = ins->arg;
+            }
+            break;
+        }
+        case OP_KEEP:
+            frames[depth - 1].status = status;
+            break;
+        case OP_LOOP_END:
+            depth--;
+            status = frames[depth].status;
+            if (frames[depth].loop) {
+                arena_release(&line_arena, frames[depth].mark);
+            }
+            break;
+        case OP_BREAK:
+        case OP_CONTINUE:
+            // Resolved by the parser; never reached
+            break;
+        }
+    }
+
+    // Loops left early give back their words
+    while (depth > 0) {
+        depth--;
+        if (frames[depth].loop) {
+            arena_release(&line_arena, frames[depth].mark);
+        }
+    }
+    free(frames);
+    return status;
+}
+
+/**
+ * Processes and executes commands based on user input
+ * The line is tokenized and parsed in one pass into an AST (sequence ->
+ * pipeline -> command + redirections), which is then executed.
+ * @param input - The command input string to process
+ * @return Exit status of the line (2 for a syntax error)
+ */
+int process_commands(char* input) {
+    // Everything parsed below is released in one step when we are done
+    ArenaMark mark = arena_mark(&line_arena);
+    Sequence seq;
+    int status = 2;
+
+    // An unfinished if, while or for goes on on the following lines
+    const char *prompt = prompt_reader && input_reader == prompt_reader ? CONTINUATION_PROMPT : NULL;
+    if (parse_input(&line_arena, input, input_reader, prompt, &seq, NULL) == 0) {
+        status = run_sequence(&seq);
+    }
+
+    arena_release(&line_arena, mark);
+    return status;
+}
+
+/**
+ * Reads $PATH for the path cache from the shell's variables, so a PATH
+ * that is set but not exported is searched too
+ * @return The search path, or NULL if PATH is unset
+ */
+const char* shell_path(void) {
+    return var_get("PATH");
+}
+
+/**
+ * Opens the history: $MINISHELL_HISTORY if set, ~/.minishell_history for
+ * interactive shells, otherwise one that is dropped on exit
+ */
+void open_history(void) {
+    // Sessions of a server keep their history to themselves
+    const char *path = server_session ? NULL : getenv("MINISHELL_HISTORY");
+    const char *home = getenv("HOME");
+    char *default_path = NULL;
+
+    if (!path && interactive && home) {
+        default_path = malloc(strlen(home) + sizeof(HISTORY_FILE) + 1);
+        if (default_path) {
+            sprintf(default_path, "%s/%s", home, HISTORY_FILE);
+        }
+        path = default_path;
+    }
+    if (history_open(path && *path ? path : NULL) != 0) {
+        fprintf(stderr, "history: cannot open %s\n", path);
+        history_open(NULL);
+    }
+    free(default_path);
+}
+
+/**
+ * Prints how to invoke the shell
+ * @param name - Name the shell was started as
+ */
+void print_usage(const char *name) {
+    fprintf(stderr, "usage: %s [-i] [-c command | script]\n"
+                    "       %s --server socket [--workers N]\n", name, name);
+}
+
+/**
+ * Main function: Initializes the shell and processes input in a loop
+ * Usage: shell [-i] [-c command | script]
+ *        shell --server socket [--workers N]
+ * Commands come from -c, a script file, or stdin. Only a user at a
+ * terminal (or -i) gets the banner and prompts; in batch mode stdout is
+ * fully buffered, so a long script costs one write per buffer of output
+ * plus one read per 64K of input. With --server, every client of the
+ * socket gets a batch session of its own (see server.h).
+ * @return Exit status of the last command
+ */
+int main(int argc, char **argv) {
+    LineReader reader;
+    char *input;
+    const char *command = NULL;   // Text given with -c
+    const char *script = NULL;    // Script file to run
+    const char *server_path = NULL; // Socket to serve sessions on
+    int workers = 0;                // Server workers waiting at once (0: one per CPU)
+    int force_interactive = 0;
+
+    for (int i = 1; i < argc && !script; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "%s: -c: option requires an argument\n", argv[0]);
+                return 2;
+            }
+            command = argv[++i];
+        } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            server_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0) {
+            force_interactive = 1;
+        } else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            return 2;
+        } else {
+            script = argv[i];
+        }
+    }
+    if (server_path && (command || script || force_interactive)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    shell_pid = getpid();
+    // Hold the free user descriptors, so the shell's own land above them
+    for (int fd = STDERR_FILENO + 1; fd < USER_FD_LIMIT; fd++) {
+        if (fcntl(fd, F_GETFD) < 0) {
+            reserve_fd(fd);
+        }
+    }
+    if (vars_init(environ) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed while reading the environment.\n");
+        return 1;
+    }
+    path_hash_set_source(shell_path);
+
+    // Pick the input: the -c text (fed like a here-document), a script or stdin
+    int fd = STDIN_FILENO;
+    if (command) {
+        fd = zc_feed(command, strlen(command));
+    } else if (script) {
+        fd = open(script, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s: No such file or directory\n", argv[0], command ? "-c" : script);
+        return 127;
+    }
+
+    arena_init(&line_arena);
+    if (line_reader_init(&reader, fd) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed while reading input.\n");
+        return 1;
+    }
+    input_reader = &reader;
+
+    // Let the environment pick the launch backend (see the launcher builtin)
+    const char *backend_name = getenv("MINISHELL_LAUNCHER");
+    LaunchBackend backend;
+    if (backend_name && parse_launch_backend(backend_name, &backend) == 0) {
+        set_launch_backend(backend);
+    }
+    // MINISHELL_TRACE=fd or file turns on the trace (see the trace builtin)
+    const char *trace_target = getenv("MINISHELL_TRACE");
+    if (trace_target && trace_open(trace_target) != 0) {
+        fprintf(stderr, "trace: cannot write to %s\n", trace_target);
+    }
+
+    // Everything above is done once; each session starts from here in a
+    // worker of its own, with the client as stdin, stdout and stderr
+    if (server_path) {
+        int conn = server_run(server_path, workers);
+        if (conn < 0) {
+            return conn == SERVER_STOPPED ? 0 : 1;
+        }
+        dup2(conn, STDIN_FILENO);
+        dup2(conn, STDOUT_FILENO);
+        dup2(conn, STDERR_FILENO);
+        close(conn);
+        shell_pid = getpid();
+        server_session = 1;
+    }
+
+    interactive = force_interactive || (fd == STDIN_FILENO && isatty(STDIN_FILENO));
+    prompt_reader = interactive ? &reader : NULL;
+    if (interactive) {
+        printf("Welcome to mini-shell\n");
+    } else {
+        // Nobody is watching: write output in large blocks
+        setvbuf(stdout, NULL, _IOFBF, BATCH_BUFFER_SIZE);
+    }
+    // Job control needs a terminal to hand to the foreground job
+    if (interactive && fd == STDIN_FILENO) {
+        job_control_init();
+    }
+    events_init(job_control_enabled());
+    open_history();
+
+    while (1) {
+        // Report background jobs that finished while the last line ran
+        job_reap(interactive ? stdout : NULL);
+        if (interactive) {
+            printf("shell $ ");
+            fflush(stdout);
+        }
+
+        // Lines come back without their newline, however long they are
+        input = line_reader_next(&reader, NULL);
+        if (input == NULL) {
+            break;
+        }
+
+        // !! and friends are replaced (and shown) before anything else; as
+        // in bash, only lines a user types are expanded and recorded
+        char *expanded = NULL;
+        if (interactive && input[0] == '!' && input[1] != '\0' && !strchr(" \t=", input[1])) {
+            expanded = history_expand(input);
+            if (!expanded) {
+                last_status = 1;
+                continue;
+            }
+            printf("%s\n", expanded);
+            input = expanded;
+        }
+        if (interactive && strcmp(input, "prev") != 0) {
+            history_add(input, strlen(input));
+        }
+
+        first_command = 0;
+        last_status = process_commands(input);
+        free(expanded);
+        if (exit_requested) {
+            break;
+        }
+        // Ctrl-C ends a script; at the prompt it only ends the command
+        if (events_take_interrupt() && !interactive) {
+            last_status = 130;
+            break;
+        }
+        if (interactive && last_status == 128 + SIGINT) {
+            printf("\n");
+        }
+    }
+    if (interactive) {
+        printf("Bye bye.\n");
+    }
+
+    fflush(stdout);
+    history_close();
+    coproc_free();
+    free(last_pipestatus);
+    events_free();
+    path_hash_free();
+    script_cache_free();
+    jobs_free();
+    trace_close();
+    vars_free();
+    memo_free();
+    arena_free(&line_arena);
+    line_reader_free(&reader);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return last_status;
+}
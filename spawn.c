@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "events.h"
+#include "pathhash.h"
+#include "spawn.h"
+
+/* Constants */
+#define IOPRIO_WHO_PROCESS 1     // ioprio_set(2) has no glibc wrapper or header
+#define SCRIPT_SHELL "/bin/sh"   // Runs a script without a #! line, as execvp does
+
+extern char **environ;
+
+static LaunchBackend current_backend = LAUNCH_POSIX_SPAWN;
+static volatile int vfork_exec_error = 0;  // Set by a vfork'ed child whose execve failed
+
+void launch_spec_init(LaunchSpec *spec) {
+    spec->stdin_fd = -1;
+    spec->stdout_fd = -1;
+    spec->close_fd = -1;
+    spec->actions = NULL;
+    spec->action_count = 0;
+    spec->pgid = -1;
+    spec->envp = NULL;
+    spec->cpu = LAUNCH_INHERIT;
+    spec->nice = LAUNCH_INHERIT;
+    spec->ioprio = LAUNCH_INHERIT;
+}
+
+/**
+ * @param set - Receives the signals the shell may block or ignore, which a
+ *              child must get back with their default action
+ */
+static void shell_signals(sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, SIGCHLD);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGQUIT);
+    sigaddset(set, SIGPIPE);
+    sigaddset(set, SIGTSTP);
+    sigaddset(set, SIGTTIN);
+    sigaddset(set, SIGTTOU);
+}
+
+/**
+ * Writes a message to stderr using only async-signal-safe calls
+ * (safe to use between vfork and exec)
+ * @param a - First part of the message
+ * @param b - Second part of the message
+ */
+static void child_error(const char *a, const char *b) {
+    write(STDERR_FILENO, a, strlen(a));
+    write(STDERR_FILENO, b, strlen(b));
+    write(STDERR_FILENO, "\n", 1);
+}
+
+void launch_apply_scheduling(const LaunchSpec *spec) {
+    if (spec->cpu != LAUNCH_INHERIT) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(spec->cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) child_error("pipe: cannot set ", "cpu");
+    }
+    if (spec->nice != LAUNCH_INHERIT && setpriority(PRIO_PROCESS, 0, spec->nice) != 0) {
+        child_error("pipe: cannot set ", "nice");
+    }
+    if (spec->ioprio != LAUNCH_INHERIT &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, spec->ioprio) != 0) {
+        child_error("pipe: cannot set ", "io priority");
+    }
+}
+
+int launch_apply_spec(const LaunchSpec *spec) {
+    if (spec->close_fd >= 0) {
+        close(spec->close_fd);
+    }
+    if (spec->stdin_fd >= 0 && spec->stdin_fd != STDIN_FILENO) {
+        dup2(spec->stdin_fd, STDIN_FILENO);
+        close(spec->stdin_fd);
+    }
+    if (spec->stdout_fd >= 0 && spec->stdout_fd != STDOUT_FILENO) {
+        dup2(spec->stdout_fd, STDOUT_FILENO);
+        close(spec->stdout_fd);
+    }
+
+    for (int i = 0; i < spec->action_count; i++) {
+        const FdAction *a = &spec->actions[i];
+        if (a->kind == FD_CLOSE) {
+            close(a->fd);
+        } else if (a->kind == FD_DUP) {
+            if (a->source != a->fd && dup2(a->source, a->fd) < 0) {
+                char number[12];
+                int len = sizeof(number) - 1;
+                number[len] = '\0';
+                unsigned int n = a->source;
+                do {
+                    number[--len] = '0' + n % 10;
+                    n /= 10;
+                } while (n > 0 && len > 0);
+                child_error(number + len, ": Bad file descriptor");
+                return -1;
+            }
+        } else {
+            int fd = open(a->path, a->flags, 0644);
+            if (fd < 0) {
+                child_error((a->flags & O_ACCMODE) == O_RDONLY ? "Cannot open input file: "
+                                                               : "Cannot open output file: ",
+                            a->path);
+                return -1;
+            }
+            if (fd != a->fd) {
+                dup2(fd, a->fd);
+                close(fd);
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Builds the arguments that run a script through SCRIPT_SHELL
+ * @param program - Resolved path of the script
+ * @param args - Argument vector for the script
+ * @param script_args - Receives SCRIPT_SHELL, the path and args[1...];
+ *                      needs room for two more entries than args has
+ */
+static void script_args_of(const char *program, char **args, char **script_args) {
+    int i = 1;
+    script_args[0] = SCRIPT_SHELL;
+    script_args[1] = (char *)program;
+    for (; args[i]; i++) {
+        script_args[i + 1] = args[i];
+    }
+    script_args[i + 1] = NULL;
+}
+
+/**
+ * @param args - Argument vector
+ * @return Number of arguments
+ */
+static int arg_count(char **args) {
+    int n = 0;
+    while (args[n]) n++;
+    return n;
+}
+
+void launch_exec(const char *program, char **args, char **envp) {
+    execve(program, args, envp);
+    if (errno == ENOEXEC) {
+        char *script_args[arg_count(args) + 2];
+        script_args_of(program, args, script_args);
+        execve(SCRIPT_SHELL, script_args, envp);
+        errno = ENOEXEC;
+    }
+}
+
+/**
+ * Wires up the child's streams and execs the program.
+ * Only uses async-signal-safe calls so it can run after fork or vfork.
+ * Never returns.
+ * @param program - Resolved path of the program
+ * @param args - Argument vector for the program
+ * @param spec - Stream wiring for the child
+ * @param shared - Whether the child shares the shell's memory (vfork), so
+ *                 a failed execve is left for the shell to report
+ */
+static void child_exec(const char *program, char **args, const LaunchSpec *spec, int shared) {
+    sigset_t set;
+    shell_signals(&set);
+    for (int sig = 1; sig < NSIG; sig++) {
+        if (sigismember(&set, sig) == 1) signal(sig, SIG_DFL);
+    }
+    sigemptyset(&set);
+    sigprocmask(SIG_SETMASK, &set, NULL);
+    if (spec->pgid >= 0) {
+        setpgid(0, spec->pgid);
+    }
+    launch_apply_scheduling(spec);
+
+    if (launch_apply_spec(spec) != 0) {
+        _exit(1);
+    }
+    launch_exec(program, args, spec->envp ? spec->envp : environ);
+    if (shared) {
+        vfork_exec_error = errno;
+        _exit(127);
+    }
+    child_error("command execution failed: ", args[0]);
+    _exit(126);
+}
+
+/**
+ * Starts a program through posix_spawn, translating the spec into file actions
+ * @param program - Resolved path of the program
+ * @param args - Argument vector for the program
+ * @param spec - Stream wiring for the child
+ * @param exec_error - Receives the error posix_spawn returned, or 0
+ * @return Child pid, or -1 on failure (only reported if exec_error is 0)
+ */
+static pid_t spawn_with_file_actions(const char *program, char **args, const LaunchSpec *spec,
+                                     int *exec_error) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t set;
+    pid_t pid;
+
+    if (posix_spawn_file_actions_init(&actions) != 0) {
+        perror("posix_spawn_file_actions_init");
+        return -1;
+    }
+    if (spec->close_fd >= 0) {
+        posix_spawn_file_actions_addclose(&actions, spec->close_fd);
+    }
+    if (spec->stdin_fd >= 0 && spec->stdin_fd != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, spec->stdin_fd, STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions, spec->stdin_fd);
+    }
+    if (spec->stdout_fd >= 0 && spec->stdout_fd != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, spec->stdout_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, spec->stdout_fd);
+    }
+    for (int i = 0; i < spec->action_count; i++) {
+        const FdAction *a = &spec->actions[i];
+        if (a->kind == FD_CLOSE) {
+            posix_spawn_file_actions_addclose(&actions, a->fd);
+        } else if (a->kind == FD_DUP) {
+            // dup2 onto itself would be a no-op that clears close-on-exec
+            if (a->source != a->fd) posix_spawn_file_actions_adddup2(&actions, a->source, a->fd);
+        } else {
+            posix_spawn_file_actions_addopen(&actions, a->fd, a->path, a->flags, 0644);
+        }
+    }
+
+    // Default signal handling, and the process group if one was asked for
+    posix_spawnattr_init(&attr);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    shell_signals(&set);
+    posix_spawnattr_setsigdefault(&attr, &set);
+    sigemptyset(&set);
+    posix_spawnattr_setsigmask(&attr, &set);
+    if (spec->pgid >= 0) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, spec->pgid);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    int err = posix_spawn(&pid, program, &actions, &attr, args, spec->envp ? spec->envp : environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    *exec_error = err;
+    return err != 0 ? -1 : pid;
+}
+
+/**
+ * @param spec - Stream wiring for a child
+ * @return 1 if the child has a file to open, 0 otherwise
+ */
+static int opens_files(const LaunchSpec *spec) {
+    for (int i = 0; i < spec->action_count; i++) {
+        if (spec->actions[i].kind == FD_OPEN) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @param spec - Settings for a child
+ * @return 1 if the child's scheduling is to be changed, 0 otherwise
+ */
+static int sets_scheduling(const LaunchSpec *spec) {
+    return spec->cpu != LAUNCH_INHERIT || spec->nice != LAUNCH_INHERIT ||
+           spec->ioprio != LAUNCH_INHERIT;
+}
+
+/**
+ * Starts a program with the selected backend
+ * @param program - Resolved path of the program
+ * @param args - Argument vector for the program
+ * @param spec - Stream wiring for the child
+ * @param exec_error - Receives why the program could not be executed, or 0
+ * @return Child pid, or -1 on failure (only reported if exec_error is 0)
+ */
+static pid_t start_program(const char *program, char **args, const LaunchSpec *spec,
+                           int *exec_error) {
+    LaunchBackend backend = current_backend;
+    pid_t pid;
+    *exec_error = 0;
+    if (backend == LAUNCH_POSIX_SPAWN && sets_scheduling(spec)) {
+        // posix_spawn has no attribute for affinity, nice or I/O priority
+        backend = LAUNCH_VFORK;
+    }
+    if (backend == LAUNCH_POSIX_SPAWN) {
+        pid = spawn_with_file_actions(program, args, spec, exec_error);
+        if (pid < 0 && *exec_error == ENOEXEC) {
+            char *script_args[arg_count(args) + 2];
+            script_args_of(program, args, script_args);
+            pid = spawn_with_file_actions(SCRIPT_SHELL, script_args, spec, exec_error);
+        }
+        if (pid >= 0 || *exec_error == 0 || !opens_files(spec)) return pid;
+        // A redirection that could not be opened fails posix_spawn just as
+        // a missing program does; a vfork'ed child tells them apart, and
+        // reports the redirection as the other backends do
+        backend = LAUNCH_VFORK;
+    }
+    switch (backend) {
+    case LAUNCH_VFORK:
+        vfork_exec_error = 0;
+        pid = vfork();
+        break;
+    case LAUNCH_FORK:
+    default:
+        // A forked child cannot tell the shell why its execve failed
+        if (access(program, X_OK) != 0) {
+            *exec_error = errno;
+            return -1;
+        }
+        pid = fork();
+        break;
+    }
+
+    if (pid < 0) {
+        perror("Fork Failed");
+        return -1;
+    }
+    if (pid == 0) {
+        child_exec(program, args, spec, backend == LAUNCH_VFORK);
+    }
+    if (backend == LAUNCH_VFORK && vfork_exec_error != 0) {
+        *exec_error = vfork_exec_error;
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+    if (spec->pgid >= 0) {
+        // Also set it here, so it holds before the child gets to it
+        setpgid(pid, spec->pgid ? spec->pgid : pid);
+    }
+    return pid;
+}
+
+pid_t launch_program(const char *program, char **args, const LaunchSpec *spec) {
+    // Flush so output the shell already printed comes before the child's
+    // (or the error below), and so a forked child does not repeat it
+    fflush(stdout);
+
+    if (program == NULL) {
+        fprintf(stderr, "%s: command not found\n", args[0]);
+        return -1;
+    }
+
+    int exec_error;
+    pid_t pid = start_program(program, args, spec, &exec_error);
+    if (pid < 0 && exec_error == ENOENT && !strchr(args[0], '/')) {
+        // The program moved since its path was cached: look it up once
+        // more, on the command's own PATH if it was given one
+        const char *own_path = NULL;
+        for (int i = 0; spec->envp && spec->envp[i] && !own_path; i++) {
+            if (strncmp(spec->envp[i], "PATH=", 5) == 0) own_path = spec->envp[i] + 5;
+        }
+        path_hash_remove(args[0]);
+        program = own_path ? path_hash_search(args[0], own_path) : path_hash_lookup(args[0]);
+        if (program == NULL) {
+            fprintf(stderr, "%s: command not found\n", args[0]);
+            return -1;
+        }
+        pid = start_program(program, args, spec, &exec_error);
+    }
+    if (pid < 0 && exec_error != 0) {
+        fprintf(stderr, "%s: %s\n", args[0], strerror(exec_error));
+    }
+    return pid;
+}
+
+int exit_status_of(int raw) {
+    if (WIFEXITED(raw)) return WEXITSTATUS(raw);
+    if (WIFSIGNALED(raw)) return 128 + WTERMSIG(raw);
+    return 1;
+}
+
+int wait_child(pid_t pid) {
+    int raw;
+    while (waitpid(pid, &raw, 0) < 0) {
+        if (errno == ECHILD && events_take_status(pid, &raw, NULL)) break;
+        if (errno != EINTR) return 127;
+    }
+    return exit_status_of(raw);
+}
+
+int wait_child_stats(pid_t pid, ProcessStats *stats) {
+    int raw;
+    memset(&stats->usage, 0, sizeof(stats->usage));
+    stats->status = 127;
+    while (wait4(pid, &raw, 0, &stats->usage) < 0) {
+        if (errno == ECHILD && events_take_status(pid, &raw, &stats->usage)) break;
+        if (errno != EINTR) {
+            stats->end = monotonic_now();
+            return 127;
+        }
+    }
+    stats->end = monotonic_now();
+    stats->status = exit_status_of(raw);
+    return stats->status;
+}
+
+double monotonic_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void set_launch_backend(LaunchBackend backend) {
+    current_backend = backend;
+}
+
+LaunchBackend get_launch_backend(void) {
+    return current_backend;
+}
+
+int parse_launch_backend(const char *name, LaunchBackend *backend) {
+    if (strcmp(name, "fork") == 0) {
+        *backend = LAUNCH_FORK;
+    } else if (strcmp(name, "vfork") == 0) {
+        *backend = LAUNCH_VFORK;
+    } else if (strcmp(name, "posix_spawn") == 0 || strcmp(name, "spawn") == 0) {
+        *backend = LAUNCH_POSIX_SPAWN;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char* launch_backend_name(LaunchBackend backend) {
+    switch (backend) {
+    case LAUNCH_FORK: return "fork";
+    case LAUNCH_VFORK: return "vfork";
+    case LAUNCH_POSIX_SPAWN: return "posix_spawn";
+    }
+    return "unknown";
+}
@@ -0,0 +1,168 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/**
+ * Process launch backends
+ * fork() copies the shell's page tables before exec, which gets slower as
+ * the shell grows; posix_spawn() and vfork() share the parent's memory
+ * until the child execs.
+ */
+typedef enum {
+    LAUNCH_FORK,
+    LAUNCH_VFORK,
+    LAUNCH_POSIX_SPAWN
+} LaunchBackend;
+
+/* Constants */
+#define LAUNCH_INHERIT INT_MIN   // Scheduling setting the child keeps from the shell
+
+typedef enum {
+    FD_OPEN,                  // Open a file on the descriptor
+    FD_DUP,                   // Make the descriptor a copy of another
+    FD_CLOSE                  // Close the descriptor
+} FdActionKind;
+
+/**
+ * One redirection, as the child carries it out
+ */
+typedef struct {
+    FdActionKind kind;
+    int fd;                   // Descriptor to set up
+    int source;               // FD_DUP: descriptor to copy
+    const char *path;         // FD_OPEN: file to open
+    int flags;                // FD_OPEN: open(2) flags (files are created 0644)
+} FdAction;
+
+/**
+ * Describes how a child's descriptors are wired up
+ * The pipe descriptors are dup'ed onto stdin/stdout first, then the
+ * actions are applied in order, so `2>&1 >file` and `>file 2>&1` differ
+ * as in any shell. Files are opened in the child so the parent never
+ * touches them; a descriptor the shell already holds is only dup'ed.
+ * The scheduling settings are applied by the child before it execs.
+ */
+typedef struct {
+    int stdin_fd;             // Descriptor to use as stdin, or -1 to inherit
+    int stdout_fd;            // Descriptor to use as stdout, or -1 to inherit
+    int close_fd;             // Extra descriptor the child must close, or -1
+    const FdAction *actions;  // Redirections, applied after stdin_fd/stdout_fd
+    int action_count;
+    pid_t pgid;               // Process group to join (0: a new one), or -1 to inherit
+    char **envp;              // Environment for the program, or NULL for environ
+    int cpu;                  // CPU to pin the child to, or LAUNCH_INHERIT
+    int nice;                 // Nice value, or LAUNCH_INHERIT
+    int ioprio;               // I/O priority as ioprio_set(2) takes it, or LAUNCH_INHERIT
+} LaunchSpec;
+
+/**
+ * What a finished child cost, collected with wait4
+ */
+typedef struct {
+    double start;             // Monotonic seconds when it was launched
+    double end;               // Monotonic seconds when it was reaped
+    int status;               // Shell-style exit status
+    struct rusage usage;      // CPU time, max RSS, context switches, ...
+} ProcessStats;
+
+/**
+ * Initializes a spec that inherits everything
+ * @param spec - Spec to reset
+ */
+void launch_spec_init(LaunchSpec *spec);
+
+/**
+ * Starts a program with the currently selected backend
+ * The child gets default signal dispositions and an empty signal mask,
+ * whatever the shell blocks or ignores. If a path found on $PATH no longer
+ * exists (the program moved since it was cached), it is looked up again.
+ * @param program - Resolved path of the program, or NULL if not found
+ * @param args - Argument vector for the program
+ * @param spec - Stream wiring for the child
+ * @return Child pid, or -1 if nothing was started (error already reported)
+ */
+pid_t launch_program(const char *program, char **args, const LaunchSpec *spec);
+
+/**
+ * Replaces the current process with a program; a file the kernel does not
+ * recognise (a script without a #! line) is run by /bin/sh, as execvp does
+ * Only uses async-signal-safe calls, for a child between vfork and exec.
+ * @param program - Resolved path of the program
+ * @param args - Argument vector for the program
+ * @param envp - Environment for the program
+ */
+void launch_exec(const char *program, char **args, char **envp);
+
+/**
+ * Waits for a child started by launch_program
+ * @param pid - Child to wait for
+ * @return Shell-style exit status (128+signal for signalled children)
+ */
+int wait_child(pid_t pid);
+
+/**
+ * Waits for a child and records what it cost
+ * @param pid - Child to wait for
+ * @param stats - Receives end, status and usage (start is left alone)
+ * @return Shell-style exit status
+ */
+int wait_child_stats(pid_t pid, ProcessStats *stats);
+
+/**
+ * @return Monotonic time in seconds
+ */
+double monotonic_now(void);
+
+/**
+ * Converts a raw waitpid status into a shell-style exit status
+ * @param raw - Status filled in by waitpid
+ * @return Exit code, or 128+signal for signalled children
+ */
+int exit_status_of(int raw);
+
+/**
+ * Applies a spec's CPU, nice value and I/O priority to the current
+ * process; a setting the kernel refuses is reported and skipped
+ * Only uses async-signal-safe calls, for a child between fork and exec.
+ * @param spec - Settings to apply
+ */
+void launch_apply_scheduling(const LaunchSpec *spec);
+
+/**
+ * Applies a spec's redirections to the current process
+ * Used by forked copies of the shell that run builtins, and by the shell
+ * itself around builtins (it saves the descriptors first) and for exec.
+ * @param spec - Stream wiring to apply
+ * @return 0 on success, -1 if a file could not be opened (error reported)
+ */
+int launch_apply_spec(const LaunchSpec *spec);
+
+/**
+ * Selects the backend used by launch_program
+ * @param backend - Backend to use from now on
+ */
+void set_launch_backend(LaunchBackend backend);
+
+/**
+ * @return The backend currently in use
+ */
+LaunchBackend get_launch_backend(void);
+
+/**
+ * Parses a backend name ("fork", "vfork" or "posix_spawn")
+ * @param name - Name to parse
+ * @param backend - Receives the parsed backend
+ * @return 0 on success, -1 for an unknown name
+ */
+int parse_launch_backend(const char *name, LaunchBackend *backend);
+
+/**
+ * @param backend - Backend to name
+ * @return Printable name of the backend
+ */
+const char* launch_backend_name(LaunchBackend backend);
+
+#endif
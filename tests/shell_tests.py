@@ -9,6 +9,8 @@ import sys
 import subprocess
 import random
 import re
+import time
+import json
 
 from shell_test_helpers import *
 
@@ -23,7 +25,7 @@ class ShellTests(ShellTestCase):
         """ Shell prints the Welcome message and correct prompt """
 
         exe = subprocess.Popen(
-                SHELL, 
+                [SHELL, "-i"], 
                 stdin = subprocess.DEVNULL, 
                 stdout = subprocess.PIPE, 
                 stderr = subprocess.STDOUT
@@ -43,7 +45,7 @@ class ShellTests(ShellTestCase):
 
     def test02(self):
         """ Exit command works """
-        rc, actual = execute(SHELL, input = "exit\n")
+        rc, actual = execute(SHELL, "-i", input = "exit\n")
         lines = actual.splitlines()
         matches = [re.match(".*Bye bye.", line) 
                    for line in lines[1:] 
@@ -105,6 +107,586 @@ class ShellTests(ShellTestCase):
         actual = self.run_shell(script)
         self.assertEqual(actual, "one\ntwo\nthree")
 
+    def test10(self):
+        """ hash remembers resolved commands and counts hits """
+        actual = self.run_shell("ls -d .\nls -d .\nhash")
+        self.assertRegex(actual, r"hits\s+command")
+        self.assertRegex(actual, r"\n\s*2\s+\S*/ls$")
+
+        actual = self.run_shell("ls -d .\nhash -r\nhash")
+        self.assertRegex(actual, r"hash table empty")
+
+    def test11(self):
+        """ Unknown commands are reported as not found """
+        rc, actual = execute(SHELL, input = "no_such_command_xyz")
+        self.assertEqual(rc, 127)
+        self.assertRegex(actual, r"no_such_command_xyz: command not found")
+
+    def test12(self):
+        """ Every launch backend runs commands and pipelines """
+        script = \
+            "launcher fork\necho a | tr a A\n"\
+            "launcher vfork\necho b | tr b B\n"\
+            "launcher posix_spawn\necho c | tr c C\n"\
+            "launcher"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "A\nB\nC\nposix_spawn")
+
+    def test13(self):
+        """ Command lines longer than any fixed buffer are not split """
+        words = [f"word{i}" for i in range(20000)]
+        actual = self.run_shell("echo " + " ".join(words) + "\necho done")
+        self.assertEqual(actual, " ".join(words) + "\ndone")
+
+    def test14(self):
+        """ Redirections and sequencing combine on one line """
+        sh("mkdir -p tmp")
+        actual = self.run_shell("echo hello > tmp/redir_out; cat < tmp/redir_out | tr a-z A-Z")
+        self.assertEqual(actual, "HELLO")
+
+        sh("rm -f tmp/redir_out")
+
+    def test15(self):
+        """ source picks up changes to a script it has already run """
+        sh("mkdir -p tmp")
+        with open("tmp/script.sh", "w") as f:
+            f.write("echo first\necho second | tr a-z A-Z\n")
+        script = \
+            "source tmp/script.sh\n"\
+            "source tmp/script.sh\n"\
+            "echo \"echo changed\" > tmp/script.sh\n"\
+            "source tmp/script.sh"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "first\nSECOND\nfirst\nSECOND\nchanged")
+
+        sh("rm -f tmp/script.sh")
+
+    def test16(self):
+        """ Syntax errors are reported and the shell keeps going """
+        actual = self.run_shell("echo a | | echo b\necho ok")
+        self.assertEqual(actual, "syntax error near unexpected token `|'\nok")
+
+    def test17(self):
+        """ Background jobs run while the shell continues, wait collects them """
+        script = \
+            "sh -c \"sleep 0.3; echo late\" &\n"\
+            "echo early\n"\
+            "wait\n"\
+            "echo done"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "early\nlate\ndone")
+
+    def test18(self):
+        """ parallel runs commands concurrently and keeps their output in order """
+        script = "parallel -j 4 { sh -c \"sleep 0.5; echo a\"; sh -c \"sleep 0.5; echo b\"; "\
+                 "echo c | tr c C; sh -c \"sleep 0.5; echo d\" }"
+        start = time.monotonic()
+        actual = self.run_shell(script)
+        elapsed = time.monotonic() - start
+        self.assertEqual(actual, "a\nb\nC\nd")
+        self.assertLess(elapsed, 1.4)
+
+    def test19(self):
+        """ Utility builtins work in-process, with redirections and in pipelines """
+        sh("mkdir -p tmp")
+        script = \
+            "echo -n a; echo b\n"\
+            "printf \"%s=%03d\\n\" x 7 y 8\n"\
+            "printf \"%s\\n\" redirected > tmp/builtin_out; cat tmp/builtin_out\n"\
+            "echo piped | tr a-z A-Z\n"\
+            "enable -n echo\n"\
+            "enable -n\n"\
+            "echo external"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "ab\nx=007\ny=008\nredirected\nPIPED\nenable -n echo\nexternal")
+
+        sh("rm -f tmp/builtin_out")
+
+    def test20(self):
+        """ Several > redirections write the same output to every file """
+        sh("mkdir -p tmp")
+        script = \
+            "seq 1 50000 > tmp/multi_a > tmp/multi_b\n"\
+            "cmp tmp/multi_a tmp/multi_b; wc -l < tmp/multi_b\n"\
+            "echo builtin > tmp/multi_a > tmp/multi_b; cat tmp/multi_a tmp/multi_b\n"\
+            "echo staged | tr a-z A-Z > tmp/multi_a > tmp/multi_b; cat tmp/multi_b"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "50000\nbuiltin\nbuiltin\nSTAGED")
+
+        sh("rm -f tmp/multi_a tmp/multi_b")
+
+    def test21(self):
+        """ Here-documents feed the following lines to a command's stdin """
+        big = "\n".join("line %d" % i for i in range(20000))
+        script = \
+            "cat <<EOF\n"\
+            "first\n"\
+            "  second\n"\
+            "EOF\n"\
+            "tr a-z A-Z <<-END\n"\
+            "\tindented\n"\
+            "\tEND\n"\
+            "wc -l <<BIG\n" + big + "\nBIG\n"\
+            "echo after"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "first\n  second\nINDENTED\n20000\nafter")
+
+    def test22(self):
+        """ time reports real, user and sys time for a pipeline """
+        actual = self.run_shell("time -p sleep 0.2 | cat\ntime echo hi")
+        lines = actual.splitlines()
+        self.assertEqual([l.split()[0] for l in lines[:3]], ["real", "user", "sys"])
+        self.assertGreaterEqual(float(lines[0].split()[1]), 0.2)
+        self.assertEqual(lines[3], "hi")
+        self.assertTrue(re.match(r"real\t0m0\.\d{3}s", lines[4]))
+
+    def test23(self):
+        """ trace writes a JSON line for every process and pipeline """
+        sh("mkdir -p tmp")
+        script = \
+            "trace tmp/trace.jsonl\n"\
+            "seq 1 1000 | sh -c \"exit 3\"\n"\
+            "echo in-shell\n"\
+            "trace off\n"\
+            "echo untraced"
+        self.run_shell(script)
+        with open("tmp/trace.jsonl") as f:
+            records = [json.loads(line) for line in f]
+        sh("rm -f tmp/trace.jsonl")
+
+        self.assertEqual([(r["type"], r["command"]) for r in records], [
+            ("process", "seq 1 1000"),
+            ("process", "sh -c exit 3"),
+            ("pipeline", "seq 1 1000 | sh -c exit 3"),
+            ("pipeline", "echo in-shell")])
+        self.assertEqual(records[1]["status"], 3)
+        self.assertEqual(records[2]["status"], 3)
+        self.assertEqual(records[0]["pipeline"], records[2]["pipeline"])
+        for field in ["wall_ms", "user_ms", "sys_ms", "maxrss_kb", "nvcsw", "nivcsw"]:
+            self.assertIn(field, records[0])
+        self.assertGreater(records[1]["maxrss_kb"], 0)
+
+    def test24(self):
+        """ Batch mode: -c, script files and exit statuses, with no prompt """
+        rc, actual = execute(SHELL, input = "echo one\necho two")
+        self.assertEqual((rc, actual), (0, "one\ntwo"))
+
+        rc, actual = execute(SHELL, "-c", "echo a; echo b | tr b B; exit 3; echo no")
+        self.assertEqual((rc, actual), (3, "a\nB"))
+
+        sh("mkdir -p tmp")
+        with open("tmp/batch.sh", "w") as f:
+            f.write("echo from script\nno_such_command_xyz\necho after\n")
+        rc, actual = execute(SHELL, "tmp/batch.sh")
+        sh("rm -f tmp/batch.sh")
+        self.assertEqual(rc, 0)
+        self.assertEqual(actual, "from script\nno_such_command_xyz: command not found\nafter")
+
+        rc, actual = execute(SHELL, "tmp/no_such_script.sh")
+        self.assertEqual(rc, 127)
+
+    def test25(self):
+        """ history persists across shells and is searchable """
+        sh("mkdir -p tmp")
+        env = dict(os.environ, MINISHELL_HISTORY = "tmp/history")
+        def run(script, *args):
+            # Only an interactive shell expands and records history
+            exe = subprocess.run([SHELL, *args], input = script.encode(), env = env,
+                                 stdout = subprocess.PIPE, stderr = subprocess.STDOUT)
+            lines = try_decode(exe.stdout).replace("shell $ ", "").strip().split("\n")
+            return "\n".join(l for l in lines if l not in ("Welcome to mini-shell", "Bye bye."))
+
+        self.assertEqual(run("echo one\necho two | tr a-z A-Z\nls -d .", "-i"), "one\nTWO\n.")
+        actual = run("history\n!1\n!ec\n!-1 again\n!nope\nhistory -s two\nhistory 2", "-i")
+        sh("rm -f tmp/history")
+        self.assertEqual(actual,
+            "    1  echo one\n"
+            "    2  echo two | tr a-z A-Z\n"
+            "    3  ls -d .\n"
+            "    4  history\n"
+            "echo one\none\n"
+            "echo one\none\n"
+            "echo one again\none again\n"
+            "!nope: event not found\n"
+            "    8  history -s two\n"
+            "    2  echo two | tr a-z A-Z\n"
+            "    8  history -s two\n"
+            "    9  history 2")
+
+        # Without a history file, prev still repeats the last line
+        self.assertEqual(run("echo again\nprev", "-i"), "again\nagain")
+
+        # A script's lines are neither expanded nor recorded
+        sh("rm -f tmp/history")
+        self.assertEqual(run("echo one\n!echo\nhistory"), "one\n!echo: command not found")
+        sh("rm -f tmp/history")
+
+    def test26(self):
+        """ coproc keeps a worker running that cowrite and coread talk to """
+        script = \
+            "coproc sed -u s/a/A/\n"\
+            "cowrite banana\n"\
+            "cowrite cat\n"\
+            "coread 2\n"\
+            "coproc UP { tr a-z A-Z; echo bye }\n"\
+            "cowrite -n UP hello world\n"\
+            "coclose -n UP\n"\
+            "coread -n UP 2\n"\
+            "coread -n UP\n"\
+            "cowrite -n UP more\n"\
+            "coclose\n"\
+            "coproc DEAD { true }\n"\
+            "wait\n"\
+            "cowrite -n DEAD too late\n"\
+            "echo alive"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "bAnana\ncAt\nHELLO WORLD\nbye\nUP: input closed\n"
+                                 "DEAD: Broken pipe\nalive")
+
+    def test27(self):
+        """ pipefail, pipestatus and the job table """
+        self.assertEqual(self.run_shell("false | true\npipestatus\ntrue | sh -c \"exit 3\" | true\npipestatus"),
+                         "1 0\n0 3 0")
+        rc, actual = execute(SHELL, "-c", "false | true")
+        self.assertEqual(rc, 0)
+        rc, actual = execute(SHELL, "-c", "set -o pipefail; false | true; exit")
+        self.assertEqual(rc, 1)
+        self.assertEqual(self.run_shell("set -o pipefail\nset\nset +o pipefail\nset"),
+                         "pipefail\ton\npipefail\toff")
+
+        actual = self.run_shell("sleep 0.2 &\njobs\nwait\njobs\nfg\nbg %3\necho done")
+        self.assertEqual(actual, "[1]+  Running                 sleep 0.2\n"
+                                 "fg: current: no such job\nbg: %3: no such job\ndone")
+
+    def test28(self):
+        """ $(...) and backquotes are replaced by the command's output """
+        script = \
+            "echo [$(echo a b) `echo c`d]\n"\
+            "echo \"$(printf \"%s\\n\" 1 2 | tr 12 xy)\"\n"\
+            "echo $(echo $(echo nested) | tr a-z A-Z) x$(true)y \"$(true)\"\n"\
+            "echo one > $(echo tmp/subst)\n"\
+            "cat < tmp/subst\n"\
+            "$(false)\n"\
+            "pipestatus\n"\
+            "echo [$(exit 3)]\n"\
+            "pipestatus\n"\
+            "rm tmp/subst\n"\
+            "echo done"
+        sh("mkdir -p tmp")
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "[a b cd]\nx\ny\nNESTED xy \none\n1\n[]\n0\ndone")
+
+    def test29(self):
+        """ Variables, export and NAME=value prefixes """
+        script = \
+            "X=1 Y=two\n"\
+            "echo $X ${X}y \"$Y\" [$Z]\n"\
+            "A=b printenv A\n"\
+            "echo [$A]\n"\
+            "export B=2\n"\
+            "printenv B | cat\n"\
+            "export\n"\
+            "unset B\n"\
+            "printenv B\n"\
+            "echo [$B]\n"\
+            "false\n"\
+            "echo $?\n"\
+            "true | false\n"\
+            "echo $PIPESTATUS\n"\
+            "L=a:b IFS=:\n"\
+            "printf [%s] $L \"$L\"\n"\
+            "unset IFS\n"\
+            "echo\n"\
+            "PATH=/nonexistent\n"\
+            "ls\n"\
+            "echo done"
+        # Start from a known environment so `export` prints a known list
+        path = os.environ["PATH"]
+        rc, output = execute("env", "-i", "PATH=" + path, SHELL, input = script)
+        self.assertEqual(rc, 0)
+        self.assertEqual(filter_shell_output(output), "1 1y two []\nb\n[]\n2\nexport B=2\nexport PATH=%s\n[]\n1\n0 1\n"
+                                 "[a][b][a:b]\nls: command not found\ndone" % path)
+
+    def test30(self):
+        """ if, while, until and for, with break and continue """
+        script = \
+            "for i in a b c; do if test $i = b; then continue; fi; echo $i; done\n"\
+            "N=\n"\
+            "while test x$N != xxxx; do N=${N}x; if test $N = xx; then break; fi; done\n"\
+            "echo $N $?\n"\
+            "until true; do echo no; done; echo $?\n"\
+            "if false; then echo 1; elif false; then echo 2; else echo 3; fi\n"\
+            "if false; then echo 1; fi; echo $?\n"\
+            "for i in 1 2\n"\
+            "do\n"\
+            "  for j in $(echo x y); do echo $i$j; done\n"\
+            "done | tr -d 12\n"\
+            "if true; then cat <<EOF\n"\
+            "body\n"\
+            "EOF\n"\
+            "fi\n"\
+            "for i in 1; do false; done; echo $?"
+        self.assertEqual(self.run_shell(script), "a\nc\nxx 0\n0\n3\n0\nx\ny\nx\ny\nbody\n1")
+        self.assertEqual(self.run_shell("break\nif true; then fi\ntrue"),
+                         "break: only meaningful in a `for', `while', or `until' loop\n"
+                         "syntax error near unexpected token `fi'")
+
+    def test31(self):
+        """ Globs expand to sorted matching paths, quoted ones stay as written """
+        sh("rm -rf tmp/glob && mkdir -p tmp/glob/d/e && cd tmp/glob && touch b.c a.c .h.c x.h d/one.c d/e/two.c")
+        script = \
+            "cd tmp/glob\n"\
+            "echo *.c\n"\
+            "echo \"*\".c '*.c' [ab].c ?.h .*.c\n"\
+            "echo */*.c\n"\
+            "echo **/*.c\n"\
+            "echo none*\n"\
+            "P=*.h\n"\
+            "echo $P \"$P\"\n"\
+            "for f in d/*; do echo $f; done\n"\
+            "touch c.c\n"\
+            "echo *.c"
+        actual = self.run_shell(script)
+        sh("rm -rf tmp/glob")
+        self.assertEqual(actual,
+                         "a.c b.c\n*.c '*.c' a.c b.c x.h .h.c\nd/one.c\na.c b.c d/e/two.c d/one.c\n"
+                         "none*\nx.h *.h\nd/e\nd/one.c\na.c b.c c.c")
+
+    def test32(self):
+        """ >>, <<<, N>file, N>&M and exec keep descriptors as other shells do """
+        script = \
+            "cd tmp\n"\
+            "echo one > redir.txt\n"\
+            "echo two >> redir.txt\n"\
+            "cat redir.txt\n"\
+            "cat <<< \"a here string\"\n"\
+            "ls /nonexistent 2> redir.err\n"\
+            "wc -l < redir.err\n"\
+            "ls /nonexistent > redir.out 2>&1\n"\
+            "wc -l < redir.out\n"\
+            "exec 3>> redir.txt\n"\
+            "echo three >&3\n"\
+            "exec 3>&-\n"\
+            "echo gone >&3\n"\
+            "echo closed $?\n"\
+            "cat redir.txt\n"\
+            "rm redir.txt redir.err redir.out"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "one\ntwo\na here string\n1\n1\n3: Bad file descriptor\nclosed 1\none\ntwo\nthree")
+
+    def test33(self):
+        """ Server mode runs each client's session in a process of its own """
+        import socket
+        path = "tmp/shell_test.sock"
+        server = subprocess.Popen([SHELL, "--server", path, "--workers", "2"])
+
+        def session(text):
+            client = socket.socket(socket.AF_UNIX)
+            for _ in range(100):
+                try:
+                    client.connect(path)
+                    break
+                except OSError:
+                    time.sleep(0.01)
+            client.sendall(text.encode())
+            client.shutdown(socket.SHUT_WR)
+            out = b""
+            while True:
+                data = client.recv(4096)
+                if not data:
+                    return try_decode(out)
+                out += data
+
+        try:
+            first = session("cd tmp\nX=5\necho $X\npwd\n")
+            second = session("echo x$X\npwd\n")
+        finally:
+            server.terminate()
+            server.wait(timeout = 5)
+        cwd = os.getcwd()
+        self.assertEqual(first, "5\n" + cwd + "/tmp\n")
+        self.assertEqual(second, "x\n" + cwd + "\n")
+        self.assertFalse(os.path.exists(path))
+
+        # A file that is not a socket is never replaced
+        sh("echo keep > tmp/not_a_socket")
+        rc, actual = execute(SHELL, "--server", "tmp/not_a_socket")
+        self.assertNotEqual(rc, 0)
+        self.assertEqual(actual.strip(), "server: tmp/not_a_socket exists and is not a socket")
+        with open("tmp/not_a_socket") as f:
+            self.assertEqual(f.read(), "keep\n")
+        sh("rm tmp/not_a_socket")
+
+    def test34(self):
+        """ Braces expand to lists and sequences; long programs run in batches """
+        script = \
+            "echo a{b,c}d x{1,2{y,z}} {1..4} {05..1..2} {a..c} \"{a,b}\" {} {a}\n"\
+            "X=v\n"\
+            "echo {$X,\"q r\"}\n"\
+            "for i in {1..3}; do echo n$i; done\n"\
+            "/bin/echo a x{1..300000} b > tmp/brace.txt\n"\
+            "if test $(wc -l < tmp/brace.txt) -gt 1; then echo batched; fi\n"\
+            "wc -w < tmp/brace.txt\n"\
+            "rm tmp/brace.txt"
+        actual = self.run_shell(script)
+        self.assertEqual(actual,
+                         "abd acd x1 x2y x2z 1 2 3 4 05 03 01 a b c {a,b} {} {a}\n"
+                         "v q r\nn1\nn2\nn3\nbatched\n300006")
+
+    def test35(self):
+        """ forall runs a command on every line of stdin, N at a time """
+        script = \
+            "printf \"3\\n1\\n\\n2\\n\" > tmp/forall.txt\n"\
+            "forall -P 3 sh -c \"sleep 0.$0; echo $0\" < tmp/forall.txt\n"\
+            "forall -P 3 -c sh -c \"sleep 0.$0; echo $0\" < tmp/forall.txt\n"\
+            "forall -P2 echo item {} {} < tmp/forall.txt\n"\
+            "forall false < tmp/forall.txt\n"\
+            "echo status $?\n"\
+            "rm tmp/forall.txt"
+        actual = self.run_shell(script)
+        self.assertEqual(actual,
+                         "3\n1\n2\n1\n2\n3\nitem 3 3\nitem 1 1\nitem 2 2\nstatus 1")
+
+    def test36(self):
+        """ pipeconf and the pipe prefix size pipes and tune stages """
+        script = \
+            "pipeconf -b 128K -n 3,-\n"\
+            "pipeconf\n"\
+            "echo x | python3 -c \"import fcntl; print(fcntl.fcntl(0, 1032))\"\n"\
+            "pipe -b 256K echo x | python3 -c \"import fcntl; print(fcntl.fcntl(0, 1032))\"\n"\
+            "pipeconf -r\n"\
+            "pipe -n -,7 echo x | nice\n"\
+            "pipe -a 0 -i idle grep Cpus_allowed_list /proc/self/status\n"\
+            "pipeconf -n 5\n"\
+            "nice\n"\
+            "nice &\n"\
+            "wait\n"\
+            "pipeconf -r\n"\
+            "pipe -n 99 echo hi\n"\
+            "pipeconf -q 1\n"\
+            "echo status $?"
+        actual = self.run_shell(script)
+        self.assertEqual(actual,
+                         "buffer\t131072\ncpu\toff\nnice\t3,-\nioprio\toff\n131072\n262144\n7\n"
+                         "Cpus_allowed_list:\t0\n0\n0\npipe: bad value for -n: 99\n"
+                         "pipeconf: unknown option: -q (use -b, -a, -n or -i)\nstatus 2")
+
+    def test37(self):
+        """ memo replays the output and status of an identical earlier run """
+        script = \
+            "memoconf -d tmp/memo\n"\
+            "printf \"b\\na\\n\" > tmp/memo.txt\n"\
+            "memo sort < tmp/memo.txt\n"\
+            "memo sort < tmp/memo.txt > tmp/memo.out\n"\
+            "cat tmp/memo.out\n"\
+            "printf \"c\\n\" >> tmp/memo.txt\n"\
+            "memo sort -r < tmp/memo.txt\n"\
+            "memo X=1 date +%N > tmp/memo.out\n"\
+            "memo X=1 date +%N >> tmp/memo.out\n"\
+            "uniq tmp/memo.out | wc -l\n"\
+            "memo sh -c \"echo run; exit 3\"\n"\
+            "memo sh -c \"echo run; exit 3\"\n"\
+            "echo status $?\n"\
+            "export MINISHELL_MEMO_DIR=tmp/memo\n"\
+            "echo one | ./shell -c \"memo cat\"\n"\
+            "echo two | ./shell -c \"memo cat\"\n"\
+            "./shell -c \"memo cat\" < tmp/memo.txt\n"\
+            "memoconf | grep -v dir\n"\
+            "memoconf -s 1\n"\
+            "memoconf -s 17179869184G\n"\
+            "memoconf -c\n"\
+            "memoconf | grep -v dir\n"\
+            "memo sort | cat\n"\
+            "rm -r tmp/memo tmp/memo.txt tmp/memo.out tmp/memo.sh"
+        # Run as a script, so the commands inherit a stdin that is not a pipe
+        sh("mkdir -p tmp")
+        with open("tmp/memo.sh", "w") as f:
+            f.write(script)
+        exe = subprocess.run([SHELL, "tmp/memo.sh"], stdin = subprocess.DEVNULL,
+                             stdout = subprocess.PIPE, stderr = subprocess.STDOUT)
+        actual = try_decode(exe.stdout).strip()
+        self.assertEqual(actual,
+                         "a\nb\na\nb\nc\nb\na\n1\nrun\nrun\nstatus 3\n"
+                         "memo: cat: not cached, stdin is a pipe or terminal\none\n"
+                         "memo: cat: not cached, stdin is a pipe or terminal\ntwo\nb\na\nc\n"
+                         "limit\t67108864\nentries\t5\nbytes\t136\nhits\t3\nmisses\t4\nevictions\t0\n"
+                         "memoconf: bad size: 17179869184G\nlimit\t1\nentries\t0\nbytes\t0\nhits\t0\nmisses\t0\nevictions\t0\n"
+                         "syntax error near unexpected token `|'")
+
+    def test38(self):
+        """ A cached program that moved is looked up again; no PATH means the default """
+        script = \
+            "mkdir -p tmp/pa tmp/pb\n"\
+            "cp /bin/echo tmp/pa/mytool\n"\
+            "export PATH=tmp/pa:tmp/pb:/usr/bin:/bin\n"\
+            "mytool one\n"\
+            "mv tmp/pa/mytool tmp/pb/mytool\n"\
+            "mytool two\n"\
+            "launcher vfork\n"\
+            "mv tmp/pb/mytool tmp/pa/mytool\n"\
+            "mytool three\n"\
+            "rm -r tmp/pa tmp/pb\n"\
+            "unset PATH\n"\
+            "ls -d tmp"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "one\ntwo\nthree\ntmp")
+
+    def test39(self):
+        """ A redirection that cannot be opened fails the same way with every launcher """
+        script = \
+            "cat < tmp/nonexistent\n"\
+            "echo status $?\n"\
+            "launcher vfork\n"\
+            "cat < tmp/nonexistent\n"\
+            "echo status $?\n"\
+            "launcher fork\n"\
+            "cat < tmp/nonexistent\n"\
+            "echo status $?"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "Cannot open input file: tmp/nonexistent\nstatus 1\n" * 2 +
+                         "Cannot open input file: tmp/nonexistent\nstatus 1")
+
+    def test40(self):
+        """ A sourced file that does not parse reports each error once, in order """
+        script = \
+            "printf \"echo a\\necho b | | c\\necho d\\n\" > tmp/bad.sh\n"\
+            "source tmp/bad.sh\n"\
+            "printf \"echo e\\nif true; then\\necho f\\n\" > tmp/bad.sh\n"\
+            "source tmp/bad.sh\n"\
+            "rm tmp/bad.sh"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "a\nsyntax error near unexpected token `|'\nd\n"
+                                 "e\nsyntax error: unexpected end of file")
+
+    def test41(self):
+        """ A script without a #! line runs through /bin/sh with every launcher """
+        script = \
+            "echo echo plain > tmp/plain.sh\n"\
+            "chmod +x tmp/plain.sh\n"\
+            "tmp/plain.sh\n"\
+            "launcher vfork\n"\
+            "tmp/plain.sh\n"\
+            "launcher fork\n"\
+            "tmp/plain.sh\n"\
+            "rm tmp/plain.sh"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "plain\nplain\nplain")
+
+    def test42(self):
+        """ A PATH prefix, and a PATH that is set but not exported, find programs """
+        script = \
+            "mkdir -p tmp/own\n"\
+            "cp /bin/echo tmp/own/owntool\n"\
+            "PATH=tmp/own:/bin owntool prefixed\n"\
+            "owntool missing\n"\
+            "unset PATH\n"\
+            "PATH=tmp/own:/usr/bin:/bin\n"\
+            "owntool unexported\n"\
+            "env | grep -c ^PATH=\n"\
+            "rm -r tmp/own"
+        actual = self.run_shell(script)
+        self.assertEqual(actual, "prefixed\nowntool: command not found\nunexported\n0")
+
 if __name__ == '__main__':
     print(f"-= {YELLOW}Running tests for {SHELL}{RESET} =-")
     unittest.main(testRunner = unittest.TextTestRunner(resultclass = PrettierTextTestResult))
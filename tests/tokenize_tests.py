@@ -49,6 +49,33 @@ class ShellTests(ShellTestCase):
                 sh("echo 'foo \"Lorem ipsum dolor sit amet\" < bar \"consectetur (adipiscing; >elit\"' | ./tokenize"), 
                 "foo\nLorem ipsum dolor sit amet\n<\nbar\nconsectetur (adipiscing; >elit")
 
+    def test07(self):
+        """Quoted parts join the surrounding word"""
+        self.assertEqual(
+                sh("echo 'ab\"c d\"e|f' | ./tokenize"),
+                "abc de\n|\nf")
+
+    def test08(self):
+        """Vector scanning tokenizes exactly like the scalar fallback (random lines)"""
+        def tokenize(line, env):
+            return subprocess.run([TOKENIZE], input = line.encode('ASCII'), capture_output = True,
+                                  env = dict(os.environ, **env)).stdout
+
+        rng = random.Random(3650)
+        pieces = ["a", "word", "x" * 40, "-flag", "/usr/bin/", "{", "}", " ", "  ", "\t",
+                  "(", ")", "<", ">", "<<", "<<-", "|", ";", "&", "\"", "\" quoted text \"", "$", "$(", "`"]
+        for _ in range(150):
+            line = "".join(rng.choice(pieces) for _ in range(rng.randint(1, 80)))
+            self.assertEqual(tokenize(line, {"MINISHELL_LEX_SCALAR": "0"}),
+                             tokenize(line, {"MINISHELL_LEX_SCALAR": "1"}), repr(line))
+
+
+    def test09(self):
+        """Command substitutions stay inside their word, as written"""
+        self.assertEqual(
+                sh("echo 'a$(b | c; d)e \"`f g`\" $x|$(h \")\")' | ./tokenize"),
+                "a$(b | c; d)e\n\"`f g`\"\n$x\n|\n$(h \")\")")
+
 
 
 if __name__ == '__main__':
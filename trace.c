@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#include "trace.h"
+
+/* Constants */
+#define MAX_PIPELINE_DEPTH 64    // Nesting tracked for process records
+
+static int trace_fd = -1;        // Where records go, or -1
+static int owns_fd = 0;          // Whether the shell opened trace_fd itself
+static long next_pipeline = 1;
+static int depth = 0;             // Number of running (nested) pipelines
+
+/**
+ * A pipeline being measured
+ */
+static struct {
+    long id;
+    long maxrss;                 // Largest max RSS among its reaped processes
+} open_pipelines[MAX_PIPELINE_DEPTH];
+
+/**
+ * @return Index of the innermost running pipeline, or -1
+ */
+static int innermost(void) {
+    if (depth == 0) return -1;
+    return depth <= MAX_PIPELINE_DEPTH ? depth - 1 : MAX_PIPELINE_DEPTH - 1;
+}
+
+int trace_open(const char *target) {
+    if (owns_fd) close(trace_fd);
+    trace_fd = -1;
+    owns_fd = 0;
+    if (target == NULL || strcmp(target, "off") == 0) return 0;
+
+    // A bare number is a descriptor the caller set up (e.g. 3>trace.jsonl)
+    char *end;
+    long fd = strtol(target, &end, 10);
+    if (*target != '\0' && *end == '\0') {
+        if (fd < 0 || fcntl((int)fd, F_GETFD) < 0) return -1;
+        trace_fd = (int)fd;
+        return 0;
+    }
+    trace_fd = open(target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (trace_fd < 0) return -1;
+    owns_fd = 1;
+    return 0;
+}
+
+int trace_enabled(void) {
+    return trace_fd >= 0;
+}
+
+/**
+ * @param tv - Time value from rusage
+ * @return The same time in milliseconds
+ */
+static double to_ms(struct timeval tv) {
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+/**
+ * Writes a string as a JSON string literal
+ * @param out - Stream to write to
+ * @param s - String to quote (NULL writes null)
+ */
+static void write_json_string(FILE *out, const char *s) {
+    if (s == NULL) {
+        fputs("null", out);
+        return;
+    }
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Writes the fields shared by process and pipeline records, ends the line
+ * and sends the whole record with one write
+ * @param out - Memory stream holding the start of the record
+ * @param buffer - Buffer behind the stream
+ * @param size - Size of the buffer
+ * @param stats - Figures to report
+ */
+static void finish_record(FILE *out, char **buffer, size_t *size, const ProcessStats *stats) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    fprintf(out, ",\"status\":%d,\"wall_ms\":%.3f,\"user_ms\":%.3f,\"sys_ms\":%.3f,"
+                 "\"maxrss_kb\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld,\"ts\":%ld.%06ld}\n",
+            stats->status, (stats->end - stats->start) * 1e3,
+            to_ms(stats->usage.ru_utime), to_ms(stats->usage.ru_stime),
+            stats->usage.ru_maxrss, stats->usage.ru_nvcsw, stats->usage.ru_nivcsw,
+            (long)now.tv_sec, now.tv_nsec / 1000);
+    fclose(out);
+
+    char *p = *buffer;
+    size_t left = *size;
+    while (left > 0) {
+        ssize_t n = write(trace_fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    free(*buffer);
+}
+
+long trace_pipeline_begin(ProcessStats *stats) {
+    long id = next_pipeline++;
+    if (depth < MAX_PIPELINE_DEPTH) {
+        open_pipelines[depth].id = id;
+        open_pipelines[depth].maxrss = 0;
+    }
+    depth++;
+
+    // Shell and children together, so in-process builtins are counted too
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    memset(&stats->usage, 0, sizeof(stats->usage));
+    timeradd(&self.ru_utime, &children.ru_utime, &stats->usage.ru_utime);
+    timeradd(&self.ru_stime, &children.ru_stime, &stats->usage.ru_stime);
+    stats->usage.ru_nvcsw = self.ru_nvcsw + children.ru_nvcsw;
+    stats->usage.ru_nivcsw = self.ru_nivcsw + children.ru_nivcsw;
+    stats->start = monotonic_now();
+    return id;
+}
+
+void trace_pipeline_end(long id, ProcessStats *stats, int status, int stages, const char *command) {
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    stats->end = monotonic_now();
+    stats->status = status;
+    int index = innermost();
+    long maxrss = index >= 0 ? open_pipelines[index].maxrss : 0;
+    if (depth > 0) depth--;
+
+    // Turn the starting totals into the pipeline's share
+    struct rusage *u = &stats->usage;
+    struct timeval user, sys;
+    timeradd(&self.ru_utime, &children.ru_utime, &user);
+    timeradd(&self.ru_stime, &children.ru_stime, &sys);
+    timersub(&user, &u->ru_utime, &u->ru_utime);
+    timersub(&sys, &u->ru_stime, &u->ru_stime);
+    u->ru_nvcsw = self.ru_nvcsw + children.ru_nvcsw - u->ru_nvcsw;
+    u->ru_nivcsw = self.ru_nivcsw + children.ru_nivcsw - u->ru_nivcsw;
+    // The kernel keeps no per-interval peak, so use the largest process's
+    u->ru_maxrss = maxrss;
+
+    if (!trace_enabled()) return;
+    char *buffer;
+    size_t size;
+    FILE *out = open_memstream(&buffer, &size);
+    if (!out) return;
+    fprintf(out, "{\"type\":\"pipeline\",\"shell\":%d,\"pipeline\":%ld,\"stages\":%d,\"command\":",
+            (int)getpid(), id, stages);
+    write_json_string(out, command);
+    finish_record(out, &buffer, &size, stats);
+}
+
+long trace_reserve_id(void) {
+    return next_pipeline++;
+}
+
+void trace_process(long pipeline, int stage, pid_t pid, const char *command, const ProcessStats *stats) {
+    int index = innermost();
+    if (pipeline == 0 && index >= 0) {
+        pipeline = open_pipelines[index].id;
+        if (stats->usage.ru_maxrss > open_pipelines[index].maxrss) {
+            open_pipelines[index].maxrss = stats->usage.ru_maxrss;
+        }
+    }
+    if (!trace_enabled()) return;
+
+    char *buffer;
+    size_t size;
+    FILE *out = open_memstream(&buffer, &size);
+    if (!out) return;
+    fprintf(out, "{\"type\":\"process\",\"shell\":%d,\"pipeline\":%ld,\"stage\":%d,\"pid\":%d,\"command\":",
+            (int)getpid(), pipeline, stage, (int)pid);
+    write_json_string(out, command);
+    finish_record(out, &buffer, &size, stats);
+}
+
+void trace_close(void) {
+    trace_open("off");
+}
@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "spawn.h"
+
+/**
+ * Execution trace
+ * When enabled, every reaped process and every finished pipeline is
+ * written as one JSON object per line to a descriptor, e.g.
+ *   {"type":"process","shell":41,"pipeline":3,"stage":0,"pid":42,
+ *    "command":"sort big","status":0,"wall_ms":12.5,"user_ms":9.1,
+ *    "sys_ms":2.0,"maxrss_kb":3412,"nvcsw":3,"nivcsw":1,"ts":1700000000.123}
+ * Pipeline records carry the same figures for the whole pipeline (the
+ * shell's own CPU included, so builtins show up too). Each record is a
+ * single write, so lines from forked copies of the shell never interleave.
+ */
+
+/**
+ * Starts, redirects or stops tracing
+ * @param target - Descriptor number, file to append to, or "off"
+ * @return 0 on success, -1 if the file could not be opened
+ */
+int trace_open(const char *target);
+
+/**
+ * @return 1 if records are being written, 0 otherwise
+ */
+int trace_enabled(void);
+
+/**
+ * Starts measuring a pipeline (for `time` and the trace)
+ * Pipelines nest: process records name the innermost one.
+ * @param stats - Receives the starting point
+ * @return Pipeline id used in trace records
+ */
+long trace_pipeline_begin(ProcessStats *stats);
+
+/**
+ * Finishes measuring a pipeline and writes its record if tracing
+ * @param id - Id returned by trace_pipeline_begin
+ * @param stats - Starting point; receives the totals (end, usage)
+ * @param status - Exit status of the pipeline
+ * @param stages - Number of stages
+ * @param command - Text of the pipeline (may be NULL)
+ */
+void trace_pipeline_end(long id, ProcessStats *stats, int status, int stages, const char *command);
+
+/**
+ * Hands out a pipeline id without measuring the pipeline (background jobs,
+ * whose processes outlive the line that started them)
+ * @return Pipeline id used in trace records
+ */
+long trace_reserve_id(void);
+
+/**
+ * Accounts for one reaped process and writes its record if tracing
+ * @param pipeline - Pipeline id, or 0 for the innermost running pipeline
+ * @param stage - Stage of the pipeline (or item of a parallel block)
+ * @param pid - Process id
+ * @param command - Text of the command (may be NULL)
+ * @param stats - What it cost
+ */
+void trace_process(long pipeline, int stage, pid_t pid, const char *command, const ProcessStats *stats);
+
+/**
+ * Stops tracing and closes a trace file the shell opened
+ */
+void trace_close(void);
+
+#endif
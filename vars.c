@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "vars.h"
+
+/* Constants */
+#define INITIAL_TABLE_SIZE 64    // Slots in a new table (a power of two)
+#define MAX_LOAD_PERCENT 70      // Grow once live and deleted slots pass this
+
+extern char **environ;
+
+/**
+ * One slot of the table
+ */
+typedef struct {
+    char *entry;              // "NAME=value" ("NAME" if not set), NULL if empty
+    unsigned long hash;
+    size_t name_len;
+    unsigned char exported;
+    unsigned char set;        // Whether it has a value
+} Var;
+
+static char tombstone[1];           // Marks a slot whose variable was removed
+static Var *table = NULL;
+static size_t capacity = 0;         // Number of slots
+static size_t used = 0;             // Live and deleted slots
+static char **envp = NULL;          // Environment built from exported variables
+static size_t envp_count = 0;
+static int envp_stale = 1;          // An exported variable changed since envp was built
+static char **retired = NULL;       // Entries still in envp but no longer in the table
+static size_t retired_count = 0;
+static size_t retired_capacity = 0;
+static char **original_environ = NULL;
+
+/**
+ * FNV-1a hash of a variable name
+ * @param s - Name
+ * @param len - Length of the name
+ * @return Hash value
+ */
+static unsigned long hash_name(const char *s, size_t len) {
+    unsigned long h = 2166136261UL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+int var_is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+int var_is_name(const char *s, size_t len) {
+    if (len == 0 || isdigit((unsigned char)s[0])) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (!var_is_name_char(s[i])) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Finds a variable's slot, or the slot it would be inserted into
+ * @param name - Name
+ * @param len - Length of the name
+ * @param hash - Hash of the name
+ * @return Index of the slot, or -1 if the table is empty
+ */
+static long find_slot(const char *name, size_t len, unsigned long hash) {
+    if (!table) return -1;
+    long insert = -1;
+    size_t mask = capacity - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        Var *v = &table[i];
+        if (v->entry == NULL) return insert >= 0 ? insert : (long)i;
+        if (v->entry == tombstone) {
+            if (insert < 0) insert = i;
+        } else if (v->hash == hash && v->name_len == len && memcmp(v->entry, name, len) == 0) {
+            return i;
+        }
+    }
+}
+
+/**
+ * @param slot - Index from find_slot
+ * @return 1 if the slot holds a variable
+ */
+static int is_live(long slot) {
+    return slot >= 0 && table[slot].entry != NULL && table[slot].entry != tombstone;
+}
+
+/**
+ * Makes room for one more variable, rehashing into a bigger table (or a
+ * same-sized one, to clear out deleted slots)
+ * @return 0 on success, -1 on allocation failure
+ */
+static int reserve_slot(void) {
+    if (table && (used + 1) * 100 <= capacity * MAX_LOAD_PERCENT) return 0;
+
+    size_t live = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        if (table[i].entry && table[i].entry != tombstone) live++;
+    }
+    size_t new_capacity = capacity ? capacity : INITIAL_TABLE_SIZE;
+    while ((live + 1) * 100 > new_capacity * MAX_LOAD_PERCENT / 2) new_capacity *= 2;
+
+    Var *bigger = calloc(new_capacity, sizeof(Var));
+    if (!bigger) return -1;
+    for (size_t i = 0; i < capacity; i++) {
+        Var *v = &table[i];
+        if (!v->entry || v->entry == tombstone) continue;
+        size_t j = v->hash & (new_capacity - 1);
+        while (bigger[j].entry) j = (j + 1) & (new_capacity - 1);
+        bigger[j] = *v;
+    }
+    free(table);
+    table = bigger;
+    capacity = new_capacity;
+    used = live;
+    return 0;
+}
+
+/**
+ * Drops an entry that the current envp may still point to
+ * Exported entries are kept until envp is rebuilt, so environ never
+ * points at freed memory.
+ * @param v - Variable whose entry is being replaced or removed
+ */
+static void retire_entry(Var *v) {
+    if (!(v->exported && v->set)) {
+        free(v->entry);
+        return;
+    }
+    envp_stale = 1;
+    if (retired_count == retired_capacity) {
+        size_t new_capacity = retired_capacity ? retired_capacity * 2 : 16;
+        char **bigger = realloc(retired, new_capacity * sizeof(char *));
+        if (!bigger) {
+            // Rather leak one string than free one environ may use
+            return;
+        }
+        retired = bigger;
+        retired_capacity = new_capacity;
+    }
+    retired[retired_count++] = v->entry;
+}
+
+/**
+ * Stores a variable
+ * @param name - Name
+ * @param len - Length of the name
+ * @param value - Value, or NULL to only export it
+ * @param export - Whether to export it (an exported variable stays exported)
+ * @return 0 on success, -1 on allocation failure
+ */
+static int store(const char *name, size_t len, const char *value, int export) {
+    unsigned long hash = hash_name(name, len);
+    long slot = find_slot(name, len, hash);
+    Var *v = is_live(slot) ? &table[slot] : NULL;
+
+    if (v && !value) {
+        // Exporting keeps the current value
+        if (export && !v->exported && v->set) envp_stale = 1;
+        v->exported = v->exported || export;
+        return 0;
+    }
+    if (v && v->set && (v->exported || !export) && strcmp(v->entry + len + 1, value) == 0) {
+        return 0;   // Nothing changes, so envp stays valid
+    }
+
+    size_t value_len = value ? strlen(value) : 0;
+    char *entry = malloc(len + value_len + 2);
+    if (!entry) return -1;
+    memcpy(entry, name, len);
+    entry[len] = '\0';
+    if (value) {
+        entry[len] = '=';
+        memcpy(entry + len + 1, value, value_len + 1);
+    }
+
+    if (v) {
+        retire_entry(v);
+    } else {
+        if (reserve_slot() != 0) {
+            free(entry);
+            return -1;
+        }
+        slot = find_slot(name, len, hash);
+        v = &table[slot];
+        if (v->entry == NULL) used++;
+        v->hash = hash;
+        v->name_len = len;
+        v->exported = 0;
+    }
+    v->entry = entry;
+    v->set = value != NULL;
+    v->exported = v->exported || export;
+    if (v->exported && v->set) envp_stale = 1;
+    return 0;
+}
+
+int vars_init(char **env) {
+    original_environ = environ;
+    for (int i = 0; env && env[i]; i++) {
+        const char *eq = strchr(env[i], '=');
+        if (!eq || !var_is_name(env[i], eq - env[i])) continue;
+        if (store(env[i], eq - env[i], eq + 1, 1) != 0) return -1;
+    }
+    return 0;
+}
+
+const char* var_get(const char *name) {
+    size_t len = strlen(name);
+    long slot = find_slot(name, len, hash_name(name, len));
+    if (!is_live(slot) || !table[slot].set) return NULL;
+    return table[slot].entry + len + 1;
+}
+
+int var_exported(const char *name) {
+    size_t len = strlen(name);
+    long slot = find_slot(name, len, hash_name(name, len));
+    return is_live(slot) && table[slot].exported;
+}
+
+int var_set(const char *name, const char *value, int export) {
+    return store(name, strlen(name), value, export);
+}
+
+int var_export(const char *name) {
+    return store(name, strlen(name), NULL, 1);
+}
+
+void var_unset(const char *name) {
+    size_t len = strlen(name);
+    long slot = find_slot(name, len, hash_name(name, len));
+    if (!is_live(slot)) return;
+    retire_entry(&table[slot]);
+    table[slot].entry = tombstone;
+}
+
+/**
+ * Orders variables by name (for qsort)
+ */
+static int compare_vars(const void *a, const void *b) {
+    const Var *x = *(const Var **)a, *y = *(const Var **)b;
+    size_t len = x->name_len < y->name_len ? x->name_len : y->name_len;
+    int c = memcmp(x->entry, y->entry, len);
+    return c ? c : (x->name_len > y->name_len) - (x->name_len < y->name_len);
+}
+
+void vars_print(FILE *out, int exported_only) {
+    Var **sorted = malloc((capacity ? capacity : 1) * sizeof(Var *));
+    size_t count = 0;
+    if (!sorted) return;
+    for (size_t i = 0; i < capacity; i++) {
+        Var *v = &table[i];
+        if (!v->entry || v->entry == tombstone) continue;
+        if (exported_only ? v->exported : v->set) sorted[count++] = v;
+    }
+    qsort(sorted, count, sizeof(Var *), compare_vars);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(out, "%s%s\n", exported_only ? "export " : "", sorted[i]->entry);
+    }
+    free(sorted);
+}
+
+char** vars_environ(void) {
+    if (!envp_stale && envp) return envp;
+
+    size_t count = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        Var *v = &table[i];
+        if (v->entry && v->entry != tombstone && v->exported && v->set) count++;
+    }
+    char **fresh = malloc((count + 1) * sizeof(char *));
+    if (!fresh) return envp ? envp : environ;
+    count = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        Var *v = &table[i];
+        if (v->entry && v->entry != tombstone && v->exported && v->set) fresh[count++] = v->entry;
+    }
+    fresh[count] = NULL;
+
+    // Nothing points into the old array or the retired entries any more
+    environ = fresh;
+    free(envp);
+    envp = fresh;
+    envp_count = count;
+    for (size_t i = 0; i < retired_count; i++) {
+        free(retired[i]);
+    }
+    retired_count = 0;
+    envp_stale = 0;
+    return envp;
+}
+
+char** vars_environ_with(char **assignments, int count) {
+    char **base = vars_environ();
+    char **env = malloc((envp_count + count + 1) * sizeof(char *));
+    if (!env) return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i < envp_count; i++) {
+        size_t len = strcspn(base[i], "=");
+        int replaced = 0;
+        for (int j = 0; j < count && !replaced; j++) {
+            replaced = strncmp(assignments[j], base[i], len) == 0 && assignments[j][len] == '=';
+        }
+        if (!replaced) env[n++] = base[i];
+    }
+    for (int j = 0; j < count; j++) {
+        env[n++] = assignments[j];
+    }
+    env[n] = NULL;
+    return env;
+}
+
+void vars_free(void) {
+    environ = original_environ;
+    for (size_t i = 0; i < capacity; i++) {
+        if (table[i].entry && table[i].entry != tombstone) free(table[i].entry);
+    }
+    for (size_t i = 0; i < retired_count; i++) {
+        free(retired[i]);
+    }
+    free(table);
+    free(envp);
+    free(retired);
+    table = NULL;
+    envp = NULL;
+    retired = NULL;
+    capacity = used = envp_count = retired_count = retired_capacity = 0;
+    envp_stale = 1;
+}
@@ -0,0 +1,105 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * Shell variables and the environment
+ * Variables live in an open-addressing hash table (linear probing, keys
+ * hashed once with FNV-1a), seeded from the environment the shell was
+ * started with. Each variable is stored as one "NAME=value" string, so
+ * an exported variable goes into the environment as is. The envp array
+ * handed to new programs is materialized lazily: changes only mark it
+ * stale, and it is rebuilt the next time it is asked for, so spawning
+ * costs the same however many variables there are and however often
+ * unexported ones change. The rebuilt array also becomes `environ`, so
+ * getenv sees what the children will.
+ */
+
+/**
+ * Checks whether text is a valid variable name
+ * @param s - Text to check
+ * @param len - Length of text
+ * @return 1 for [A-Za-z_][A-Za-z0-9_]*, 0 otherwise
+ */
+int var_is_name(const char *s, size_t len);
+
+/**
+ * @param c - Character to check
+ * @return 1 if c may appear in a name after its first character
+ */
+int var_is_name_char(char c);
+
+/**
+ * Imports the environment as exported variables
+ * @param env - NULL-terminated "NAME=value" strings
+ * @return 0 on success, -1 on allocation failure
+ */
+int vars_init(char **env);
+
+/**
+ * @param name - Variable name
+ * @return Its value, or NULL if it is not set
+ */
+const char* var_get(const char *name);
+
+/**
+ * @param name - Variable name
+ * @return 1 if it is exported (set or not), 0 otherwise
+ */
+int var_exported(const char *name);
+
+/**
+ * Sets a variable, keeping its export flag
+ * @param name - Variable name (must be valid)
+ * @param value - New value
+ * @param export - Also export it
+ * @return 0 on success, -1 on allocation failure
+ */
+int var_set(const char *name, const char *value, int export);
+
+/**
+ * Exports a variable; one that is not set is exported once it is
+ * @param name - Variable name
+ * @return 0 on success, -1 on allocation failure
+ */
+int var_export(const char *name);
+
+/**
+ * Removes a variable (and its export flag)
+ * @param name - Variable name
+ */
+void var_unset(const char *name);
+
+/**
+ * Prints variables as `NAME=value` lines, sorted by name
+ * @param out - Stream to print to
+ * @param exported_only - Print only exported variables, as `export NAME=value`
+ */
+void vars_print(FILE *out, int exported_only);
+
+/**
+ * Returns the environment for new programs, rebuilding it only if an
+ * exported variable changed since the last call
+ * @return NULL-terminated envp (owned by the store; also set as environ)
+ */
+char** vars_environ(void);
+
+/**
+ * Builds an environment with some variables replaced or added, for one
+ * command's NAME=value prefixes
+ * @param assignments - "NAME=value" strings
+ * @param count - Number of assignments
+ * @return envp whose strings are borrowed (free only the array), or NULL
+ *         on allocation failure
+ */
+char** vars_environ_with(char **assignments, int count);
+
+/**
+ * Frees every variable and the environment, pointing environ back at the
+ * one the shell was started with
+ */
+void vars_free(void);
+
+#endif
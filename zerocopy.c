@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#endif
+
+#include "zerocopy.h"
+
+/* Constants */
+#define CHUNK_SIZE (1 << 20)     // Bytes moved per kernel call
+#define BUFFER_SIZE 65536        // Buffer for the read/write fallback
+
+/**
+ * Writes a whole buffer, retrying short writes
+ * @param fd - Destination
+ * @param data - Bytes to write
+ * @param len - Number of bytes
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Copies with read/write through a user-space buffer (the fallback)
+ * @param in_fd - Source
+ * @param out_fd - Destination
+ * @return Bytes copied, or -1 on error
+ */
+static ssize_t copy_with_buffer(int in_fd, int out_fd) {
+    char buffer[BUFFER_SIZE];
+    ssize_t total = 0, n;
+    while ((n = read(in_fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (write_all(out_fd, buffer, n) != 0) return -1;
+        total += n;
+    }
+    return total;
+}
+
+/**
+ * @param fd - Descriptor to check
+ * @return 1 if fd is a pipe (or FIFO), 0 otherwise
+ */
+static int is_pipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+/**
+ * @param fd - Descriptor to check
+ * @return 1 if fd is a regular file, 0 otherwise
+ */
+static int is_regular(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+ssize_t zc_copy(int in_fd, int out_fd) {
+    // Each kernel path is abandoned for the next one if it fails before
+    // moving anything (EINVAL, EXDEV, EBADF for O_APPEND outputs, ...)
+    ssize_t total = 0;
+#ifdef __linux__
+    ssize_t n;
+    int in_pipe = is_pipe(in_fd), out_pipe = is_pipe(out_fd);
+
+    // splice needs a pipe on at least one side
+    if (in_pipe || out_pipe) {
+        while ((n = splice(in_fd, NULL, out_fd, NULL, CHUNK_SIZE, SPLICE_F_MOVE)) > 0) {
+            total += n;
+        }
+        if (n == 0 || total > 0) return n == 0 ? total : -1;
+    } else if (is_regular(in_fd)) {
+        // File to file stays inside the filesystem (may even share extents)
+        if (is_regular(out_fd)) {
+            while ((n = copy_file_range(in_fd, NULL, out_fd, NULL, CHUNK_SIZE, 0)) > 0) {
+                total += n;
+            }
+            if (n == 0 || total > 0) return n == 0 ? total : -1;
+        }
+        // File to anything else (tty, socket)
+        while ((n = sendfile(out_fd, in_fd, NULL, CHUNK_SIZE)) > 0) {
+            total += n;
+        }
+        if (n == 0 || total > 0) return n == 0 ? total : -1;
+    }
+#endif
+    ssize_t rest = copy_with_buffer(in_fd, out_fd);
+    return rest < 0 ? -1 : total + rest;
+}
+
+#ifdef __linux__
+/**
+ * Moves exactly len bytes from a pipe to a descriptor with splice
+ * @param in_fd - Source pipe
+ * @param out_fd - Destination
+ * @param len - Bytes to move
+ * @return 0 on success, -1 on error
+ */
+static int splice_exactly(int in_fd, int out_fd, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Fans out a pipe with tee: every destination but the last gets its own
+ * scratch pipe that tee fills without consuming the source; the last
+ * destination consumes the source with splice
+ * @param in_fd - Source pipe
+ * @param out_fds - Destinations
+ * @param count - Number of destinations
+ * @return 0 on success, -1 on error, -2 if tee/splice cannot be used here
+ *         (nothing was consumed, so the caller can fall back)
+ */
+static int fanout_with_tee(int in_fd, const int *out_fds, int count) {
+    int scratch[count][2];
+    int made = 0, result = 0, moved_any = 0, saved_errno;
+
+    for (; made < count - 1; made++) {
+        if (pipe(scratch[made]) != 0) {
+            result = -1;
+            goto done;
+        }
+    }
+
+    while (1) {
+        // Duplicate the next chunk into each scratch pipe, drain them, then
+        // consume the chunk into the last output (a lone output just splices)
+        ssize_t len = count > 1 ? tee(in_fd, scratch[0][1], CHUNK_SIZE, 0)
+                                : splice(in_fd, NULL, out_fds[0], NULL, CHUNK_SIZE, SPLICE_F_MOVE);
+        if (len == 0) break;
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            goto done;
+        }
+        moved_any = 1;
+        if (count == 1) continue;
+
+        // tee never consumes, so every scratch pipe gets the same bytes;
+        // they are empty and as large as the source, so one call suffices
+        for (int i = 1; i < count - 1; i++) {
+            if (tee(in_fd, scratch[i][1], len, 0) != len) {
+                result = -1;
+                goto done;
+            }
+        }
+        for (int i = 0; i < count - 1; i++) {
+            if (splice_exactly(scratch[i][0], out_fds[i], len) != 0) {
+                result = -1;
+                goto done;
+            }
+        }
+        if (splice_exactly(in_fd, out_fds[count - 1], len) != 0) {
+            result = -1;
+            goto done;
+        }
+    }
+
+done:
+    saved_errno = errno;
+    for (int i = 0; i < made; i++) {
+        close(scratch[i][0]);
+        close(scratch[i][1]);
+    }
+    // Only report "unsupported" if nothing was consumed yet
+    if (result != 0 && !moved_any && (saved_errno == EINVAL || saved_errno == ENOSYS)) return -2;
+    return result;
+}
+#endif
+
+/**
+ * @param fd - Descriptor to check
+ * @return 1 if writes to fd append (splice refuses such files), 0 otherwise
+ */
+static int is_append(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && (flags & O_APPEND);
+}
+
+int zc_fanout(int in_fd, const int *out_fds, int count) {
+    if (count <= 0) return 0;
+#ifdef __linux__
+    int can_splice = is_pipe(in_fd);
+    for (int i = 0; i < count && can_splice; i++) {
+        can_splice = !is_append(out_fds[i]);
+    }
+    if (can_splice) {
+        int r = fanout_with_tee(in_fd, out_fds, count);
+        if (r != -2) return r;
+    }
+#endif
+    // Fallback: read once, write to every destination
+    char buffer[BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(in_fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (write_all(out_fds[i], buffer, n) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+pid_t zc_start_fanout(const int *out_fds, int count, int *write_fd) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe failed");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Fork Failed");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[1]);
+        _exit(zc_fanout(fds[0], out_fds, count) == 0 ? 0 : 1);
+    }
+    close(fds[0]);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);  // Only the producer's stdout keeps it open
+    *write_fd = fds[1];
+    return pid;
+}
+
+int zc_feed(const char *data, size_t len) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+
+#ifdef __linux__
+    // Small bodies fit in the pipe: map them in with vmsplice and we are done
+    int capacity = fcntl(fds[1], F_GETPIPE_SZ);
+    if (capacity > 0 && len <= (size_t)capacity) {
+        struct iovec iov = {(void *)data, len};
+        while (iov.iov_len > 0) {
+            ssize_t n = vmsplice(fds[1], &iov, 1, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            iov.iov_base = (char *)iov.iov_base + n;
+            iov.iov_len -= n;
+        }
+        if (iov.iov_len == 0) {
+            close(fds[1]);
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            return fds[0];
+        }
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    // Larger bodies go into an anonymous file the command reads directly
+    int fd = memfd_create("heredoc", MFD_CLOEXEC);
+#else
+    if (len <= 4096) {
+        int ok = write_all(fds[1], data, len) == 0;
+        close(fds[1]);
+        if (ok) {
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            return fds[0];
+        }
+        close(fds[0]);
+        return -1;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    char path[] = "/tmp/heredocXXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    if (fd < 0) return -1;
+    if (write_all(fd, data, len) != 0 || lseek(fd, 0, SEEK_SET) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
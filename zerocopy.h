@@ -0,0 +1,54 @@
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Zero-copy data movement
+ * Moves bytes between files and pipes inside the kernel where possible:
+ * copy_file_range(2) between files, splice(2) when a pipe is involved,
+ * sendfile(2) from a file to anything else, and tee(2) to duplicate pipe
+ * data to several outputs. Every path falls back to read/write when the
+ * kernel call is unavailable for the descriptors at hand.
+ */
+
+/**
+ * Copies everything from in_fd (from its current offset) to out_fd
+ * @param in_fd - Source descriptor
+ * @param out_fd - Destination descriptor
+ * @return Bytes copied, or -1 on error
+ */
+ssize_t zc_copy(int in_fd, int out_fd);
+
+/**
+ * Copies everything read from a pipe to several outputs
+ * With tee(2) the data is duplicated between pipes without being read
+ * into user space.
+ * @param in_fd - Source descriptor (ideally a pipe)
+ * @param out_fds - Destination descriptors
+ * @param count - Number of destinations
+ * @return 0 on success, -1 on error
+ */
+int zc_fanout(int in_fd, const int *out_fds, int count);
+
+/**
+ * Starts a helper process that copies a pipe to several outputs
+ * @param out_fds - Destination descriptors (the caller closes its copies)
+ * @param count - Number of destinations
+ * @param write_fd - Receives the write end the producer should use as stdout
+ * @return Pid of the helper, or -1 on failure
+ */
+pid_t zc_start_fanout(const int *out_fds, int count, int *write_fd);
+
+/**
+ * Makes a readable descriptor that yields the given bytes, for feeding a
+ * here-document to a command's stdin. Small bodies go into a pipe with
+ * vmsplice(2); larger ones into an anonymous file so no helper is needed.
+ * @param data - Bytes to feed
+ * @param len - Number of bytes
+ * @return Descriptor positioned at the start of the data, or -1 on error
+ */
+int zc_feed(const char *data, size_t len);
+
+#endif